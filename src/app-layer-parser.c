@@ -37,6 +37,7 @@
 
 #include "util-validate.h"
 #include "util-config.h"
+#include "util-cpu-ticks.h"
 
 #include "app-layer.h"
 #include "app-layer-detect-proto.h"
@@ -1384,8 +1385,10 @@ int AppLayerParserParse(ThreadVars *tv, AppLayerParserThreadCtx *alp_tctx, Flow
         }
 #endif
         /* invoke the parser */
+        const int ticks_prev = CpuTicksEnter(CPU_TICKS_STAGE_APPLAYER(alproto));
         AppLayerResult res = p->Parser[direction](f, alstate, pstate, stream_slice,
                 alp_tctx->alproto_local_storage[alproto][f->protomap]);
+        CpuTicksLeave(ticks_prev);
         if (res.status < 0) {
             AppLayerIncParserErrorCounter(tv, f);
             goto error;
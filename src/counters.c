@@ -37,6 +37,7 @@
 #include "util-conf.h"
 #include "util-hash.h"
 #include "util-time.h"
+#include "util-flow-cost.h"
 
 #include "tm-threads.h"
 #include "util-privs.h"
@@ -157,6 +158,27 @@ void StatsAddUI64(ThreadVars *tv, uint16_t id, uint64_t x)
     pca->head[id].updates++;
 }
 
+/**
+ * \brief Subtracts a value of type uint64_t from the local counter.
+ *
+ * \param id  ID of the counter as set by the API
+ * \param pca Counter array that holds the local counter for this TM
+ * \param x   Value to subtract from this local counter
+ */
+void StatsSubUI64(ThreadVars *tv, uint16_t id, uint64_t x)
+{
+    StatsPrivateThreadContext *pca = &tv->perf_private_ctx;
+#if defined(UNITTESTS) || defined(FUZZ)
+    if (pca->initialized == 0)
+        return;
+#endif
+#ifdef DEBUG
+    BUG_ON((id < 1) || (id > pca->size));
+#endif
+    pca->head[id].value -= x;
+    pca->head[id].updates++;
+}
+
 /**
  * \brief Increments the local counter
  *
@@ -817,6 +839,8 @@ static int StatsOutput(ThreadVars *tv)
     /* invoke logger(s) */
     if (stats_loggers_active) {
         OutputStatsLog(tv, td, &stats_table);
+        /* all loggers reported the same expensive flows for this interval */
+        FlowCostTopReset();
     }
     return 1;
 }
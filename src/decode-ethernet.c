@@ -34,11 +34,111 @@
 #include "decode.h"
 #include "decode-ethernet.h"
 #include "decode-events.h"
+#include "decode-vlan.h"
+#include "decode-ipv4.h"
+#include "decode-ipv6.h"
 
 #include "util-validate.h"
 #include "util-unittest.h"
 #include "util-debug.h"
 
+/** \internal
+ *  \brief fast path for the common Ethernet[+VLAN]/IPv4|IPv6/TCP|UDP stack
+ *
+ *  Validates the VLAN and IP headers in one pass and hands the L4 header
+ *  straight to DecodeTCP() or DecodeUDP(). Only packets the generic path
+ *  would decode without setting an event take it: at most one VLAN header,
+ *  IPv4 without options that is not a fragment, IPv6 without extension
+ *  headers. Everything else falls back to DecodeNetworkLayer().
+ *
+ *  The packet, including the stats, ends up exactly as the generic path
+ *  would leave it.
+ *
+ *  \retval true packet was decoded
+ *  \retval false not a fast path packet, the packet was not modified
+ */
+static inline bool DecodeEthernetFast(ThreadVars *tv, DecodeThreadVars *dtv, Packet *p,
+        const uint16_t eth_type, const uint8_t *pkt, uint32_t len)
+{
+    uint16_t type = eth_type;
+    const VLANHdr *vlan_hdr = NULL;
+
+    if (type == ETHERNET_TYPE_VLAN) {
+        if (p->vlan_idx != 0 || len < VLAN_HEADER_LEN)
+            return false;
+        vlan_hdr = (const VLANHdr *)pkt;
+        type = GET_VLAN_PROTO(vlan_hdr);
+        pkt += VLAN_HEADER_LEN;
+        len -= VLAN_HEADER_LEN;
+    }
+    /* the VLAN and IP layers must both pass PacketIncreaseCheckLayers() */
+    const uint8_t layers = (vlan_hdr != NULL) ? 2 : 1;
+    if (p->nb_decoded_layers + layers >= decoder_max_layers)
+        return false;
+
+    const uint16_t ip_len = (len < USHRT_MAX) ? (uint16_t)len : (uint16_t)USHRT_MAX;
+    const uint8_t *l4 = NULL;
+    uint16_t l4_len = 0;
+    uint8_t proto = 0;
+
+    if (type == ETHERNET_TYPE_IP) {
+        if (ip_len < IPV4_HEADER_LEN)
+            return false;
+        const IPV4Hdr *ip4h = (const IPV4Hdr *)pkt;
+        /* version 4 without options, not a fragment */
+        if (ip4h->ip_verhl != 0x45 || (IPV4_GET_RAW_IPOFFSET(ip4h) & 0x3fff) != 0)
+            return false;
+        const uint16_t iplen = IPV4_GET_RAW_IPLEN(ip4h);
+        if (iplen < IPV4_HEADER_LEN || iplen > ip_len)
+            return false;
+        proto = IPV4_GET_RAW_IPPROTO(ip4h);
+        l4 = pkt + IPV4_HEADER_LEN;
+        l4_len = iplen - IPV4_HEADER_LEN;
+    } else if (type == ETHERNET_TYPE_IPV6) {
+        if (ip_len < IPV6_HEADER_LEN || IP_GET_RAW_VER(pkt) != 6)
+            return false;
+        const IPV6Hdr *ip6h = (const IPV6Hdr *)pkt;
+        const uint16_t plen = IPV6_GET_RAW_PLEN(ip6h);
+        if (ip_len < IPV6_HEADER_LEN + plen)
+            return false;
+        proto = IPV6_GET_RAW_NH(ip6h);
+        l4 = pkt + IPV6_HEADER_LEN;
+        l4_len = plen;
+    } else {
+        return false;
+    }
+    if (proto != IPPROTO_TCP && proto != IPPROTO_UDP)
+        return false;
+
+    /* all checks passed, update the packet like the generic decoders do */
+    if (vlan_hdr != NULL) {
+        StatsIncr(tv, dtv->counter_vlan);
+        p->nb_decoded_layers++;
+        p->vlan_id[p->vlan_idx++] = GET_VLAN_ID(vlan_hdr);
+    }
+    p->nb_decoded_layers++;
+    if (type == ETHERNET_TYPE_IP) {
+        StatsIncr(tv, dtv->counter_ipv4);
+        const IPV4Hdr *ip4h = PacketSetIPV4(p, pkt);
+        SET_IPV4_SRC_ADDR(ip4h, &p->src);
+        SET_IPV4_DST_ADDR(ip4h, &p->dst);
+    } else {
+        StatsIncr(tv, dtv->counter_ipv6);
+        const IPV6Hdr *ip6h = PacketSetIPV6(p, pkt);
+        SET_IPV6_SRC_ADDR(ip6h, &p->src);
+        SET_IPV6_DST_ADDR(ip6h, &p->dst);
+        IPV6_SET_L4PROTO(p, proto);
+    }
+    p->proto = proto;
+
+    if (proto == IPPROTO_TCP) {
+        DecodeTCP(tv, dtv, p, l4, l4_len);
+    } else {
+        DecodeUDP(tv, dtv, p, l4, l4_len);
+    }
+    return true;
+}
+
 int DecodeEthernet(ThreadVars *tv, DecodeThreadVars *dtv, Packet *p,
                    const uint8_t *pkt, uint32_t len)
 {
@@ -58,8 +158,12 @@ int DecodeEthernet(ThreadVars *tv, DecodeThreadVars *dtv, Packet *p,
 
     SCLogDebug("p %p pkt %p ether type %04x", p, pkt, SCNtohs(ethh->eth_type));
 
-    DecodeNetworkLayer(tv, dtv, SCNtohs(ethh->eth_type), p, pkt + ETHERNET_HEADER_LEN,
-            len - ETHERNET_HEADER_LEN);
+    const uint16_t eth_type = SCNtohs(ethh->eth_type);
+    if (DecodeEthernetFast(
+                tv, dtv, p, eth_type, pkt + ETHERNET_HEADER_LEN, len - ETHERNET_HEADER_LEN))
+        return TM_ECODE_OK;
+
+    DecodeNetworkLayer(tv, dtv, eth_type, p, pkt + ETHERNET_HEADER_LEN, len - ETHERNET_HEADER_LEN);
 
     return TM_ECODE_OK;
 }
@@ -166,6 +270,99 @@ static int DecodeEthernetTestDceNextTooSmall(void)
     PASS;
 }
 
+/**
+ * Test the fast path on a VLAN/IPv4/TCP frame.
+ */
+static int DecodeEthernetTestFastPath01(void)
+{
+    uint8_t raw_eth[] = {
+        0x00, 0x10, 0x94, 0x55, 0x00, 0x01, 0x00, 0x10,
+        0x94, 0x56, 0x00, 0x01, 0x81, 0x00, 0x00, 0x64,
+        0x08, 0x00, 0x45, 0x00, 0x00, 0x2c, 0x00, 0x01,
+        0x00, 0x00, 0x40, 0x06, 0x00, 0x00, 0xc0, 0xa8,
+        0x01, 0x01, 0xc0, 0xa8, 0x01, 0x02, 0x04, 0xd2,
+        0x00, 0x50, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00,
+        0x00, 0x00, 0x50, 0x02, 0xff, 0xff, 0x00, 0x00,
+        0x00, 0x00, 0x61, 0x62, 0x63, 0x64,
+    };
+
+    Packet *p = PacketGetFromAlloc();
+    FAIL_IF_NULL(p);
+    ThreadVars tv;
+    DecodeThreadVars dtv;
+
+    memset(&dtv, 0, sizeof(DecodeThreadVars));
+    memset(&tv,  0, sizeof(ThreadVars));
+
+    FAIL_IF_NOT(DecodeEthernet(&tv, &dtv, p, raw_eth, sizeof(raw_eth)) == TM_ECODE_OK);
+    FAIL_IF_NOT(PacketIsIPv4(p));
+    FAIL_IF_NOT(PacketIsTCP(p));
+    FAIL_IF_NOT(p->vlan_idx == 1);
+    FAIL_IF_NOT(p->vlan_id[0] == 100);
+    FAIL_IF_NOT(p->nb_decoded_layers == 3);
+    FAIL_IF_NOT(p->sp == 1234);
+    FAIL_IF_NOT(p->dp == 80);
+    FAIL_IF_NOT(p->payload_len == 4);
+    FAIL_IF_NOT(p->events.cnt == 0);
+    FAIL_IF(p->flags & PKT_IS_INVALID);
+
+    SCFree(p);
+    PASS;
+}
+
+/**
+ * Test that the fast path leaves an IPv6/UDP packet like the generic path.
+ */
+static int DecodeEthernetTestFastPath02(void)
+{
+    uint8_t raw_eth[] = {
+        0x00, 0x10, 0x94, 0x55, 0x00, 0x01, 0x00, 0x10,
+        0x94, 0x56, 0x00, 0x01, 0x86, 0xdd, 0x60, 0x00,
+        0x00, 0x00, 0x00, 0x0c, 0x11, 0x40, 0x20, 0x01,
+        0x0d, 0xb8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x20, 0x01,
+        0x0d, 0xb8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x13, 0x88,
+        0x00, 0x35, 0x00, 0x0c, 0x00, 0x00, 0x61, 0x62,
+        0x63, 0x64,
+    };
+
+    Packet *p1 = PacketGetFromAlloc();
+    FAIL_IF_NULL(p1);
+    Packet *p2 = PacketGetFromAlloc();
+    FAIL_IF_NULL(p2);
+    ThreadVars tv;
+    DecodeThreadVars dtv;
+
+    memset(&dtv, 0, sizeof(DecodeThreadVars));
+    memset(&tv,  0, sizeof(ThreadVars));
+
+    FAIL_IF_NOT(DecodeEthernet(&tv, &dtv, p1, raw_eth, sizeof(raw_eth)) == TM_ECODE_OK);
+
+    /* generic path */
+    FAIL_IF_NOT(PacketIncreaseCheckLayers(p2));
+    PacketSetEthernet(p2, raw_eth);
+    FAIL_IF_NOT(DecodeNetworkLayer(&tv, &dtv, ETHERNET_TYPE_IPV6, p2,
+            raw_eth + ETHERNET_HEADER_LEN, sizeof(raw_eth) - ETHERNET_HEADER_LEN));
+
+    FAIL_IF_NOT(PacketIsIPv6(p1) && PacketIsIPv6(p2));
+    FAIL_IF_NOT(PacketIsUDP(p1) && PacketIsUDP(p2));
+    FAIL_IF_NOT(CMP_ADDR(&p1->src, &p2->src));
+    FAIL_IF_NOT(CMP_ADDR(&p1->dst, &p2->dst));
+    FAIL_IF_NOT(p1->sp == p2->sp && p1->dp == p2->dp);
+    FAIL_IF_NOT(p1->proto == p2->proto);
+    FAIL_IF_NOT(IPV6_GET_L4PROTO(p1) == IPV6_GET_L4PROTO(p2));
+    FAIL_IF_NOT(p1->payload_len == p2->payload_len);
+    FAIL_IF_NOT(p1->flow_hash == p2->flow_hash);
+    FAIL_IF_NOT(p1->flags == p2->flags);
+    FAIL_IF_NOT(p1->nb_decoded_layers == p2->nb_decoded_layers);
+    FAIL_IF_NOT(p1->events.cnt == 0 && p2->events.cnt == 0);
+
+    SCFree(p1);
+    SCFree(p2);
+    PASS;
+}
+
 #endif /* UNITTESTS */
 
 
@@ -181,6 +378,8 @@ void DecodeEthernetRegisterTests(void)
             DecodeEthernetTestDceNextTooSmall);
     UtRegisterTest("DecodeEthernetTestDceTooSmall",
             DecodeEthernetTestDceTooSmall);
+    UtRegisterTest("DecodeEthernetTestFastPath01", DecodeEthernetTestFastPath01);
+    UtRegisterTest("DecodeEthernetTestFastPath02", DecodeEthernetTestFastPath02);
 #endif /* UNITTESTS */
 }
 /**
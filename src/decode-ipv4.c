@@ -1561,6 +1561,65 @@ static int DecodeEthernetTestIPv4Opt(void)
     PASS;
 }
 
+static void *DecodeIPV4TunnelReleaseThread(void *data)
+{
+    Packet *tp = data;
+    tp->ReleasePacket(tp);
+    return NULL;
+}
+
+/**
+ * \test A zero copy tunnel packet released by another thread goes back to
+ *       the tunnel packet pool of the decoding thread.
+ */
+static int DecodeIPV4TunnelPoolReturnTest01(void)
+{
+    /* IPv4 in IPv4 with an inner UDP packet */
+    uint8_t raw_ipip[] = {
+        0x45, 0x00, 0x00, 0x30, 0x00, 0x01, 0x00, 0x00,
+        0x40, 0x04, 0x00, 0x00, 0x0a, 0x00, 0x00, 0x01,
+        0x0a, 0x00, 0x00, 0x02, 0x45, 0x00, 0x00, 0x1c,
+        0x00, 0x02, 0x00, 0x00, 0x40, 0x11, 0x00, 0x00,
+        0xc0, 0xa8, 0x00, 0x01, 0xc0, 0xa8, 0x00, 0x02,
+        0x04, 0xd2, 0x00, 0x35, 0x00, 0x08, 0x00, 0x00
+    };
+    ThreadVars tv;
+    DecodeThreadVars dtv;
+    memset(&tv, 0, sizeof(ThreadVars));
+    memset(&dtv, 0, sizeof(DecodeThreadVars));
+
+    Packet *p = PacketGetFromAlloc();
+    FAIL_IF_NULL(p);
+    FlowInitConfig(FLOW_QUIET);
+    /* start with an empty pool */
+    PacketTunnelPoolFree();
+
+    PacketCopyData(p, raw_ipip, sizeof(raw_ipip));
+    DecodeIPV4(&tv, &dtv, p, GET_PKT_DATA(p), GET_PKT_LEN(p));
+    Packet *tp = PacketDequeueNoLock(&tv.decode_pq);
+    FAIL_IF_NULL(tp);
+    FAIL_IF_NOT(PacketIsUDP(tp));
+    FAIL_IF(GET_PKT_DATA(tp) != GET_PKT_DATA(p) + IPV4_HEADER_LEN);
+
+    pthread_t thread;
+    FAIL_IF(pthread_create(&thread, NULL, DecodeIPV4TunnelReleaseThread, tp) != 0);
+    FAIL_IF(pthread_join(thread, NULL) != 0);
+
+    /* the next tunnel packet reuses the one returned by the other thread */
+    PacketRecycle(p);
+    PacketCopyData(p, raw_ipip, sizeof(raw_ipip));
+    DecodeIPV4(&tv, &dtv, p, GET_PKT_DATA(p), GET_PKT_LEN(p));
+    Packet *tp2 = PacketDequeueNoLock(&tv.decode_pq);
+    FAIL_IF(tp2 != tp);
+    tp2->ReleasePacket(tp2);
+
+    PacketTunnelPoolFree();
+    PacketRecycle(p);
+    FlowShutdown();
+    SCFree(p);
+    PASS;
+}
+
 #endif /* UNITTESTS */
 
 void DecodeIPV4RegisterTests(void)
@@ -1607,6 +1666,7 @@ void DecodeIPV4RegisterTests(void)
     UtRegisterTest("DecodeIPV4DefragTest02", DecodeIPV4DefragTest02);
     UtRegisterTest("DecodeIPV4DefragTest03", DecodeIPV4DefragTest03);
     UtRegisterTest("DecodeEthernetTestIPv4Opt", DecodeEthernetTestIPv4Opt);
+    UtRegisterTest("DecodeIPV4TunnelPoolReturnTest01", DecodeIPV4TunnelPoolReturnTest01);
 #endif /* UNITTESTS */
 }
 /**
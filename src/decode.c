@@ -79,6 +79,9 @@ extern bool stats_decoder_events;
 extern const char *stats_decoder_events_prefix;
 extern bool stats_stream_events;
 uint8_t decoder_max_layers = PKT_DEFAULT_MAX_DECODED_LAYERS;
+/** set up tunnel packets as a view into the root packet's data instead of
+ *  copying it, see decoder.tunnel-zero-copy */
+static bool g_tunnel_zero_copy = true;
 uint16_t packet_alert_max = PACKET_ALERT_MAX;
 
 /* Settings order as in the enum */
@@ -145,6 +148,47 @@ PacketAlert *PacketAlertCreate(void)
     return pa_array;
 }
 
+/** number of alert arrays each thread keeps for reuse */
+#define PACKET_ALERT_CACHE_SIZE 64
+
+/** per thread cache of alert arrays. Most packets never alert, so packets
+ *  only get an alert array attached when they do, and the array is handed
+ *  back to the cache of the thread recycling the packet. */
+static thread_local struct {
+    uint32_t cnt;
+    PacketAlert *arrays[PACKET_ALERT_CACHE_SIZE];
+} t_alert_cache;
+
+/** \brief get an alert array from the thread's cache or allocate one
+ *  \retval pa_array or NULL on allocation failure */
+PacketAlert *PacketAlertGet(void)
+{
+    if (t_alert_cache.cnt > 0)
+        return t_alert_cache.arrays[--t_alert_cache.cnt];
+    return PacketAlertCreate();
+}
+
+/** \brief hand an alert array back to the thread's cache
+ *
+ *  Json info of the used alerts has to be cleaned with PacketAlertRecycle()
+ *  first. */
+void PacketAlertRelease(PacketAlert *pa_array)
+{
+    if (t_alert_cache.cnt < PACKET_ALERT_CACHE_SIZE) {
+        t_alert_cache.arrays[t_alert_cache.cnt++] = pa_array;
+    } else {
+        PacketAlertFree(pa_array);
+    }
+}
+
+/** \brief free the alert arrays cached by the calling thread */
+void PacketAlertCacheFree(void)
+{
+    while (t_alert_cache.cnt > 0) {
+        PacketAlertFree(t_alert_cache.arrays[--t_alert_cache.cnt]);
+    }
+}
+
 void PacketAlertRecycle(PacketAlert *pa_array, uint16_t cnt)
 {
     if (pa_array == NULL)
@@ -306,6 +350,132 @@ Packet *PacketGetFromQueueOrAlloc(void)
     return p;
 }
 
+/** \internal
+ *  \brief get a packet for a pseudo packet holding its own copy of the data
+ *
+ *  Like PacketGetFromQueueOrAlloc(), but counts the allocations done because
+ *  the packet pool was empty.
+ */
+static Packet *PacketGetPseudo(ThreadVars *tv, DecodeThreadVars *dtv)
+{
+    Packet *p = PacketPoolGetPacket();
+    if (p == NULL) {
+        StatsIncr(tv, dtv->counter_pseudo_pkt_alloc);
+        return PacketGetFromAlloc();
+    }
+    DEBUG_VALIDATE_BUG_ON(p->ReleasePacket != PacketPoolReturnPacket);
+    PACKET_PROFILING_START(p);
+    return p;
+}
+
+/** number of tunnel packets each thread keeps for reuse */
+#define TUNNEL_PKT_POOL_SIZE 256
+
+/** per thread pool of zero copy tunnel packets. These are only a Packet
+ *  header, without the inline data buffer: their data is a view into the
+ *  root packet, which is only released after all its tunnel packets.
+ *
+ *  The packets go back to the pool of the thread that set them up. Other
+ *  threads, like the workers in autofp mode, push them onto the return
+ *  stack, which the owner takes all at once when its own list is empty. */
+typedef struct TunnelPktPool_ {
+    uint32_t cnt;
+    Packet *head;
+    /** packets released by other threads */
+    SC_ATOMIC_DECLARE(Packet *, return_head);
+} TunnelPktPool;
+
+static thread_local TunnelPktPool t_tunnel_pkt_pool;
+
+/** zero copy tunnel packet and the pool it belongs to */
+typedef struct TunnelPacket_ {
+    Packet p; /**< first, so PacketFree() frees the whole struct */
+    TunnelPktPool *pool;
+} TunnelPacket;
+
+static void PacketTunnelPoolReturn(Packet *p)
+{
+    PacketReleaseRefs(p);
+    TunnelPktPool *pool = ((TunnelPacket *)p)->pool;
+    if (pool != &t_tunnel_pkt_pool) {
+        Packet *head;
+        do {
+            head = SC_ATOMIC_GET(pool->return_head);
+            p->next = head;
+        } while (!SC_ATOMIC_CAS(&pool->return_head, head, p));
+    } else if (pool->cnt < TUNNEL_PKT_POOL_SIZE) {
+        p->next = pool->head;
+        pool->head = p;
+        pool->cnt++;
+    } else {
+        PacketFree(p);
+    }
+}
+
+/** \brief move the packets released by other threads to the owner's list
+ *
+ *  Other threads only ever push onto the return stack, so taking it all at
+ *  once has no ABA issue. Packets over the pool size are freed. */
+static void PacketTunnelPoolGetReturned(TunnelPktPool *pool)
+{
+    Packet *head = SC_ATOMIC_GET(pool->return_head);
+    while (head != NULL && !SC_ATOMIC_CAS(&pool->return_head, head, NULL)) {
+        head = SC_ATOMIC_GET(pool->return_head);
+    }
+    while (head != NULL) {
+        Packet *p = head;
+        head = p->next;
+        if (pool->cnt < TUNNEL_PKT_POOL_SIZE) {
+            p->next = pool->head;
+            pool->head = p;
+            pool->cnt++;
+        } else {
+            PacketFree(p);
+        }
+    }
+}
+
+static Packet *PacketTunnelPoolGet(ThreadVars *tv, DecodeThreadVars *dtv)
+{
+    TunnelPktPool *pool = &t_tunnel_pkt_pool;
+    if (pool->head == NULL) {
+        PacketTunnelPoolGetReturned(pool);
+    }
+    Packet *p = pool->head;
+    if (p != NULL) {
+        pool->head = p->next;
+        pool->cnt--;
+        PacketReinit(p);
+    } else {
+        TunnelPacket *tp = SCCalloc(1, sizeof(TunnelPacket));
+        if (unlikely(tp == NULL)) {
+            return NULL;
+        }
+        tp->pool = pool;
+        p = &tp->p;
+        PacketInit(p);
+        StatsIncr(tv, dtv->counter_tunnel_pkt_alloc);
+    }
+    p->ReleasePacket = PacketTunnelPoolReturn;
+    PACKET_PROFILING_START(p);
+    return p;
+}
+
+/** \brief free the tunnel packets pooled by the calling thread */
+void PacketTunnelPoolFree(void)
+{
+    TunnelPktPool *pool = &t_tunnel_pkt_pool;
+    do {
+        while (pool->head != NULL) {
+            Packet *p = pool->head;
+            pool->head = p->next;
+            pool->cnt--;
+            PacketFree(p);
+        }
+        PacketTunnelPoolGetReturned(pool);
+    } while (pool->head != NULL);
+}
+
 inline int PacketCallocExtPkt(Packet *p, int datalen)
 {
     if (! p->ext_pkt) {
@@ -402,14 +572,28 @@ Packet *PacketTunnelPktSetup(ThreadVars *tv, DecodeThreadVars *dtv, Packet *pare
         SCReturnPtr(NULL, "Packet");
     }
 
-    /* get us a packet */
-    Packet *p = PacketGetFromQueueOrAlloc();
-    if (unlikely(p == NULL)) {
-        SCReturnPtr(NULL, "Packet");
+    /* if the tunneled data is part of the root packet's data, which is the
+     * case unless it comes from a reassembled packet, point into it instead
+     * of copying. The root is only released after all its tunnel packets. */
+    const Packet *root = parent->root != NULL ? parent->root : parent;
+    const uintptr_t root_data = (uintptr_t)GET_PKT_DATA(root);
+    Packet *p = NULL;
+    if (g_tunnel_zero_copy && (uintptr_t)pkt >= root_data &&
+            (uintptr_t)pkt + len <= root_data + GET_PKT_LEN(root)) {
+        p = PacketTunnelPoolGet(tv, dtv);
+        if (unlikely(p == NULL)) {
+            SCReturnPtr(NULL, "Packet");
+        }
+        (void)PacketSetData(p, pkt, len);
+        StatsIncr(tv, dtv->counter_tunnel_zero_copy);
+    } else {
+        p = PacketGetPseudo(tv, dtv);
+        if (unlikely(p == NULL)) {
+            SCReturnPtr(NULL, "Packet");
+        }
+        /* copy packet and set length, proto */
+        PacketCopyData(p, pkt, len);
     }
-
-    /* copy packet and set length, proto */
-    PacketCopyData(p, pkt, len);
     DEBUG_VALIDATE_BUG_ON(parent->recursion_level == 255);
     p->recursion_level = parent->recursion_level + 1;
     DEBUG_VALIDATE_BUG_ON(parent->nb_decoded_layers >= decoder_max_layers);
@@ -470,12 +654,13 @@ Packet *PacketTunnelPktSetup(ThreadVars *tv, DecodeThreadVars *dtv, Packet *pare
  *
  *  \retval p the pseudo packet or NULL if out of memory
  */
-Packet *PacketDefragPktSetup(Packet *parent, const uint8_t *pkt, uint32_t len, uint8_t proto)
+Packet *PacketDefragPktSetup(ThreadVars *tv, DecodeThreadVars *dtv, Packet *parent,
+        const uint8_t *pkt, uint32_t len, uint8_t proto)
 {
     SCEnter();
 
     /* get us a packet */
-    Packet *p = PacketGetFromQueueOrAlloc();
+    Packet *p = PacketGetPseudo(tv, dtv);
     if (unlikely(p == NULL)) {
         SCReturnPtr(NULL, "Packet");
     }
@@ -668,6 +853,9 @@ void DecodeRegisterPerfCounters(DecodeThreadVars *dtv, ThreadVars *tv)
     dtv->counter_ipv6inipv4 = StatsRegisterCounter("decoder.ipv6_in_ipv4", tv);
     dtv->counter_ipv4inipv6 = StatsRegisterCounter("decoder.ipv4_in_ipv6", tv);
     dtv->counter_ipv6inipv6 = StatsRegisterCounter("decoder.ipv6_in_ipv6", tv);
+    dtv->counter_pseudo_pkt_alloc = StatsRegisterCounter("decoder.pseudo_pkt_alloc", tv);
+    dtv->counter_tunnel_zero_copy = StatsRegisterCounter("decoder.tunnel_zero_copy", tv);
+    dtv->counter_tunnel_pkt_alloc = StatsRegisterCounter("decoder.tunnel_pkt_alloc", tv);
     dtv->counter_mpls = StatsRegisterCounter("decoder.mpls", tv);
     dtv->counter_avg_pkt_size = StatsRegisterAvgCounter("decoder.avg_pkt_size", tv);
     dtv->counter_max_pkt_size = StatsRegisterMaxCounter("decoder.max_pkt_size", tv);
@@ -809,6 +997,7 @@ DecodeThreadVars *DecodeThreadVarsAlloc(ThreadVars *tv)
         return NULL;
 
     dtv->app_tctx = AppLayerGetCtxThread();
+    dtv->defrag_shard = DefragTrackerShardNew();
 
     if (OutputFlowLogThreadInit(tv, &dtv->output_flow_thread_data) != TM_ECODE_OK) {
         SCLogError("initializing flow log API for thread failed");
@@ -825,6 +1014,8 @@ void DecodeThreadVarsFree(ThreadVars *tv, DecodeThreadVars *dtv)
         if (dtv->app_tctx != NULL)
             AppLayerDestroyCtxThread(dtv->app_tctx);
 
+        DefragTrackerShardFree(dtv->defrag_shard);
+
         if (dtv->output_flow_thread_data != NULL)
             OutputFlowLogThreadDeinit(tv, dtv->output_flow_thread_data);
 
@@ -1061,6 +1252,10 @@ void DecodeGlobalConfig(void)
             decoder_max_layers = (uint8_t)value;
         }
     }
+    int zero_copy = 0;
+    if (SCConfGetBool("decoder.tunnel-zero-copy", &zero_copy) == 1) {
+        g_tunnel_zero_copy = zero_copy != 0;
+    }
     PacketAlertGetMaxConfig();
 }
 
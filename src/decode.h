@@ -287,6 +287,8 @@ typedef struct PacketAlerts_ {
     uint16_t cnt;
     uint16_t discarded;
     uint16_t suppressed;
+    /** alert array of packet_alert_max entries. Only attached once the
+     *  packet has an alert, see PacketAlertsAttach(). */
     PacketAlert *alerts;
     /* single pa used when we're dropping,
      * so we can log it out in the drop log. */
@@ -297,6 +299,18 @@ PacketAlert *PacketAlertCreate(void);
 void PacketAlertRecycle(PacketAlert *pa_array, uint16_t cnt);
 
 void PacketAlertFree(PacketAlert *pa);
+PacketAlert *PacketAlertGet(void);
+void PacketAlertRelease(PacketAlert *pa_array);
+void PacketAlertCacheFree(void);
+
+/** \brief make sure the packet has an alert array
+ *  \retval true if the packet has an alert array */
+static inline bool PacketAlertsAttach(PacketAlerts *alerts)
+{
+    if (alerts->alerts == NULL)
+        alerts->alerts = PacketAlertGet();
+    return alerts->alerts != NULL;
+}
 
 /** number of decoder events we support per packet. Power of 2 minus 1
  *  for memory layout */
@@ -402,6 +416,17 @@ enum PacketDropReason {
     PKT_DROP_REASON_MAX,
 };
 
+/** pipeline points at which a packet is time stamped if stats.latency
+ *  is enabled. See util-latency.c */
+enum PacketLatencyStage {
+    PKT_LATENCY_START = 0, /**< entry into the packet pipeline */
+    PKT_LATENCY_DECODE,    /**< after the decode module */
+    PKT_LATENCY_FLOW,      /**< after flow, stream and app-layer handling */
+    PKT_LATENCY_DETECT,    /**< after detect */
+    PKT_LATENCY_OUTPUT,    /**< after the packet loggers */
+    PKT_LATENCY_STAGE_MAX,
+};
+
 enum PacketTunnelType {
     PacketTunnelNone,
     PacketTunnelRoot,
@@ -672,6 +697,10 @@ typedef struct Packet_
 #ifdef PROFILING
     PktProfiling *profile;
 #endif
+    /** cpu ticks per enum PacketLatencyStage. Only set if latency
+     *  tracking is enabled, 0 otherwise. */
+    uint64_t latency_ts[PKT_LATENCY_STAGE_MAX];
+
     /* things in the packet that live beyond a reinit */
     struct {
         /** lock to protect access to:
@@ -964,6 +993,10 @@ typedef struct DecodeThreadVars_
     /** Specific context for udp protocol detection (here atm) */
     AppLayerThreadCtx *app_tctx;
 
+    /** thread's own defrag trackers if defrag.per-thread-trackers is
+     *  enabled, NULL otherwise */
+    struct DefragTrackerShard_ *defrag_shard;
+
     /** stats/counters */
     uint16_t counter_pkts;
     uint16_t counter_bytes;
@@ -1011,6 +1044,9 @@ typedef struct DecodeThreadVars_
     uint16_t counter_ipv6inipv4;
     uint16_t counter_ipv4inipv6;
     uint16_t counter_ipv6inipv6;
+    uint16_t counter_pseudo_pkt_alloc;
+    uint16_t counter_tunnel_zero_copy;
+    uint16_t counter_tunnel_pkt_alloc;
     uint16_t counter_erspan;
     uint16_t counter_nsh;
 
@@ -1114,7 +1150,9 @@ enum DecodeTunnelProto {
 
 Packet *PacketTunnelPktSetup(ThreadVars *tv, DecodeThreadVars *dtv, Packet *parent,
                              const uint8_t *pkt, uint32_t len, enum DecodeTunnelProto proto);
-Packet *PacketDefragPktSetup(Packet *parent, const uint8_t *pkt, uint32_t len, uint8_t proto);
+Packet *PacketDefragPktSetup(ThreadVars *tv, DecodeThreadVars *dtv, Packet *parent,
+        const uint8_t *pkt, uint32_t len, uint8_t proto);
+void PacketTunnelPoolFree(void);
 void PacketDefragPktSetupParent(Packet *parent);
 void DecodeRegisterPerfCounters(DecodeThreadVars *, ThreadVars *);
 Packet *PacketGetFromQueueOrAlloc(void);
@@ -1270,7 +1308,8 @@ void DecodeUnregisterCounters(void);
                    reinject/replace */
 #define PKT_STREAM_MODIFIED BIT_U32(10)
 
-// vacancy
+/** Packet holds a reference on its autofp 'balanced' scheduler bucket */
+#define PKT_AUTOFP_BALANCED BIT_U32(11)
 
 /** Exclude packet from pcap logging as it's part of a stream that has reassembly \
                    depth reached. */
@@ -163,6 +163,7 @@ void DefragTrackerClearMemory(DefragTracker *dt)
 #define DEFRAG_DEFAULT_HASHSIZE 4096
 #define DEFRAG_DEFAULT_MEMCAP 16777216
 #define DEFRAG_DEFAULT_PREALLOC 1000
+#define DEFRAG_DEFAULT_SHARD_HASHSIZE 4096
 
 /** \brief initialize the configuration
  *  \warning Not thread safe */
@@ -181,6 +182,7 @@ void DefragInitConfig(bool quiet)
     defrag_config.hash_rand   = (uint32_t)RandomGet();
     defrag_config.hash_size   = DEFRAG_DEFAULT_HASHSIZE;
     defrag_config.prealloc    = DEFRAG_DEFAULT_PREALLOC;
+    defrag_config.shard_hash_size = DEFRAG_DEFAULT_SHARD_HASHSIZE;
     SC_ATOMIC_SET(defrag_config.memcap, DEFRAG_DEFAULT_MEMCAP);
     defrag_config.memcap_policy = ExceptionPolicyParse("defrag.memcap-policy", false);
 
@@ -217,6 +219,18 @@ void DefragInitConfig(bool quiet)
             WarnInvalidConfEntry("defrag.trackers", "%"PRIu32, defrag_config.prealloc);
         }
     }
+    int per_thread = 0;
+    if (SCConfGetBool("defrag.per-thread-trackers", &per_thread) == 1) {
+        defrag_config.per_thread = per_thread != 0;
+    }
+    if ((SCConfGet("defrag.per-thread-hash-size", &conf_val)) == 1) {
+        if (StringParseUint32(&configval, 10, strlen(conf_val), conf_val) > 0 && configval > 0) {
+            defrag_config.shard_hash_size = configval;
+        } else {
+            WarnInvalidConfEntry(
+                    "defrag.per-thread-hash-size", "%" PRIu32, defrag_config.shard_hash_size);
+        }
+    }
     SCLogDebug("DefragTracker config from suricata.yaml: memcap: %"PRIu64", hash-size: "
                "%"PRIu32", prealloc: %"PRIu32, SC_ATOMIC_GET(defrag_config.memcap),
                defrag_config.hash_size, defrag_config.prealloc);
@@ -365,7 +379,7 @@ typedef struct DefragHashKey6_ {
     };
 } DefragHashKey6;
 
-/* calculate the hash key for this packet
+/* calculate the hash for this packet
  *
  * we're using:
  *  hash_rand -- set at init time
@@ -374,9 +388,9 @@ typedef struct DefragHashKey6_ {
  *  id
  *  vlan_id
  */
-static inline uint32_t DefragHashGetKey(Packet *p)
+static inline uint32_t DefragHashGetHash(Packet *p)
 {
-    uint32_t key;
+    uint32_t hash;
 
     if (PacketIsIPv4(p)) {
         const IPV4Hdr *ip4h = PacketGetIPv4(p);
@@ -391,9 +405,7 @@ static inline uint32_t DefragHashGetKey(Packet *p)
         dhk.id = (uint32_t)IPV4_GET_RAW_IPID(ip4h);
         memcpy(&dhk.vlan_id[0], &p->vlan_id[0], sizeof(dhk.vlan_id));
 
-        uint32_t hash =
-                hashword(dhk.u32, sizeof(dhk.u32) / sizeof(uint32_t), defrag_config.hash_rand);
-        key = hash % defrag_config.hash_size;
+        hash = hashword(dhk.u32, sizeof(dhk.u32) / sizeof(uint32_t), defrag_config.hash_rand);
     } else if (PacketIsIPv6(p)) {
         DefragHashKey6 dhk = { .pad[0] = 0 };
         if (DefragHashRawAddressIPv6GtU32(p->src.addr_data32, p->dst.addr_data32)) {
@@ -418,13 +430,17 @@ static inline uint32_t DefragHashGetKey(Packet *p)
         dhk.id = IPV6_EXTHDR_GET_FH_ID(p);
         memcpy(&dhk.vlan_id[0], &p->vlan_id[0], sizeof(dhk.vlan_id));
 
-        uint32_t hash =
-                hashword(dhk.u32, sizeof(dhk.u32) / sizeof(uint32_t), defrag_config.hash_rand);
-        key = hash % defrag_config.hash_size;
+        hash = hashword(dhk.u32, sizeof(dhk.u32) / sizeof(uint32_t), defrag_config.hash_rand);
     } else {
-        key = 0;
+        hash = 0;
     }
-    return key;
+    return hash;
+}
+
+/* calculate the hash key for this packet in the global hash */
+static inline uint32_t DefragHashGetKey(Packet *p)
+{
+    return DefragHashGetHash(p) % defrag_config.hash_size;
 }
 
 /* Since two or more trackers can have the same hash key, we need to compare
@@ -458,6 +474,14 @@ static void DefragExceptionPolicyStatsIncr(
     }
 }
 
+/** \internal
+ *  \brief apply the memcap exception policy when no tracker can be had */
+static void DefragTrackerMemcapHit(ThreadVars *tv, DecodeThreadVars *dtv, Packet *p)
+{
+    ExceptionPolicyApply(p, defrag_config.memcap_policy, PKT_DROP_REASON_DEFRAG_MEMCAP);
+    DefragExceptionPolicyStatsIncr(tv, dtv, defrag_config.memcap_policy);
+}
+
 /**
  *  \brief Get a new defrag tracker
  *
@@ -471,8 +495,7 @@ static DefragTracker *DefragTrackerGetNew(ThreadVars *tv, DecodeThreadVars *dtv,
 #ifdef DEBUG
     if (g_eps_defrag_memcap != UINT64_MAX && g_eps_defrag_memcap == p->pcap_cnt) {
         SCLogNotice("simulating memcap hit for packet %" PRIu64, p->pcap_cnt);
-        ExceptionPolicyApply(p, defrag_config.memcap_policy, PKT_DROP_REASON_DEFRAG_MEMCAP);
-        DefragExceptionPolicyStatsIncr(tv, dtv, defrag_config.memcap_policy);
+        DefragTrackerMemcapHit(tv, dtv, p);
         return NULL;
     }
 #endif
@@ -486,8 +509,7 @@ static DefragTracker *DefragTrackerGetNew(ThreadVars *tv, DecodeThreadVars *dtv,
         if (!(DEFRAG_CHECK_MEMCAP(sizeof(DefragTracker)))) {
             dt = DefragTrackerGetUsedDefragTracker(tv, dtv);
             if (dt == NULL) {
-                ExceptionPolicyApply(p, defrag_config.memcap_policy, PKT_DROP_REASON_DEFRAG_MEMCAP);
-                DefragExceptionPolicyStatsIncr(tv, dtv, defrag_config.memcap_policy);
+                DefragTrackerMemcapHit(tv, dtv, p);
                 return NULL;
             }
 
@@ -496,8 +518,7 @@ static DefragTracker *DefragTrackerGetNew(ThreadVars *tv, DecodeThreadVars *dtv,
             /* now see if we can alloc a new tracker */
             dt = DefragTrackerAlloc();
             if (dt == NULL) {
-                ExceptionPolicyApply(p, defrag_config.memcap_policy, PKT_DROP_REASON_DEFRAG_MEMCAP);
-                DefragExceptionPolicyStatsIncr(tv, dtv, defrag_config.memcap_policy);
+                DefragTrackerMemcapHit(tv, dtv, p);
                 return NULL;
             }
 
@@ -726,3 +747,322 @@ static DefragTracker *DefragTrackerGetUsedDefragTracker(ThreadVars *tv, const De
 
     return NULL;
 }
+
+/** max number of spare trackers a shard keeps for itself, the rest goes
+ *  back to the global spare queue */
+#define DEFRAG_SHARD_SPARE_MAX 256
+
+/**
+ * Per thread tracker table, used if defrag.per-thread-trackers is enabled.
+ *
+ * This relies on the capture method delivering all fragments of a packet
+ * to the same thread. Its trackers are not in the global hash, so they are
+ * timed out by the owner when it handles fragments and, if the owner is
+ * idle, by the flow manager. The shard lock is only contended in the latter
+ * case. To not scan all the rows for timeouts, the trackers in the table are
+ * also kept in a list, in insertion order.
+ */
+struct DefragTrackerShard_ {
+    SCMutex lock;
+    DefragTracker **hash;  /**< hash rows, defrag_config.shard_hash_size of them */
+    DefragTracker *used;   /**< trackers in the hash, linked by lnext */
+    DefragTracker *used_tail;
+    DefragTracker *spare;  /**< trackers for reuse, linked by lnext */
+    uint32_t spare_cnt;
+    uint64_t timeout_secs; /**< packet time of the last timeout pass */
+    struct DefragTrackerShard_ *next; /**< next in defrag_shards */
+};
+
+/** all shards, for the flow manager to time out idle ones */
+static DefragTrackerShard *defrag_shards = NULL;
+static SCMutex defrag_shards_lock = SCMUTEX_INITIALIZER;
+
+/** \brief set up a tracker shard for the calling thread
+ *
+ *  \retval shard or NULL if per thread trackers are disabled or the shard
+ *          could not be set up, in which case the global hash is used */
+DefragTrackerShard *DefragTrackerShardNew(void)
+{
+    if (!defrag_config.per_thread)
+        return NULL;
+
+    const uint64_t hash_size = (uint64_t)defrag_config.shard_hash_size * sizeof(DefragTracker *);
+    if (!(DEFRAG_CHECK_MEMCAP(hash_size))) {
+        SCLogWarning("defrag memcap reached, thread uses the global defrag hash");
+        return NULL;
+    }
+
+    DefragTrackerShard *s = SCCalloc(1, sizeof(*s));
+    if (unlikely(s == NULL))
+        return NULL;
+    s->hash = SCCalloc(defrag_config.shard_hash_size, sizeof(DefragTracker *));
+    if (unlikely(s->hash == NULL)) {
+        SCFree(s);
+        return NULL;
+    }
+    SCMutexInit(&s->lock, NULL);
+    (void)SC_ATOMIC_ADD(defrag_memuse, hash_size);
+
+    SCMutexLock(&defrag_shards_lock);
+    s->next = defrag_shards;
+    defrag_shards = s;
+    SCMutexUnlock(&defrag_shards_lock);
+    return s;
+}
+
+void DefragTrackerShardFree(DefragTrackerShard *s)
+{
+    if (s == NULL)
+        return;
+
+    SCMutexLock(&defrag_shards_lock);
+    DefragTrackerShard **ps = &defrag_shards;
+    while (*ps != NULL && *ps != s) {
+        ps = &(*ps)->next;
+    }
+    if (*ps != NULL) {
+        *ps = s->next;
+    }
+    SCMutexUnlock(&defrag_shards_lock);
+
+    for (uint32_t u = 0; u < defrag_config.shard_hash_size; u++) {
+        DefragTracker *dt = s->hash[u];
+        while (dt) {
+            DefragTracker *n = dt->hnext;
+            (void)SC_ATOMIC_SUB(defragtracker_counter, 1);
+            DefragTrackerFree(dt);
+            dt = n;
+        }
+    }
+    while (s->spare) {
+        DefragTracker *n = s->spare->lnext;
+        DefragTrackerFree(s->spare);
+        s->spare = n;
+    }
+    SCFree(s->hash);
+    (void)SC_ATOMIC_SUB(
+            defrag_memuse, (uint64_t)defrag_config.shard_hash_size * sizeof(DefragTracker *));
+    SCMutexDestroy(&s->lock);
+    SCFree(s);
+}
+
+/** \internal
+ *  \brief clear a tracker that was removed from the shard and keep it */
+static void DefragShardTrackerMoveToSpare(DefragTrackerShard *s, DefragTracker *dt)
+{
+    DefragTrackerClearMemory(dt);
+    if (s->spare_cnt < DEFRAG_SHARD_SPARE_MAX) {
+        dt->lnext = s->spare;
+        s->spare = dt;
+        s->spare_cnt++;
+        (void)SC_ATOMIC_SUB(defragtracker_counter, 1);
+    } else {
+        DefragTrackerMoveToSpare(dt);
+    }
+}
+
+/** \internal
+ *  \brief remove a tracker from the shard's hash and used list
+ *
+ *  \param prev_dt tracker before dt in the used list, NULL if dt is first */
+static void DefragShardTrackerRemove(
+        DefragTrackerShard *s, DefragTracker *dt, DefragTracker *prev_dt)
+{
+    if (prev_dt != NULL) {
+        prev_dt->lnext = dt->lnext;
+    } else {
+        s->used = dt->lnext;
+    }
+    if (s->used_tail == dt) {
+        s->used_tail = prev_dt;
+    }
+    dt->lnext = NULL;
+
+    DefragTracker **pdt = &s->hash[dt->shard_row];
+    while (*pdt != dt) {
+        pdt = &(*pdt)->hnext;
+    }
+    *pdt = dt->hnext;
+    dt->hnext = NULL;
+}
+
+/** \internal
+ *  \brief remove timed out trackers from the shard
+ *
+ *  Only the trackers in use are checked, not all the hash rows. Trackers
+ *  the owner is currently using are skipped by DefragTrackerTimedOut().
+ *
+ *  \param s shard *LOCKED*
+ *
+ *  \retval cnt number of timed out trackers */
+static uint32_t DefragShardTimeout(DefragTrackerShard *s, SCTime_t ts)
+{
+    uint32_t cnt = 0;
+    s->timeout_secs = SCTIME_SECS(ts);
+
+    DefragTracker *prev_dt = NULL;
+    DefragTracker *dt = s->used;
+    while (dt != NULL) {
+        DefragTracker *next_dt = dt->lnext;
+        if (DefragTrackerTimedOut(dt, ts)) {
+            DefragShardTrackerRemove(s, dt, prev_dt);
+            DefragShardTrackerMoveToSpare(s, dt);
+            cnt++;
+        } else {
+            prev_dt = dt;
+        }
+        dt = next_dt;
+    }
+    return cnt;
+}
+
+/** \brief time out the trackers of idle shards
+ *
+ *  Called by the flow manager. A shard is idle if its owner has not done
+ *  a timeout pass in the last second. Shards in use are skipped.
+ *
+ *  \retval cnt number of timed out trackers */
+uint32_t DefragTimeoutShards(SCTime_t ts)
+{
+    uint32_t cnt = 0;
+
+    SCMutexLock(&defrag_shards_lock);
+    for (DefragTrackerShard *s = defrag_shards; s != NULL; s = s->next) {
+        if (SCMutexTrylock(&s->lock) != 0)
+            continue;
+        if ((uint64_t)SCTIME_SECS(ts) > s->timeout_secs + 1) {
+            cnt += DefragShardTimeout(s, ts);
+        }
+        SCMutexUnlock(&s->lock);
+    }
+    SCMutexUnlock(&defrag_shards_lock);
+
+    return cnt;
+}
+
+/** \internal
+ *  \brief take the oldest tracker from the shard when the memcap is reached
+ *
+ *  \retval dt cleared tracker or NULL */
+static DefragTracker *DefragShardGetUsedTracker(
+        ThreadVars *tv, DecodeThreadVars *dtv, DefragTrackerShard *s)
+{
+    DefragTracker *prev_dt = NULL;
+    for (DefragTracker *dt = s->used; dt != NULL; prev_dt = dt, dt = dt->lnext) {
+        /** never take a tracker this thread is currently using */
+        if (SC_ATOMIC_GET(dt->use_cnt) > 0)
+            continue;
+
+        /* only count "forced" reuse */
+        if (!dt->remove) {
+            StatsIncr(tv, dtv->counter_defrag_tracker_hard_reuse);
+        } else {
+            StatsIncr(tv, dtv->counter_defrag_tracker_soft_reuse);
+        }
+
+        DefragShardTrackerRemove(s, dt, prev_dt);
+        DefragTrackerClearMemory(dt);
+        (void)SC_ATOMIC_SUB(defragtracker_counter, 1);
+        return dt;
+    }
+
+    return NULL;
+}
+
+/** \internal
+ *  \brief get a tracker for the shard: a spare of the shard, one from the
+ *         global spare queue, a new one or, at the memcap, a used one. */
+static DefragTracker *DefragShardTrackerGetNew(
+        ThreadVars *tv, DecodeThreadVars *dtv, DefragTrackerShard *s, Packet *p)
+{
+#ifdef DEBUG
+    if (g_eps_defrag_memcap != UINT64_MAX && g_eps_defrag_memcap == p->pcap_cnt) {
+        SCLogNotice("simulating memcap hit for packet %" PRIu64, p->pcap_cnt);
+        DefragTrackerMemcapHit(tv, dtv, p);
+        return NULL;
+    }
+#endif
+
+    DefragTracker *dt = s->spare;
+    if (dt != NULL) {
+        s->spare = dt->lnext;
+        dt->lnext = NULL;
+        s->spare_cnt--;
+    } else {
+        dt = DefragTrackerDequeue(&defragtracker_spare_q);
+        if (dt == NULL) {
+            if (!(DEFRAG_CHECK_MEMCAP(sizeof(DefragTracker)))) {
+                dt = DefragShardGetUsedTracker(tv, dtv, s);
+            } else {
+                dt = DefragTrackerAlloc();
+            }
+            if (dt == NULL) {
+                DefragTrackerMemcapHit(tv, dtv, p);
+                return NULL;
+            }
+        }
+    }
+
+    (void)SC_ATOMIC_ADD(defragtracker_counter, 1);
+    return dt;
+}
+
+/** \internal
+ *  \brief look up or add the tracker for a fragment in a *LOCKED* shard */
+static DefragTracker *DefragShardGetTracker(
+        ThreadVars *tv, DecodeThreadVars *dtv, DefragTrackerShard *s, Packet *p)
+{
+    /* at most one timeout pass per second of packet time */
+    if (SCTIME_SECS(p->ts) != s->timeout_secs) {
+        const uint32_t cnt = DefragShardTimeout(s, p->ts);
+        if (cnt > 0) {
+            StatsAddUI64(tv, dtv->counter_defrag_tracker_timeout, cnt);
+        }
+    }
+
+    /* timed out trackers are left to DefragShardTimeout(), which also
+     * removes them from the used list */
+    const uint32_t key = DefragHashGetHash(p) % defrag_config.shard_hash_size;
+    for (DefragTracker *dt = s->hash[key]; dt != NULL; dt = dt->hnext) {
+        if (!dt->remove && !DefragTrackerTimedOut(dt, p->ts) && DefragTrackerCompare(dt, p)) {
+            (void)DefragTrackerIncrUsecnt(dt);
+            return dt;
+        }
+    }
+
+    DefragTracker *dt = DefragShardTrackerGetNew(tv, dtv, s, p);
+    if (dt == NULL)
+        return NULL;
+    dt->hnext = s->hash[key];
+    s->hash[key] = dt;
+    dt->shard_row = key;
+    if (s->used_tail != NULL) {
+        s->used_tail->lnext = dt;
+    } else {
+        s->used = dt;
+    }
+    s->used_tail = dt;
+    DefragTrackerInit(dt, p);
+    return dt;
+}
+
+/** \brief get the tracker for a fragment from the thread's shard
+ *
+ *  Like DefragGetTrackerFromHash(), but the tracker is not locked. Its
+ *  use_cnt keeps the flow manager from timing it out.
+ *
+ *  \retval dt tracker, *NOT* locked, or NULL */
+DefragTracker *DefragGetTrackerFromShard(ThreadVars *tv, DecodeThreadVars *dtv, Packet *p)
+{
+    DefragTrackerShard *s = dtv->defrag_shard;
+
+    SCMutexLock(&s->lock);
+    DefragTracker *dt = DefragShardGetTracker(tv, dtv, s, p);
+    SCMutexUnlock(&s->lock);
+    return dt;
+}
+
+void DefragTrackerShardRelease(DefragTracker *t)
+{
+    (void)DefragTrackerDecrUsecnt(t);
+}
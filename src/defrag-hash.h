@@ -71,8 +71,12 @@ typedef struct DefragConfig_ {
     uint32_t hash_size;
     uint32_t prealloc;
     enum ExceptionPolicy memcap_policy;
+    bool per_thread;         /**< use per thread tracker shards */
+    uint32_t shard_hash_size; /**< hash rows of a per thread tracker shard */
 } DefragConfig;
 
+typedef struct DefragTrackerShard_ DefragTrackerShard;
+
 /** \brief check if a memory alloc would fit in the memcap
  *
  *  \param size memory allocation size to check
@@ -97,6 +101,12 @@ void DefragTrackerRelease(DefragTracker *);
 void DefragTrackerClearMemory(DefragTracker *);
 void DefragTrackerMoveToSpare(DefragTracker *);
 
+DefragTrackerShard *DefragTrackerShardNew(void);
+void DefragTrackerShardFree(DefragTrackerShard *);
+DefragTracker *DefragGetTrackerFromShard(ThreadVars *tv, DecodeThreadVars *dtv, Packet *);
+void DefragTrackerShardRelease(DefragTracker *);
+uint32_t DefragTimeoutShards(SCTime_t ts);
+
 int DefragTrackerSetMemcap(uint64_t);
 uint64_t DefragTrackerGetMemcap(void);
 uint64_t DefragTrackerGetMemuse(void);
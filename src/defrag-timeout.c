@@ -113,7 +113,7 @@ static uint32_t DefragTrackerHashRowTimeout(
 }
 
 /**
- *  \brief time out tracker from the hash
+ *  \brief time out tracker from the hash and the idle shards
  *
  *  \param ts timestamp
  *
@@ -142,6 +142,11 @@ uint32_t DefragTimeoutHash(SCTime_t ts)
         DRLOCK_UNLOCK(hb);
     }
 
+    /* per thread trackers of threads that are not seeing fragments */
+    if (defrag_config.per_thread) {
+        cnt += DefragTimeoutShards(ts);
+    }
+
     return cnt;
 }
 
@@ -125,6 +125,52 @@ DefragFragInit(void *data, void *initdata)
     return 1;
 }
 
+/**
+ * \brief Check if a frag is one of the tracker's inline frags.
+ */
+static inline bool DefragFragIsInline(const DefragTracker *tracker, const Frag *frag)
+{
+    return frag >= &tracker->frags_inline[0] && frag < &tracker->frags_inline[DEFRAG_FRAGS_INLINE];
+}
+
+/**
+ * \brief Get a frag for a tracker.
+ *
+ * Uses a free inline frag of the tracker if there is one, otherwise gets
+ * one from the frag pool.
+ *
+ * \retval frag or NULL if the frag pool is exhausted
+ */
+static Frag *DefragFragGet(DefragTracker *tracker)
+{
+    for (uint8_t i = 0; i < DEFRAG_FRAGS_INLINE; i++) {
+        if (!(tracker->frags_inline_used & BIT_U8(i))) {
+            tracker->frags_inline_used |= BIT_U8(i);
+            return &tracker->frags_inline[i];
+        }
+    }
+
+    SCMutexLock(&defrag_context->frag_pool_lock);
+    Frag *frag = PoolGet(defrag_context->frag_pool);
+    SCMutexUnlock(&defrag_context->frag_pool_lock);
+    return frag;
+}
+
+/**
+ * \brief Reset a frag and return it to the tracker or the frag pool.
+ */
+static void DefragFragReturn(DefragTracker *tracker, Frag *frag)
+{
+    DefragFragReset(frag);
+    if (DefragFragIsInline(tracker, frag)) {
+        tracker->frags_inline_used &= (uint8_t)~BIT_U8(frag - tracker->frags_inline);
+        return;
+    }
+    SCMutexLock(&defrag_context->frag_pool_lock);
+    PoolReturn(defrag_context->frag_pool, frag);
+    SCMutexUnlock(&defrag_context->frag_pool_lock);
+}
+
 /**
  * \brief Free all frags associated with a tracker.
  */
@@ -132,17 +178,26 @@ void
 DefragTrackerFreeFrags(DefragTracker *tracker)
 {
     Frag *frag, *tmp;
-
-    /* Lock the frag pool as we'll be return items to it. */
-    SCMutexLock(&defrag_context->frag_pool_lock);
+    bool locked = false;
 
     RB_FOREACH_SAFE(frag, IP_FRAGMENTS, &tracker->fragment_tree, tmp) {
         RB_REMOVE(IP_FRAGMENTS, &tracker->fragment_tree, frag);
         DefragFragReset(frag);
+        if (DefragFragIsInline(tracker, frag)) {
+            continue;
+        }
+        /* Lock the frag pool once as we may return more items to it. */
+        if (!locked) {
+            SCMutexLock(&defrag_context->frag_pool_lock);
+            locked = true;
+        }
         PoolReturn(defrag_context->frag_pool, frag);
     }
+    tracker->frags_inline_used = 0;
 
-    SCMutexUnlock(&defrag_context->frag_pool_lock);
+    if (locked) {
+        SCMutexUnlock(&defrag_context->frag_pool_lock);
+    }
 }
 
 /**
@@ -222,7 +277,7 @@ DefragContextDestroy(DefragContext *dc)
  * \param tracker The defragmentation tracker to reassemble from.
  */
 static Packet *
-Defrag4Reassemble(ThreadVars *tv, DefragTracker *tracker, Packet *p)
+Defrag4Reassemble(ThreadVars *tv, DecodeThreadVars *dtv, DefragTracker *tracker, Packet *p)
 {
     Packet *rp = NULL;
 
@@ -263,7 +318,7 @@ Defrag4Reassemble(ThreadVars *tv, DefragTracker *tracker, Packet *p)
 
     /* Allocate a Packet for the reassembled packet.  On failure we
      * SCFree all the resources held by this tracker. */
-    rp = PacketDefragPktSetup(p, NULL, 0, IPV4_GET_RAW_IPPROTO(oip4h));
+    rp = PacketDefragPktSetup(tv, dtv, p, NULL, 0, IPV4_GET_RAW_IPPROTO(oip4h));
     if (rp == NULL) {
         goto error_remove_tracker;
     }
@@ -372,7 +427,7 @@ error_remove_tracker:
  * \param tracker The defragmentation tracker to reassemble from.
  */
 static Packet *
-Defrag6Reassemble(ThreadVars *tv, DefragTracker *tracker, Packet *p)
+Defrag6Reassemble(ThreadVars *tv, DecodeThreadVars *dtv, DefragTracker *tracker, Packet *p)
 {
     Packet *rp = NULL;
 
@@ -419,12 +474,10 @@ Defrag6Reassemble(ThreadVars *tv, DefragTracker *tracker, Packet *p)
         }
     }
 
-    const IPV6Hdr *oip6h = PacketGetIPv6(p);
-
     /* Allocate a Packet for the reassembled packet.  On failure we
-     * SCFree all the resources held by this tracker. */
-    rp = PacketDefragPktSetup(
-            p, (const uint8_t *)oip6h, IPV6_GET_RAW_PLEN(oip6h) + sizeof(IPV6Hdr), 0);
+     * SCFree all the resources held by this tracker. The data is
+     * copied in from the first fragment below. */
+    rp = PacketDefragPktSetup(tv, dtv, p, NULL, 0, 0);
     if (rp == NULL) {
         goto error_remove_tracker;
     }
@@ -846,10 +899,7 @@ DefragInsertFrag(ThreadVars *tv, DecodeThreadVars *dtv, DefragTracker *tracker,
              * onto it. */
             if (prev->skip || prev->ltrim >= prev->data_len) {
                 RB_REMOVE(IP_FRAGMENTS, &tracker->fragment_tree, prev);
-                DefragFragReset(prev);
-                SCMutexLock(&defrag_context->frag_pool_lock);
-                PoolReturn(defrag_context->frag_pool, prev);
-                SCMutexUnlock(&defrag_context->frag_pool_lock);
+                DefragFragReturn(tracker, prev);
             }
             break;
         }
@@ -862,9 +912,7 @@ DefragInsertFrag(ThreadVars *tv, DecodeThreadVars *dtv, DefragTracker *tracker,
     }
 
     /* Allocate fragment and insert. */
-    SCMutexLock(&defrag_context->frag_pool_lock);
-    Frag *new = PoolGet(defrag_context->frag_pool);
-    SCMutexUnlock(&defrag_context->frag_pool_lock);
+    Frag *new = DefragFragGet(tracker);
     if (new == NULL) {
         if (af == AF_INET) {
             ENGINE_SET_EVENT(p, IPV4_FRAG_IGNORED);
@@ -876,11 +924,14 @@ DefragInsertFrag(ThreadVars *tv, DecodeThreadVars *dtv, DefragTracker *tracker,
         }
         goto error_remove_tracker;
     }
-    new->pkt = SCMalloc(GET_PKT_LEN(p));
+    /* The headers are only used from the first fragment, for the others
+     * we only keep the (trimmed) fragment data. */
+    const bool first = (frag_offset + ltrim == 0);
+    const uint8_t *copy_src = first ? GET_PKT_DATA(p) : GET_PKT_DATA(p) + data_offset + ltrim;
+    const uint32_t copy_len = first ? GET_PKT_LEN(p) : (uint32_t)(data_len - ltrim);
+    new->pkt = SCMalloc(copy_len);
     if (new->pkt == NULL) {
-        SCMutexLock(&defrag_context->frag_pool_lock);
-        PoolReturn(defrag_context->frag_pool, new);
-        SCMutexUnlock(&defrag_context->frag_pool_lock);
+        DefragFragReturn(tracker, new);
         if (af == AF_INET) {
             ENGINE_SET_EVENT(p, IPV4_FRAG_IGNORED);
         } else {
@@ -888,8 +939,8 @@ DefragInsertFrag(ThreadVars *tv, DecodeThreadVars *dtv, DefragTracker *tracker,
         }
         goto error_remove_tracker;
     }
-    memcpy(new->pkt, GET_PKT_DATA(p) + ltrim, GET_PKT_LEN(p) - ltrim);
-    new->len = (GET_PKT_LEN(p) - ltrim);
+    memcpy(new->pkt, copy_src, copy_len);
+    new->len = copy_len;
     /* in case of unfragmentable exthdrs, update the 'next hdr' field
      * in the raw buffer so the reassembled packet will point to the
      * correct next header after stripping the frag header */
@@ -903,7 +954,7 @@ DefragInsertFrag(ThreadVars *tv, DecodeThreadVars *dtv, DefragTracker *tracker,
 
     new->hlen = hlen;
     new->offset = frag_offset + ltrim;
-    new->data_offset = data_offset;
+    new->data_offset = first ? data_offset : 0;
     new->data_len = data_len - ltrim;
     new->frag_hdr_offset = frag_hdr_offset;
     new->more_frags = more_frags;
@@ -923,7 +974,7 @@ DefragInsertFrag(ThreadVars *tv, DecodeThreadVars *dtv, DefragTracker *tracker,
 
     if (tracker->seen_last) {
         if (tracker->af == AF_INET) {
-            r = Defrag4Reassemble(tv, tracker, p);
+            r = Defrag4Reassemble(tv, dtv, tracker, p);
             if (r != NULL && tv != NULL && dtv != NULL) {
                 StatsIncr(tv, dtv->counter_defrag_ipv4_reassembled);
                 const uint32_t len = GET_PKT_LEN(r) - (uint32_t)tracker->ip_hdr_offset;
@@ -939,7 +990,7 @@ DefragInsertFrag(ThreadVars *tv, DecodeThreadVars *dtv, DefragTracker *tracker,
             }
         }
         else if (tracker->af == AF_INET6) {
-            r = Defrag6Reassemble(tv, tracker, p);
+            r = Defrag6Reassemble(tv, dtv, tracker, p);
             if (r != NULL && tv != NULL && dtv != NULL) {
                 StatsIncr(tv, dtv->counter_defrag_ipv6_reassembled);
                 const uint32_t len = GET_PKT_LEN(r) - (uint32_t)tracker->ip_hdr_offset;
@@ -1042,10 +1093,14 @@ DefragGetOsPolicy(Packet *p)
 
 /** \internal
  *
- *  \retval NULL or a *LOCKED* tracker */
+ *  \retval NULL or a *LOCKED* tracker. With per thread trackers the
+ *          tracker is not locked, as only this thread uses it. */
 static DefragTracker *
 DefragGetTracker(ThreadVars *tv, DecodeThreadVars *dtv, Packet *p)
 {
+    if (dtv->defrag_shard != NULL) {
+        return DefragGetTrackerFromShard(tv, dtv, p);
+    }
     return DefragGetTrackerFromHash(tv, dtv, p);
 }
 
@@ -1100,7 +1155,11 @@ Defrag(ThreadVars *tv, DecodeThreadVars *dtv, Packet *p)
     }
 
     Packet *rp = DefragInsertFrag(tv, dtv, tracker, p);
-    DefragTrackerRelease(tracker);
+    if (dtv->defrag_shard != NULL) {
+        DefragTrackerShardRelease(tracker);
+    } else {
+        DefragTrackerRelease(tracker);
+    }
 
     return rp;
 }
@@ -1137,6 +1196,8 @@ void DefragDestroy(void)
 #ifdef UNITTESTS
 #include "util-unittest-helper.h"
 #include "packet.h"
+#include "conf-yaml-loader.h"
+#include "defrag-timeout.h"
 
 #define IP_MF 0x2000
 
@@ -1456,6 +1517,80 @@ static int DefragInOrderSimpleTest(void)
     PASS;
 }
 
+/**
+ * \test The first fragments are stored in the tracker and only the ones
+ *       beyond DEFRAG_FRAGS_INLINE come from the frag pool.
+ */
+static int DefragInlineFragsTest(void)
+{
+    Packet *packets[DEFRAG_FRAGS_INLINE + 2];
+    const int cnt = DEFRAG_FRAGS_INLINE + 2;
+    int id = 12;
+
+    DefragInit();
+
+    for (int i = 0; i < cnt; i++) {
+        packets[i] = BuildIpv4TestPacket(IPPROTO_ICMP, id, i, i < cnt - 1, (char)('A' + i), 8);
+        FAIL_IF_NULL(packets[i]);
+    }
+
+    for (int i = 0; i < DEFRAG_FRAGS_INLINE; i++) {
+        FAIL_IF(Defrag(&test_tv, &test_dtv, packets[i]) != NULL);
+    }
+    FAIL_IF(defrag_context->frag_pool->outstanding != 0);
+
+    FAIL_IF(Defrag(&test_tv, &test_dtv, packets[cnt - 2]) != NULL);
+    FAIL_IF(defrag_context->frag_pool->outstanding != 1);
+
+    Packet *reassembled = Defrag(&test_tv, &test_dtv, packets[cnt - 1]);
+    FAIL_IF_NULL(reassembled);
+    FAIL_IF(defrag_context->frag_pool->outstanding != 0);
+
+    FAIL_IF(IPV4_GET_RAW_IPLEN(PacketGetIPv4(reassembled)) != 20 + cnt * 8);
+    for (int i = 0; i < cnt * 8; i++) {
+        FAIL_IF(GET_PKT_DATA(reassembled)[20 + i] != 'A' + i / 8);
+    }
+
+    for (int i = 0; i < cnt; i++) {
+        SCFree(packets[i]);
+    }
+    SCFree(reassembled);
+
+    DefragDestroy();
+    PASS;
+}
+
+/**
+ * \test The default defrag settings of suricata.yaml preallocate all the
+ *       trackers within the memcap.
+ */
+static int DefragPreallocDefaultsTest(void)
+{
+    const char config[] = "\
+%YAML 1.1\n\
+---\n\
+defrag:\n\
+  memcap: 32 MiB\n\
+  hash-size: 65536\n\
+  trackers: 65535\n\
+  max-frags: 65535\n\
+  prealloc: yes\n\
+  timeout: 60\n";
+
+    SCConfCreateContextBackup();
+    SCConfInit();
+    SCConfYamlLoadString(config, strlen(config));
+
+    DefragInit();
+    FAIL_IF(SC_ATOMIC_GET(defrag_memuse) < 65535 * sizeof(DefragTracker));
+    FAIL_IF(SC_ATOMIC_GET(defrag_memuse) > SC_ATOMIC_GET(defrag_config.memcap));
+    DefragDestroy();
+
+    SCConfDeInit();
+    SCConfRestoreContextBackup();
+    PASS;
+}
+
 /**
  * Simple fragmented packet in reverse order.
  */
@@ -2315,6 +2450,93 @@ static int DefragTimeoutTest(void)
     PASS;
 }
 
+/**
+ * Test that with per thread trackers the fragments are tracked in the
+ * thread's shard and not in the global hash.
+ */
+static int DefragPerThreadTrackersTest(void)
+{
+    int id = 12;
+
+    FAIL_IF_NOT(SCConfSet("defrag.per-thread-trackers", "yes"));
+    DefragInit();
+
+    DecodeThreadVars dtv = { 0 };
+    dtv.defrag_shard = DefragTrackerShardNew();
+    FAIL_IF_NULL(dtv.defrag_shard);
+
+    Packet *p1 = BuildIpv4TestPacket(IPPROTO_ICMP, id, 0, 1, 'A', 8);
+    FAIL_IF_NULL(p1);
+    Packet *p2 = BuildIpv4TestPacket(IPPROTO_ICMP, id, 1, 1, 'B', 8);
+    FAIL_IF_NULL(p2);
+    Packet *p3 = BuildIpv4TestPacket(IPPROTO_ICMP, id, 2, 0, 'C', 3);
+    FAIL_IF_NULL(p3);
+
+    FAIL_IF(Defrag(&test_tv, &dtv, p1) != NULL);
+    FAIL_IF_NOT_NULL(DefragLookupTrackerFromHash(p1));
+    FAIL_IF(SC_ATOMIC_GET(defragtracker_counter) != 1);
+    FAIL_IF(Defrag(&test_tv, &dtv, p2) != NULL);
+
+    Packet *reassembled = Defrag(&test_tv, &dtv, p3);
+    FAIL_IF_NULL(reassembled);
+    FAIL_IF(IPV4_GET_RAW_IPLEN(PacketGetIPv4(reassembled)) != 39);
+
+    /* A fragment a second later has the shard remove the finished
+     * tracker before tracking its own. */
+    Packet *p4 = BuildIpv4TestPacket(IPPROTO_ICMP, id + 1, 0, 1, 'D', 8);
+    FAIL_IF_NULL(p4);
+    p4->ts = SCTIME_ADD_SECS(p3->ts, 1);
+    FAIL_IF(Defrag(&test_tv, &dtv, p4) != NULL);
+    FAIL_IF(SC_ATOMIC_GET(defragtracker_counter) != 1);
+
+    SCFree(p1);
+    SCFree(p2);
+    SCFree(p3);
+    SCFree(p4);
+    SCFree(reassembled);
+
+    DefragTrackerShardFree(dtv.defrag_shard);
+    FAIL_IF(SC_ATOMIC_GET(defragtracker_counter) != 0);
+    DefragDestroy();
+    FAIL_IF_NOT(SCConfSet("defrag.per-thread-trackers", "no"));
+    PASS;
+}
+
+/**
+ * Test that the trackers of a shard whose thread sees no more fragments
+ * are timed out by the flow manager.
+ */
+static int DefragPerThreadTrackersTest02(void)
+{
+    FAIL_IF_NOT(SCConfSet("defrag.per-thread-trackers", "yes"));
+    FAIL_IF_NOT(SCConfSet("defrag.per-thread-hash-size", "16"));
+    DefragInit();
+    FAIL_IF(defrag_config.shard_hash_size != 16);
+
+    DecodeThreadVars dtv = { 0 };
+    dtv.defrag_shard = DefragTrackerShardNew();
+    FAIL_IF_NULL(dtv.defrag_shard);
+
+    Packet *p1 = BuildIpv4TestPacket(IPPROTO_ICMP, 1, 0, 1, 'A', 8);
+    FAIL_IF_NULL(p1);
+    FAIL_IF(Defrag(&test_tv, &dtv, p1) != NULL);
+    FAIL_IF(SC_ATOMIC_GET(defragtracker_counter) != 1);
+
+    /* the tracker has not timed out yet */
+    FAIL_IF(DefragTimeoutHash(SCTIME_ADD_SECS(p1->ts, 2)) != 0);
+    FAIL_IF(SC_ATOMIC_GET(defragtracker_counter) != 1);
+
+    FAIL_IF(DefragTimeoutHash(SCTIME_ADD_SECS(p1->ts, 3600)) != 1);
+    FAIL_IF(SC_ATOMIC_GET(defragtracker_counter) != 0);
+
+    SCFree(p1);
+    DefragTrackerShardFree(dtv.defrag_shard);
+    DefragDestroy();
+    FAIL_IF_NOT(SCConfSet("defrag.per-thread-hash-size", "4096"));
+    FAIL_IF_NOT(SCConfSet("defrag.per-thread-trackers", "no"));
+    PASS;
+}
+
 /**
  * QA found that if you send a packet where more frags is 0, offset is
  * > 0 and there is no data in the packet that the re-assembler will
@@ -3112,6 +3334,8 @@ void DefragRegisterTests(void)
 {
 #ifdef UNITTESTS
     UtRegisterTest("DefragInOrderSimpleTest", DefragInOrderSimpleTest);
+    UtRegisterTest("DefragInlineFragsTest", DefragInlineFragsTest);
+    UtRegisterTest("DefragPreallocDefaultsTest", DefragPreallocDefaultsTest);
     UtRegisterTest("DefragReverseSimpleTest", DefragReverseSimpleTest);
     UtRegisterTest("DefragSturgesNovakBsdTest", DefragSturgesNovakBsdTest);
     UtRegisterTest("DefragSturgesNovakLinuxIpv4Test",
@@ -3140,6 +3364,8 @@ void DefragRegisterTests(void)
     UtRegisterTest("DefragVlanQinQinQTest", DefragVlanQinQinQTest);
     UtRegisterTest("DefragTrackerReuseTest", DefragTrackerReuseTest);
     UtRegisterTest("DefragTimeoutTest", DefragTimeoutTest);
+    UtRegisterTest("DefragPerThreadTrackersTest", DefragPerThreadTrackersTest);
+    UtRegisterTest("DefragPerThreadTrackersTest02", DefragPerThreadTrackersTest02);
     UtRegisterTest("DefragMfIpv4Test", DefragMfIpv4Test);
     UtRegisterTest("DefragMfIpv6Test", DefragMfIpv6Test);
     UtRegisterTest("DefragTestBadProto", DefragTestBadProto);
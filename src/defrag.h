@@ -77,6 +77,12 @@ int DefragRbFragCompare(struct Frag_ *a, struct Frag_ *b);
 RB_HEAD(IP_FRAGMENTS, Frag_);
 RB_PROTOTYPE(IP_FRAGMENTS, Frag_, rb, DefragRbFragCompare);
 
+/** Number of fragments stored in the tracker itself. Most fragmented
+ *  packets have only two fragments, so these don't need the global
+ *  fragment pool. Each slot adds a Frag to every tracker, and all trackers
+ *  are preallocated within the defrag memcap by default, so keep it small. */
+#define DEFRAG_FRAGS_INLINE 2
+
 /**
  * A defragmentation tracker.  Used to track fragments that make up a
  * single packet.
@@ -103,18 +109,24 @@ typedef struct DefragTracker_ {
 
     uint8_t remove; /**< remove */
 
+    uint8_t frags_inline_used; /**< Bitmask of the frags_inline in use. */
+
     Address src_addr; /**< Source address for this tracker. */
     Address dst_addr; /**< Destination address for this tracker. */
 
     int datalink;           /**< datalink for reassembled packet, set by first fragment */
     SCTime_t timeout;       /**< When this tracker will timeout. */
     uint32_t host_timeout;  /**< Host timeout, statically assigned from the yaml */
+    uint32_t shard_row;     /**< Hash row in the per thread shard, if used */
 
     /** use cnt, reference counter */
     SC_ATOMIC_DECLARE(unsigned int, use_cnt);
 
     struct IP_FRAGMENTS fragment_tree;
 
+    /** storage for the first fragments, see DEFRAG_FRAGS_INLINE */
+    Frag frags_inline[DEFRAG_FRAGS_INLINE];
+
     /** hash pointer, protected by hash row mutex/spin */
     struct DefragTracker_ *hnext;
 
@@ -531,7 +531,7 @@ static inline void PacketAlertFinalizeProcessQueue(
                     s->id, res, s->action);
             /* we will not copy this to the AlertQueue */
             p->alerts.suppressed++;
-        } else if (p->alerts.cnt < packet_alert_max) {
+        } else if (p->alerts.cnt < packet_alert_max && PacketAlertsAttach(&p->alerts)) {
             p->alerts.alerts[p->alerts.cnt] = *pa;
             SCLogDebug("Appending sid %" PRIu32 " alert to Packet::alerts at pos %u", s->id, i);
 
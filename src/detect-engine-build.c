@@ -28,6 +28,7 @@
 #include "detect-engine-mpm.h"
 #include "detect-engine-siggroup.h"
 #include "detect-engine-port.h"
+#include "detect-engine-sampling.h"
 #include "detect-engine-prefilter.h"
 #include "detect-engine-proto.h"
 #include "detect-engine-threshold.h"
@@ -2242,6 +2243,7 @@ int SigGroupBuild(DetectEngineCtx *de_ctx)
 #ifdef PROFILE_RULES
     SCProfilingRuleInitCounters(de_ctx);
 #endif
+    RuleSamplingInitCtx(de_ctx);
 
     if (!DetectEngineMultiTenantEnabled()) {
         VarNameStoreActivate();
@@ -1619,6 +1619,9 @@ static void MpmStoreSetup(const DetectEngineCtx *de_ctx, MpmStore *ms)
 
     if (de_ctx->mpm_cfg && de_ctx->mpm_cfg->cache_dir_path)
         ms->mpm_ctx->flags |= MPMCTX_FLAGS_CACHE_TO_DISK;
+    if (de_ctx->stream_mpm_streaming &&
+            (ms->buffer == MPMB_TCP_STREAM_TS || ms->buffer == MPMB_TCP_STREAM_TC))
+        ms->mpm_ctx->flags |= MPMCTX_FLAGS_STREAMING;
 
     const bool mpm_supports_endswith =
             (mpm_table[de_ctx->mpm_matcher].feature_flags & MPM_FEATURE_FLAG_ENDSWITH) != 0;
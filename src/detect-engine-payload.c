@@ -71,6 +71,30 @@ static int StreamMpmFunc(
     return 0;
 }
 
+struct StreamMpmStreamingData {
+    DetectEngineThreadCtx *det_ctx;
+    const MpmCtx *mpm_ctx;
+    TcpStream *stream;
+};
+
+/** \internal
+ *  \brief raw stream callback for the streaming mode MPM: data that was
+ *         scanned on a previous packet is skipped and matches can span the
+ *         boundaries of the chunks. */
+static int StreamMpmStreamingFunc(
+        void *cb_data, const uint8_t *data, const uint32_t data_len, const uint64_t offset)
+{
+    struct StreamMpmStreamingData *smd = cb_data;
+#ifdef DEBUG
+    smd->det_ctx->stream_mpm_cnt++;
+    smd->det_ctx->stream_mpm_size += data_len;
+#endif
+    (void)MpmStreamSearch(smd->mpm_ctx, &smd->det_ctx->mtc, &smd->stream->mpm_stream,
+            &smd->det_ctx->pmq, data, data_len, offset);
+    PREFILTER_PROFILING_ADD_BYTES(smd->det_ctx, data_len);
+    return 0;
+}
+
 static void PrefilterPktStream(DetectEngineThreadCtx *det_ctx,
         Packet *p, const void *pectx)
 {
@@ -82,11 +106,20 @@ static void PrefilterPktStream(DetectEngineThreadCtx *det_ctx,
     if (p->flags & PKT_DETECT_HAS_STREAMDATA) {
         SCLogDebug("PRE det_ctx->raw_stream_progress %"PRIu64,
                 det_ctx->raw_stream_progress);
-        struct StreamMpmData stream_mpm_data = { det_ctx, mpm_ctx };
-        StreamReassembleRaw(p->flow->protoctx, p,
-                StreamMpmFunc, &stream_mpm_data,
-                &det_ctx->raw_stream_progress,
-                false /* mpm doesn't use min inspect depth */);
+        if (mpm_ctx->flags & MPMCTX_FLAGS_STREAMING) {
+            TcpSession *ssn = p->flow->protoctx;
+            struct StreamMpmStreamingData stream_mpm_data = { det_ctx, mpm_ctx,
+                PKT_IS_TOSERVER(p) ? &ssn->client : &ssn->server };
+            StreamReassembleRaw(ssn, p, StreamMpmStreamingFunc, &stream_mpm_data,
+                    &det_ctx->raw_stream_progress,
+                    false /* mpm doesn't use min inspect depth */);
+        } else {
+            struct StreamMpmData stream_mpm_data = { det_ctx, mpm_ctx };
+            StreamReassembleRaw(p->flow->protoctx, p,
+                    StreamMpmFunc, &stream_mpm_data,
+                    &det_ctx->raw_stream_progress,
+                    false /* mpm doesn't use min inspect depth */);
+        }
         SCLogDebug("POST det_ctx->raw_stream_progress %"PRIu64,
                 det_ctx->raw_stream_progress);
 
@@ -0,0 +1,359 @@
+/* Copyright (C) 2025 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Sample based rule profiling, available in regular builds.
+ *
+ * Unlike the rule profiling of --enable-profiling-rules builds, which
+ * times every rule evaluation, only the rules of every Nth packet of a
+ * thread are timed here. The tick counts are kept in a per thread array
+ * indexed by Signature::iid that only the owning thread writes. Once per
+ * second (packet time) the thread adds its counts to the per engine
+ * counters using atomic adds, so there is no lock on the packet path.
+ *
+ * The most expensive rules can be retrieved through the unix socket
+ * command 'ruleset-sample-profile' or added to the eve stats records.
+ */
+
+#include "suricata-common.h"
+#include "conf.h"
+#include "detect.h"
+#include "detect-engine-sampling.h"
+#include "util-atomic.h"
+#include "util-time.h"
+#include "util-unittest.h"
+
+#define RULE_SAMPLING_DEFAULT_RATE  1024
+#define RULE_SAMPLING_DEFAULT_LIMIT 20
+
+typedef struct RuleSampleCounter_ {
+    SC_ATOMIC_DECLARE(uint64_t, ticks);
+    SC_ATOMIC_DECLARE(uint64_t, max);
+    SC_ATOMIC_DECLARE(uint64_t, checks);
+    SC_ATOMIC_DECLARE(uint64_t, matches);
+} RuleSampleCounter;
+
+typedef struct RuleSampleCtx_ {
+    uint32_t rate;
+    uint32_t limit;
+    uint32_t size;
+    RuleSampleCounter *counters; /**< indexed by Signature::iid */
+} RuleSampleCtx;
+
+/**
+ *  \brief setup the per engine counters if detect.profiling.sampling
+ *         is enabled
+ */
+void RuleSamplingInitCtx(DetectEngineCtx *de_ctx)
+{
+    int enabled = 0;
+    if (SCConfGetBool("detect.profiling.sampling.enabled", &enabled) != 1 || !enabled)
+        return;
+    if (de_ctx->sig_array_len == 0)
+        return;
+
+    intmax_t rate = RULE_SAMPLING_DEFAULT_RATE;
+    if (SCConfGetInt("detect.profiling.sampling.sample-rate", &rate) == 1) {
+        if (rate < 1 || rate > (1 << 30)) {
+            SCLogWarning("detect.profiling.sampling.sample-rate %" PRIdMAX
+                         " out of range, using %u",
+                    rate, RULE_SAMPLING_DEFAULT_RATE);
+            rate = RULE_SAMPLING_DEFAULT_RATE;
+        }
+    }
+    /* round down to a power of 2 so a mask can select the packets */
+    uint32_t r = 1;
+    while ((intmax_t)r * 2 <= rate)
+        r *= 2;
+
+    intmax_t limit = RULE_SAMPLING_DEFAULT_LIMIT;
+    if (SCConfGetInt("detect.profiling.sampling.limit", &limit) == 1) {
+        if (limit < 1 || limit > UINT32_MAX) {
+            SCLogWarning("detect.profiling.sampling.limit %" PRIdMAX " out of range, using %u",
+                    limit, RULE_SAMPLING_DEFAULT_LIMIT);
+            limit = RULE_SAMPLING_DEFAULT_LIMIT;
+        }
+    }
+
+    RuleSampleCtx *ctx = SCCalloc(1, sizeof(*ctx));
+    if (ctx == NULL)
+        return;
+    ctx->counters = SCCalloc(de_ctx->sig_array_len, sizeof(RuleSampleCounter));
+    if (ctx->counters == NULL) {
+        SCFree(ctx);
+        return;
+    }
+    ctx->size = de_ctx->sig_array_len;
+    ctx->rate = r;
+    ctx->limit = (uint32_t)limit;
+    de_ctx->rule_sample_ctx = ctx;
+
+    SCLogConfig("rule sampling: timing the rules of every %uth packet per thread", r);
+}
+
+void RuleSamplingFreeCtx(DetectEngineCtx *de_ctx)
+{
+    RuleSampleCtx *ctx = de_ctx->rule_sample_ctx;
+    if (ctx != NULL) {
+        SCFree(ctx->counters);
+        SCFree(ctx);
+        de_ctx->rule_sample_ctx = NULL;
+    }
+}
+
+void RuleSamplingThreadInit(const DetectEngineCtx *de_ctx, DetectEngineThreadCtx *det_ctx)
+{
+    const RuleSampleCtx *ctx = de_ctx->rule_sample_ctx;
+    if (ctx == NULL)
+        return;
+
+    RuleSampleThreadCtx *rs = SCCalloc(1, sizeof(*rs));
+    if (rs == NULL)
+        return;
+    rs->entries = SCCalloc(ctx->size, sizeof(RuleSampleEntry));
+    if (rs->entries == NULL) {
+        SCFree(rs);
+        return;
+    }
+    rs->size = ctx->size;
+    rs->mask = ctx->rate - 1;
+    det_ctx->rule_sample = rs;
+}
+
+/**
+ *  \brief add the thread's counts to the engine counters and reset them
+ *
+ *  Only the owning thread calls this, so the per thread entries need no
+ *  protection. The engine counters are updated atomically.
+ */
+void RuleSamplingThreadMerge(DetectEngineThreadCtx *det_ctx)
+{
+    RuleSampleThreadCtx *rs = det_ctx->rule_sample;
+    if (rs == NULL || det_ctx->de_ctx == NULL || det_ctx->de_ctx->rule_sample_ctx == NULL)
+        return;
+    RuleSampleCtx *ctx = det_ctx->de_ctx->rule_sample_ctx;
+
+    const uint32_t size = MIN(rs->size, ctx->size);
+    for (uint32_t i = 0; i < size; i++) {
+        RuleSampleEntry *e = &rs->entries[i];
+        if (e->checks == 0)
+            continue;
+
+        RuleSampleCounter *c = &ctx->counters[i];
+        SC_ATOMIC_ADD(c->ticks, e->ticks);
+        SC_ATOMIC_ADD(c->checks, e->checks);
+        SC_ATOMIC_ADD(c->matches, e->matches);
+        uint64_t max = SC_ATOMIC_GET(c->max);
+        while (e->max > max) {
+            if (SC_ATOMIC_CAS(&c->max, max, e->max))
+                break;
+            max = SC_ATOMIC_GET(c->max);
+        }
+        memset(e, 0, sizeof(*e));
+    }
+}
+
+void RuleSamplingThreadFree(DetectEngineThreadCtx *det_ctx)
+{
+    RuleSampleThreadCtx *rs = det_ctx->rule_sample;
+    if (rs == NULL)
+        return;
+
+    RuleSamplingThreadMerge(det_ctx);
+    SCFree(rs->entries);
+    SCFree(rs);
+    det_ctx->rule_sample = NULL;
+}
+
+typedef struct RuleSampleSummary_ {
+    uint32_t iid;
+    uint64_t ticks;
+} RuleSampleSummary;
+
+static int RuleSampleSortByTicks(const void *a, const void *b)
+{
+    const RuleSampleSummary *s0 = a;
+    const RuleSampleSummary *s1 = b;
+    if (s1->ticks == s0->ticks)
+        return 0;
+    return s1->ticks > s0->ticks ? 1 : -1;
+}
+
+/**
+ *  \brief get the most expensive rules of the sampled packets
+ *
+ *  \retval js object with the sampling rate and the top rules by ticks,
+ *          NULL if sampling is disabled
+ */
+json_t *RuleSamplingToJSON(const DetectEngineCtx *de_ctx)
+{
+    const RuleSampleCtx *ctx = de_ctx->rule_sample_ctx;
+    if (ctx == NULL)
+        return NULL;
+
+    RuleSampleSummary *summary = SCCalloc(ctx->size, sizeof(RuleSampleSummary));
+    if (summary == NULL)
+        return NULL;
+
+    uint64_t total_ticks = 0;
+    for (uint32_t i = 0; i < ctx->size; i++) {
+        summary[i].iid = i;
+        summary[i].ticks = SC_ATOMIC_GET(ctx->counters[i].ticks);
+        total_ticks += summary[i].ticks;
+    }
+    qsort(summary, ctx->size, sizeof(RuleSampleSummary), RuleSampleSortByTicks);
+
+    json_t *js = json_object();
+    json_t *jsa = json_array();
+    if (js == NULL || jsa == NULL) {
+        json_decref(js);
+        json_decref(jsa);
+        SCFree(summary);
+        return NULL;
+    }
+    json_object_set_new(js, "sample_rate", json_integer(ctx->rate));
+    json_object_set_new(js, "ticks_total", json_integer(total_ticks));
+
+    for (uint32_t i = 0; i < MIN(ctx->size, ctx->limit); i++) {
+        /* sorted, so the rest wasn't evaluated on a sampled packet either */
+        if (summary[i].ticks == 0)
+            break;
+
+        const Signature *s = de_ctx->sig_array[summary[i].iid];
+        const RuleSampleCounter *c = &ctx->counters[summary[i].iid];
+        const uint64_t checks = SC_ATOMIC_GET(c->checks);
+
+        json_t *jsm = json_object();
+        if (jsm == NULL)
+            break;
+        json_object_set_new(jsm, "signature_id", json_integer(s->id));
+        json_object_set_new(jsm, "gid", json_integer(s->gid));
+        json_object_set_new(jsm, "rev", json_integer(s->rev));
+        json_object_set_new(jsm, "checks", json_integer(checks));
+        json_object_set_new(jsm, "matches", json_integer(SC_ATOMIC_GET(c->matches)));
+        json_object_set_new(jsm, "ticks_total", json_integer(summary[i].ticks));
+        json_object_set_new(jsm, "ticks_max", json_integer(SC_ATOMIC_GET(c->max)));
+        json_object_set_new(
+                jsm, "ticks_avg", json_integer(checks ? summary[i].ticks / checks : 0));
+        json_object_set_new(jsm, "percent",
+                json_integer((long double)summary[i].ticks / (long double)total_ticks * 100));
+        json_array_append_new(jsa, jsm);
+    }
+    json_object_set_new(js, "rules", jsa);
+
+    SCFree(summary);
+    return js;
+}
+
+#ifdef UNITTESTS
+#include "detect-engine.h"
+#include "detect-engine-build.h"
+#include "detect-parse.h"
+
+static int RuleSamplingTest01(void)
+{
+    SCConfCreateContextBackup();
+    SCConfInit();
+    FAIL_IF(SCConfSetFinal("detect.profiling.sampling.enabled", "yes") != 1);
+    FAIL_IF(SCConfSetFinal("detect.profiling.sampling.sample-rate", "3") != 1);
+
+    DetectEngineCtx *de_ctx = DetectEngineCtxInit();
+    FAIL_IF_NULL(de_ctx);
+    Signature *s1 = DetectEngineAppendSig(de_ctx, "alert ip any any -> any any (sid:1;)");
+    FAIL_IF_NULL(s1);
+    Signature *s2 = DetectEngineAppendSig(de_ctx, "alert ip any any -> any any (sid:2;)");
+    FAIL_IF_NULL(s2);
+    SigGroupBuild(de_ctx);
+
+    RuleSampleCtx *ctx = de_ctx->rule_sample_ctx;
+    FAIL_IF_NULL(ctx);
+    /* 3 rounds down to 2 */
+    FAIL_IF_NOT(ctx->rate == 2);
+
+    DetectEngineThreadCtx det_ctx;
+    memset(&det_ctx, 0, sizeof(det_ctx));
+    det_ctx.de_ctx = de_ctx;
+    RuleSamplingThreadInit(de_ctx, &det_ctx);
+    FAIL_IF_NULL(det_ctx.rule_sample);
+
+    /* every 2nd packet is sampled */
+    RuleSamplingPacketStart(&det_ctx);
+    FAIL_IF(det_ctx.rule_sample_active);
+    RuleSamplingPacketStart(&det_ctx);
+    FAIL_IF_NOT(det_ctx.rule_sample_active);
+
+    RuleSamplingUpdate(&det_ctx, s1, 10, false);
+    RuleSamplingUpdate(&det_ctx, s2, 100, true);
+    RuleSamplingUpdate(&det_ctx, s2, 50, false);
+    RuleSamplingThreadMerge(&det_ctx);
+    FAIL_IF_NOT(det_ctx.rule_sample->entries[s2->iid].checks == 0);
+
+    FAIL_IF_NOT(SC_ATOMIC_GET(ctx->counters[s2->iid].ticks) == 150);
+    FAIL_IF_NOT(SC_ATOMIC_GET(ctx->counters[s2->iid].max) == 100);
+    FAIL_IF_NOT(SC_ATOMIC_GET(ctx->counters[s2->iid].checks) == 2);
+    FAIL_IF_NOT(SC_ATOMIC_GET(ctx->counters[s2->iid].matches) == 1);
+
+    json_t *js = RuleSamplingToJSON(de_ctx);
+    FAIL_IF_NULL(js);
+    json_t *rules = json_object_get(js, "rules");
+    FAIL_IF_NOT(json_array_size(rules) == 2);
+    /* most expensive first */
+    FAIL_IF_NOT(json_integer_value(json_object_get(json_array_get(rules, 0), "signature_id")) ==
+                2);
+    json_decref(js);
+
+    RuleSamplingThreadFree(&det_ctx);
+    DetectEngineCtxFree(de_ctx);
+    SCConfDeInit();
+    SCConfRestoreContextBackup();
+    PASS;
+}
+
+/** \test an out of range limit falls back to the default */
+static int RuleSamplingTest02(void)
+{
+    SCConfCreateContextBackup();
+    SCConfInit();
+    FAIL_IF(SCConfSetFinal("detect.profiling.sampling.enabled", "yes") != 1);
+    FAIL_IF(SCConfSetFinal("detect.profiling.sampling.limit", "0") != 1);
+
+    DetectEngineCtx *de_ctx = DetectEngineCtxInit();
+    FAIL_IF_NULL(de_ctx);
+    FAIL_IF_NULL(DetectEngineAppendSig(de_ctx, "alert ip any any -> any any (sid:1;)"));
+    SigGroupBuild(de_ctx);
+
+    RuleSampleCtx *ctx = de_ctx->rule_sample_ctx;
+    FAIL_IF_NULL(ctx);
+    FAIL_IF_NOT(ctx->limit == RULE_SAMPLING_DEFAULT_LIMIT);
+    FAIL_IF_NOT(ctx->rate == RULE_SAMPLING_DEFAULT_RATE);
+
+    DetectEngineCtxFree(de_ctx);
+    SCConfDeInit();
+    SCConfRestoreContextBackup();
+    PASS;
+}
+#endif /* UNITTESTS */
+
+void RuleSamplingRegisterTests(void)
+{
+#ifdef UNITTESTS
+    UtRegisterTest("RuleSamplingTest01", RuleSamplingTest01);
+    UtRegisterTest("RuleSamplingTest02", RuleSamplingTest02);
+#endif /* UNITTESTS */
+}
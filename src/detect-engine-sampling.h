@@ -0,0 +1,101 @@
+/* Copyright (C) 2025 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Sample based rule profiling, available in regular builds.
+ */
+
+#ifndef SURICATA_DETECT_ENGINE_SAMPLING_H
+#define SURICATA_DETECT_ENGINE_SAMPLING_H
+
+#include "detect.h"
+#include "util-cpu.h"
+
+/** per thread, per rule cost of the sampled packets */
+typedef struct RuleSampleEntry_ {
+    uint64_t ticks;
+    uint64_t max;
+    uint32_t checks;
+    uint32_t matches;
+} RuleSampleEntry;
+
+typedef struct RuleSampleThreadCtx_ {
+    uint32_t pkts;      /**< packets seen, to select the samples */
+    uint32_t mask;      /**< sample-rate - 1 */
+    uint32_t last_sync; /**< packet time (secs) of the last merge */
+    uint32_t size;
+    RuleSampleEntry *entries; /**< indexed by Signature::iid */
+} RuleSampleThreadCtx;
+
+void RuleSamplingInitCtx(DetectEngineCtx *de_ctx);
+void RuleSamplingFreeCtx(DetectEngineCtx *de_ctx);
+void RuleSamplingThreadInit(const DetectEngineCtx *de_ctx, DetectEngineThreadCtx *det_ctx);
+void RuleSamplingThreadFree(DetectEngineThreadCtx *det_ctx);
+void RuleSamplingThreadMerge(DetectEngineThreadCtx *det_ctx);
+json_t *RuleSamplingToJSON(const DetectEngineCtx *de_ctx);
+void RuleSamplingRegisterTests(void);
+
+/** \brief decide if the rules for this packet are to be timed */
+static inline void RuleSamplingPacketStart(DetectEngineThreadCtx *det_ctx)
+{
+    RuleSampleThreadCtx *rs = det_ctx->rule_sample;
+    if (rs != NULL) {
+        det_ctx->rule_sample_active = (++rs->pkts & rs->mask) == 0;
+    }
+}
+
+/** \brief done with the packet, merge into the engine once per second */
+static inline void RuleSamplingPacketEnd(DetectEngineThreadCtx *det_ctx, const Packet *p)
+{
+    RuleSampleThreadCtx *rs = det_ctx->rule_sample;
+    if (rs != NULL) {
+        det_ctx->rule_sample_active = false;
+        if ((uint32_t)SCTIME_SECS(p->ts) != rs->last_sync) {
+            RuleSamplingThreadMerge(det_ctx);
+            rs->last_sync = (uint32_t)SCTIME_SECS(p->ts);
+        }
+    }
+}
+
+static inline void RuleSamplingUpdate(
+        DetectEngineThreadCtx *det_ctx, const Signature *s, const uint64_t ticks, const bool match)
+{
+    RuleSampleThreadCtx *rs = det_ctx->rule_sample;
+    if (likely(s->iid < rs->size)) {
+        RuleSampleEntry *e = &rs->entries[s->iid];
+        e->ticks += ticks;
+        e->checks++;
+        e->matches += match;
+        if (ticks > e->max)
+            e->max = ticks;
+    }
+}
+
+#define RULE_SAMPLING_START(det_ctx)                                                               \
+    uint64_t rule_sample_start_ = 0;                                                               \
+    if (unlikely((det_ctx)->rule_sample_active)) {                                                 \
+        rule_sample_start_ = UtilCpuGetTicksFast();                                                \
+    }
+
+#define RULE_SAMPLING_END(det_ctx, s, m)                                                           \
+    if (unlikely(rule_sample_start_ != 0)) {                                                       \
+        RuleSamplingUpdate((det_ctx), (s), UtilCpuGetTicksFast() - rule_sample_start_, (m));       \
+    }
+
+#endif /* SURICATA_DETECT_ENGINE_SAMPLING_H */
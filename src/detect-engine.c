@@ -28,6 +28,7 @@
 #include "flow-private.h"
 #include "flow-util.h"
 #include "flow-worker.h"
+#include "stream-tcp.h"
 #include "conf.h"
 #include "conf-yaml-loader.h"
 #include "datasets.h"
@@ -65,6 +66,7 @@
 #include "detect-engine-loader.h"
 
 #include "detect-engine-alert.h"
+#include "detect-engine-sampling.h"
 
 #include "util-classification-config.h"
 #include "util-reference-config.h"
@@ -2536,6 +2538,24 @@ static DetectEngineCtx *DetectEngineCtxInitReal(
                 de_ctx->mpm_cfg, DetectEngineMpmCachingGetPath());
     }
 
+    const char *stream_mpm = NULL;
+    if (SCConfGet("detect.stream-mpm", &stream_mpm) == 1 && stream_mpm != NULL) {
+        if (strcmp(stream_mpm, "streaming") == 0) {
+            if (!(mpm_table[de_ctx->mpm_matcher].feature_flags & MPM_FEATURE_FLAG_STREAMING)) {
+                SCLogWarning("detect.stream-mpm: MPM %s has no streaming mode, using block mode",
+                        mpm_table[de_ctx->mpm_matcher].name);
+            } else if (StreamTcpInlineMode()) {
+                SCLogWarning("detect.stream-mpm: streaming mode not supported with inline "
+                             "stream engine, using block mode");
+            } else {
+                de_ctx->stream_mpm_streaming = true;
+                SCLogConfig("stream MPM: streaming mode");
+            }
+        } else if (strcmp(stream_mpm, "block") != 0) {
+            SCLogWarning("invalid value for detect.stream-mpm: %s, using block mode", stream_mpm);
+        }
+    }
+
     de_ctx->spm_global_thread_ctx = SpmInitGlobalThreadCtx(de_ctx->spm_matcher);
     if (de_ctx->spm_global_thread_ctx == NULL) {
         SCLogDebug("Unable to alloc SpmGlobalThreadCtx.");
@@ -2651,6 +2671,7 @@ void DetectEngineCtxFree(DetectEngineCtx *de_ctx)
         de_ctx->profile_ctx = NULL;
     }
 #endif
+    RuleSamplingFreeCtx(de_ctx);
 #ifdef PROFILING
     if (de_ctx->profile_keyword_ctx != NULL) {
         SCProfilingKeywordDestroyCtx(de_ctx);//->profile_keyword_ctx);
@@ -3339,6 +3360,7 @@ static TmEcode ThreadCtxDoInit (DetectEngineCtx *de_ctx, DetectEngineThreadCtx *
 #ifdef PROFILE_RULES
     SCProfilingRuleThreadSetup(de_ctx->profile_ctx, det_ctx);
 #endif
+    RuleSamplingThreadInit(de_ctx, det_ctx);
 #ifdef PROFILING
     SCProfilingKeywordThreadSetup(de_ctx->profile_keyword_ctx, det_ctx);
     SCProfilingPrefilterThreadSetup(de_ctx->profile_prefilter_ctx, det_ctx);
@@ -3517,6 +3539,7 @@ static void DetectEngineThreadCtxFree(DetectEngineThreadCtx *det_ctx)
 #ifdef PROFILE_RULES
     SCProfilingRuleThreadCleanup(det_ctx);
 #endif
+    RuleSamplingThreadFree(det_ctx);
 #ifdef PROFILING
     SCProfilingKeywordThreadCleanup(det_ctx);
     SCProfilingPrefilterThreadCleanup(det_ctx);
@@ -3881,6 +3904,51 @@ bool DetectEngineMultiTenantEnabled(void)
     return enabled;
 }
 
+/** \brief get the rule sampling profile of the current detection engine
+ *         or, in multi-tenant mode, of each tenant
+ *
+ *  \retval js profile, in multi-tenant mode an object with a profile per
+ *          tenant id, NULL if no engine samples rules */
+json_t *DetectEngineRuleSamplingToJSON(void)
+{
+    DetectEngineMasterCtx *master = &g_master_de_ctx;
+    SCMutexLock(&master->lock);
+
+    if (!DetectEngineMultiTenantEnabledWithLock()) {
+        SCMutexUnlock(&master->lock);
+
+        DetectEngineCtx *de_ctx = DetectEngineGetCurrent();
+        if (de_ctx == NULL)
+            return NULL;
+        json_t *js = RuleSamplingToJSON(de_ctx);
+        DetectEngineDeReference(&de_ctx);
+        return js;
+    }
+
+    /* the tenants can't be freed while the master lock is held */
+    json_t *js = NULL;
+    for (DetectEngineCtx *de_ctx = master->list; de_ctx != NULL; de_ctx = de_ctx->next) {
+        if (de_ctx->type != DETECT_ENGINE_TYPE_TENANT)
+            continue;
+        json_t *js_tenant = RuleSamplingToJSON(de_ctx);
+        if (js_tenant == NULL)
+            continue;
+        if (js == NULL) {
+            js = json_object();
+            if (js == NULL) {
+                json_decref(js_tenant);
+                break;
+            }
+        }
+        char tenant_id[16];
+        snprintf(tenant_id, sizeof(tenant_id), "%u", de_ctx->tenant_id);
+        json_object_set_new(js, tenant_id, js_tenant);
+    }
+
+    SCMutexUnlock(&master->lock);
+    return js;
+}
+
 /** \internal
  *  \brief load a tenant from a yaml file
  *
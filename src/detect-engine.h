@@ -109,6 +109,7 @@ int DetectEngineReload(const SCInstance *suri);
 int DetectEngineEnabled(void);
 int DetectEngineMTApply(void);
 bool DetectEngineMultiTenantEnabled(void);
+json_t *DetectEngineRuleSamplingToJSON(void);
 int DetectEngineMultiTenantSetup(const bool unix_socket);
 
 int DetectEngineReloadStart(void);
@@ -40,6 +40,7 @@
 #include "detect-engine-build.h"
 #include "detect-engine-frame.h"
 #include "detect-engine-profile.h"
+#include "detect-engine-sampling.h"
 
 #include "detect-engine-alert.h"
 #include "detect-engine-siggroup.h"
@@ -62,6 +63,7 @@
 
 #include "util-validate.h"
 #include "util-detect.h"
+#include "util-cpu-ticks.h"
 #include "util-profiling.h"
 
 #include "action-globals.h"
@@ -684,11 +686,10 @@ static inline uint8_t DetectRulePacketRules(ThreadVars *const tv,
     }
     while (match_cnt--) {
         RULE_PROFILING_START(p);
+        RULE_SAMPLING_START(det_ctx);
         bool break_out_of_packet_filter = false;
         uint8_t alert_flags = 0;
-#ifdef PROFILE_RULES
         bool smatch = false; /* signature match */
-#endif
         const Signature *s = next_s;
         sflags = next_sflags;
         if (match_cnt) {
@@ -754,9 +755,7 @@ static inline uint8_t DetectRulePacketRules(ThreadVars *const tv,
             goto next;
         }
 
-#ifdef PROFILE_RULES
         smatch = true;
-#endif
         DetectRunPostMatch(tv, det_ctx, p, s);
 
         uint64_t txid = PACKET_ALERT_NOTX;
@@ -886,6 +885,7 @@ next:
         DetectVarProcessList(det_ctx, pflow, p);
         DetectReplaceFree(det_ctx);
         RULE_PROFILING_END(det_ctx, s, smatch, p);
+        RULE_SAMPLING_END(det_ctx, s, smatch);
 
         /* fw accept:packet or accept:flow means we're done here */
         if (break_out_of_packet_filter)
@@ -1963,6 +1963,7 @@ static void DetectRunTx(ThreadVars *tv,
 
             /* call individual rule inspection */
             RULE_PROFILING_START(p);
+            RULE_SAMPLING_START(det_ctx);
             const int r = DetectRunTxInspectRule(tv, de_ctx, det_ctx, p, f, flow_flags,
                     alstate, &tx, s, inspect_flags, can, scratch);
             if (r == 1) {
@@ -2006,6 +2007,7 @@ static void DetectRunTx(ThreadVars *tv,
             }
             DetectVarProcessList(det_ctx, p->flow, p);
             RULE_PROFILING_END(det_ctx, s, r, p);
+            RULE_SAMPLING_END(det_ctx, s, r == 1);
 
             if (det_ctx->post_rule_work_queue.len > 0) {
                 SCLogDebug("%p/%" PRIu64 " post_rule_work_queue len %u", tx.tx_ptr, tx.tx_id,
@@ -2200,6 +2202,7 @@ static void DetectRunFrames(ThreadVars *tv, DetectEngineCtx *de_ctx, DetectEngin
 
             /* call individual rule inspection */
             RULE_PROFILING_START(p);
+            RULE_SAMPLING_START(det_ctx);
             bool r = DetectRunInspectRuleHeader(p, f, s, s->flags, s->proto.flags);
             if (r) {
                 r = DetectRunFrameInspectRule(tv, det_ctx, s, f, p, frames, frame);
@@ -2219,6 +2222,7 @@ static void DetectRunFrames(ThreadVars *tv, DetectEngineCtx *de_ctx, DetectEngin
             }
             DetectVarProcessList(det_ctx, p->flow, p);
             RULE_PROFILING_END(det_ctx, s, r, p);
+            RULE_SAMPLING_END(det_ctx, s, r);
         }
 
         /* update Frame::inspect_progress here instead of in the code above. The reason is that a
@@ -2379,11 +2383,15 @@ TmEcode Detect(ThreadVars *tv, Packet *p, void *data)
         de_ctx = det_ctx->de_ctx;
     }
 
+    const int ticks_prev = CpuTicksEnter(CPU_TICKS_DETECT);
+    RuleSamplingPacketStart(det_ctx);
     if (p->flow) {
         DetectFlow(tv, de_ctx, det_ctx, p);
     } else {
         DetectNoFlow(tv, de_ctx, det_ctx, p);
     }
+    RuleSamplingPacketEnd(det_ctx, p);
+    CpuTicksLeave(ticks_prev);
 
 #ifdef PROFILE_RULES
     /* aggregate statistics */
@@ -935,6 +935,8 @@ typedef struct DetectEngineCtx_ {
     uint8_t mpm_matcher; /**< mpm matcher this ctx uses */
     MpmConfig *mpm_cfg;
     uint8_t spm_matcher; /**< spm matcher this ctx uses */
+    /** raw stream mpm uses the matcher's streaming mode (detect.stream-mpm) */
+    bool stream_mpm_streaming;
 
     uint32_t tenant_id;
 
@@ -1041,6 +1043,8 @@ typedef struct DetectEngineCtx_ {
 #ifdef PROFILE_RULES
     struct SCProfileDetectCtx_ *profile_ctx;
 #endif
+    /** sampled rule profiling, NULL if disabled */
+    struct RuleSampleCtx_ *rule_sample_ctx;
 #ifdef PROFILING
     struct SCProfileKeywordDetectCtx_ *profile_keyword_ctx;
     struct SCProfilePrefilterDetectCtx_ *profile_prefilter_ctx;
@@ -1398,6 +1402,10 @@ typedef struct DetectEngineThreadCtx_ {
     int rule_perf_data_size;
     uint32_t rule_perf_last_sync;
 #endif
+    /** sampled rule profiling, NULL if disabled */
+    struct RuleSampleThreadCtx_ *rule_sample;
+    /** rules of the current packet are being timed */
+    bool rule_sample_active;
 #ifdef PROFILING
     struct SCProfileKeywordData_ *keyword_perf_data;
     struct SCProfileKeywordData_ **keyword_perf_data_per_list;
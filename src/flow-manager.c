@@ -121,6 +121,9 @@ typedef struct FlowTimeoutCounters_ {
     uint32_t bypassed_count;
     uint64_t bypassed_pkts;
     uint64_t bypassed_bytes;
+
+    uint32_t tcp_compacted;
+    uint64_t tcp_compacted_bytes;
 } FlowTimeoutCounters;
 
 /**
@@ -220,6 +223,41 @@ static bool FlowManagerFlowTimeout(Flow *f, SCTime_t ts, uint32_t *next_ts, cons
     return true;
 }
 
+/** \internal
+ *  \brief release the buffers of idle TCP sessions
+ *
+ *  Sessions that saw no packets for stream.idle-compact-timeout seconds are
+ *  compacted, see StreamTcpSessionCompact. Uses the same time source as
+ *  FlowManagerFlowTimeout. If the flow is not idle long enough yet next_ts
+ *  is updated, so the row is revisited in time.
+ *
+ *  \param f locked flow that didn't time out
+ */
+static void FlowManagerFlowCompact(
+        Flow *f, SCTime_t ts, uint32_t *next_ts, FlowTimeoutCounters *counters)
+{
+    if (stream_config.idle_compact_timeout == 0 || f->proto != IPPROTO_TCP ||
+            f->protoctx == NULL || f->flow_state != FLOW_STATE_ESTABLISHED)
+        return;
+
+    const SCTime_t compact_at = SCTIME_ADD_SECS(f->lastts, stream_config.idle_compact_timeout);
+    SCTime_t checkts = ts;
+    if (!TimeModeIsLive() && f->thread_id[0] != 0) {
+        checkts = TmThreadsGetThreadTime(f->thread_id[0]);
+    }
+    if (SCTIME_CMP_LT(checkts, compact_at)) {
+        if (*next_ts == 0 || (uint32_t)SCTIME_SECS(compact_at) < *next_ts)
+            *next_ts = (uint32_t)SCTIME_SECS(compact_at);
+        return;
+    }
+
+    const uint32_t size = StreamTcpSessionCompact(f->protoctx);
+    if (size > 0) {
+        counters->tcp_compacted++;
+        counters->tcp_compacted_bytes += size;
+    }
+}
+
 #ifdef CAPTURE_OFFLOAD
 /** \internal
  *  \brief check timeout of captured bypassed flow by querying capture method
@@ -357,6 +395,7 @@ static void FlowManagerHashRowTimeout(FlowManagerTimeoutThread *td, Flow *f, SCT
 
         /* timeout logic goes here */
         if (!FlowManagerFlowTimeout(f, ts, next_ts, emergency)) {
+            FlowManagerFlowCompact(f, ts, next_ts, counters);
             FLOWLOCK_UNLOCK(f);
             counters->flows_notimeout++;
 
@@ -660,6 +699,9 @@ typedef struct FlowCounters_ {
     uint16_t flow_bypassed_pkts;
     uint16_t flow_bypassed_bytes;
 
+    uint16_t flow_mgr_tcp_compacted;
+    uint16_t flow_mgr_tcp_compacted_bytes;
+
     uint16_t memcap_pressure;
     uint16_t memcap_pressure_max;
 } FlowCounters;
@@ -696,6 +738,9 @@ static void FlowCountersInit(ThreadVars *t, FlowCounters *fc)
     fc->flow_bypassed_pkts = StatsRegisterCounter("flow_bypassed.pkts", t);
     fc->flow_bypassed_bytes = StatsRegisterCounter("flow_bypassed.bytes", t);
 
+    fc->flow_mgr_tcp_compacted = StatsRegisterCounter("flow.mgr.tcp_compacted", t);
+    fc->flow_mgr_tcp_compacted_bytes = StatsRegisterCounter("flow.mgr.tcp_compacted_bytes", t);
+
     fc->memcap_pressure = StatsRegisterCounter("memcap.pressure", t);
     fc->memcap_pressure_max = StatsRegisterMaxCounter("memcap.pressure_max", t);
 }
@@ -715,6 +760,9 @@ static void FlowCountersUpdate(
     StatsAddUI64(th_v, ftd->cnt.flow_bypassed_pkts, (uint64_t)counters->bypassed_pkts);
     StatsAddUI64(th_v, ftd->cnt.flow_bypassed_bytes, (uint64_t)counters->bypassed_bytes);
 
+    StatsAddUI64(th_v, ftd->cnt.flow_mgr_tcp_compacted, (uint64_t)counters->tcp_compacted);
+    StatsAddUI64(th_v, ftd->cnt.flow_mgr_tcp_compacted_bytes, counters->tcp_compacted_bytes);
+
     StatsSetUI64(th_v, ftd->cnt.flow_mgr_rows_maxlen, (uint64_t)counters->rows_maxlen);
 }
 
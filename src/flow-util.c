@@ -37,6 +37,7 @@
 #include "util-debug.h"
 #include "util-macset.h"
 #include "util-flow-rate.h"
+#include "util-flow-cost.h"
 #include "flow-storage.h"
 
 #include "detect.h"
@@ -212,6 +213,12 @@ void FlowInit(ThreadVars *tv, Flow *f, const Packet *p)
         FlowSetStorageById(f, FlowRateGetStorageID(), frs);
     }
 
+    if (FlowCostStorageEnabled()) {
+        DEBUG_VALIDATE_BUG_ON(FlowGetStorageById(f, FlowCostGetStorageID()) != NULL);
+        FlowCost *fc = FlowCostInit();
+        FlowSetStorageById(f, FlowCostGetStorageID(), fc);
+    }
+
     SCFlowRunInitCallbacks(tv, f, p);
 
     SCReturn;
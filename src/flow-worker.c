@@ -46,6 +46,9 @@
 #include "app-layer-frames.h"
 
 #include "util-profiling.h"
+#include "util-latency.h"
+#include "util-cpu-ticks.h"
+#include "util-flow-cost.h"
 #include "util-validate.h"
 #include "util-time.h"
 #include "tmqh-packetpool.h"
@@ -375,7 +378,9 @@ static inline void FlowWorkerStreamTCPUpdate(ThreadVars *tv, FlowWorkerThreadDat
     }
 
     FLOWWORKER_PROFILING_START(p, PROFILE_FLOWWORKER_STREAM);
+    const int ticks_prev = CpuTicksEnter(CPU_TICKS_STREAM);
     StreamTcp(tv, p, fw->stream_thread, &fw->pq);
+    CpuTicksLeave(ticks_prev);
     FLOWWORKER_PROFILING_END(p, PROFILE_FLOWWORKER_STREAM);
 
     // this is the first packet that sets no payload inspection
@@ -409,8 +414,8 @@ static inline void FlowWorkerStreamTCPUpdate(ThreadVars *tv, FlowWorkerThreadDat
         FramesPrune(x->flow, x);
         /*  Release tcp segments. Done here after alerting can use them. */
         FLOWWORKER_PROFILING_START(x, PROFILE_FLOWWORKER_TCPPRUNE);
-        StreamTcpPruneSession(
-                x->flow, x->flowflags & FLOW_PKT_TOSERVER ? STREAM_TOSERVER : STREAM_TOCLIENT);
+        StreamTcpReassemblePruneSession(tv, fw->stream_thread->ra_ctx, x->flow,
+                x->flowflags & FLOW_PKT_TOSERVER ? STREAM_TOSERVER : STREAM_TOCLIENT);
         FLOWWORKER_PROFILING_END(x, PROFILE_FLOWWORKER_TCPPRUNE);
 
         /* no need to keep a flow ref beyond this point */
@@ -440,6 +445,8 @@ static void FlowWorkerFlowTimeout(
     DEBUG_VALIDATE_BUG_ON(!(p->flow && PacketIsTCP(p)));
     DEBUG_ASSERT_FLOW_LOCKED(p->flow);
 
+    FlowCost *cost_prev = FlowCostEnter(p->flow);
+
     /* handle TCP and app layer */
     FlowWorkerStreamTCPUpdate(tv, fw, p, det_ctx, true);
 
@@ -460,13 +467,14 @@ static void FlowWorkerFlowTimeout(
 
     /*  Release tcp segments. Done here after alerting can use them. */
     FLOWWORKER_PROFILING_START(p, PROFILE_FLOWWORKER_TCPPRUNE);
-    StreamTcpPruneSession(p->flow, p->flowflags & FLOW_PKT_TOSERVER ?
-            STREAM_TOSERVER : STREAM_TOCLIENT);
+    StreamTcpReassemblePruneSession(tv, fw->stream_thread->ra_ctx, p->flow,
+            p->flowflags & FLOW_PKT_TOSERVER ? STREAM_TOSERVER : STREAM_TOCLIENT);
     FLOWWORKER_PROFILING_END(p, PROFILE_FLOWWORKER_TCPPRUNE);
 
     /* run tx cleanup last */
     AppLayerParserTransactionsCleanup(p->flow, STREAM_FLAGS_FOR_PACKET(p));
 
+    FlowCostLeave(cost_prev);
     FlowDeReference(&p->flow);
     /* flow is unlocked later in FlowFinish() */
 }
@@ -573,6 +581,10 @@ static TmEcode FlowWorker(ThreadVars *tv, Packet *p, void *data)
         return TM_ECODE_OK;
     }
 
+    /* anything not claimed by stream, detect or output is flow handling */
+    const int ticks_prev = CpuTicksEnter(CPU_TICKS_FLOW);
+    FlowCost *cost_prev = NULL;
+
     /* handle Flow */
     if (det_ctx != NULL && det_ctx->de_ctx->PreFlowHook != NULL) {
         const uint8_t action = det_ctx->de_ctx->PreFlowHook(tv, det_ctx, p);
@@ -616,6 +628,9 @@ static TmEcode FlowWorker(ThreadVars *tv, Packet *p, void *data)
 
     /* handle TCP and app layer */
     if (p->flow) {
+        /* charge the work on the flow until it's unlocked */
+        cost_prev = FlowCostEnter(p->flow);
+
         SCLogDebug("packet %" PRIu64
                    ": direction %s FLOW_TS_APP_UPDATE_NEXT %s FLOW_TC_APP_UPDATE_NEXT %s",
                 p->pcap_cnt, PKT_IS_TOSERVER(p) ? "toserver" : "toclient",
@@ -651,6 +666,8 @@ static TmEcode FlowWorker(ThreadVars *tv, Packet *p, void *data)
             /* handle the app layer part of the UDP packet payload */
         } else if (p->proto == IPPROTO_UDP && !PacketCheckAction(p, ACTION_DROP)) {
             FLOWWORKER_PROFILING_START(p, PROFILE_FLOWWORKER_APPLAYERUDP);
+            /* protocol detection stays in the flow stage, the parsers
+             * charge their own app-layer stage */
             AppLayerHandleUdp(tv, fw->stream_thread->ra_ctx->app_tctx, p, p->flow);
             FLOWWORKER_PROFILING_END(p, PROFILE_FLOWWORKER_APPLAYERUDP);
             PacketAppUpdate2FlowFlags(p);
@@ -658,6 +675,7 @@ static TmEcode FlowWorker(ThreadVars *tv, Packet *p, void *data)
     }
 
     PacketUpdateEngineEventCounters(tv, fw->dtv, p);
+    PACKET_LATENCY_STAMP(p, PKT_LATENCY_FLOW);
 
     /* handle Detect */
     DEBUG_ASSERT_FLOW_LOCKED(p->flow);
@@ -667,10 +685,12 @@ static TmEcode FlowWorker(ThreadVars *tv, Packet *p, void *data)
         Detect(tv, p, det_ctx);
         FLOWWORKER_PROFILING_END(p, PROFILE_FLOWWORKER_DETECT);
     }
+    PACKET_LATENCY_STAMP(p, PKT_LATENCY_DETECT);
 
 pre_flow_drop:
     // Outputs.
     OutputLoggerLog(tv, p, fw->output_thread);
+    PACKET_LATENCY_STAMP(p, PKT_LATENCY_OUTPUT);
 
     /*  Release tcp segments. Done here after alerting can use them. */
     if (p->flow != NULL) {
@@ -688,8 +708,8 @@ pre_flow_drop:
                 FramesPrune(p->flow, p);
             }
             FLOWWORKER_PROFILING_START(p, PROFILE_FLOWWORKER_TCPPRUNE);
-            StreamTcpPruneSession(p->flow, p->flowflags & FLOW_PKT_TOSERVER ?
-                    STREAM_TOSERVER : STREAM_TOCLIENT);
+            StreamTcpReassemblePruneSession(tv, fw->stream_thread->ra_ctx, p->flow,
+                    p->flowflags & FLOW_PKT_TOSERVER ? STREAM_TOSERVER : STREAM_TOCLIENT);
             FLOWWORKER_PROFILING_END(p, PROFILE_FLOWWORKER_TCPPRUNE);
         } else if (p->proto == IPPROTO_UDP) {
             FramesPrune(p->flow, p);
@@ -721,6 +741,7 @@ pre_flow_drop:
             p->flow->flags &= ~(FLOW_TS_APP_UPDATED | FLOW_TC_APP_UPDATED);
         }
 
+        FlowCostLeave(cost_prev);
         Flow *f = p->flow;
         FlowDeReference(&p->flow);
         FLOWLOCK_UNLOCK(f);
@@ -734,6 +755,7 @@ housekeeping:
     /* process local work queue */
     FlowWorkerProcessLocalFlows(tv, fw, p);
 
+    CpuTicksLeave(ticks_prev);
     return TM_ECODE_OK;
 }
 
@@ -54,6 +54,7 @@
 #include "util-misc.h"
 #include "util-macset.h"
 #include "util-flow-rate.h"
+#include "util-flow-cost.h"
 
 #include "util-debug.h"
 
@@ -484,6 +485,16 @@ void FlowHandlePacketUpdate(Flow *f, Packet *p, ThreadVars *tv, DecodeThreadVars
     }
     if (f->thread_id[pkt_dir] == 0) {
         f->thread_id[pkt_dir] = (FlowThreadId)tv->id;
+    } else if ((p->flags & PKT_AUTOFP_BALANCED) && f->thread_id[pkt_dir] != (FlowThreadId)tv->id) {
+        /* the 'balanced' autofp scheduler moved the flow to this thread. It
+         * only does so while none of the flow's packets are in flight, and
+         * both directions move together: take over the flow so it's not seen
+         * as on the wrong thread and its timeout handling comes to us. */
+        SCLogDebug("flow %p moved from thread %u to %d", f, f->thread_id[pkt_dir], tv->id);
+        for (int i = 0; i < 2; i++) {
+            if (f->thread_id[i] != 0)
+                f->thread_id[i] = (FlowThreadId)tv->id;
+        }
     }
 
     if (f->flow_state == FLOW_STATE_ESTABLISHED) {
@@ -1106,6 +1117,10 @@ int FlowClearMemory(Flow* f, uint8_t proto_map)
         flow_freefuncs[proto_map].Freefunc(f->protoctx);
     }
 
+    if (g_flow_cost_enabled) {
+        FlowCostFlowEnd(f);
+    }
+
     FlowFreeStorage(f);
 
     FLOW_RECYCLE(f);
@@ -503,6 +503,32 @@ end:
     return ret;
 }
 
+/** \test a host found without the row lock is locked and referenced */
+static int HostBitTest12 (void)
+{
+    HostInitConfig(true);
+
+    Address a = { .family = AF_INET, .addr_data32 = { 0x01020304, 0, 0, 0 } };
+    Address b = { .family = AF_INET, .addr_data32 = { 0x04030201, 0, 0, 0 } };
+
+    Host *h = HostGetHostFromHash(&a);
+    FAIL_IF_NULL(h);
+    HostBitAdd(h, 0, SCTIME_FROM_SECS(90));
+    HostRelease(h);
+
+    Host *lh = HostLookupHostFromHash(&a);
+    FAIL_IF(lh != h);
+    FAIL_IF(SC_ATOMIC_GET(lh->use_cnt) != 1);
+    FAIL_IF(SCMutexTrylock(&lh->m) == 0);
+    FAIL_IF_NULL(HostBitGet(lh, 0));
+    HostRelease(lh);
+
+    FAIL_IF_NOT_NULL(HostLookupHostFromHash(&b));
+
+    HostShutdown();
+    PASS;
+}
+
 #endif /* UNITTESTS */
 
 void HostBitRegisterTests(void)
@@ -519,5 +545,6 @@ void HostBitRegisterTests(void)
     UtRegisterTest("HostBitTest09", HostBitTest09);
     UtRegisterTest("HostBitTest10", HostBitTest10);
     UtRegisterTest("HostBitTest11", HostBitTest11);
+    UtRegisterTest("HostBitTest12", HostBitTest12);
 #endif /* UNITTESTS */
 }
@@ -242,6 +242,7 @@ void HostInitConfig(bool quiet)
     uint32_t i = 0;
     for (i = 0; i < host_config.hash_size; i++) {
         HRLOCK_INIT(&host_hash[i]);
+        SC_ATOMIC_INIT(host_hash[i].version);
     }
     (void) SC_ATOMIC_ADD(host_memuse, (host_config.hash_size * sizeof(HostHashRow)));
 
@@ -308,9 +309,9 @@ void HostShutdown(void)
     /* clear and free the hash */
     if (host_hash != NULL) {
         for (u = 0; u < host_config.hash_size; u++) {
-            h = host_hash[u].head;
+            h = HR_GET_HEAD(&host_hash[u]);
             while (h) {
-                Host *n = h->hnext;
+                Host *n = HR_GET_HNEXT(h);
                 HostFree(h);
                 h = n;
             }
@@ -335,30 +336,32 @@ void HostCleanup(void)
         for (uint32_t u = 0; u < host_config.hash_size; u++) {
             HostHashRow *hb = &host_hash[u];
             HRLOCK_LOCK(hb);
-            Host *h = host_hash[u].head;
+            HRVERSION_BEGIN(hb);
+            Host *h = HR_GET_HEAD(&host_hash[u]);
             while (h) {
                 if ((SC_ATOMIC_GET(h->use_cnt) > 0) && (h->iprep != NULL)) {
                     /* iprep is attached to host only clear local storage */
                     HostFreeStorage(h);
-                    h = h->hnext;
+                    h = HR_GET_HNEXT(h);
                 } else {
-                    Host *n = h->hnext;
+                    Host *n = HR_GET_HNEXT(h);
                     /* remove from the hash */
                     if (h->hprev != NULL)
-                        h->hprev->hnext = h->hnext;
-                    if (h->hnext != NULL)
-                        h->hnext->hprev = h->hprev;
-                    if (hb->head == h)
-                        hb->head = h->hnext;
+                        HR_SET_HNEXT(h->hprev, HR_GET_HNEXT(h));
+                    if (HR_GET_HNEXT(h) != NULL)
+                        HR_GET_HNEXT(h)->hprev = h->hprev;
+                    if (HR_GET_HEAD(hb) == h)
+                        HR_SET_HEAD(hb, HR_GET_HNEXT(h));
                     if (hb->tail == h)
                         hb->tail = h->hprev;
-                    h->hnext = NULL;
+                    HR_SET_HNEXT(h, NULL);
                     h->hprev = NULL;
                     HostClearMemory(h);
                     HostMoveToSpare(h);
                     h = n;
                 }
             }
+            HRVERSION_END(hb);
             HRLOCK_UNLOCK(hb);
         }
     }
@@ -399,6 +402,54 @@ static inline int HostCompare(Host *h, Address *a)
     return 0;
 }
 
+/** max entries to walk in a row without its lock, before falling back
+ *  to a locked lookup */
+#define HOST_LOCKLESS_MAX_WALK 32
+
+/** \internal
+ *  \brief look up a host without taking the hash row lock
+ *
+ *  Hosts are never freed at runtime, only recycled through the spare queue,
+ *  so a row can be walked while it is being changed. A miss is only
+ *  trusted if the row version didn't change during the walk. A host that is
+ *  found is locked before checking the version again: hosts are only
+ *  removed from a row with their own lock held.
+ *
+ *  \retval true lookup done, *res is the *LOCKED* host, or NULL if it's not
+ *          in the hash
+ *  \retval false row changed, caller needs to do a locked lookup
+ */
+static bool HostLookupLockless(HostHashRow *hb, Address *a, Host **res)
+{
+    const uint32_t version = SC_ATOMIC_GET(hb->version);
+    if (version & 1)
+        return false;
+
+    Host *h = HR_GET_HEAD(hb);
+    for (int i = 0; h != NULL && HostCompare(h, a) == 0; i++) {
+        if (i == HOST_LOCKLESS_MAX_WALK)
+            return false;
+        h = HR_GET_HNEXT(h);
+    }
+    SC_ATOMIC_THREAD_FENCE(SC_ATOMIC_MEMORY_ORDER_ACQUIRE);
+
+    if (h == NULL) {
+        if (SC_ATOMIC_GET(hb->version) != version)
+            return false;
+        *res = NULL;
+        return true;
+    }
+
+    SCMutexLock(&h->m);
+    if (SC_ATOMIC_GET(hb->version) != version) {
+        SCMutexUnlock(&h->m);
+        return false;
+    }
+    (void)HostIncrUsecnt(h);
+    *res = h;
+    return true;
+}
+
 /**
  *  \brief Get a new host
  *
@@ -489,12 +540,17 @@ Host *HostGetHostFromHash (Address *a)
 
     /* get the key to our bucket */
     uint32_t key = HostGetKey(a);
-    /* get our hash bucket and lock it */
     HostHashRow *hb = &host_hash[key];
+
+    /* try without the row lock first */
+    if (HostLookupLockless(hb, a, &h) && h != NULL)
+        return h;
+
+    /* get our hash bucket and lock it */
     HRLOCK_LOCK(hb);
 
     /* see if the bucket already has a host */
-    if (hb->head == NULL) {
+    if (HR_GET_HEAD(hb) == NULL) {
         h = HostGetNew(a);
         if (h == NULL) {
             HRLOCK_UNLOCK(hb);
@@ -502,18 +558,20 @@ Host *HostGetHostFromHash (Address *a)
         }
 
         /* host is locked */
-        hb->head = h;
+        HRVERSION_BEGIN(hb);
+        HR_SET_HEAD(hb, h);
         hb->tail = h;
 
         /* got one, now lock, initialize and return */
         HostInit(h,a);
+        HRVERSION_END(hb);
 
         HRLOCK_UNLOCK(hb);
         return h;
     }
 
     /* ok, we have a host in the bucket. Let's find out if it is our host */
-    h = hb->head;
+    h = HR_GET_HEAD(hb);
 
     /* see if this is the host we are looking for */
     if (HostCompare(h, a) == 0) {
@@ -521,14 +579,16 @@ Host *HostGetHostFromHash (Address *a)
 
         while (h) {
             ph = h;
-            h = h->hnext;
+            h = HR_GET_HNEXT(h);
 
             if (h == NULL) {
-                h = ph->hnext = HostGetNew(a);
+                h = HostGetNew(a);
                 if (h == NULL) {
                     HRLOCK_UNLOCK(hb);
                     return NULL;
                 }
+                HRVERSION_BEGIN(hb);
+                HR_SET_HNEXT(ph, h);
                 hb->tail = h;
 
                 /* host is locked */
@@ -537,6 +597,7 @@ Host *HostGetHostFromHash (Address *a)
 
                 /* initialize and return */
                 HostInit(h,a);
+                HRVERSION_END(hb);
 
                 HRLOCK_UNLOCK(hb);
                 return h;
@@ -545,20 +606,22 @@ Host *HostGetHostFromHash (Address *a)
             if (HostCompare(h, a) != 0) {
                 /* we found our host, lets put it on top of the
                  * hash list -- this rewards active hosts */
-                if (h->hnext) {
-                    h->hnext->hprev = h->hprev;
+                HRVERSION_BEGIN(hb);
+                if (HR_GET_HNEXT(h)) {
+                    HR_GET_HNEXT(h)->hprev = h->hprev;
                 }
                 if (h->hprev) {
-                    h->hprev->hnext = h->hnext;
+                    HR_SET_HNEXT(h->hprev, HR_GET_HNEXT(h));
                 }
                 if (h == hb->tail) {
                     hb->tail = h->hprev;
                 }
 
-                h->hnext = hb->head;
+                HR_SET_HNEXT(h, HR_GET_HEAD(hb));
                 h->hprev = NULL;
-                hb->head->hprev = h;
-                hb->head = h;
+                HR_GET_HEAD(hb)->hprev = h;
+                HR_SET_HEAD(hb, h);
+                HRVERSION_END(hb);
 
                 /* found our host, lock & return */
                 SCMutexLock(&h->m);
@@ -588,23 +651,28 @@ Host *HostLookupHostFromHash (Address *a)
 
     /* get the key to our bucket */
     uint32_t key = HostGetKey(a);
-    /* get our hash bucket and lock it */
     HostHashRow *hb = &host_hash[key];
+
+    /* try without the row lock first */
+    if (HostLookupLockless(hb, a, &h))
+        return h;
+
+    /* get our hash bucket and lock it */
     HRLOCK_LOCK(hb);
 
     /* see if the bucket already has a host */
-    if (hb->head == NULL) {
+    if (HR_GET_HEAD(hb) == NULL) {
         HRLOCK_UNLOCK(hb);
         return h;
     }
 
     /* ok, we have a host in the bucket. Let's find out if it is our host */
-    h = hb->head;
+    h = HR_GET_HEAD(hb);
 
     /* see if this is the host we are looking for */
     if (HostCompare(h, a) == 0) {
         while (h) {
-            h = h->hnext;
+            h = HR_GET_HNEXT(h);
 
             if (h == NULL) {
                 HRLOCK_UNLOCK(hb);
@@ -614,20 +682,22 @@ Host *HostLookupHostFromHash (Address *a)
             if (HostCompare(h, a) != 0) {
                 /* we found our host, lets put it on top of the
                  * hash list -- this rewards active hosts */
-                if (h->hnext) {
-                    h->hnext->hprev = h->hprev;
+                HRVERSION_BEGIN(hb);
+                if (HR_GET_HNEXT(h)) {
+                    HR_GET_HNEXT(h)->hprev = h->hprev;
                 }
                 if (h->hprev) {
-                    h->hprev->hnext = h->hnext;
+                    HR_SET_HNEXT(h->hprev, HR_GET_HNEXT(h));
                 }
                 if (h == hb->tail) {
                     hb->tail = h->hprev;
                 }
 
-                h->hnext = hb->head;
+                HR_SET_HNEXT(h, HR_GET_HEAD(hb));
                 h->hprev = NULL;
-                hb->head->hprev = h;
-                hb->head = h;
+                HR_GET_HEAD(hb)->hprev = h;
+                HR_SET_HEAD(hb, h);
+                HRVERSION_END(hb);
 
                 /* found our host, lock & return */
                 SCMutexLock(&h->m);
@@ -690,17 +760,19 @@ static Host *HostGetUsedHost(void)
         }
 
         /* remove from the hash */
+        HRVERSION_BEGIN(hb);
         if (h->hprev != NULL)
-            h->hprev->hnext = h->hnext;
-        if (h->hnext != NULL)
-            h->hnext->hprev = h->hprev;
-        if (hb->head == h)
-            hb->head = h->hnext;
+            HR_SET_HNEXT(h->hprev, HR_GET_HNEXT(h));
+        if (HR_GET_HNEXT(h) != NULL)
+            HR_GET_HNEXT(h)->hprev = h->hprev;
+        if (HR_GET_HEAD(hb) == h)
+            HR_SET_HEAD(hb, HR_GET_HNEXT(h));
         if (hb->tail == h)
             hb->tail = h->hprev;
 
-        h->hnext = NULL;
+        HR_SET_HNEXT(h, NULL);
         h->hprev = NULL;
+        HRVERSION_END(hb);
         HRLOCK_UNLOCK(hb);
 
         HostClearMemory (h);
@@ -55,6 +55,23 @@
     #error Enable HRLOCK_SPIN or HRLOCK_MUTEX
 #endif
 
+/** Writers bump the version of a locked hash row before and after changing
+ *  it, so lookups that walk the row without its lock can tell the row
+ *  changed under them. Entries are only removed from a row while the entry
+ *  itself is locked as well. */
+#define HRVERSION_BEGIN(hb) (void)SC_ATOMIC_ADD((hb)->version, 1)
+#define HRVERSION_END(hb)   (void)SC_ATOMIC_ADD((hb)->version, 1)
+
+/** The row head and the hnext links are read by the lockless lookup, so
+ *  they are atomics. Writers hold the row lock and publish them with
+ *  release stores, all reads are relaxed. */
+#define HR_GET_HEAD(hb) SC_ATOMIC_LOAD_EXPLICIT((hb)->head, SC_ATOMIC_MEMORY_ORDER_RELAXED)
+#define HR_SET_HEAD(hb, h)                                                                         \
+    SC_ATOMIC_STORE_EXPLICIT((hb)->head, (h), SC_ATOMIC_MEMORY_ORDER_RELEASE)
+#define HR_GET_HNEXT(h) SC_ATOMIC_LOAD_EXPLICIT((h)->hnext, SC_ATOMIC_MEMORY_ORDER_RELAXED)
+#define HR_SET_HNEXT(h, n)                                                                         \
+    SC_ATOMIC_STORE_EXPLICIT((h)->hnext, (n), SC_ATOMIC_MEMORY_ORDER_RELEASE)
+
 typedef struct Host_ {
     /** host mutex */
     SCMutex m;
@@ -69,7 +86,7 @@ typedef struct Host_ {
     void *iprep;
 
     /** hash pointers, protected by hash row mutex/spin */
-    struct Host_ *hnext;
+    SC_ATOMIC_DECLARE(struct Host_ *, hnext);
     struct Host_ *hprev;
 
     /** list pointers, protected by host-queue mutex/spin */
@@ -82,8 +99,10 @@ typedef struct Host_ {
 
 typedef struct HostHashRow_ {
     HRLOCK_TYPE lock;
-    Host *head;
+    SC_ATOMIC_DECLARE(Host *, head);
     Host *tail;
+    /** bumped before and after each change to the row, see HRVERSION_BEGIN */
+    SC_ATOMIC_DECLARE(uint32_t, version);
 } __attribute__((aligned(CLS))) HostHashRow;
 
 /** host hash table */
@@ -82,17 +82,19 @@ static uint32_t IPPairHashRowTimeout(IPPairHashRow *hb, IPPair *h, SCTime_t ts)
          * ready to be discarded. */
         if (IPPairTimedOut(h, ts) == 1) {
             /* remove from the hash */
+            HRVERSION_BEGIN(hb);
             if (h->hprev != NULL)
-                h->hprev->hnext = h->hnext;
-            if (h->hnext != NULL)
-                h->hnext->hprev = h->hprev;
-            if (hb->head == h)
-                hb->head = h->hnext;
+                HR_SET_HNEXT(h->hprev, HR_GET_HNEXT(h));
+            if (HR_GET_HNEXT(h) != NULL)
+                HR_GET_HNEXT(h)->hprev = h->hprev;
+            if (HR_GET_HEAD(hb) == h)
+                HR_SET_HEAD(hb, HR_GET_HNEXT(h));
             if (hb->tail == h)
                 hb->tail = h->hprev;
 
-            h->hnext = NULL;
+            HR_SET_HNEXT(h, NULL);
             h->hprev = NULL;
+            HRVERSION_END(hb);
 
             IPPairClearMemory (h);
 
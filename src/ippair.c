@@ -236,6 +236,7 @@ void IPPairInitConfig(bool quiet)
     uint32_t i = 0;
     for (i = 0; i < ippair_config.hash_size; i++) {
         HRLOCK_INIT(&ippair_hash[i]);
+        SC_ATOMIC_INIT(ippair_hash[i].version);
     }
     (void) SC_ATOMIC_ADD(ippair_memuse, (ippair_config.hash_size * sizeof(IPPairHashRow)));
 
@@ -303,9 +304,9 @@ void IPPairShutdown(void)
     /* clear and free the hash */
     if (ippair_hash != NULL) {
         for (u = 0; u < ippair_config.hash_size; u++) {
-            h = ippair_hash[u].head;
+            h = HR_GET_HEAD(&ippair_hash[u]);
             while (h) {
-                IPPair *n = h->hnext;
+                IPPair *n = HR_GET_HNEXT(h);
                 IPPairFree(h);
                 h = n;
             }
@@ -330,30 +331,32 @@ void IPPairCleanup(void)
         for (uint32_t u = 0; u < ippair_config.hash_size; u++) {
             IPPairHashRow *hb = &ippair_hash[u];
             HRLOCK_LOCK(hb);
-            IPPair *h = ippair_hash[u].head;
+            HRVERSION_BEGIN(hb);
+            IPPair *h = HR_GET_HEAD(&ippair_hash[u]);
             while (h) {
                 if ((SC_ATOMIC_GET(h->use_cnt) > 0)) {
                     /* iprep is attached to ippair only clear local storage */
                     IPPairFreeStorage(h);
-                    h = h->hnext;
+                    h = HR_GET_HNEXT(h);
                 } else {
-                    IPPair *n = h->hnext;
+                    IPPair *n = HR_GET_HNEXT(h);
                     /* remove from the hash */
                     if (h->hprev != NULL)
-                        h->hprev->hnext = h->hnext;
-                    if (h->hnext != NULL)
-                        h->hnext->hprev = h->hprev;
-                    if (hb->head == h)
-                        hb->head = h->hnext;
+                        HR_SET_HNEXT(h->hprev, HR_GET_HNEXT(h));
+                    if (HR_GET_HNEXT(h) != NULL)
+                        HR_GET_HNEXT(h)->hprev = h->hprev;
+                    if (HR_GET_HEAD(hb) == h)
+                        HR_SET_HEAD(hb, HR_GET_HNEXT(h));
                     if (hb->tail == h)
                         hb->tail = h->hprev;
-                    h->hnext = NULL;
+                    HR_SET_HNEXT(h, NULL);
                     h->hprev = NULL;
                     IPPairClearMemory(h);
                     IPPairMoveToSpare(h);
                     h = n;
                 }
             }
+            HRVERSION_END(hb);
             HRLOCK_UNLOCK(hb);
         }
     }
@@ -439,6 +442,54 @@ static inline int IPPairCompare(IPPair *p, Address *a, Address *b)
     return 0;
 }
 
+/** max entries to walk in a row without its lock, before falling back
+ *  to a locked lookup */
+#define IPPAIR_LOCKLESS_MAX_WALK 32
+
+/** \internal
+ *  \brief look up an ippair without taking the hash row lock
+ *
+ *  IPPairs are never freed at runtime, only recycled through the spare queue,
+ *  so a row can be walked while it is being changed. A miss is only
+ *  trusted if the row version didn't change during the walk. An ippair that is
+ *  found is locked before checking the version again: ippairs are only
+ *  removed from a row with their own lock held.
+ *
+ *  \retval true lookup done, *res is the *LOCKED* ippair, or NULL if it's not
+ *          in the hash
+ *  \retval false row changed, caller needs to do a locked lookup
+ */
+static bool IPPairLookupLockless(IPPairHashRow *hb, Address *a, Address *b, IPPair **res)
+{
+    const uint32_t version = SC_ATOMIC_GET(hb->version);
+    if (version & 1)
+        return false;
+
+    IPPair *h = HR_GET_HEAD(hb);
+    for (int i = 0; h != NULL && IPPairCompare(h, a, b) == 0; i++) {
+        if (i == IPPAIR_LOCKLESS_MAX_WALK)
+            return false;
+        h = HR_GET_HNEXT(h);
+    }
+    SC_ATOMIC_THREAD_FENCE(SC_ATOMIC_MEMORY_ORDER_ACQUIRE);
+
+    if (h == NULL) {
+        if (SC_ATOMIC_GET(hb->version) != version)
+            return false;
+        *res = NULL;
+        return true;
+    }
+
+    SCMutexLock(&h->m);
+    if (SC_ATOMIC_GET(hb->version) != version) {
+        SCMutexUnlock(&h->m);
+        return false;
+    }
+    (void)IPPairIncrUsecnt(h);
+    *res = h;
+    return true;
+}
+
 /**
  *  \brief Get a new ippair
  *
@@ -524,12 +575,17 @@ IPPair *IPPairGetIPPairFromHash (Address *a, Address *b)
 
     /* get the key to our bucket */
     uint32_t key = IPPairGetKey(a, b);
-    /* get our hash bucket and lock it */
     IPPairHashRow *hb = &ippair_hash[key];
+
+    /* try without the row lock first */
+    if (IPPairLookupLockless(hb, a, b, &h) && h != NULL)
+        return h;
+
+    /* get our hash bucket and lock it */
     HRLOCK_LOCK(hb);
 
     /* see if the bucket already has a ippair */
-    if (hb->head == NULL) {
+    if (HR_GET_HEAD(hb) == NULL) {
         h = IPPairGetNew(a,b);
         if (h == NULL) {
             HRLOCK_UNLOCK(hb);
@@ -537,18 +593,20 @@ IPPair *IPPairGetIPPairFromHash (Address *a, Address *b)
         }
 
         /* ippair is locked */
-        hb->head = h;
+        HRVERSION_BEGIN(hb);
+        HR_SET_HEAD(hb, h);
         hb->tail = h;
 
         /* got one, now lock, initialize and return */
         IPPairInit(h,a,b);
+        HRVERSION_END(hb);
 
         HRLOCK_UNLOCK(hb);
         return h;
     }
 
     /* ok, we have a ippair in the bucket. Let's find out if it is our ippair */
-    h = hb->head;
+    h = HR_GET_HEAD(hb);
 
     /* see if this is the ippair we are looking for */
     if (IPPairCompare(h, a, b) == 0) {
@@ -556,14 +614,16 @@ IPPair *IPPairGetIPPairFromHash (Address *a, Address *b)
 
         while (h) {
             ph = h;
-            h = h->hnext;
+            h = HR_GET_HNEXT(h);
 
             if (h == NULL) {
-                h = ph->hnext = IPPairGetNew(a,b);
+                h = IPPairGetNew(a,b);
                 if (h == NULL) {
                     HRLOCK_UNLOCK(hb);
                     return NULL;
                 }
+                HRVERSION_BEGIN(hb);
+                HR_SET_HNEXT(ph, h);
                 hb->tail = h;
 
                 /* ippair is locked */
@@ -572,6 +632,7 @@ IPPair *IPPairGetIPPairFromHash (Address *a, Address *b)
 
                 /* initialize and return */
                 IPPairInit(h,a,b);
+                HRVERSION_END(hb);
 
                 HRLOCK_UNLOCK(hb);
                 return h;
@@ -580,20 +641,22 @@ IPPair *IPPairGetIPPairFromHash (Address *a, Address *b)
             if (IPPairCompare(h, a, b) != 0) {
                 /* we found our ippair, lets put it on top of the
                  * hash list -- this rewards active ippairs */
-                if (h->hnext) {
-                    h->hnext->hprev = h->hprev;
+                HRVERSION_BEGIN(hb);
+                if (HR_GET_HNEXT(h)) {
+                    HR_GET_HNEXT(h)->hprev = h->hprev;
                 }
                 if (h->hprev) {
-                    h->hprev->hnext = h->hnext;
+                    HR_SET_HNEXT(h->hprev, HR_GET_HNEXT(h));
                 }
                 if (h == hb->tail) {
                     hb->tail = h->hprev;
                 }
 
-                h->hnext = hb->head;
+                HR_SET_HNEXT(h, HR_GET_HEAD(hb));
                 h->hprev = NULL;
-                hb->head->hprev = h;
-                hb->head = h;
+                HR_GET_HEAD(hb)->hprev = h;
+                HR_SET_HEAD(hb, h);
+                HRVERSION_END(hb);
 
                 /* found our ippair, lock & return */
                 SCMutexLock(&h->m);
@@ -623,23 +686,28 @@ IPPair *IPPairLookupIPPairFromHash (Address *a, Address *b)
 
     /* get the key to our bucket */
     uint32_t key = IPPairGetKey(a, b);
-    /* get our hash bucket and lock it */
     IPPairHashRow *hb = &ippair_hash[key];
+
+    /* try without the row lock first */
+    if (IPPairLookupLockless(hb, a, b, &h))
+        return h;
+
+    /* get our hash bucket and lock it */
     HRLOCK_LOCK(hb);
 
     /* see if the bucket already has a ippair */
-    if (hb->head == NULL) {
+    if (HR_GET_HEAD(hb) == NULL) {
         HRLOCK_UNLOCK(hb);
         return h;
     }
 
     /* ok, we have a ippair in the bucket. Let's find out if it is our ippair */
-    h = hb->head;
+    h = HR_GET_HEAD(hb);
 
     /* see if this is the ippair we are looking for */
     if (IPPairCompare(h, a, b) == 0) {
         while (h) {
-            h = h->hnext;
+            h = HR_GET_HNEXT(h);
 
             if (h == NULL) {
                 HRLOCK_UNLOCK(hb);
@@ -649,20 +717,22 @@ IPPair *IPPairLookupIPPairFromHash (Address *a, Address *b)
             if (IPPairCompare(h, a, b) != 0) {
                 /* we found our ippair, lets put it on top of the
                  * hash list -- this rewards active ippairs */
-                if (h->hnext) {
-                    h->hnext->hprev = h->hprev;
+                HRVERSION_BEGIN(hb);
+                if (HR_GET_HNEXT(h)) {
+                    HR_GET_HNEXT(h)->hprev = h->hprev;
                 }
                 if (h->hprev) {
-                    h->hprev->hnext = h->hnext;
+                    HR_SET_HNEXT(h->hprev, HR_GET_HNEXT(h));
                 }
                 if (h == hb->tail) {
                     hb->tail = h->hprev;
                 }
 
-                h->hnext = hb->head;
+                HR_SET_HNEXT(h, HR_GET_HEAD(hb));
                 h->hprev = NULL;
-                hb->head->hprev = h;
-                hb->head = h;
+                HR_GET_HEAD(hb)->hprev = h;
+                HR_SET_HEAD(hb, h);
+                HRVERSION_END(hb);
 
                 /* found our ippair, lock & return */
                 SCMutexLock(&h->m);
@@ -725,17 +795,19 @@ static IPPair *IPPairGetUsedIPPair(void)
         }
 
         /* remove from the hash */
+        HRVERSION_BEGIN(hb);
         if (h->hprev != NULL)
-            h->hprev->hnext = h->hnext;
-        if (h->hnext != NULL)
-            h->hnext->hprev = h->hprev;
-        if (hb->head == h)
-            hb->head = h->hnext;
+            HR_SET_HNEXT(h->hprev, HR_GET_HNEXT(h));
+        if (HR_GET_HNEXT(h) != NULL)
+            HR_GET_HNEXT(h)->hprev = h->hprev;
+        if (HR_GET_HEAD(hb) == h)
+            HR_SET_HEAD(hb, HR_GET_HNEXT(h));
         if (hb->tail == h)
             hb->tail = h->hprev;
 
-        h->hnext = NULL;
+        HR_SET_HNEXT(h, NULL);
         h->hprev = NULL;
+        HRVERSION_END(hb);
         HRLOCK_UNLOCK(hb);
 
         IPPairClearMemory (h);
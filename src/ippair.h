@@ -55,6 +55,23 @@
     #error Enable HRLOCK_SPIN or HRLOCK_MUTEX
 #endif
 
+/** Writers bump the version of a locked hash row before and after changing
+ *  it, so lookups that walk the row without its lock can tell the row
+ *  changed under them. Entries are only removed from a row while the entry
+ *  itself is locked as well. */
+#define HRVERSION_BEGIN(hb) (void)SC_ATOMIC_ADD((hb)->version, 1)
+#define HRVERSION_END(hb)   (void)SC_ATOMIC_ADD((hb)->version, 1)
+
+/** The row head and the hnext links are read by the lockless lookup, so
+ *  they are atomics. Writers hold the row lock and publish them with
+ *  release stores, all reads are relaxed. */
+#define HR_GET_HEAD(hb) SC_ATOMIC_LOAD_EXPLICIT((hb)->head, SC_ATOMIC_MEMORY_ORDER_RELAXED)
+#define HR_SET_HEAD(hb, h)                                                                         \
+    SC_ATOMIC_STORE_EXPLICIT((hb)->head, (h), SC_ATOMIC_MEMORY_ORDER_RELEASE)
+#define HR_GET_HNEXT(h) SC_ATOMIC_LOAD_EXPLICIT((h)->hnext, SC_ATOMIC_MEMORY_ORDER_RELAXED)
+#define HR_SET_HNEXT(h, n)                                                                         \
+    SC_ATOMIC_STORE_EXPLICIT((h)->hnext, (n), SC_ATOMIC_MEMORY_ORDER_RELEASE)
+
 typedef struct IPPair_ {
     /** ippair mutex */
     SCMutex m;
@@ -66,7 +83,7 @@ typedef struct IPPair_ {
     SC_ATOMIC_DECLARE(unsigned int, use_cnt);
 
     /** hash pointers, protected by hash row mutex/spin */
-    struct IPPair_ *hnext;
+    SC_ATOMIC_DECLARE(struct IPPair_ *, hnext);
     struct IPPair_ *hprev;
 
     /** list pointers, protected by ippair-queue mutex/spin */
@@ -79,8 +96,10 @@ typedef struct IPPair_ {
 
 typedef struct IPPairHashRow_ {
     HRLOCK_TYPE lock;
-    IPPair *head;
+    SC_ATOMIC_DECLARE(IPPair *, head);
     IPPair *tail;
+    /** bumped before and after each change to the row, see HRVERSION_BEGIN */
+    SC_ATOMIC_DECLARE(uint32_t, version);
 } __attribute__((aligned(CLS))) IPPairHashRow;
 
 /** ippair hash table */
@@ -34,6 +34,7 @@
 #include "util-file.h"
 #include "util-magic.h"
 #include "util-profiling.h"
+#include "util-cpu-ticks.h"
 #include "util-validate.h"
 
 bool g_file_logger_enabled = false;
@@ -139,8 +140,10 @@ void OutputFileLogFfc(ThreadVars *tv, OutputFileLoggerThreadData *op_thread_data
 
                 SCLogDebug("logger %p", logger);
                 PACKET_PROFILING_LOGGER_START(p, logger->logger_id);
+                const int ticks_prev = CpuTicksEnter(CPU_TICKS_STAGE_LOGGER(logger->logger_id));
                 logger->LogFunc(tv, store->thread_data, (const Packet *)p, (const File *)ff, txv,
                         tx_id, dir);
+                CpuTicksLeave(ticks_prev);
                 PACKET_PROFILING_LOGGER_END(p, logger->logger_id);
                 file_logged = true;
 
@@ -30,6 +30,7 @@
 #include "detect-filemagic.h"
 #include "conf.h"
 #include "util-profiling.h"
+#include "util-cpu-ticks.h"
 #include "util-validate.h"
 #include "util-magic.h"
 #include "util-path.h"
@@ -94,8 +95,10 @@ static int CallLoggers(ThreadVars *tv, OutputLoggerThreadStore *store_list, Pack
 
         SCLogDebug("logger %p", logger);
         PACKET_PROFILING_LOGGER_START(p, logger->logger_id);
+        const int ticks_prev = CpuTicksEnter(CPU_TICKS_STAGE_LOGGER(logger->logger_id));
         logger->LogFunc(tv, store->thread_data, (const Packet *)p, ff, tx, tx_id, data, data_len,
                 flags, dir);
+        CpuTicksLeave(ticks_prev);
         PACKET_PROFILING_LOGGER_END(p, logger->logger_id);
 
         file_logged = 1;
@@ -578,7 +578,7 @@ void EveAddVerdict(SCJsonBuilder *jb, const Packet *p)
         JB_SET_STRING(jb, "action", "drop");
     } else if (PacketCheckAction(p, ACTION_ACCEPT)) {
         JB_SET_STRING(jb, "action", "accept");
-    } else if (p->alerts.alerts[p->alerts.cnt].action & ACTION_PASS) {
+    } else if (p->alerts.alerts != NULL && p->alerts.alerts[p->alerts.cnt].action & ACTION_PASS) {
         JB_SET_STRING(jb, "action", "pass");
     } else {
         // TODO make sure we don't have a situation where this wouldn't work
@@ -52,6 +52,7 @@
 #include "stream-tcp-private.h"
 #include "flow-storage.h"
 #include "util-exception-policy.h"
+#include "util-flow-cost.h"
 
 static SCJsonBuilder *CreateEveHeaderFromFlow(const Flow *f)
 {
@@ -365,6 +366,18 @@ static void EveFlowLogJSON(OutputJsonThreadCtx *aft, SCJsonBuilder *jb, Flow *f)
         }
     }
 
+    if (FlowCostStorageEnabled()) {
+        const FlowCost *fc = FlowGetStorageById(f, FlowCostGetStorageID());
+        if (fc != NULL) {
+            SCJbOpenObject(jb, "cpu_ticks");
+            SCJbSetUint(jb, "stream", fc->ticks[FLOW_COST_STREAM]);
+            SCJbSetUint(jb, "app_layer", fc->ticks[FLOW_COST_APP_LAYER]);
+            SCJbSetUint(jb, "detect", fc->ticks[FLOW_COST_DETECT]);
+            SCJbSetUint(jb, "total", FlowCostTotal(fc));
+            SCJbClose(jb);
+        }
+    }
+
     /* Close flow. */
     SCJbClose(jb);
 
@@ -28,6 +28,7 @@
 #include "pkt-var.h"
 #include "conf.h"
 #include "detect-engine.h"
+#include "util-flow-cost.h"
 
 #include "threads.h"
 #include "threadvars.h"
@@ -349,6 +350,18 @@ static int JsonStatsLogger(ThreadVars *tv, void *thread_data, const StatsTable *
         return 0;
     }
 
+    if (aft->statslog_ctx->flags & JSON_STATS_RULE_SAMPLING) {
+        json_t *js_sampling = DetectEngineRuleSamplingToJSON();
+        if (js_sampling != NULL)
+            json_object_set_new(js_stats, "rule_sampling", js_sampling);
+    }
+
+    if (aft->statslog_ctx->flags & JSON_STATS_EXPENSIVE_FLOWS) {
+        json_t *js_flows = FlowCostTopToJSON();
+        if (js_flows != NULL)
+            json_object_set_new(js_stats, "expensive_flows", js_flows);
+    }
+
     json_object_set_new(js, "stats", js_stats);
 
     OutputJSONBuffer(js, aft->file_ctx, &aft->buffer);
@@ -451,6 +464,8 @@ static OutputInitResult OutputStatsLogInitSub(SCConfNode *conf, OutputCtx *paren
         const char *threads = SCConfNodeLookupChildValue(conf, "threads");
         const char *deltas = SCConfNodeLookupChildValue(conf, "deltas");
         const char *zero_counters = SCConfNodeLookupChildValue(conf, "null-values");
+        const char *rule_sampling = SCConfNodeLookupChildValue(conf, "rule-sampling");
+        const char *expensive_flows = SCConfNodeLookupChildValue(conf, "expensive-flows");
         SCLogDebug("totals %s threads %s deltas %s", totals, threads, deltas);
 
         if ((totals != NULL && SCConfValIsFalse(totals)) &&
@@ -472,6 +487,12 @@ static OutputInitResult OutputStatsLogInitSub(SCConfNode *conf, OutputCtx *paren
         if (zero_counters != NULL && SCConfValIsFalse(zero_counters)) {
             stats_ctx->flags |= JSON_STATS_NO_ZEROES;
         }
+        if (rule_sampling != NULL && SCConfValIsTrue(rule_sampling)) {
+            stats_ctx->flags |= JSON_STATS_RULE_SAMPLING;
+        }
+        if (expensive_flows != NULL && SCConfValIsTrue(expensive_flows)) {
+            stats_ctx->flags |= JSON_STATS_EXPENSIVE_FLOWS;
+        }
         SCLogDebug("stats_ctx->flags %08x", stats_ctx->flags);
     }
 
@@ -26,10 +26,12 @@
 
 #include "output-stats.h"
 
-#define JSON_STATS_TOTALS    (1 << 0)
-#define JSON_STATS_THREADS   (1 << 1)
-#define JSON_STATS_DELTAS    (1 << 2)
-#define JSON_STATS_NO_ZEROES (1 << 3)
+#define JSON_STATS_TOTALS          (1 << 0)
+#define JSON_STATS_THREADS         (1 << 1)
+#define JSON_STATS_DELTAS          (1 << 2)
+#define JSON_STATS_NO_ZEROES       (1 << 3)
+#define JSON_STATS_RULE_SAMPLING   (1 << 4)
+#define JSON_STATS_EXPENSIVE_FLOWS (1 << 5)
 
 json_t *StatsToJSON(const StatsTable *st, uint8_t flags);
 TmEcode OutputEngineStatsReloadTime(json_t **jdata);
@@ -27,6 +27,7 @@
 #include "output.h"
 #include "output-packet.h"
 #include "util-profiling.h"
+#include "util-cpu-ticks.h"
 #include "util-validate.h"
 
 /** per thread data for this module, contains a list of per thread
@@ -103,7 +104,9 @@ static TmEcode OutputPacketLog(ThreadVars *tv, Packet *p, void *thread_data)
 
         if (logger->ConditionFunc(tv, store->thread_data, (const Packet *)p)) {
             PACKET_PROFILING_LOGGER_START(p, logger->logger_id);
+            const int ticks_prev = CpuTicksEnter(CPU_TICKS_STAGE_LOGGER(logger->logger_id));
             logger->LogFunc(tv, store->thread_data, (const Packet *)p);
+            CpuTicksLeave(ticks_prev);
             PACKET_PROFILING_LOGGER_END(p, logger->logger_id);
         }
 
@@ -32,6 +32,7 @@
 #include "util-print.h"
 #include "conf.h"
 #include "util-profiling.h"
+#include "util-cpu-ticks.h"
 #include "stream-tcp.h"
 #include "stream-tcp-inline.h"
 #include "stream-tcp-reassemble.h"
@@ -120,7 +121,9 @@ static int Streamer(void *cbdata, Flow *f, const uint8_t *data, uint32_t data_le
         if (logger->type == streamer_cbdata->type) {
             SCLogDebug("logger %p", logger);
             PACKET_PROFILING_LOGGER_START(p, logger->logger_id);
+            const int ticks_prev = CpuTicksEnter(CPU_TICKS_STAGE_LOGGER(logger->logger_id));
             logger->LogFunc(tv, store->thread_data, (const Flow *)f, data, data_len, tx_id, flags);
+            CpuTicksLeave(ticks_prev);
             PACKET_PROFILING_LOGGER_END(p, logger->logger_id);
         }
 
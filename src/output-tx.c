@@ -31,6 +31,7 @@
 #include "app-layer-parser.h"
 #include "util-config.h"
 #include "util-profiling.h"
+#include "util-cpu-ticks.h"
 #include "util-validate.h"
 
 /** per thread data for this module, contains a list of per thread
@@ -256,7 +257,9 @@ static void OutputTxLogList0(ThreadVars *tv, OutputTxLoggerThreadData *op_thread
         /* always invoke "wild card" tx loggers */
         SCLogDebug("Logging tx_id %"PRIu64" to logger %d", tx_id, logger->logger_id);
         PACKET_PROFILING_LOGGER_START(p, logger->logger_id);
+        const int ticks_prev = CpuTicksEnter(CPU_TICKS_STAGE_LOGGER(logger->logger_id));
         logger->LogFunc(tv, store->thread_data, p, f, f->alstate, tx, tx_id);
+        CpuTicksLeave(ticks_prev);
         PACKET_PROFILING_LOGGER_END(p, logger->logger_id);
 
         logger = logger->next;
@@ -318,7 +321,9 @@ static void OutputTxLogCallLoggers(ThreadVars *tv, OutputTxLoggerThreadData *op_
 
             SCLogDebug("Logging tx_id %" PRIu64 " to logger %d", tx_id, logger->logger_id);
             PACKET_PROFILING_LOGGER_START(p, logger->logger_id);
+            const int ticks_prev = CpuTicksEnter(CPU_TICKS_STAGE_LOGGER(logger->logger_id));
             logger->LogFunc(tv, store->thread_data, p, f, alstate, tx, tx_id);
+            CpuTicksLeave(ticks_prev);
             PACKET_PROFILING_LOGGER_END(p, logger->logger_id);
 
             ctx->tx_logged |= BIT_U32(logger->logger_id);
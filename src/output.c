@@ -38,6 +38,7 @@
 #include "tm-threads.h"
 #include "util-error.h"
 #include "util-debug.h"
+#include "util-cpu-ticks.h"
 #include "output.h"
 #include "output-eve-bindgen.h"
 
@@ -805,12 +806,14 @@ TmEcode OutputLoggerLog(ThreadVars *tv, Packet *p, void *thread_data)
     LoggerThreadStore *thread_store = (LoggerThreadStore *)thread_data;
     RootLogger *logger = TAILQ_FIRST(&active_loggers);
     LoggerThreadStoreNode *thread_store_node = TAILQ_FIRST(thread_store);
+    const int ticks_prev = CpuTicksEnter(CPU_TICKS_OUTPUT);
     while (logger && thread_store_node) {
         logger->LogFunc(tv, p, thread_store_node->thread_data);
 
         logger = TAILQ_NEXT(logger, entries);
         thread_store_node = TAILQ_NEXT(thread_store_node, entries);
     }
+    CpuTicksLeave(ticks_prev);
     return TM_ECODE_OK;
 }
 
@@ -234,3 +234,94 @@ void PacketQueueFree(PacketQueue *pq)
     SCMutexDestroy(&pq->mutex_q);
     SCFree(pq);
 }
+
+/**
+ *  \brief allocate a ring for at least 'size' packets
+ *
+ *  \param size minimal number of slots, rounded up to a power of 2
+ */
+PacketRing *PacketRingAlloc(uint32_t size)
+{
+    uint32_t slots = PACKET_RING_BATCH;
+    while (slots < size && slots < (1U << 31))
+        slots <<= 1;
+
+    PacketRing *r = SCMallocAligned(sizeof(*r), CLS);
+    if (r == NULL)
+        return NULL;
+    memset(r, 0, sizeof(*r));
+    r->slots = SCCalloc(slots, sizeof(Packet *));
+    if (r->slots == NULL) {
+        SCFreeAligned(r);
+        return NULL;
+    }
+    r->mask = slots - 1;
+    SC_ATOMIC_INIT(r->prod.tail);
+    SC_ATOMIC_INIT(r->cons.head);
+    return r;
+}
+
+void PacketRingFree(PacketRing *r)
+{
+    if (r == NULL)
+        return;
+    SCFree(r->slots);
+    SCFreeAligned(r);
+}
+
+/**
+ *  \brief add a packet to the ring, producer only
+ *
+ *  \retval true packet was added
+ *  \retval false ring is full
+ */
+bool PacketRingEnqueue(PacketRing *r, Packet *p)
+{
+    const uint32_t tail = SC_ATOMIC_LOAD_EXPLICIT(r->prod.tail, SC_ATOMIC_MEMORY_ORDER_RELAXED);
+    if (tail - r->prod.head_cache > r->mask) {
+        r->prod.head_cache = SC_ATOMIC_GET(r->cons.head);
+        if (tail - r->prod.head_cache > r->mask)
+            return false;
+    }
+    r->slots[tail & r->mask] = p;
+    /* full barrier store: the producer checks if the consumer sleeps next */
+    SC_ATOMIC_SET(r->prod.tail, tail + 1);
+    return true;
+}
+
+/**
+ *  \brief get the next packet from the ring, consumer only
+ *
+ *  The producer's tail is only read when the packets seen at the last read
+ *  are all consumed. The consumed slots are handed back to the producer
+ *  every PACKET_RING_BATCH packets and when the batch runs out.
+ *
+ *  \retval p packet or NULL if the ring is empty
+ */
+Packet *PacketRingDequeue(PacketRing *r)
+{
+    uint32_t head = r->cons.head_local;
+    if (head == r->cons.tail_cache) {
+        if (SC_ATOMIC_LOAD_EXPLICIT(r->cons.head, SC_ATOMIC_MEMORY_ORDER_RELAXED) != head)
+            SC_ATOMIC_SET(r->cons.head, head);
+        r->cons.tail_cache = SC_ATOMIC_GET(r->prod.tail);
+        if (head == r->cons.tail_cache)
+            return NULL;
+    }
+
+    Packet *p = r->slots[head & r->mask];
+    head++;
+    r->cons.head_local = head;
+    if ((head & (PACKET_RING_BATCH - 1)) == 0)
+        SC_ATOMIC_SET(r->cons.head, head);
+    return p;
+}
+
+/**
+ *  \brief check if the ring has packets that have not been fully handled by
+ *         the consumer yet. Safe to call from any thread.
+ */
+bool PacketRingIsEmpty(PacketRing *r)
+{
+    return SC_ATOMIC_GET(r->prod.tail) == SC_ATOMIC_GET(r->cons.head);
+}
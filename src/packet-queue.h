@@ -57,6 +57,42 @@ typedef struct PacketQueue_ {
     SCCondT cond_q;
 } PacketQueue;
 
+/** \brief single producer, single consumer ring of packets
+ *
+ *  Lock free: only the producer writes the tail and only the consumer
+ *  writes the head. Both sides keep a private copy of the other side's
+ *  index, so the shared cache line is only read once the cached view says
+ *  the ring is full (producer) or empty (consumer). The consumer publishes
+ *  its head once per batch instead of for each packet.
+ *
+ *  Indices are free running, the size is a power of 2.
+ */
+typedef struct PacketRing_ {
+    struct Packet_ **slots;
+    uint32_t mask;
+
+    /* producer side */
+    struct {
+        SC_ATOMIC_DECLARE(uint32_t, tail);
+        uint32_t head_cache;
+    } __attribute__((aligned(CLS))) prod;
+
+    /* consumer side */
+    struct {
+        SC_ATOMIC_DECLARE(uint32_t, head);
+        uint32_t head_local;
+        uint32_t tail_cache;
+    } __attribute__((aligned(CLS))) cons;
+} PacketRing;
+
+/** number of packets the consumer takes before publishing its head */
+#define PACKET_RING_BATCH 32
+
+PacketRing *PacketRingAlloc(uint32_t size);
+void PacketRingFree(PacketRing *r);
+bool PacketRingEnqueue(PacketRing *r, struct Packet_ *p);
+struct Packet_ *PacketRingDequeue(PacketRing *r);
+bool PacketRingIsEmpty(PacketRing *r);
 
 void PacketEnqueueNoLock(PacketQueueNoLock *qnl, struct Packet_ *p);
 void PacketEnqueue (PacketQueue *, struct Packet_ *);
@@ -63,7 +63,7 @@ bool PacketCheckAction(const Packet *p, const uint8_t a)
 void PacketInit(Packet *p)
 {
     SCSpinInit(&p->persistent.tunnel_lock, 0);
-    p->alerts.alerts = PacketAlertCreate();
+    p->alerts.alerts = NULL;
     p->livedev = NULL;
 }
 
@@ -127,11 +127,13 @@ void PacketReinit(Packet *p)
     p->alerts.discarded = 0;
     p->alerts.suppressed = 0;
     p->alerts.drop.action = 0;
-    if (p->alerts.cnt > 0) {
-        if (pflags & PKT_ALERT_CTX_USED)
+    if (p->alerts.alerts != NULL) {
+        if (p->alerts.cnt > 0 && (pflags & PKT_ALERT_CTX_USED))
             PacketAlertRecycle(p->alerts.alerts, p->alerts.cnt);
-        p->alerts.cnt = 0;
+        PacketAlertRelease(p->alerts.alerts);
+        p->alerts.alerts = NULL;
     }
+    p->alerts.cnt = 0;
     p->pcap_cnt = 0;
     p->tunnel_rtv_cnt = 0;
     p->tunnel_tpr_cnt = 0;
@@ -143,6 +145,8 @@ void PacketReinit(Packet *p)
     p->root = NULL;
     p->livedev = NULL;
     PACKET_PROFILING_RESET(p);
+    if (p->latency_ts[PKT_LATENCY_START] != 0)
+        memset(p->latency_ts, 0, sizeof(p->latency_ts));
     p->tenant_id = 0;
     p->nb_decoded_layers = 0;
 }
@@ -31,6 +31,7 @@
  */
 #define SC_PCAP_DONT_INCLUDE_PCAP_H  1
 #include "suricata-common.h"
+#include "suricata.h"
 #include "tm-threads.h"
 #include "conf.h"
 #include "runmodes.h"
@@ -68,14 +69,77 @@ const char *RunModeAFXDPGetDefaultMode(void)
     return "workers";
 }
 
+static bool AFXDPRunModeIsIPS(void)
+{
+    int nlive = LiveGetDeviceCount();
+    bool has_ips = false;
+    bool has_ids = false;
+
+    SCConfNode *af_xdp_node = SCConfGetNode("af-xdp");
+    if (af_xdp_node == NULL) {
+        SCLogConfig("no 'af-xdp' section in the yaml, default to IDS");
+        return false;
+    }
+
+    SCConfNode *if_default = ConfFindDeviceConfig(af_xdp_node, "default");
+
+    for (int ldev = 0; ldev < nlive; ldev++) {
+        const char *live_dev = LiveGetDeviceName(ldev);
+        if (live_dev == NULL) {
+            SCLogConfig("invalid livedev at index %d, default to IDS", ldev);
+            return false;
+        }
+        SCConfNode *if_root = ConfFindDeviceConfig(af_xdp_node, live_dev);
+        if (if_root == NULL) {
+            if (if_default == NULL) {
+                SCLogConfig("no 'af-xdp' section for '%s' or 'default' in the yaml, default to IDS",
+                        live_dev);
+                return false;
+            }
+            if_root = if_default;
+        }
+
+        const char *copymodestr = NULL;
+        const char *copyifacestr = NULL;
+        if (SCConfGetChildValueWithDefault(if_root, if_default, "copy-mode", &copymodestr) == 1 &&
+                SCConfGetChildValue(if_root, "copy-iface", &copyifacestr) == 1) {
+            if (strcmp(copymodestr, "ips") == 0) {
+                has_ips = true;
+            } else {
+                has_ids = true;
+            }
+        } else {
+            has_ids = true;
+        }
+    }
+
+    if (has_ids && has_ips) {
+        SCLogError("using both IPS and TAP/IDS mode is not allowed due to undefined behavior. See "
+                   "ticket #5588.");
+        return false;
+    }
+
+    return has_ips;
+}
+
+static int AFXDPRunModeEnableIPS(void)
+{
+    bool r = AFXDPRunModeIsIPS();
+    if (r) {
+        SCLogInfo("Setting IPS mode");
+        EngineModeSetIPS();
+    }
+    return r;
+}
+
 void RunModeIdsAFXDPRegister(void)
 {
     RunModeRegisterNewRunMode(RUNMODE_AFXDP_DEV, "single", "Single threaded af-xdp mode",
-            RunModeIdsAFXDPSingle, NULL);
+            RunModeIdsAFXDPSingle, AFXDPRunModeEnableIPS);
     RunModeRegisterNewRunMode(RUNMODE_AFXDP_DEV, "workers",
             "Workers af-xdp mode, each thread does all"
             " tasks from acquisition to logging",
-            RunModeIdsAFXDPWorkers, NULL);
+            RunModeIdsAFXDPWorkers, AFXDPRunModeEnableIPS);
 }
 
 #ifdef HAVE_AF_XDP
@@ -218,6 +282,7 @@ static void *ParseAFXDPConfig(const char *iface)
 
     SC_ATOMIC_RESET(aconf->ref);
     (void)SC_ATOMIC_ADD(aconf->ref, aconf->threads);
+    SC_ATOMIC_RESET(aconf->queue_num);
 
     /* Promisc Mode */
     (void)SCConfGetChildValueBoolWithDefault(if_root, if_default, "disable-promisc", &boolval);
@@ -258,6 +323,48 @@ static void *ParseAFXDPConfig(const char *iface)
         }
     }
 
+    /* IPS and TAP mode */
+    const char *out_iface = NULL;
+    if (SCConfGetChildValueWithDefault(if_root, if_default, "copy-iface", &out_iface) == 1) {
+        if (strlen(out_iface) > 0) {
+            aconf->out_iface = out_iface;
+        }
+    }
+
+    if (SCConfGetChildValueWithDefault(if_root, if_default, "copy-mode", &confstr) == 1) {
+        if (aconf->out_iface == NULL) {
+            SCLogWarning("%s: copy mode activated but no destination iface. Disabling feature",
+                    iface);
+        } else if (strcmp(confstr, "ips") == 0) {
+            SCLogInfo("%s: AF_XDP IPS mode activated %s->%s", iface, iface, aconf->out_iface);
+            aconf->copy_mode = AFXDP_COPY_MODE_IPS;
+        } else if (strcmp(confstr, "tap") == 0) {
+            SCLogInfo("%s: AF_XDP TAP mode activated %s->%s", iface, iface, aconf->out_iface);
+            aconf->copy_mode = AFXDP_COPY_MODE_TAP;
+        } else {
+            SCLogWarning("Invalid 'copy-mode' (not in tap, ips)");
+        }
+    }
+
+    if (aconf->copy_mode != AFXDP_COPY_MODE_NONE) {
+        /* frames are forwarded from the umem shared with the copy iface */
+        aconf->shared_umem = true;
+        if (LiveGetDevice(aconf->out_iface) == NULL) {
+            SCLogError("%s: copy-iface %s is not a capture interface", iface, aconf->out_iface);
+            /* ref is already set for all threads, but none of them got it */
+            SCFree(aconf);
+            return NULL;
+        }
+    }
+
+    /* one umem for all queues of the interface */
+    if (SCConfGetChildValueBoolWithDefault(if_root, if_default, "shared-umem", &conf_val) == 1) {
+        aconf->shared_umem = conf_val != 0;
+        if (aconf->shared_umem) {
+            SCLogConfig("%s: sharing umem between %d queues", aconf->iface, aconf->threads);
+        }
+    }
+
     /* Busy polling options */
     if (SCConfGetChildValueBoolWithDefault(if_root, if_default, "enable-busy-poll", &conf_val) ==
             1) {
@@ -336,12 +443,21 @@ int RunModeIdsAFXDPSingle(void)
         FatalError("Unable to init AF_XDP queue protection.");
     }
 
+    if (AFXDPPeersListInit() != TM_ECODE_OK) {
+        FatalError("Unable to init peers list.");
+    }
+
     ret = RunModeSetLiveCaptureSingle(ParseAFXDPConfig, AFXDPConfigGetThreadsCount, "ReceiveAFXDP",
             "DecodeAFXDP", thread_name_single, live_dev);
     if (ret != 0) {
         FatalError("Unable to start runmode");
     }
 
+    /* In IPS mode each threads must have a peer */
+    if (AFXDPPeersListCheck() != TM_ECODE_OK) {
+        FatalError("Some IPS capture threads did not peer.");
+    }
+
     SCLogDebug("RunModeIdsAFXDPSingle initialised");
 
 #endif /* HAVE_AF_XDP */
@@ -370,12 +486,21 @@ int RunModeIdsAFXDPWorkers(void)
         FatalError("Unable to init AF_XDP queue protection.");
     }
 
+    if (AFXDPPeersListInit() != TM_ECODE_OK) {
+        FatalError("Unable to init peers list.");
+    }
+
     ret = RunModeSetLiveCaptureWorkers(ParseAFXDPConfig, AFXDPConfigGetThreadsCount, "ReceiveAFXDP",
             "DecodeAFXDP", thread_name_workers, live_dev);
     if (ret != 0) {
         FatalError("Unable to start runmode");
     }
 
+    /* In IPS mode each threads must have a peer */
+    if (AFXDPPeersListCheck() != TM_ECODE_OK) {
+        FatalError("Some IPS capture threads did not peer.");
+    }
+
     SCLogDebug("RunModeIdsAFXDPWorkers initialised");
 
 #endif /* HAVE_AF_XDP */
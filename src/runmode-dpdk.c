@@ -42,6 +42,7 @@
 #include "util-device-private.h"
 #include "util-dpdk.h"
 #include "util-dpdk-bonding.h"
+#include "util-dpdk-bypass.h"
 #include "util-dpdk-common.h"
 #include "util-dpdk-i40e.h"
 #include "util-dpdk-ice.h"
@@ -54,6 +55,8 @@
 
 #ifdef HAVE_DPDK
 
+extern uint32_t max_pending_packets;
+
 // Calculates the closest multiple of y from x
 #define ROUNDUP(x, y) ((((x) + ((y)-1)) / (y)) * (y))
 
@@ -87,6 +90,7 @@ static int ConfigSetRxDescriptors(DPDKIfaceConfig *iconf, const char *entry_str,
 static int ConfigSetTxDescriptors(
         DPDKIfaceConfig *iconf, const char *entry_str, uint16_t max_desc, bool iface_sends_pkts);
 static int ConfigSetMtu(DPDKIfaceConfig *iconf, intmax_t entry_int);
+static int ConfigSetMbufSize(DPDKIfaceConfig *iconf, const char *entry_str);
 static bool ConfigSetPromiscuousMode(DPDKIfaceConfig *iconf, int entry_bool);
 static bool ConfigSetMulticast(DPDKIfaceConfig *iconf, int entry_bool);
 static int ConfigSetChecksumChecks(DPDKIfaceConfig *iconf, int entry_bool);
@@ -94,6 +98,7 @@ static int ConfigSetChecksumOffload(DPDKIfaceConfig *iconf, int entry_bool);
 static int ConfigSetCopyIface(DPDKIfaceConfig *iconf, const char *entry_str);
 static int ConfigSetCopyMode(DPDKIfaceConfig *iconf, const char *entry_str);
 static int ConfigSetCopyIfaceSettings(DPDKIfaceConfig *iconf, const char *iface, const char *mode);
+static void ConfigSetBypass(DPDKIfaceConfig *iconf, int entry_bool);
 static void ConfigInit(DPDKIfaceConfig **iconf);
 static int ConfigLoad(DPDKIfaceConfig *iconf, const char *iface);
 static DPDKIfaceConfig *ConfigParse(const char *iface);
@@ -116,6 +121,7 @@ static void DPDKDerefConfig(void *conf);
 #define DPDK_CONFIG_DEFAULT_TX_DESCRIPTORS              "auto"
 #define DPDK_CONFIG_DEFAULT_RSS_HASH_FUNCTIONS          RTE_ETH_RSS_IP
 #define DPDK_CONFIG_DEFAULT_MTU                         1500
+#define DPDK_CONFIG_DEFAULT_MBUF_SIZE                   "auto"
 #define DPDK_CONFIG_DEFAULT_PROMISCUOUS_MODE            1
 #define DPDK_CONFIG_DEFAULT_MULTICAST_MODE              1
 #define DPDK_CONFIG_DEFAULT_CHECKSUM_VALIDATION         1
@@ -124,6 +130,7 @@ static void DPDKDerefConfig(void *conf);
 #define DPDK_CONFIG_DEFAULT_LINKUP_TIMEOUT              0
 #define DPDK_CONFIG_DEFAULT_COPY_MODE                   "none"
 #define DPDK_CONFIG_DEFAULT_COPY_INTERFACE              "none"
+#define DPDK_CONFIG_DEFAULT_BYPASS                      0
 
 DPDKIfaceConfigAttributes dpdk_yaml = {
     .threads = "threads",
@@ -133,6 +140,7 @@ DPDKIfaceConfigAttributes dpdk_yaml = {
     .checksum_checks = "checksum-checks",
     .checksum_checks_offload = "checksum-checks-offload",
     .mtu = "mtu",
+    .mbuf_size = "mbuf-size",
     .vlan_strip_offload = "vlan-strip-offload",
     .rss_hf = "rss-hash-functions",
     .linkup_timeout = "linkup-timeout",
@@ -142,6 +150,7 @@ DPDKIfaceConfigAttributes dpdk_yaml = {
     .tx_descriptors = "tx-descriptors",
     .copy_mode = "copy-mode",
     .copy_iface = "copy-iface",
+    .bypass = "bypass",
 };
 
 /**
@@ -378,6 +387,17 @@ static void ConfigSetIface(DPDKIfaceConfig *iconf, const char *entry_str)
     SCReturn;
 }
 
+/**
+ * \brief Name of the CPU set the capture threads are pinned to
+ *
+ * In workers mode the capture threads do all the work. In autofp they only
+ * receive and decode, the detection runs in the worker-cpu-set.
+ */
+static const char *ConfigThreadsCpuSetName(void)
+{
+    return RunmodeIsAutofp() ? "receive-cpu-set" : "worker-cpu-set";
+}
+
 static int ConfigSetThreads(DPDKIfaceConfig *iconf, const char *entry_str)
 {
     SCEnter();
@@ -387,13 +407,14 @@ static int ConfigSetThreads(DPDKIfaceConfig *iconf, const char *entry_str)
         SCReturnInt(-EINVAL);
     }
 
+    const char *cpu_set_name = ConfigThreadsCpuSetName();
     bool wtaf_periface = true;
-    ThreadsAffinityType *wtaf = GetAffinityTypeForNameAndIface("worker-cpu-set", iconf->iface);
+    ThreadsAffinityType *wtaf = GetAffinityTypeForNameAndIface(cpu_set_name, iconf->iface);
     if (wtaf == NULL) {
         wtaf_periface = false;
-        wtaf = GetAffinityTypeForNameAndIface("worker-cpu-set", NULL); // mandatory
+        wtaf = GetAffinityTypeForNameAndIface(cpu_set_name, NULL); // mandatory
         if (wtaf == NULL) {
-            SCLogError("Specify worker-cpu-set list in the threading section");
+            SCLogError("Specify %s list in the threading section", cpu_set_name);
             SCReturnInt(-EINVAL);
         }
     }
@@ -404,17 +425,17 @@ static int ConfigSetThreads(DPDKIfaceConfig *iconf, const char *entry_str)
     }
     uint16_t sched_cpus = UtilAffinityGetAffinedCPUNum(wtaf);
     if (sched_cpus == UtilCpuGetNumProcessorsOnline()) {
-        SCLogWarning(
-                "\"all\" specified in worker CPU cores affinity, excluding management threads");
+        SCLogWarning("\"all\" specified in %s CPU cores affinity, excluding management threads",
+                cpu_set_name);
         UtilAffinityCpusExclude(wtaf, mtaf);
         sched_cpus = UtilAffinityGetAffinedCPUNum(wtaf);
     }
 
     if (sched_cpus == 0) {
-        SCLogError("No worker CPU cores with configured affinity were configured");
+        SCLogError("No %s CPU cores with configured affinity were configured", cpu_set_name);
         SCReturnInt(-EINVAL);
     } else if (UtilAffinityCpusOverlap(wtaf, mtaf) != 0) {
-        SCLogWarning("Worker threads should not overlap with management threads in the CPU core "
+        SCLogWarning("Capture threads should not overlap with management threads in the CPU core "
                      "affinity configuration");
     }
 
@@ -443,7 +464,7 @@ static int ConfigSetThreads(DPDKIfaceConfig *iconf, const char *entry_str)
         }
         iconf->threads = sched_cpus / live_dev_count;
         if (iconf->threads == 0) {
-            SCLogError("Not enough worker CPU cores with affinity were configured");
+            SCLogError("Not enough %s CPU cores with affinity were configured", cpu_set_name);
             SCReturnInt(-ERANGE);
         }
 
@@ -535,6 +556,10 @@ static uint32_t MempoolSizeCalculate(
     uint32_t sz = rx_queues * rx_desc + tx_queues * tx_desc;
     if (!tx_queues || !tx_desc)
         sz *= 2; // double to have enough space for RX descriptors
+    // in autofp the mbufs of the packets waiting in the worker queues are not
+    // returned to the mempool, each receive thread can hold its whole packet pool
+    if (RunmodeIsAutofp())
+        sz += rx_queues * max_pending_packets;
 
     return sz;
 }
@@ -730,6 +755,94 @@ static int ConfigSetMtu(DPDKIfaceConfig *iconf, intmax_t entry_int)
     SCReturnInt(0);
 }
 
+static uint16_t MbufFrameSizeCalculate(uint16_t mtu)
+{
+    // +4 for VLAN header
+    return mtu + RTE_ETHER_CRC_LEN + RTE_ETHER_HDR_LEN + 4;
+}
+
+static int ConfigSetMbufSize(DPDKIfaceConfig *iconf, const char *entry_str)
+{
+    SCEnter();
+    const uint16_t frame_size = MbufFrameSizeCalculate(iconf->mtu);
+    if (entry_str == NULL || entry_str[0] == '\0' || strcmp(entry_str, "auto") == 0) {
+        // a frame always fits into a single mbuf
+        iconf->mbuf_size = ROUNDUP(frame_size, 1024);
+        SCReturnInt(0);
+    }
+
+    if (StringParseUint16(&iconf->mbuf_size, 10, 0, entry_str) < 0) {
+        SCLogError("%s: mbuf size entry contain non-numerical characters - \"%s\"", iconf->iface,
+                entry_str);
+        SCReturnInt(-EINVAL);
+    }
+
+    if (iconf->mbuf_size < RTE_ETHER_MIN_LEN ||
+            iconf->mbuf_size > UINT16_MAX - RTE_PKTMBUF_HEADROOM) {
+        SCLogError("%s: mbuf size can only be between %" PRIu32 " and %" PRIu32, iconf->iface,
+                RTE_ETHER_MIN_LEN, UINT16_MAX - RTE_PKTMBUF_HEADROOM);
+        SCReturnInt(-ERANGE);
+    }
+
+    if (iconf->mbuf_size < frame_size) {
+        iconf->flags |= DPDK_MULTI_SEG;
+        SCLogConfig("%s: frames up to %" PRIu16 " bytes span up to %u mbufs of %" PRIu16 " bytes",
+                iconf->iface, frame_size, (frame_size + iconf->mbuf_size - 1) / iconf->mbuf_size,
+                iconf->mbuf_size);
+    }
+
+    SCReturnInt(0);
+}
+
+/**
+ * \brief Size the packet buffers for frames spanning multiple mbufs
+ *
+ * DPDK ports are not kernel interfaces, so default-packet-size is not taken
+ * from their MTU. Frames copied out of an mbuf chain that don't fit the
+ * packet's own buffer need an allocation of MAX_PAYLOAD_SIZE each. Unless
+ * default-packet-size is set, it is raised to the largest frame of the
+ * multi-segment ports before the packet pools are created.
+ */
+static void DPDKSetDefaultPacketSize(void)
+{
+    const char *entry_str = NULL;
+    if (SCConfGet("default-packet-size", &entry_str) == 1)
+        return;
+
+    uint32_t max_frame_size = 0;
+    const int nlive = LiveGetDeviceCount();
+    for (int ldev = 0; ldev < nlive; ldev++) {
+        const char *live_dev = LiveGetDeviceName(ldev);
+        SCConfNode *if_root;
+        SCConfNode *if_default;
+        if (live_dev == NULL ||
+                SCConfSetRootAndDefaultNodes("dpdk.interfaces", live_dev, &if_root, &if_default) <
+                        0)
+            continue;
+
+        intmax_t mtu = DPDK_CONFIG_DEFAULT_MTU;
+        (void)SCConfGetChildValueIntWithDefault(if_root, if_default, dpdk_yaml.mtu, &mtu);
+        uint16_t mbuf_size = 0;
+        if (mtu < RTE_ETHER_MIN_MTU || mtu > RTE_ETHER_MAX_JUMBO_FRAME_LEN ||
+                SCConfGetChildValueWithDefault(
+                        if_root, if_default, dpdk_yaml.mbuf_size, &entry_str) != 1 ||
+                StringParseUint16(&mbuf_size, 10, 0, entry_str) < 0) {
+            // invalid values are reported when the port is configured
+            continue;
+        }
+
+        const uint16_t frame_size = MbufFrameSizeCalculate((uint16_t)mtu);
+        if (mbuf_size < frame_size && frame_size > max_frame_size)
+            max_frame_size = frame_size;
+    }
+
+    if (max_frame_size > default_packet_size) {
+        SCLogConfig("default-packet-size set to %" PRIu32 " for multi-segment mbufs",
+                max_frame_size);
+        default_packet_size = max_frame_size;
+    }
+}
+
 static int ConfigSetLinkupTimeout(DPDKIfaceConfig *iconf, intmax_t entry_int)
 {
     SCEnter();
@@ -787,6 +900,14 @@ static void ConfigSetVlanStrip(DPDKIfaceConfig *iconf, int entry_bool)
     SCReturn;
 }
 
+static void ConfigSetBypass(DPDKIfaceConfig *iconf, int entry_bool)
+{
+    SCEnter();
+    if (entry_bool)
+        iconf->flags |= DPDK_BYPASS;
+    SCReturn;
+}
+
 static int ConfigSetCopyIface(DPDKIfaceConfig *iconf, const char *entry_str)
 {
     SCEnter();
@@ -860,6 +981,14 @@ static int ConfigSetCopyIfaceSettings(DPDKIfaceConfig *iconf, const char *iface,
         SCReturnInt(-EINVAL);
     }
 
+    if (RunmodeIsAutofp()) {
+        // packets are released by the worker threads, these cannot share the TX queue
+        // of the receive thread
+        SCLogError("%s: copy mode \"%s\" is supported only in the workers runmode", iconf->iface,
+                mode);
+        SCReturnInt(-ENOTSUP);
+    }
+
     SCReturnInt(0);
 }
 
@@ -967,6 +1096,13 @@ static int ConfigLoad(DPDKIfaceConfig *iconf, const char *iface)
     if (retval < 0)
         SCReturnInt(retval);
 
+    retval = SCConfGetChildValueWithDefault(
+                     if_root, if_default, dpdk_yaml.mbuf_size, &entry_str) != 1
+                     ? ConfigSetMbufSize(iconf, DPDK_CONFIG_DEFAULT_MBUF_SIZE)
+                     : ConfigSetMbufSize(iconf, entry_str);
+    if (retval < 0)
+        SCReturnInt(retval);
+
     retval = SCConfGetChildValueWithDefault(if_root, if_default, dpdk_yaml.rss_hf, &entry_str) != 1
                      ? ConfigSetRSSHashFunctions(iconf, NULL)
                      : ConfigSetRSSHashFunctions(iconf, entry_str);
@@ -1027,6 +1163,13 @@ static int ConfigLoad(DPDKIfaceConfig *iconf, const char *iface)
     if (retval < 0)
         SCReturnInt(retval);
 
+    retval = SCConfGetChildValueBoolWithDefault(if_root, if_default, dpdk_yaml.bypass, &entry_bool);
+    if (retval != 1) {
+        ConfigSetBypass(iconf, DPDK_CONFIG_DEFAULT_BYPASS);
+    } else {
+        ConfigSetBypass(iconf, entry_bool);
+    }
+
     SCReturnInt(0);
 }
 
@@ -1035,13 +1178,13 @@ static bool ConfigThreadsGenericIsValid(uint16_t iface_threads, ThreadsAffinityT
     static uint32_t total_cpus = 0;
     total_cpus += iface_threads;
     if (wtaf == NULL) {
-        SCLogError("Specify worker-cpu-set list in the threading section");
+        SCLogError("Specify %s list in the threading section", ConfigThreadsCpuSetName());
         return false;
     }
     if (total_cpus > UtilAffinityGetAffinedCPUNum(wtaf)) {
-        SCLogError("Interfaces requested more cores than configured in the worker-cpu-set "
+        SCLogError("Interfaces requested more cores than configured in the %s "
                    "threading section (requested %d configured %d",
-                total_cpus, UtilAffinityGetAffinedCPUNum(wtaf));
+                ConfigThreadsCpuSetName(), total_cpus, UtilAffinityGetAffinedCPUNum(wtaf));
         return false;
     }
 
@@ -1062,8 +1205,8 @@ static bool ConfigThreadsInterfaceIsValid(uint16_t iface_threads, ThreadsAffinit
 
 static bool ConfigIsThreadingValid(uint16_t iface_threads, const char *iface)
 {
-    ThreadsAffinityType *itaf = GetAffinityTypeForNameAndIface("worker-cpu-set", iface);
-    ThreadsAffinityType *wtaf = GetAffinityTypeForNameAndIface("worker-cpu-set", NULL);
+    ThreadsAffinityType *itaf = GetAffinityTypeForNameAndIface(ConfigThreadsCpuSetName(), iface);
+    ThreadsAffinityType *wtaf = GetAffinityTypeForNameAndIface(ConfigThreadsCpuSetName(), NULL);
     if (itaf && !ConfigThreadsInterfaceIsValid(iface_threads, itaf)) {
         return false;
     } else if (itaf == NULL && !ConfigThreadsGenericIsValid(iface_threads, wtaf)) {
@@ -1305,6 +1448,23 @@ static int DeviceValidateMTU(const DPDKIfaceConfig *iconf, const struct rte_eth_
         SCReturnInt(-ERANGE);
     }
 
+    if (iconf->flags & DPDK_MULTI_SEG) {
+        if (!(dev_info->rx_offload_capa & RTE_ETH_RX_OFFLOAD_SCATTER)) {
+            SCLogError("%s: mbuf size %" PRIu16 " is too small for MTU %" PRIu16
+                       " and the device does not support RX scatter",
+                    iconf->iface, iconf->mbuf_size, iconf->mtu);
+            SCReturnInt(-EINVAL);
+        }
+        // in IPS mode the chained mbufs of the copy interface are sent from our port
+        if (iconf->copy_mode != DPDK_COPY_MODE_NONE &&
+                !(dev_info->tx_offload_capa & RTE_ETH_TX_OFFLOAD_MULTI_SEGS)) {
+            SCLogError("%s: mbuf size %" PRIu16 " is too small for MTU %" PRIu16
+                       " and the device cannot send multi-segment mbufs",
+                    iconf->iface, iconf->mbuf_size, iconf->mtu);
+            SCReturnInt(-EINVAL);
+        }
+    }
+
 #if RTE_VERSION < RTE_VERSION_NUM(21, 11, 0, 0)
     // check if jumbo frames are set and are available
     if (iconf->mtu > RTE_ETHER_MAX_LEN &&
@@ -1432,7 +1592,14 @@ static void DeviceInitPortConf(const DPDKIfaceConfig *iconf,
     DeviceSetMTU(port_conf, iconf->mtu);
     PortConfSetVlanOffload(iconf, dev_info, port_conf);
 
-    if (dev_info->tx_offload_capa & RTE_ETH_TX_OFFLOAD_MBUF_FAST_FREE) {
+    if (iconf->flags & DPDK_MULTI_SEG) {
+        SCLogConfig("%s: multi-segment mbufs enabled", iconf->iface);
+        port_conf->rxmode.offloads |= RTE_ETH_RX_OFFLOAD_SCATTER;
+        if (iconf->copy_mode != DPDK_COPY_MODE_NONE) {
+            port_conf->txmode.offloads |= RTE_ETH_TX_OFFLOAD_MULTI_SEGS;
+        }
+    } else if (dev_info->tx_offload_capa & RTE_ETH_TX_OFFLOAD_MBUF_FAST_FREE) {
+        // fast free is only safe for single segment mbufs
         port_conf->txmode.offloads |= RTE_ETH_TX_OFFLOAD_MBUF_FAST_FREE;
     }
 }
@@ -1450,9 +1617,7 @@ static int DeviceConfigureQueues(DPDKIfaceConfig *iconf, const struct rte_eth_de
         goto cleanup;
     }
 
-    // +4 for VLAN header
-    uint16_t mtu_size = iconf->mtu + RTE_ETHER_CRC_LEN + RTE_ETHER_HDR_LEN + 4;
-    uint16_t mbuf_size = ROUNDUP(mtu_size, 1024) + RTE_PKTMBUF_HEADROOM;
+    uint16_t mbuf_size = iconf->mbuf_size + RTE_PKTMBUF_HEADROOM;
     // ceil the div so e.g. mp_size of 262144 and 262143 both lead to 65535 on 4 rx queues
     uint32_t q_mp_sz = (iconf->mempool_size + iconf->nb_rx_queues - 1) / iconf->nb_rx_queues - 1;
     uint32_t q_mp_cache_sz = MempoolCacheSizeCalculate(q_mp_sz);
@@ -1552,6 +1717,13 @@ static int DeviceValidateOutIfaceConfig(DPDKIfaceConfig *iconf)
                 iconf->iface, iconf->mtu, out_iconf->iface, out_iconf->mtu);
         out_iconf->DerefFunc(out_iconf);
         SCReturnInt(-EINVAL);
+    } else if ((iconf->flags & DPDK_MULTI_SEG) != (out_iconf->flags & DPDK_MULTI_SEG)) {
+        SCLogError("%s: multi-segment mbufs are %s but %s on copy interface %s"
+                   " - mbuf-size must allow for the same",
+                iconf->iface, iconf->flags & DPDK_MULTI_SEG ? "enabled" : "disabled",
+                out_iconf->flags & DPDK_MULTI_SEG ? "enabled" : "disabled", out_iconf->iface);
+        out_iconf->DerefFunc(out_iconf);
+        SCReturnInt(-EINVAL);
     } else if (iconf->copy_mode != out_iconf->copy_mode) {
         SCLogError("%s: copy modes of interfaces %s and %s are not equal", iconf->iface,
                 iconf->iface, out_iconf->iface);
@@ -1609,6 +1781,56 @@ static int DeviceConfigureIPS(DPDKIfaceConfig *iconf)
     SCReturnInt(0);
 }
 
+/**
+ * \brief Ask the PMD to deliver the rte_flow marks in the mbufs
+ *
+ * Needed for the mark rules used to bypass flows in TAP/IPS mode. Must be
+ * called before the device is configured.
+ */
+static void DeviceNegotiateBypassMark(DPDKIfaceConfig *iconf)
+{
+    SCEnter();
+    if (!(iconf->flags & DPDK_BYPASS) || iconf->copy_mode == DPDK_COPY_MODE_NONE)
+        SCReturn;
+
+#if RTE_VERSION >= RTE_VERSION_NUM(21, 11, 0, 0)
+    uint64_t features = RTE_ETH_RX_METADATA_USER_MARK;
+    int retval = rte_eth_rx_metadata_negotiate(iconf->port_id, &features);
+    // -ENOTSUP means the PMD delivers the metadata without negotiation
+    if (retval != -ENOTSUP && (retval != 0 || !(features & RTE_ETH_RX_METADATA_USER_MARK))) {
+        SCLogWarning("%s: unable to receive rte_flow marks, disabling bypass offload",
+                iconf->iface);
+        iconf->flags &= ~DPDK_BYPASS;
+    }
+#endif /* RTE_VERSION >= RTE_VERSION_NUM(21, 11, 0, 0) */
+    SCReturn;
+}
+
+/**
+ * \brief Check the device accepts the rte_flow rules of the bypass offload
+ *
+ * Flows are bypassed locally on devices without rte_flow support.
+ */
+static void DeviceValidateBypass(DPDKIfaceConfig *iconf)
+{
+    SCEnter();
+    if (!(iconf->flags & DPDK_BYPASS))
+        SCReturn;
+
+    bool mark = iconf->copy_mode != DPDK_COPY_MODE_NONE;
+    int retval = DPDKBypassProbe(iconf->port_id, iconf->iface, mark);
+    if (retval != 0) {
+        SCLogWarning("%s: rte_flow %s rules are not supported (%s), bypassed flows will not be "
+                     "offloaded",
+                iconf->iface, mark ? "mark" : "drop", rte_strerror(-retval));
+        iconf->flags &= ~DPDK_BYPASS;
+        SCReturn;
+    }
+    SCLogConfig("%s: bypassed flows are offloaded with rte_flow %s rules", iconf->iface,
+            mark ? "mark" : "drop");
+    SCReturn;
+}
+
 /**
  * Function verifies changes in e.g. device info after configuration has
  * happened. Sometimes (e.g. DPDK Bond PMD with Intel NICs i40e/ixgbe) change
@@ -1695,6 +1917,8 @@ static int DeviceConfigure(DPDKIfaceConfig *iconf)
         iconf->checksum_mode = CHECKSUM_VALIDATION_OFFLOAD;
     }
 
+    DeviceNegotiateBypassMark(iconf);
+
     retval = rte_eth_dev_configure(
             iconf->port_id, iconf->nb_rx_queues, iconf->nb_tx_queues, &port_conf);
     if (retval < 0) {
@@ -1786,6 +2010,8 @@ static int DeviceConfigure(DPDKIfaceConfig *iconf)
         SCReturnInt(retval);
     }
 
+    DeviceValidateBypass(iconf);
+
     SCReturnInt(0);
 }
 
@@ -1937,6 +2163,11 @@ void RunModeDpdkRegister(void)
             "Workers DPDK mode, each thread does all"
             " tasks from acquisition to logging",
             RunModeIdsDpdkWorkers, DPDKRunModeEnableIPS);
+    RunModeRegisterNewRunMode(RUNMODE_DPDK, "autofp",
+            "Multi threaded DPDK mode. Receive threads "
+            "decode packets, packets from each flow are "
+            "assigned to a single detect thread",
+            RunModeIdsDpdkAutoFp, NULL);
 }
 
 /**
@@ -1954,6 +2185,7 @@ int RunModeIdsDpdkWorkers(void)
     TimeModeSetLive();
 
     InitEal();
+    DPDKSetDefaultPacketSize();
     ret = RunModeSetLiveCaptureWorkers(ParseDpdkConfigAndConfigureDevice, DPDKConfigGetThreadsCount,
             "ReceiveDPDK", "DecodeDPDK", thread_name_workers, NULL);
     if (ret != 0) {
@@ -1966,6 +2198,34 @@ int RunModeIdsDpdkWorkers(void)
     SCReturnInt(0);
 }
 
+/**
+ * \brief Autofp version of the DPDK processing.
+ *
+ * Receive threads poll the RX queues and decode the packets, then pass them
+ * to the detect threads through the flow queue handler.
+ */
+int RunModeIdsDpdkAutoFp(void)
+{
+    SCEnter();
+#ifdef HAVE_DPDK
+    int ret;
+
+    TimeModeSetLive();
+
+    InitEal();
+    DPDKSetDefaultPacketSize();
+    ret = RunModeSetLiveCaptureAutoFp(ParseDpdkConfigAndConfigureDevice,
+            DPDKConfigGetThreadsCount, "ReceiveDPDK", "DecodeDPDK", thread_name_autofp, NULL);
+    if (ret != 0) {
+        FatalError("Unable to start runmode");
+    }
+
+    SCLogDebug("RunModeIdsDpdkAutoFp initialised");
+
+#endif /* HAVE_DPDK */
+    SCReturnInt(0);
+}
+
 /**
  * @}
  */
@@ -45,6 +45,10 @@ void RunModeFilePcapRegister(void)
             "Multi-threaded pcap file mode. Packets from each flow are assigned to a consistent "
             "detection thread",
             RunModeFilePcapAutoFp, NULL);
+    RunModeRegisterNewRunMode(RUNMODE_PCAP_FILE, "workers",
+            "Multi-threaded pcap file mode. Each worker reads the input and processes "
+            "the packets of its share of the IP pairs",
+            RunModeFilePcapWorkers, NULL);
 }
 
 /**
@@ -100,6 +104,81 @@ int RunModeFilePcapSingle(void)
     return 0;
 }
 
+/**
+ * \brief RunModeFilePcapWorkers sets up a number of worker threads that each
+ *        read the full input, but only decode and inspect the packets whose
+ *        IP pair maps to their shard. This avoids the single reader and the
+ *        packet hand off of autofp, at the cost of every thread going over
+ *        all the packet headers.
+ *
+ * \retval 0 If all goes well. (If any problem is detected the engine will
+ *           exit()).
+ */
+int RunModeFilePcapWorkers(void)
+{
+    SCEnter();
+    char tname[TM_THREAD_NAME_MAX];
+
+    const char *file = NULL;
+    if (SCConfGet("pcap-file.file", &file) == 0) {
+        FatalError("Failed retrieving pcap-file from Conf");
+    }
+    SCLogDebug("file %s", file);
+
+    TimeModeSetOffline();
+
+    PcapFileGlobalInit();
+
+    /* always create at least one thread */
+    int thread_max = TmThreadGetNbThreads(WORKER_CPU_SET);
+    if (thread_max == 0)
+        thread_max = UtilCpuGetNumProcessorsOnline() * threading_detect_ratio;
+    if (thread_max < 1)
+        thread_max = 1;
+    if (thread_max > 1024)
+        thread_max = 1024;
+
+    PcapFileSetShards((uint16_t)thread_max);
+
+    for (int thread = 0; thread < thread_max; thread++) {
+        snprintf(tname, sizeof(tname), "%s#%02d", thread_name_workers, thread + 1);
+
+        ThreadVars *tv = TmThreadCreatePacketHandler(tname,
+                "packetpool", "packetpool",
+                "packetpool", "packetpool",
+                "pktacqloop");
+        if (tv == NULL) {
+            FatalError("threading setup failed");
+        }
+
+        TmModule *tm_module = TmModuleGetByName("ReceivePcapFile");
+        if (tm_module == NULL) {
+            FatalError("TmModuleGetByName failed for ReceivePcap");
+        }
+        TmSlotSetFuncAppend(tv, tm_module, file);
+
+        tm_module = TmModuleGetByName("DecodePcapFile");
+        if (tm_module == NULL) {
+            FatalError("TmModuleGetByName DecodePcap failed");
+        }
+        TmSlotSetFuncAppend(tv, tm_module, NULL);
+
+        tm_module = TmModuleGetByName("FlowWorker");
+        if (tm_module == NULL) {
+            FatalError("TmModuleGetByName for FlowWorker failed");
+        }
+        TmSlotSetFuncAppend(tv, tm_module, NULL);
+
+        TmThreadSetCPU(tv, WORKER_CPU_SET);
+
+        if (TmThreadSpawn(tv) != TM_ECODE_OK) {
+            FatalError("TmThreadSpawn failed");
+        }
+    }
+
+    return 0;
+}
+
 /**
  * \brief RunModeFilePcapAutoFp set up the following thread packet handlers:
  *        - Receive thread (from pcap file)
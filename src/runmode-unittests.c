@@ -29,6 +29,7 @@
 #include "detect-parse.h"
 #include "detect-engine.h"
 #include "detect-engine-alert.h"
+#include "detect-engine-sampling.h"
 #include "detect-engine-address.h"
 #include "detect-engine-proto.h"
 #include "detect-engine-port.h"
@@ -92,6 +93,9 @@
 #include "util-proto-name.h"
 #include "util-macset.h"
 #include "util-flow-rate.h"
+#include "util-latency.h"
+#include "util-cpu-ticks.h"
+#include "util-flow-cost.h"
 #include "util-memrchr.h"
 
 #include "util-mpm-ac.h"
@@ -204,12 +208,16 @@ static void RegisterUnittests(void)
     DetectProtoTests();
     DetectPortTests();
     DetectEngineAlertRegisterTests();
+    RuleSamplingRegisterTests();
     SCAtomicRegisterTests();
     MemrchrRegisterTests();
     AppLayerUnittestsRegister();
     StreamingBufferRegisterTests();
     MacSetRegisterTests();
     FlowRateRegisterTests();
+    PacketLatencyRegisterTests();
+    CpuTicksRegisterTests();
+    FlowCostRegisterTests();
 #ifdef OS_WIN32
     Win32SyscallRegisterTests();
 #endif
@@ -171,6 +171,9 @@ TmEcode NoAFPSupportExit(ThreadVars *tv, const void *initdata, void **data)
 #define AFP_RECONNECT_TIMEOUT 500000
 #define AFP_DOWN_COUNTER_INTERVAL 40
 
+/* max number of packets of a TPACKET_V3 block set up before processing them */
+#define AFP_V3_BATCH_SIZE 32
+
 #define POLL_TIMEOUT 100
 
 /* kernel flags defined for RX ring tp_status */
@@ -954,11 +957,16 @@ static inline void AFPFlushBlock(struct tpacket_block_desc *pbd)
     pbd->hdr.bh1.block_status = TP_STATUS_KERNEL;
 }
 
-static inline int AFPParsePacketV3(AFPThreadVars *ptv, struct tpacket_block_desc *pbd, struct tpacket3_hdr *ppd)
+/** \internal
+ *  \brief set up a packet from a TPACKET_V3 frame, without processing it
+ *
+ *  \retval p the packet or NULL if no packet could be allocated
+ */
+static inline Packet *AFPSetupPacketV3(AFPThreadVars *ptv, struct tpacket3_hdr *ppd)
 {
     Packet *p = PacketGetFromQueueOrAlloc();
     if (p == NULL) {
-        SCReturnInt(AFP_SURI_FAILURE);
+        return NULL;
     }
     PKT_SET_SRC(p, PKT_SRC_WIRE);
 
@@ -1009,39 +1017,75 @@ static inline int AFPParsePacketV3(AFPThreadVars *ptv, struct tpacket_block_desc
         }
     }
 
-    if (TmThreadsSlotProcessPkt(ptv->tv, ptv->slot, p) != TM_ECODE_OK) {
-        SCReturnInt(AFP_SURI_FAILURE);
-    }
+    return p;
+}
 
-    SCReturnInt(AFP_READ_OK);
+/** \internal
+ *  \brief run a batch of packets through the slots
+ *
+ *  While a packet is processed the Packet and the start of the frame data
+ *  of the next one are prefetched.
+ */
+static inline void AFPProcessBatchV3(AFPThreadVars *ptv, Packet **batch, const int cnt)
+{
+    for (int i = 0; i < cnt; i++) {
+        if (i + 1 < cnt) {
+            const Packet *next = batch[i + 1];
+            prefetch(next);
+            prefetch(GET_PKT_DATA(next));
+            prefetch(GET_PKT_DATA(next) + 64);
+        }
+        if (TmThreadsSlotProcessPkt(ptv->tv, ptv->slot, batch[i]) != TM_ECODE_OK) {
+            /* Internal error but let's just continue and
+             * treat the next packet */
+            SCLogDebug("failed to process packet %d of the batch", i);
+        }
+    }
 }
 
+/** \internal
+ *  \brief process the frames of a block
+ *
+ *  The frames are handled in batches: the packets of up to
+ *  AFP_V3_BATCH_SIZE frames are set up first, prefetching the header of the
+ *  next frame, then the batch is run through the slots. This keeps the setup
+ *  code hot in the cache and lets the frame headers load while the previous
+ *  packet is handled.
+ */
 static inline int AFPWalkBlock(AFPThreadVars *ptv, struct tpacket_block_desc *pbd)
 {
     const int num_pkts = pbd->hdr.bh1.num_pkts;
     uint8_t *ppd = (uint8_t *)pbd + pbd->hdr.bh1.offset_to_first_pkt;
+    Packet *batch[AFP_V3_BATCH_SIZE];
+    int cnt = 0;
 
     for (int i = 0; i < num_pkts; ++i) {
+        struct tpacket3_hdr *hdr = (struct tpacket3_hdr *)ppd;
+        ppd = ppd + hdr->tp_next_offset;
+        if (i + 1 < num_pkts) {
+            prefetch(ppd);
+        }
+
         const struct sockaddr_ll *sll =
-                (const struct sockaddr_ll *)(ppd + TPACKET_ALIGN(sizeof(struct tpacket3_hdr)));
+                (const struct sockaddr_ll *)((uint8_t *)hdr +
+                                             TPACKET_ALIGN(sizeof(struct tpacket3_hdr)));
         if (unlikely(AFPShouldIgnoreFrame(ptv, sll))) {
-            ppd = ppd + ((struct tpacket3_hdr *)ppd)->tp_next_offset;
             continue;
         }
-        int ret = AFPParsePacketV3(ptv, pbd, (struct tpacket3_hdr *)ppd);
-        switch (ret) {
-            case AFP_READ_OK:
-                break;
-            case AFP_SURI_FAILURE:
-                /* Internal error but let's just continue and
-                 * treat thenext packet */
-                break;
-            case AFP_READ_FAILURE:
-                SCReturnInt(AFP_READ_FAILURE);
-            default:
-                SCReturnInt(ret);
+        Packet *p = AFPSetupPacketV3(ptv, hdr);
+        if (unlikely(p == NULL)) {
+            /* Internal error but let's just continue and
+             * treat the next packet */
+            continue;
+        }
+        batch[cnt++] = p;
+        if (cnt == AFP_V3_BATCH_SIZE) {
+            AFPProcessBatchV3(ptv, batch, cnt);
+            cnt = 0;
         }
-        ppd = ppd + ((struct tpacket3_hdr *)ppd)->tp_next_offset;
+    }
+    if (cnt > 0) {
+        AFPProcessBatchV3(ptv, batch, cnt);
     }
 
     SCReturnInt(AFP_READ_OK);
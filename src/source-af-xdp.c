@@ -33,6 +33,8 @@
 #include "suricata-common.h"
 #include "suricata.h"
 #include "decode.h"
+#include "packet.h"
+#include "action-globals.h"
 #include "packet-queue.h"
 #include "threads.h"
 #include "threadvars.h"
@@ -120,15 +122,34 @@ TmEcode NoAFXDPSupportExit(ThreadVars *tv, const void *initdata, void **data)
 #define FRAME_SIZE        XSK_UMEM__DEFAULT_FRAME_SIZE
 #define MEM_BYTES         (NUM_FRAMES * FRAME_SIZE * 2)
 #define RECONNECT_TIMEOUT 500000
+/* max descriptors taken from the RX ring per poll, unless busy polling
+ * is enabled: then the busy poll budget is used */
+#define AFXDP_RX_BATCH 64
+/* frames that can be queued on the peer's TX ring or wait for completion */
+#define AFXDP_TX_INFLIGHT (NUM_FRAMES_PROD + NUM_FRAMES_CONS)
 
 /* Interface state */
 enum state { AFXDP_STATE_DOWN, AFXDP_STATE_UP };
 
 struct XskInitProtect {
     SCMutex queue_protect;
-    SC_ATOMIC_DECLARE(uint8_t, queue_num);
 } xsk_protect;
 
+/* UMEM shared by the sockets of all queues of an interface */
+typedef struct AFXDPSharedUmem_ {
+    char iface[AFXDP_IFACE_NAME_LENGTH];
+    void *buf;
+    uint64_t size;
+    struct xsk_umem *umem;
+    /* number of sockets that got a slice of the frames */
+    uint32_t slices;
+    uint32_t refcnt;
+    TAILQ_ENTRY(AFXDPSharedUmem_) next;
+} AFXDPSharedUmem;
+
+static TAILQ_HEAD(, AFXDPSharedUmem_) shared_umems = TAILQ_HEAD_INITIALIZER(shared_umems);
+static SCMutex shared_umem_lock = SCMUTEX_INITIALIZER;
+
 struct UmemInfo {
     void *buf;
     struct xsk_umem *umem;
@@ -136,6 +157,15 @@ struct UmemInfo {
     struct xsk_ring_cons cq;
     struct xsk_umem_config cfg;
     int mmap_alignment_flag;
+
+    /* set if the UMEM is shared with the other queues of the interface */
+    AFXDPSharedUmem *shared;
+    /* offset of this socket's slice of frames in the UMEM */
+    uint64_t frame_base;
+
+    /* frames released by the engine, not yet back on the fill ring */
+    uint64_t *stash;
+    uint32_t stash_cnt;
 };
 
 struct QueueAssignment {
@@ -156,10 +186,49 @@ struct XskSockInfo {
     bool enable_busy_poll;
     uint32_t busy_poll_time;
     uint32_t busy_poll_budget;
+    uint32_t rx_batch;
 
     struct pollfd fd;
 };
 
+/**
+ * \brief Socket of a capture thread in copy mode
+ *
+ * Thread N of an interface is peered with thread N of the copy interface:
+ * it puts the frames it forwards on the TX ring of the peer's socket and
+ * takes them back from the peer's completion ring. Both sockets are bound
+ * to the same UMEM, so frames are forwarded without a copy.
+ */
+typedef struct AFXDPPeer_ {
+    char iface[AFXDP_IFACE_NAME_LENGTH];
+    char out_iface[AFXDP_IFACE_NAME_LENGTH];
+    uint32_t queue_num;
+    SC_ATOMIC_DECLARE(uint8_t, state);
+    /* thread vars owning the socket */
+    struct AFXDPThreadVars_ *ptv;
+    /* set when the thread is gone, its socket is kept until the peer is
+     * gone too as the peer writes to it */
+    bool done;
+    /* held by the peer's thread while it uses the socket's TX and
+     * completion rings, and by the thread while it replaces the socket */
+    SCMutex sock_protect;
+    /* bumped when the socket is closed: frames the peer had queued on it
+     * will never complete */
+    uint32_t sock_gen;
+    struct AFXDPPeer_ *peer;
+    TAILQ_ENTRY(AFXDPPeer_) next;
+} AFXDPPeer;
+
+typedef struct AFXDPPeersList_ {
+    TAILQ_HEAD(, AFXDPPeer_) peers;
+    SCMutex lock;
+    int cnt;
+    int peered;
+} AFXDPPeersList;
+
+static AFXDPPeersList peerslist = { .peers = TAILQ_HEAD_INITIALIZER(peerslist.peers),
+    .lock = SCMUTEX_INITIALIZER };
+
 /**
  * \brief Structure to hold thread specific variables.
  */
@@ -182,6 +251,21 @@ typedef struct AFXDPThreadVars_ {
     uint32_t napi_defer_hard_irqs;
     uint32_t prog_id;
 
+    /* copy mode */
+    uint8_t copy_mode;
+    char out_iface[AFXDP_IFACE_NAME_LENGTH];
+    AFXDPPeer *mpeer;
+    /* frames put on the peer's TX ring since the last kick */
+    uint32_t tx_pending;
+    uint64_t tx_failed;
+    /* frames given to the peer's socket and not completed yet, oldest
+     * first. Completions come in the same order. */
+    uint64_t *tx_inflight;
+    uint32_t tx_inflight_head;
+    uint32_t tx_inflight_cnt;
+    /* sock_gen of the peer when the in-flight frames were queued */
+    uint32_t tx_gen;
+
     /* Handle state */
     uint8_t afxdp_state;
 
@@ -196,6 +280,7 @@ typedef struct AFXDPThreadVars_ {
     uint16_t capture_afxdp_empty_reads;
     uint16_t capture_afxdp_failed_reads;
     uint16_t capture_afxdp_acquire_pkt_failed;
+    uint16_t capture_afxdp_tx_failed;
 } AFXDPThreadVars;
 
 static TmEcode ReceiveAFXDPThreadInit(ThreadVars *, const void *, void **);
@@ -251,6 +336,8 @@ static inline void AFXDPDumpCounters(AFXDPThreadVars *ptv)
         StatsAddUI64(ptv->tv, ptv->capture_kernel_drops,
                 rx_dropped - StatsGetLocalCounterValue(ptv->tv, ptv->capture_kernel_drops));
         StatsAddUI64(ptv->tv, ptv->capture_afxdp_packets, ptv->pkts);
+        if (ptv->copy_mode != AFXDP_COPY_MODE_NONE)
+            StatsAddUI64(ptv->tv, ptv->capture_afxdp_tx_failed, ptv->tx_failed);
 
         (void)SC_ATOMIC_SET(ptv->livedev->drop, rx_dropped);
         (void)SC_ATOMIC_ADD(ptv->livedev->pkts, ptv->pkts);
@@ -260,6 +347,7 @@ static inline void AFXDPDumpCounters(AFXDPThreadVars *ptv)
                 ptv->bytes, StatsGetLocalCounterValue(ptv->tv, ptv->capture_kernel_drops));
 
         ptv->pkts = 0;
+        ptv->tx_failed = 0;
     }
 }
 
@@ -278,15 +366,19 @@ TmEcode AFXDPQueueProtectionInit(void)
     SCEnter();
 
     SCMutexInit(&xsk_protect.queue_protect, NULL);
-    SC_ATOMIC_SET(xsk_protect.queue_num, 0);
     SCReturnInt(TM_ECODE_OK);
 }
 
-static TmEcode AFXDPAssignQueueID(AFXDPThreadVars *ptv)
+/**
+ * \brief Bind the socket to the next queue of its interface
+ *
+ * Queues are counted per interface, so thread N of each interface ends up
+ * on queue N.
+ */
+static TmEcode AFXDPAssignQueueID(AFXDPThreadVars *ptv, AFXDPIfaceConfig *afxdpconfig)
 {
     if (!ptv->xsk.queue.assigned) {
-        ptv->xsk.queue.queue_num = SC_ATOMIC_GET(xsk_protect.queue_num);
-        SC_ATOMIC_ADD(xsk_protect.queue_num, 1);
+        ptv->xsk.queue.queue_num = SC_ATOMIC_ADD(afxdpconfig->queue_num, 1);
 
         /* Queue only needs assigned once, on startup */
         ptv->xsk.queue.assigned = true;
@@ -294,6 +386,148 @@ static TmEcode AFXDPAssignQueueID(AFXDPThreadVars *ptv)
     SCReturnInt(TM_ECODE_OK);
 }
 
+static void AFXDPThreadVarsFree(AFXDPThreadVars *ptv);
+
+/**
+ * \brief Init the global list of ::AFXDPPeer
+ */
+TmEcode AFXDPPeersListInit(void)
+{
+    SCEnter();
+    SCMutexLock(&peerslist.lock);
+    peerslist.cnt = 0;
+    peerslist.peered = 0;
+    SCMutexUnlock(&peerslist.lock);
+    SCReturnInt(TM_ECODE_OK);
+}
+
+/**
+ * \brief Check that all ::AFXDPPeer got a peer
+ *
+ * \retval TM_ECODE_FAILED if some threads are not peered or TM_ECODE_OK else.
+ */
+TmEcode AFXDPPeersListCheck(void)
+{
+#define AFXDP_PEERS_MAX_TRY 4
+#define AFXDP_PEERS_WAIT    20000
+    SCEnter();
+    for (int try = 0; try < AFXDP_PEERS_MAX_TRY; try++) {
+        SCMutexLock(&peerslist.lock);
+        const bool all_peered = peerslist.cnt == peerslist.peered;
+        SCMutexUnlock(&peerslist.lock);
+        if (all_peered) {
+            SCReturnInt(TM_ECODE_OK);
+        }
+        usleep(AFXDP_PEERS_WAIT);
+    }
+    SCLogError("af-xdp: copy interfaces need the same number of threads");
+    SCReturnInt(TM_ECODE_FAILED);
+}
+
+/**
+ * \brief Declare a copy mode thread to the peers list and pair it with the
+ * thread of the same queue on the copy interface.
+ */
+static TmEcode AFXDPPeersListAdd(AFXDPThreadVars *ptv, const char *out_iface)
+{
+    SCEnter();
+    AFXDPPeer *peer = SCCalloc(1, sizeof(AFXDPPeer));
+    if (unlikely(peer == NULL)) {
+        SCReturnInt(TM_ECODE_FAILED);
+    }
+    strlcpy(peer->iface, ptv->iface, sizeof(peer->iface));
+    strlcpy(peer->out_iface, out_iface, sizeof(peer->out_iface));
+    peer->queue_num = ptv->xsk.queue.queue_num;
+    peer->ptv = ptv;
+    SCMutexInit(&peer->sock_protect, NULL);
+    SC_ATOMIC_INIT(peer->state);
+    (void)SC_ATOMIC_SET(peer->state, ptv->afxdp_state);
+    ptv->mpeer = peer;
+
+    SCMutexLock(&peerslist.lock);
+    TAILQ_INSERT_TAIL(&peerslist.peers, peer, next);
+    peerslist.cnt++;
+
+    AFXDPPeer *pitem;
+    TAILQ_FOREACH (pitem, &peerslist.peers, next) {
+        if (pitem->peer || pitem == peer)
+            continue;
+        if (strcmp(pitem->iface, peer->out_iface) != 0 || pitem->queue_num != peer->queue_num)
+            continue;
+        if (pitem->ptv->umem.umem != ptv->umem.umem) {
+            SCLogError("%s: umem is not shared with %s", ptv->iface, pitem->iface);
+            break;
+        }
+        peer->peer = pitem;
+        pitem->peer = peer;
+        peerslist.peered += 2;
+        SCLogDebug("%s queue %u peered with %s", peer->iface, peer->queue_num, pitem->iface);
+        break;
+    }
+    SCMutexUnlock(&peerslist.lock);
+
+    SCReturnInt(TM_ECODE_OK);
+}
+
+static bool AFXDPPeerIsReady(AFXDPPeer *peer)
+{
+    SCMutexLock(&peerslist.lock);
+    const bool ready = peer->peer != NULL;
+    SCMutexUnlock(&peerslist.lock);
+    return ready;
+}
+
+/**
+ * \brief Mark the thread's peer entry as gone
+ *
+ * \retval true if the peer still runs: the thread vars are then freed
+ *         with the peer's
+ */
+static bool AFXDPPeerRelease(AFXDPThreadVars *ptv)
+{
+    AFXDPPeer *peer = ptv->mpeer;
+    AFXDPThreadVars *other = NULL;
+    bool keep = false;
+
+    SCMutexLock(&peerslist.lock);
+    (void)SC_ATOMIC_SET(peer->state, AFXDP_STATE_DOWN);
+    peer->done = true;
+    if (peer->peer != NULL) {
+        if (!peer->peer->done) {
+            keep = true;
+        } else {
+            /* peer left its socket for us to close */
+            other = peer->peer->ptv;
+            peer->peer->ptv = NULL;
+        }
+    }
+    if (!keep) {
+        peer->ptv = NULL;
+    }
+    SCMutexUnlock(&peerslist.lock);
+
+    if (other != NULL) {
+        AFXDPThreadVarsFree(other);
+    }
+    return keep;
+}
+
+/**
+ * \brief Clean the global peers list.
+ */
+void AFXDPPeersListClean(void)
+{
+    AFXDPPeer *pitem;
+
+    SCMutexLock(&peerslist.lock);
+    while ((pitem = TAILQ_FIRST(&peerslist.peers))) {
+        TAILQ_REMOVE(&peerslist.peers, pitem, next);
+        SCMutexDestroy(&pitem->sock_protect);
+        SCFree(pitem);
+    }
+    SCMutexUnlock(&peerslist.lock);
+}
+
 static void AFXDPAllThreadsRunning(AFXDPThreadVars *ptv)
 {
     SCMutexLock(&xsk_protect.queue_protect);
@@ -303,13 +537,106 @@ static void AFXDPAllThreadsRunning(AFXDPThreadVars *ptv)
     SCMutexUnlock(&xsk_protect.queue_protect);
 }
 
-static TmEcode AcquireBuffer(AFXDPThreadVars *ptv)
+/**
+ * \brief get a slice of the interface's shared UMEM buffer
+ *
+ * The first thread of the interface maps the buffer for all of them, each
+ * socket gets MEM_BYTES of it for its initial fill ring. In copy mode the
+ * UMEM is also shared with the threads of the copy interface.
+ */
+static TmEcode AcquireSharedBuffer(AFXDPThreadVars *ptv)
+{
+    SCMutexLock(&shared_umem_lock);
+    AFXDPSharedUmem *shared = NULL;
+    TAILQ_FOREACH (shared, &shared_umems, next) {
+        if (strcmp(shared->iface, ptv->iface) == 0)
+            break;
+        if (ptv->copy_mode != AFXDP_COPY_MODE_NONE && strcmp(shared->iface, ptv->out_iface) == 0)
+            break;
+    }
+
+    if (shared == NULL) {
+        shared = SCCalloc(1, sizeof(*shared));
+        if (shared == NULL) {
+            SCMutexUnlock(&shared_umem_lock);
+            SCReturnInt(TM_ECODE_FAILED);
+        }
+        strlcpy(shared->iface, ptv->iface, sizeof(shared->iface));
+        shared->size = (uint64_t)ptv->threads * MEM_BYTES;
+        if (ptv->copy_mode != AFXDP_COPY_MODE_NONE) {
+            /* the copy interface runs as many threads */
+            shared->size *= 2;
+        }
+
+        int mmap_flags = MAP_PRIVATE | MAP_ANONYMOUS | ptv->umem.mmap_alignment_flag;
+        shared->buf = mmap(NULL, shared->size, PROT_READ | PROT_WRITE, mmap_flags, -1, 0);
+        if (shared->buf == MAP_FAILED) {
+            SCLogError("mmap: failed to acquire memory");
+            SCFree(shared);
+            SCMutexUnlock(&shared_umem_lock);
+            SCReturnInt(TM_ECODE_FAILED);
+        }
+        TAILQ_INSERT_TAIL(&shared_umems, shared, next);
+    }
+
+    if ((uint64_t)(shared->slices + 1) * MEM_BYTES > shared->size) {
+        SCLogError("%s: no room left in shared umem", ptv->iface);
+        SCMutexUnlock(&shared_umem_lock);
+        SCReturnInt(TM_ECODE_FAILED);
+    }
+    ptv->umem.frame_base = (uint64_t)shared->slices * MEM_BYTES;
+    shared->slices++;
+    shared->refcnt++;
+    ptv->umem.shared = shared;
+    ptv->umem.buf = shared->buf;
+    SCMutexUnlock(&shared_umem_lock);
+
+    SCReturnInt(TM_ECODE_OK);
+}
+
+static void ReleaseSharedBuffer(AFXDPThreadVars *ptv)
+{
+    AFXDPSharedUmem *shared = ptv->umem.shared;
+
+    SCMutexLock(&shared_umem_lock);
+    if (--shared->refcnt == 0) {
+        if (shared->umem) {
+            xsk_umem__delete(shared->umem);
+        }
+        munmap(shared->buf, shared->size);
+        TAILQ_REMOVE(&shared_umems, shared, next);
+        SCFree(shared);
+    }
+    SCMutexUnlock(&shared_umem_lock);
+
+    ptv->umem.shared = NULL;
+    ptv->umem.umem = NULL;
+    ptv->umem.buf = NULL;
+}
+
+static TmEcode AcquireBuffer(AFXDPThreadVars *ptv, const bool shared)
 {
+    ptv->umem.stash = SCCalloc(NUM_FRAMES * 2, sizeof(uint64_t));
+    if (ptv->umem.stash == NULL) {
+        SCReturnInt(TM_ECODE_FAILED);
+    }
+
+    if (shared) {
+        if (AcquireSharedBuffer(ptv) != TM_ECODE_OK) {
+            SCFree(ptv->umem.stash);
+            ptv->umem.stash = NULL;
+            SCReturnInt(TM_ECODE_FAILED);
+        }
+        SCReturnInt(TM_ECODE_OK);
+    }
+
     int mmap_flags = MAP_PRIVATE | MAP_ANONYMOUS | ptv->umem.mmap_alignment_flag;
     ptv->umem.buf = mmap(NULL, MEM_BYTES, PROT_READ | PROT_WRITE, mmap_flags, -1, 0);
 
     if (ptv->umem.buf == MAP_FAILED) {
         SCLogError("mmap: failed to acquire memory");
+        SCFree(ptv->umem.stash);
+        ptv->umem.stash = NULL;
         SCReturnInt(TM_ECODE_FAILED);
     }
 
@@ -318,33 +645,106 @@ static TmEcode AcquireBuffer(AFXDPThreadVars *ptv)
 
 static TmEcode ConfigureXSKUmem(AFXDPThreadVars *ptv)
 {
-    if (xsk_umem__create(&ptv->umem.umem, ptv->umem.buf, MEM_BYTES, &ptv->umem.fq, &ptv->umem.cq,
+    AFXDPSharedUmem *shared = ptv->umem.shared;
+    if (shared != NULL) {
+        SCMutexLock(&shared_umem_lock);
+        if (shared->umem != NULL) {
+            /* the socket gets its own fill and completion rings */
+            ptv->umem.umem = shared->umem;
+            SCMutexUnlock(&shared_umem_lock);
+            SCReturnInt(TM_ECODE_OK);
+        }
+    }
+
+    uint64_t size = shared ? shared->size : MEM_BYTES;
+    if (xsk_umem__create(&ptv->umem.umem, ptv->umem.buf, size, &ptv->umem.fq, &ptv->umem.cq,
                 &ptv->umem.cfg)) {
         SCLogError("failed to create umem: %s", strerror(errno));
+        if (shared != NULL)
+            SCMutexUnlock(&shared_umem_lock);
         SCReturnInt(TM_ECODE_FAILED);
     }
 
+    if (shared != NULL) {
+        shared->umem = ptv->umem.umem;
+        SCMutexUnlock(&shared_umem_lock);
+    }
     SCReturnInt(TM_ECODE_OK);
 }
 
+/**
+ * \brief Put all frames of the socket's slice on the fill ring
+ *
+ * On a reconnect, frames still queued on the peer's TX ring are left out:
+ * they are stashed when they complete.
+ */
 static TmEcode InitFillRing(AFXDPThreadVars *ptv, const uint32_t cnt)
 {
+    uint8_t inflight[(NUM_FRAMES * 2 + 7) / 8];
+    uint32_t inflight_cnt = 0;
     uint32_t idx_fq = 0;
 
-    uint32_t ret = xsk_ring_prod__reserve(&ptv->umem.fq, cnt, &idx_fq);
-    if (ret != cnt) {
+    DEBUG_VALIDATE_BUG_ON(cnt > NUM_FRAMES * 2);
+    memset(inflight, 0, sizeof(inflight));
+    for (uint32_t i = 0; i < ptv->tx_inflight_cnt; i++) {
+        const uint64_t addr =
+                ptv->tx_inflight[(ptv->tx_inflight_head + i) % AFXDP_TX_INFLIGHT];
+        const uint64_t frame = (addr - ptv->umem.frame_base) / FRAME_SIZE;
+        if (frame < cnt && !(inflight[frame / 8] & (1 << (frame % 8)))) {
+            inflight[frame / 8] |= (uint8_t)(1 << (frame % 8));
+            inflight_cnt++;
+        }
+    }
+
+    const uint32_t fill_cnt = cnt - inflight_cnt;
+    uint32_t ret = xsk_ring_prod__reserve(&ptv->umem.fq, fill_cnt, &idx_fq);
+    if (ret != fill_cnt) {
         SCLogError("Failed to initialise the fill ring.");
         SCReturnInt(TM_ECODE_FAILED);
     }
 
     for (uint32_t i = 0; i < cnt; i++) {
-        *xsk_ring_prod__fill_addr(&ptv->umem.fq, idx_fq++) = i * FRAME_SIZE;
+        if (inflight[i / 8] & (1 << (i % 8)))
+            continue;
+        *xsk_ring_prod__fill_addr(&ptv->umem.fq, idx_fq++) =
+                ptv->umem.frame_base + (uint64_t)i * FRAME_SIZE;
     }
 
-    xsk_ring_prod__submit(&ptv->umem.fq, cnt);
+    xsk_ring_prod__submit(&ptv->umem.fq, fill_cnt);
+
+    /* all our frames are on the fill ring now */
+    ptv->umem.stash_cnt = 0;
     SCReturnInt(TM_ECODE_OK);
 }
 
+/**
+ * \brief Hand the frames released since the last call back to the kernel
+ *
+ * Frames are returned when the engine is done with them instead of when
+ * the RX batch is done, so packets can point into the UMEM for as long as
+ * they live.
+ */
+static void RefillFillRing(AFXDPThreadVars *ptv)
+{
+    struct UmemInfo *umem = &ptv->umem;
+    if (umem->stash_cnt == 0)
+        return;
+
+    uint32_t cnt = xsk_prod_nb_free(&umem->fq, umem->stash_cnt);
+    if (cnt > umem->stash_cnt)
+        cnt = umem->stash_cnt;
+
+    uint32_t idx_fq = 0;
+    if (cnt == 0 || xsk_ring_prod__reserve(&umem->fq, cnt, &idx_fq) != cnt) {
+        StatsIncr(ptv->tv, ptv->capture_afxdp_failed_reads);
+        return;
+    }
+    for (uint32_t i = 0; i < cnt; i++) {
+        *xsk_ring_prod__fill_addr(&umem->fq, idx_fq++) = umem->stash[--umem->stash_cnt];
+    }
+    xsk_ring_prod__submit(&umem->fq, cnt);
+}
+
 /**
  * \brief Linux knobs are tuned to enable a NAPI polling context
  *
@@ -423,6 +823,11 @@ static TmEcode ConfigureBusyPolling(AFXDPThreadVars *ptv)
 static void AFXDPSwitchState(AFXDPThreadVars *ptv, int state)
 {
     ptv->afxdp_state = state;
+    if (ptv->mpeer != NULL) {
+        SCMutexLock(&ptv->mpeer->sock_protect);
+        (void)SC_ATOMIC_SET(ptv->mpeer->state, state);
+        SCMutexUnlock(&ptv->mpeer->sock_protect);
+    }
 }
 
 static TmEcode OpenXSKSocket(AFXDPThreadVars *ptv)
@@ -431,13 +836,11 @@ static TmEcode OpenXSKSocket(AFXDPThreadVars *ptv)
 
     SCMutexLock(&xsk_protect.queue_protect);
 
-    if (AFXDPAssignQueueID(ptv) != TM_ECODE_OK) {
-        SCLogError("Failed to assign queue ID");
-        SCReturnInt(TM_ECODE_FAILED);
-    }
-
-    if ((ret = xsk_socket__create(&ptv->xsk.xsk, ptv->livedev->dev, ptv->xsk.queue.queue_num,
-                 ptv->umem.umem, &ptv->xsk.rx, &ptv->xsk.tx, &ptv->xsk.cfg))) {
+    /* with a shared umem, only the first socket uses the rings created with
+     * the umem, the others get their own */
+    if ((ret = xsk_socket__create_shared(&ptv->xsk.xsk, ptv->livedev->dev,
+                 ptv->xsk.queue.queue_num, ptv->umem.umem, &ptv->xsk.rx, &ptv->xsk.tx,
+                 &ptv->umem.fq, &ptv->umem.cq, &ptv->xsk.cfg))) {
         SCLogError("Failed to create socket: %s", strerror(-ret));
         SCReturnInt(TM_ECODE_FAILED);
     }
@@ -456,18 +859,31 @@ static TmEcode OpenXSKSocket(AFXDPThreadVars *ptv)
 
 static void AFXDPCloseSocket(AFXDPThreadVars *ptv)
 {
+    /* keep the peer's thread off our rings while the socket goes away */
+    AFXDPPeer *peer = ptv->mpeer;
+    if (peer != NULL) {
+        SCMutexLock(&peer->sock_protect);
+        (void)SC_ATOMIC_SET(peer->state, AFXDP_STATE_DOWN);
+        peer->sock_gen++;
+    }
+
     if (ptv->xsk.xsk) {
         xsk_socket__delete(ptv->xsk.xsk);
         ptv->xsk.xsk = NULL;
     }
 
-    if (ptv->umem.umem) {
+    /* a shared umem lives until the last socket of the interface is gone */
+    if (ptv->umem.umem && ptv->umem.shared == NULL) {
         xsk_umem__delete(ptv->umem.umem);
         ptv->umem.umem = NULL;
     }
 
     memset(&ptv->umem.fq, 0, sizeof(struct xsk_ring_prod));
     memset(&ptv->umem.cq, 0, sizeof(struct xsk_ring_cons));
+
+    if (peer != NULL) {
+        SCMutexUnlock(&peer->sock_protect);
+    }
 }
 
 static TmEcode AFXDPSocketCreation(AFXDPThreadVars *ptv)
@@ -476,12 +892,13 @@ static TmEcode AFXDPSocketCreation(AFXDPThreadVars *ptv)
         SCReturnInt(TM_ECODE_FAILED);
     }
 
-    if (InitFillRing(ptv, NUM_FRAMES * 2) != TM_ECODE_OK) {
+    /* Open AF_XDP socket */
+    if (OpenXSKSocket(ptv) != TM_ECODE_OK) {
         SCReturnInt(TM_ECODE_FAILED);
     }
 
-    /* Open AF_XDP socket */
-    if (OpenXSKSocket(ptv) != TM_ECODE_OK) {
+    /* the fill ring of a socket sharing the umem only exists from here */
+    if (InitFillRing(ptv, NUM_FRAMES * 2) != TM_ECODE_OK) {
         SCReturnInt(TM_ECODE_FAILED);
     }
 
@@ -537,16 +954,185 @@ sock_err:
     SCReturnInt(TM_ECODE_FAILED);
 }
 
+static inline void AFXDPStashFrame(AFXDPThreadVars *ptv, const uint64_t addr)
+{
+    DEBUG_VALIDATE_BUG_ON(ptv->umem.stash_cnt >= NUM_FRAMES * 2);
+    ptv->umem.stash[ptv->umem.stash_cnt++] = addr;
+}
+
+/**
+ * \brief Take back the frames queued on a closed socket of the peer
+ *
+ * The frames on the TX ring of a socket that was closed never complete.
+ *
+ * \note the peer's sock_protect must be held
+ */
+static void AFXDPReclaimTx(AFXDPThreadVars *ptv, AFXDPPeer *out)
+{
+    if (likely(ptv->tx_gen == out->sock_gen))
+        return;
+
+    SCLogDebug("%s: reclaiming %u frames queued on %s", ptv->iface, ptv->tx_inflight_cnt,
+            out->iface);
+    while (ptv->tx_inflight_cnt > 0) {
+        AFXDPStashFrame(ptv, ptv->tx_inflight[ptv->tx_inflight_head]);
+        ptv->tx_inflight_head = (ptv->tx_inflight_head + 1) % AFXDP_TX_INFLIGHT;
+        ptv->tx_inflight_cnt--;
+    }
+    ptv->tx_pending = 0;
+    ptv->tx_gen = out->sock_gen;
+}
+
+/**
+ * \brief Take back the frames the peer's socket is done sending
+ *
+ * The frames come from our own slice of the UMEM, so they go to our stash.
+ *
+ * \note the peer's sock_protect must be held
+ */
+static void AFXDPCompleteTxLocked(AFXDPThreadVars *ptv, AFXDPPeer *out)
+{
+    AFXDPReclaimTx(ptv, out);
+    if (unlikely(SC_ATOMIC_GET(out->state) != AFXDP_STATE_UP))
+        return;
+
+    struct xsk_ring_cons *cq = &out->ptv->umem.cq;
+    uint32_t idx_cq = 0;
+
+    uint32_t done = xsk_ring_cons__peek(cq, NUM_FRAMES_CONS, &idx_cq);
+    if (done == 0)
+        return;
+
+    for (uint32_t i = 0; i < done; i++) {
+        uint64_t addr = *xsk_ring_cons__comp_addr(cq, idx_cq++);
+        AFXDPStashFrame(ptv, xsk_umem__extract_addr(addr));
+    }
+    xsk_ring_cons__release(cq, done);
+
+    DEBUG_VALIDATE_BUG_ON(done > ptv->tx_inflight_cnt);
+    done = MIN(done, ptv->tx_inflight_cnt);
+    ptv->tx_inflight_head = (ptv->tx_inflight_head + done) % AFXDP_TX_INFLIGHT;
+    ptv->tx_inflight_cnt -= done;
+}
+
+static void AFXDPCompleteTx(AFXDPThreadVars *ptv)
+{
+    AFXDPPeer *out = ptv->mpeer->peer;
+    SCMutexLock(&out->sock_protect);
+    AFXDPCompleteTxLocked(ptv, out);
+    SCMutexUnlock(&out->sock_protect);
+}
+
+/**
+ * \brief Have the kernel send the frames put on the peer's TX ring
+ *
+ * \note the peer's sock_protect must be held
+ */
+static void AFXDPFlushTxLocked(AFXDPThreadVars *ptv, AFXDPPeer *out)
+{
+    if (ptv->tx_pending == 0)
+        return;
+    ptv->tx_pending = 0;
+    if (unlikely(SC_ATOMIC_GET(out->state) != AFXDP_STATE_UP))
+        return;
+
+    AFXDPThreadVars *optv = out->ptv;
+    if (!(optv->xsk.cfg.bind_flags & XDP_USE_NEED_WAKEUP) ||
+            xsk_ring_prod__needs_wakeup(&optv->xsk.tx)) {
+        /* EAGAIN, EBUSY and ENOBUFS only mean the kernel is still busy
+         * with the ring: the frames go with the next kick */
+        // cppcheck-suppress nullPointer
+        (void)sendto(xsk_socket__fd(optv->xsk.xsk), NULL, 0, MSG_DONTWAIT, NULL, 0);
+    }
+}
+
+static void AFXDPFlushTx(AFXDPThreadVars *ptv)
+{
+    if (ptv->tx_pending == 0)
+        return;
+
+    AFXDPPeer *out = ptv->mpeer->peer;
+    SCMutexLock(&out->sock_protect);
+    AFXDPFlushTxLocked(ptv, out);
+    SCMutexUnlock(&out->sock_protect);
+}
+
+/**
+ * \brief Put the packet's frame on the TX ring of the peer's socket
+ *
+ * This thread is the only producer of the peer's TX ring. The peer's
+ * sock_protect is held for the whole enqueue, so the peer can't replace
+ * its socket underneath us.
+ *
+ * \retval true if the frame is now owned by the peer's socket
+ */
+static bool AFXDPWritePacket(Packet *p)
+{
+    if (p->afxdp_v.copy_mode == AFXDP_COPY_MODE_IPS) {
+        if (PacketCheckAction(p, ACTION_DROP)) {
+            return false;
+        }
+    }
+
+    AFXDPPeer *peer = (AFXDPPeer *)p->afxdp_v.peer;
+    AFXDPThreadVars *ptv = peer->ptv;
+    AFXDPPeer *out = peer->peer;
+
+    SCMutexLock(&out->sock_protect);
+    AFXDPReclaimTx(ptv, out);
+    if (unlikely(SC_ATOMIC_GET(out->state) != AFXDP_STATE_UP)) {
+        goto fail;
+    }
+
+    struct xsk_ring_prod *tx = &out->ptv->xsk.tx;
+    uint32_t idx_tx = 0;
+    if (unlikely(ptv->tx_inflight_cnt == AFXDP_TX_INFLIGHT ||
+                 xsk_ring_prod__reserve(tx, 1, &idx_tx) != 1)) {
+        /* make the kernel progress on the frames it has */
+        AFXDPFlushTxLocked(ptv, out);
+        AFXDPCompleteTxLocked(ptv, out);
+        if (ptv->tx_inflight_cnt == AFXDP_TX_INFLIGHT ||
+                SC_ATOMIC_GET(out->state) != AFXDP_STATE_UP ||
+                xsk_ring_prod__reserve(tx, 1, &idx_tx) != 1) {
+            goto fail;
+        }
+    }
+
+    struct xdp_desc *desc = xsk_ring_prod__tx_desc(tx, idx_tx);
+    desc->addr = p->afxdp_v.addr;
+    desc->len = GET_PKT_LEN(p);
+    xsk_ring_prod__submit(tx, 1);
+    ptv->tx_inflight[(ptv->tx_inflight_head + ptv->tx_inflight_cnt) % AFXDP_TX_INFLIGHT] =
+            p->afxdp_v.orig;
+    ptv->tx_inflight_cnt++;
+    ptv->tx_pending++;
+    SCMutexUnlock(&out->sock_protect);
+    return true;
+
+fail:
+    ptv->tx_failed++;
+    SCMutexUnlock(&out->sock_protect);
+    return false;
+}
+
 /**
- * \brief Write packet entry to the fill ring, freeing
- * this slot for re/fill with inbound packet descriptor
+ * \brief Stash the packet's frame so the capture loop can return it to
+ * the fill ring with the next batch.
+ *
+ * The AF_XDP runmodes release packets in the capture thread, so the stash
+ * needs no locking. In copy mode the frame is forwarded to the peer
+ * interface instead, unless the packet is dropped.
+ *
  * \param pointer to Packet
  * \retval: None
  */
 static void AFXDPReleasePacket(Packet *p)
 {
-    *xsk_ring_prod__fill_addr((struct xsk_ring_prod *)p->afxdp_v.fq, p->afxdp_v.fq_idx) =
-            p->afxdp_v.orig;
+    if (p->afxdp_v.copy_mode == AFXDP_COPY_MODE_NONE || !AFXDPWritePacket(p)) {
+        struct UmemInfo *umem = (struct UmemInfo *)p->afxdp_v.umem;
+        DEBUG_VALIDATE_BUG_ON(umem->stash_cnt >= NUM_FRAMES * 2);
+        umem->stash[umem->stash_cnt++] = p->afxdp_v.orig;
+    }
 
     PacketFreeOrRelease(p);
 }
@@ -657,6 +1243,7 @@ static TmEcode ReceiveAFXDPThreadInit(ThreadVars *tv, const void *initdata, void
     ptv->xsk.busy_poll_time = afxdpconfig->busy_poll_time;
     ptv->gro_flush_timeout = afxdpconfig->gro_flush_timeout;
     ptv->napi_defer_hard_irqs = afxdpconfig->napi_defer_hard_irqs;
+    ptv->xsk.rx_batch = ptv->xsk.enable_busy_poll ? ptv->xsk.busy_poll_budget : AFXDP_RX_BATCH;
 
     /* Stats registration */
     ptv->capture_afxdp_packets = StatsRegisterCounter("capture.afxdp_packets", ptv->tv);
@@ -669,8 +1256,24 @@ static TmEcode ReceiveAFXDPThreadInit(ThreadVars *tv, const void *initdata, void
     ptv->capture_afxdp_acquire_pkt_failed =
             StatsRegisterCounter("capture.afxdp.acquire_pkt_failed", ptv->tv);
 
+    /* Copy mode: forwarding needs both sockets on the same UMEM */
+    ptv->copy_mode = afxdpconfig->copy_mode;
+    if (ptv->copy_mode != AFXDP_COPY_MODE_NONE) {
+        strlcpy(ptv->out_iface, afxdpconfig->out_iface, AFXDP_IFACE_NAME_LENGTH);
+        ptv->capture_afxdp_tx_failed = StatsRegisterCounter("capture.afxdp.tx_failed", ptv->tv);
+        ptv->tx_inflight = SCCalloc(AFXDP_TX_INFLIGHT, sizeof(uint64_t));
+        if (unlikely(ptv->tx_inflight == NULL)) {
+            SCFree(ptv);
+            SCReturnInt(TM_ECODE_FAILED);
+        }
+    }
+
+    (void)AFXDPAssignQueueID(ptv, afxdpconfig);
+
     /* Reserve memory for umem  */
-    if (AcquireBuffer(ptv) != TM_ECODE_OK) {
+    if (AcquireBuffer(ptv, afxdpconfig->shared_umem || ptv->copy_mode != AFXDP_COPY_MODE_NONE) !=
+            TM_ECODE_OK) {
+        SCFree(ptv->tx_inflight);
         SCFree(ptv);
         SCReturnInt(TM_ECODE_FAILED);
     }
@@ -680,6 +1283,13 @@ static TmEcode ReceiveAFXDPThreadInit(ThreadVars *tv, const void *initdata, void
         SCReturnInt(TM_ECODE_FAILED);
     }
 
+    if (ptv->copy_mode != AFXDP_COPY_MODE_NONE) {
+        if (AFXDPPeersListAdd(ptv, afxdpconfig->out_iface) != TM_ECODE_OK) {
+            ReceiveAFXDPThreadDeinit(tv, ptv);
+            SCReturnInt(TM_ECODE_FAILED);
+        }
+    }
+
     *data = (void *)ptv;
     afxdpconfig->DerefFunc(afxdpconfig);
     SCReturnInt(TM_ECODE_OK);
@@ -695,7 +1305,7 @@ static TmEcode ReceiveAFXDPLoop(ThreadVars *tv, void *data, void *slot)
     Packet *p;
     time_t last_dump = 0;
     struct timeval ts;
-    uint32_t idx_rx = 0, idx_fq = 0, rcvd;
+    uint32_t idx_rx = 0, rcvd;
     int r;
     AFXDPThreadVars *ptv = (AFXDPThreadVars *)data;
     TmSlot *s = (TmSlot *)slot;
@@ -709,6 +1319,15 @@ static TmEcode ReceiveAFXDPLoop(ThreadVars *tv, void *data, void *slot)
     TmThreadsSetFlag(tv, THV_RUNNING);
 
     PacketPoolWait();
+
+    /* the peer's socket may be created by a thread started after us */
+    while (ptv->mpeer != NULL && !AFXDPPeerIsReady(ptv->mpeer)) {
+        if (unlikely(suricata_ctl_flags != 0)) {
+            SCReturnInt(TM_ECODE_OK);
+        }
+        usleep(RECONNECT_TIMEOUT / 100);
+    }
+
     while (1) {
         /* Start by checking the state of our interface */
         if (unlikely(ptv->afxdp_state == AFXDP_STATE_DOWN)) {
@@ -727,6 +1346,13 @@ static TmEcode ReceiveAFXDPLoop(ThreadVars *tv, void *data, void *slot)
             break;
         }
 
+        /* give the kernel back the frames released since the last batch,
+         * including the ones the peer is done sending */
+        if (ptv->mpeer != NULL) {
+            AFXDPCompleteTx(ptv);
+        }
+        RefillFillRing(ptv);
+
         /* Busy polling is not set, using poll() to maintain (relatively) decent
          * performance. xdp_busy_poll must be disabled for kernels < 5.11
          */
@@ -750,7 +1376,7 @@ static TmEcode ReceiveAFXDPLoop(ThreadVars *tv, void *data, void *slot)
             }
         }
 
-        rcvd = xsk_ring_cons__peek(&ptv->xsk.rx, ptv->xsk.busy_poll_budget, &idx_rx);
+        rcvd = xsk_ring_cons__peek(&ptv->xsk.rx, ptv->xsk.rx_batch, &idx_rx);
         if (!rcvd) {
             StatsIncr(ptv->tv, ptv->capture_afxdp_empty_reads);
             ssize_t ret = WakeupSocket(ptv);
@@ -762,24 +1388,15 @@ static TmEcode ReceiveAFXDPLoop(ThreadVars *tv, void *data, void *slot)
             continue;
         }
 
-        uint32_t res = xsk_ring_prod__reserve(&ptv->umem.fq, rcvd, &idx_fq);
-        while (res != rcvd) {
-            StatsIncr(ptv->tv, ptv->capture_afxdp_failed_reads);
-            ssize_t ret = WakeupSocket(ptv);
-            if (ret < 0) {
-                SCLogWarning("recv failed with retval %ld", ret);
-                AFXDPSwitchState(ptv, AFXDP_STATE_DOWN);
-                continue;
-            }
-            res = xsk_ring_prod__reserve(&ptv->umem.fq, rcvd, &idx_fq);
-        }
-
         gettimeofday(&ts, NULL);
         ptv->pkts += rcvd;
         for (uint32_t i = 0; i < rcvd; i++) {
             p = PacketGetFromQueueOrAlloc();
             if (unlikely(p == NULL)) {
                 StatsIncr(ptv->tv, ptv->capture_afxdp_acquire_pkt_failed);
+                /* frame goes straight back */
+                uint64_t addr = xsk_ring_cons__rx_desc(&ptv->xsk.rx, idx_rx++)->addr;
+                ptv->umem.stash[ptv->umem.stash_cnt++] = xsk_umem__extract_addr(addr);
                 continue;
             }
 
@@ -791,18 +1408,20 @@ static TmEcode ReceiveAFXDPLoop(ThreadVars *tv, void *data, void *slot)
 
             p->ts = SCTIME_FROM_TIMEVAL(&ts);
 
-            uint64_t addr = xsk_ring_cons__rx_desc(&ptv->xsk.rx, idx_rx)->addr;
+            const uint64_t desc_addr = xsk_ring_cons__rx_desc(&ptv->xsk.rx, idx_rx)->addr;
             uint32_t len = xsk_ring_cons__rx_desc(&ptv->xsk.rx, idx_rx++)->len;
-            uint64_t orig = xsk_umem__extract_addr(addr);
-            addr = xsk_umem__add_offset_to_addr(addr);
+            uint64_t orig = xsk_umem__extract_addr(desc_addr);
+            uint64_t addr = xsk_umem__add_offset_to_addr(desc_addr);
 
             uint8_t *pkt_data = xsk_umem__get_data(ptv->umem.buf, addr);
 
             ptv->bytes += len;
 
-            p->afxdp_v.fq_idx = idx_fq++;
             p->afxdp_v.orig = orig;
-            p->afxdp_v.fq = &ptv->umem.fq;
+            p->afxdp_v.addr = desc_addr;
+            p->afxdp_v.umem = &ptv->umem;
+            p->afxdp_v.copy_mode = ptv->copy_mode;
+            p->afxdp_v.peer = ptv->mpeer;
 
             PacketSetData(p, pkt_data, len);
 
@@ -812,9 +1431,12 @@ static TmEcode ReceiveAFXDPLoop(ThreadVars *tv, void *data, void *slot)
             }
         }
 
-        xsk_ring_prod__submit(&ptv->umem.fq, rcvd);
         xsk_ring_cons__release(&ptv->xsk.rx, rcvd);
 
+        if (ptv->mpeer != NULL) {
+            AFXDPFlushTx(ptv);
+        }
+
         /* Trigger one dump of stats every second */
         DumpStatsEverySecond(ptv, &last_dump);
     }
@@ -863,10 +1485,8 @@ static void RunModeAFXDPRemoveProg(char *iface_name)
  */
 static SCMutex sync_deinit = SCMUTEX_INITIALIZER;
 
-static TmEcode ReceiveAFXDPThreadDeinit(ThreadVars *tv, void *data)
+static void AFXDPThreadVarsFree(AFXDPThreadVars *ptv)
 {
-    AFXDPThreadVars *ptv = (AFXDPThreadVars *)data;
-
     /*
      * If AF_XDP is enabled, the program must be detached before the AF_XDP sockets
      * are closed to mitigate a bug that causes an IO_PAGEFAULT in linux kernel
@@ -881,13 +1501,31 @@ static TmEcode ReceiveAFXDPThreadDeinit(ThreadVars *tv, void *data)
         ptv->xsk.xsk = NULL;
     }
 
-    if (ptv->umem.umem) {
-        xsk_umem__delete(ptv->umem.umem);
-        ptv->umem.umem = NULL;
+    if (ptv->umem.shared) {
+        ReleaseSharedBuffer(ptv);
+    } else {
+        if (ptv->umem.umem) {
+            xsk_umem__delete(ptv->umem.umem);
+            ptv->umem.umem = NULL;
+        }
+        munmap(ptv->umem.buf, MEM_BYTES);
     }
-    munmap(ptv->umem.buf, MEM_BYTES);
+    SCFree(ptv->umem.stash);
+    SCFree(ptv->tx_inflight);
 
     SCFree(ptv);
+}
+
+static TmEcode ReceiveAFXDPThreadDeinit(ThreadVars *tv, void *data)
+{
+    AFXDPThreadVars *ptv = (AFXDPThreadVars *)data;
+
+    /* in copy mode the peer's thread may still send through our socket */
+    if (ptv->mpeer != NULL && AFXDPPeerRelease(ptv)) {
+        SCReturnInt(TM_ECODE_OK);
+    }
+
+    AFXDPThreadVarsFree(ptv);
     SCReturnInt(TM_ECODE_OK);
 }
 
@@ -26,6 +26,10 @@
 
 #define AFXDP_IFACE_NAME_LENGTH 48
 
+#define AFXDP_COPY_MODE_NONE 0
+#define AFXDP_COPY_MODE_TAP  1
+#define AFXDP_COPY_MODE_IPS  2
+
 typedef struct AFXDPIfaceConfig {
     char iface[AFXDP_IFACE_NAME_LENGTH];
     /* number of threads */
@@ -36,6 +40,12 @@ typedef struct AFXDPIfaceConfig {
     uint32_t mode;
     uint32_t bind_flags;
     int mem_alignment;
+    bool shared_umem;
+    /* forward packets to the socket of the same queue on out_iface */
+    int copy_mode;
+    const char *out_iface;
+    /* next queue to bind a socket of the interface to */
+    SC_ATOMIC_DECLARE(uint32_t, queue_num);
     bool enable_busy_poll;
     uint32_t busy_poll_time;
     uint32_t busy_poll_budget;
@@ -52,17 +62,23 @@ typedef struct AFXDPIfaceConfig {
  * This structure is used by the release data system
  */
 typedef struct AFXDPPacketVars_ {
-    /* Fill queue used by kernel for inbound packets */
-    void *fq;
-    /* Indexed location within queue to release */
-    uint32_t fq_idx;
+    /* UMEM info of the socket the frame is returned to on release */
+    void *umem;
     /* Origin address of packet */
     uint64_t orig;
+    /* RX descriptor address, reused for the TX descriptor in copy mode */
+    uint64_t addr;
+    uint8_t copy_mode;
+    /* ::AFXDPPeer of the capture thread */
+    void *peer;
 } AFXDPPacketVars;
 
 void TmModuleReceiveAFXDPRegister(void);
 void TmModuleDecodeAFXDPRegister(void);
 
 TmEcode AFXDPQueueProtectionInit(void);
+TmEcode AFXDPPeersListInit(void);
+TmEcode AFXDPPeersListCheck(void);
+void AFXDPPeersListClean(void);
 
 #endif /* SURICATA_SOURCE_AFXDP_H */
@@ -93,6 +93,7 @@ TmEcode NoDPDKSupportExit(ThreadVars *tv, const void *initdata, void **data)
 #include "util-dpdk-ixgbe.h"
 #include "util-dpdk-mlx5.h"
 #include "util-dpdk-bonding.h"
+#include "util-dpdk-bypass.h"
 #include <numa.h>
 
 #define BURST_SIZE 32
@@ -121,7 +122,9 @@ typedef struct DPDKThreadVars_ {
     uint16_t capture_dpdk_imissed;
     uint16_t capture_dpdk_rx_no_mbufs;
     uint16_t capture_dpdk_ierrors;
+    uint16_t capture_dpdk_segmented;
     uint16_t capture_dpdk_tx_errs;
+    uint16_t capture_dpdk_bypassed;
     unsigned int flags;
     uint16_t threads;
     /* for IPS */
@@ -136,6 +139,8 @@ typedef struct DPDKThreadVars_ {
     uint16_t queue_id;
     int32_t port_socket_id;
     struct rte_mbuf *received_mbufs[BURST_SIZE];
+    /* mbufs of bypassed flows forwarded without inspection */
+    struct rte_mbuf *bypassed_mbufs[BURST_SIZE];
     DPDKWorkerSync *workers_sync;
 } DPDKThreadVars;
 
@@ -218,12 +223,7 @@ static void DevicePreClosePMDSpecificActions(DPDKThreadVars *ptv, const char *dr
             strcmp(driver_name, "net_ixgbe") == 0 || strcmp(driver_name, "net_ice") == 0 ||
             strcmp(driver_name, "mlx5_pci") == 0) {
         // Flush the RSS rules that have been inserted in the post start section
-        struct rte_flow_error flush_error = { 0 };
-        int32_t retval = rte_flow_flush(ptv->port_id, &flush_error);
-        if (retval != 0) {
-            SCLogError("%s: unable to flush rte_flow rules: %s Flush error msg: %s",
-                    ptv->livedev->dev, rte_strerror(-retval), flush_error.message);
-        }
+        DPDKBypassPortFlush(ptv->port_id, ptv->livedev->dev);
     }
 }
 
@@ -430,9 +430,13 @@ static inline Packet *PacketInitFromMbuf(DPDKThreadVars *ptv, struct rte_mbuf *m
     p->dpdk_v.mbuf = mbuf;
     p->ReleasePacket = DPDKReleasePacket;
     p->dpdk_v.copy_mode = ptv->copy_mode;
+    p->dpdk_v.port_id = ptv->port_id;
     p->dpdk_v.out_port_id = ptv->out_port_id;
     p->dpdk_v.out_queue_id = ptv->queue_id;
     p->livedev = ptv->livedev;
+    if (ptv->flags & DPDK_BYPASS) {
+        p->BypassPacketsFlow = DPDKBypassCallback;
+    }
 
     if (ptv->checksum_mode == CHECKSUM_VALIDATION_DISABLE) {
         p->flags |= PKT_IGNORE_CHECKSUM;
@@ -460,25 +464,68 @@ static inline Packet *PacketInitFromMbuf(DPDKThreadVars *ptv, struct rte_mbuf *m
     return p;
 }
 
-static inline void DPDKSegmentedMbufWarning(struct rte_mbuf *mbuf)
+/**
+ * \brief Sets the packet data from the mbuf
+ *
+ * A frame held in a single mbuf is used in place. A frame spanning chained
+ * mbufs is copied into the packet's own buffer, as the decoders need the
+ * data to be contiguous. The mbuf chain stays attached to the packet so it
+ * is forwarded as is in IPS mode.
+ *
+ * \return 0 on success, -1 if the frame could not be copied
+ */
+static inline int PacketSetDataFromMbuf(DPDKThreadVars *ptv, Packet *p, struct rte_mbuf *mbuf)
 {
-    static thread_local bool segmented_mbufs_warned = false;
-    if (!segmented_mbufs_warned && !rte_pktmbuf_is_contiguous(mbuf)) {
-        char warn_s[] = "Segmented mbufs detected! Redmine Ticket #6012 "
-                        "Check your configuration or report the issue";
-        enum rte_proc_type_t eal_t = rte_eal_process_type();
-        if (eal_t == RTE_PROC_SECONDARY) {
-            SCLogWarning("%s. To avoid segmented mbufs, "
-                         "try to increase mbuf size in your primary application",
-                    warn_s);
-        } else if (eal_t == RTE_PROC_PRIMARY) {
-            SCLogWarning("%s. To avoid segmented mbufs, "
-                         "try to increase MTU in your suricata.yaml",
-                    warn_s);
+    if (likely(rte_pktmbuf_is_contiguous(mbuf))) {
+        PacketSetData(p, rte_pktmbuf_mtod(mbuf, uint8_t *), rte_pktmbuf_pkt_len(mbuf));
+        return 0;
+    }
+
+    StatsIncr(ptv->tv, ptv->capture_dpdk_segmented);
+    uint32_t offset = 0;
+    for (const struct rte_mbuf *seg = mbuf; seg != NULL; seg = seg->next) {
+        const uint16_t seg_len = rte_pktmbuf_data_len(seg);
+        if (PacketCopyDataOffset(p, offset, rte_pktmbuf_mtod(seg, const uint8_t *), seg_len) < 0)
+            return -1;
+        offset += seg_len;
+    }
+    SET_PKT_LEN(p, offset);
+    return 0;
+}
+
+/**
+ * \brief Forwards the mbufs of flows bypassed with mark rules
+ *
+ * In TAP/IPS mode the NIC marks the packets of the bypassed flows instead of
+ * dropping them. These are sent to the copy interface right away and removed
+ * from the burst.
+ *
+ * \return number of mbufs left in the burst for inspection
+ */
+static inline uint16_t BypassMarkedMbufs(DPDKThreadVars *ptv, uint16_t nb_rx)
+{
+    uint16_t nb_bypassed = 0;
+    uint16_t nb_inspected = 0;
+    for (uint16_t i = 0; i < nb_rx; i++) {
+        struct rte_mbuf *mbuf = ptv->received_mbufs[i];
+        if (DPDKBypassMbufIsMarked(mbuf)) {
+            ptv->bypassed_mbufs[nb_bypassed++] = mbuf;
+        } else {
+            ptv->received_mbufs[nb_inspected++] = mbuf;
         }
+    }
 
-        segmented_mbufs_warned = true;
+    if (nb_bypassed > 0) {
+        StatsAddUI64(ptv->tv, ptv->capture_dpdk_bypassed, nb_bypassed);
+        uint16_t nb_tx =
+                rte_eth_tx_burst(ptv->out_port_id, ptv->queue_id, ptv->bypassed_mbufs, nb_bypassed);
+        if (unlikely(nb_tx < nb_bypassed)) {
+            SCLogDebug("Unable to transmit %u bypassed packets on port %u queue %u",
+                    nb_bypassed - nb_tx, ptv->out_port_id, ptv->queue_id);
+            DPDKFreeMbufArray(ptv->bypassed_mbufs, nb_bypassed, nb_tx);
+        }
     }
+    return nb_inspected;
 }
 
 static void HandleShutdown(DPDKThreadVars *ptv)
@@ -540,15 +587,19 @@ static TmEcode ReceiveDPDKLoop(ThreadVars *tv, void *data, void *slot)
         }
 
         ptv->pkts += (uint64_t)nb_rx;
+        if ((ptv->flags & DPDK_BYPASS) && ptv->copy_mode != DPDK_COPY_MODE_NONE) {
+            nb_rx = BypassMarkedMbufs(ptv, nb_rx);
+        }
         for (uint16_t i = 0; i < nb_rx; i++) {
             Packet *p = PacketInitFromMbuf(ptv, ptv->received_mbufs[i]);
             if (p == NULL) {
                 rte_pktmbuf_free(ptv->received_mbufs[i]);
                 continue;
             }
-            DPDKSegmentedMbufWarning(ptv->received_mbufs[i]);
-            PacketSetData(p, rte_pktmbuf_mtod(p->dpdk_v.mbuf, uint8_t *),
-                    rte_pktmbuf_pkt_len(p->dpdk_v.mbuf));
+            if (unlikely(PacketSetDataFromMbuf(ptv, p, ptv->received_mbufs[i]) < 0)) {
+                SCLogDebug("%s: failed to copy a segmented frame", ptv->livedev->dev);
+                PacketDrop(p, ACTION_DROP, PKT_DROP_REASON_DECODE_ERROR);
+            }
             if (TmThreadsSlotProcessPkt(ptv->tv, ptv->slot, p) != TM_ECODE_OK) {
                 TmqhOutputPacketpool(ptv->tv, p);
                 DPDKFreeMbufArray(ptv->received_mbufs, nb_rx - i - 1, i + 1);
@@ -600,11 +651,16 @@ static TmEcode ReceiveDPDKThreadInit(ThreadVars *tv, const void *initdata, void
     ptv->capture_dpdk_imissed = StatsRegisterCounter("capture.dpdk.imissed", ptv->tv);
     ptv->capture_dpdk_rx_no_mbufs = StatsRegisterCounter("capture.dpdk.no_mbufs", ptv->tv);
     ptv->capture_dpdk_ierrors = StatsRegisterCounter("capture.dpdk.ierrors", ptv->tv);
+    ptv->capture_dpdk_segmented = StatsRegisterCounter("capture.dpdk.segmented", ptv->tv);
+    if (dpdk_config->flags & DPDK_BYPASS) {
+        ptv->capture_dpdk_bypassed = StatsRegisterCounter("capture.dpdk.bypassed", ptv->tv);
+    }
 
     ptv->copy_mode = dpdk_config->copy_mode;
     ptv->checksum_mode = dpdk_config->checksum_mode;
 
     ptv->threads = dpdk_config->threads;
+    ptv->flags = dpdk_config->flags;
     ptv->intr_enabled = (dpdk_config->flags & DPDK_IRQ_MODE) ? true : false;
     ptv->port_id = dpdk_config->port_id;
     ptv->out_port_id = dpdk_config->out_port_id;
@@ -804,6 +860,11 @@ static TmEcode ReceiveDPDKThreadDeinit(ThreadVars *tv, void *data)
 
         DevicePreClosePMDSpecificActions(ptv, dev_info.driver_name);
 
+        if (ptv->flags & DPDK_BYPASS) {
+            // remove the rules of the flows still bypassed, no-op if already flushed above
+            DPDKBypassPortFlush(ptv->port_id, ptv->livedev->dev);
+        }
+
         if (ptv->workers_sync) {
             SCFree(ptv->workers_sync);
         }
@@ -40,6 +40,8 @@ typedef enum { DPDK_COPY_MODE_NONE, DPDK_COPY_MODE_TAP, DPDK_COPY_MODE_IPS } Dpd
 #define DPDK_PROMISC   (1 << 0) /**< Promiscuous mode */
 #define DPDK_MULTICAST (1 << 1) /**< Enable multicast packets */
 #define DPDK_IRQ_MODE  (1 << 2) /**< Interrupt mode */
+#define DPDK_MULTI_SEG (1 << 3) /**< Frames can span multiple mbufs */
+#define DPDK_BYPASS    (1 << 5) /**< Offload bypassed flows with rte_flow rules */
 // Offloads
 #define DPDK_RX_CHECKSUM_OFFLOAD (1 << 4) /**< Enable chsum offload */
 
@@ -66,6 +68,8 @@ typedef struct DPDKIfaceConfig_ {
     uint64_t rss_hf;
     /* set maximum transmission unit of the device in bytes */
     uint16_t mtu;
+    /* data room of the mbufs, headroom excluded */
+    uint16_t mbuf_size;
     bool vlan_strip_enabled;
     uint16_t nb_rx_queues;
     uint16_t nb_rx_desc;
@@ -93,6 +97,7 @@ typedef struct DPDKIfaceConfig_ {
  */
 typedef struct DPDKPacketVars_ {
     struct rte_mbuf *mbuf;
+    uint16_t port_id;
     uint16_t out_port_id;
     uint16_t out_queue_id;
     DpdkCopyModeEnum copy_mode;
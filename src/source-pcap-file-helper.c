@@ -30,15 +30,34 @@
 #include "util-profiling.h"
 #include "source-pcap-file.h"
 #include "util-exception-policy.h"
+#include "decode-ethernet.h"
+#include "decode-vlan.h"
+#include "decode-sll.h"
+#include "decode-sll2.h"
+#include "util-bpf.h"
+#include "util-byte.h"
 
 extern uint32_t max_pending_packets;
 extern PcapFileGlobalVars pcap_g;
 
 static void PcapFileCallbackLoop(char *user, struct pcap_pkthdr *h, u_char *pkt);
+#ifdef HAVE_SYS_MMAN_H
+static void PcapFileMapDeref(PcapFileMap *map);
+#endif
 
 void CleanupPcapFileFileVars(PcapFileFileVars *pfv)
 {
     if (pfv != NULL) {
+#ifdef HAVE_SYS_MMAN_H
+        if (pfv->map != NULL) {
+            PcapFileMapDeref(pfv->map);
+            pfv->map = NULL;
+        }
+        if (pfv->map_filter) {
+            SCBPFFree(&pfv->filter);
+            pfv->map_filter = false;
+        }
+#endif
         if (pfv->pcap_handle != NULL) {
             pcap_close(pfv->pcap_handle);
             pfv->pcap_handle = NULL;
@@ -58,6 +77,115 @@ void CleanupPcapFileFileVars(PcapFileFileVars *pfv)
     }
 }
 
+/** \internal
+ *  \brief get the offset of the IP header and the IP version in a raw packet
+ *  \retval version 4 or 6, 0 if the packet is not IP or too short
+ */
+static uint8_t PcapFileShardGetIPHeader(
+        const int datalink, const uint8_t *pkt, const uint32_t len, uint32_t *offset)
+{
+    uint32_t o = 0;
+    uint16_t type = 0;
+
+    switch (datalink) {
+        case LINKTYPE_ETHERNET:
+            if (len < ETHERNET_HEADER_LEN)
+                return 0;
+            type = (uint16_t)(pkt[12] << 8 | pkt[13]);
+            o = ETHERNET_HEADER_LEN;
+            while (type == ETHERNET_TYPE_VLAN || type == ETHERNET_TYPE_8021AD ||
+                    type == ETHERNET_TYPE_8021QINQ) {
+                if (len < o + 4)
+                    return 0;
+                type = (uint16_t)(pkt[o + 2] << 8 | pkt[o + 3]);
+                o += 4;
+            }
+            break;
+        case LINKTYPE_LINUX_SLL:
+            if (len < SLL_HEADER_LEN)
+                return 0;
+            type = (uint16_t)(pkt[14] << 8 | pkt[15]);
+            o = SLL_HEADER_LEN;
+            break;
+        case LINKTYPE_LINUX_SLL2:
+            if (len < SLL2_HEADER_LEN)
+                return 0;
+            type = (uint16_t)(pkt[0] << 8 | pkt[1]);
+            o = SLL2_HEADER_LEN;
+            break;
+        case LINKTYPE_RAW:
+        case LINKTYPE_RAW2:
+        case LINKTYPE_IPV4:
+        case LINKTYPE_IPV6:
+            if (len < 1)
+                return 0;
+            type = (pkt[0] >> 4) == 6 ? ETHERNET_TYPE_IPV6 : ETHERNET_TYPE_IP;
+            break;
+        default:
+            return 0;
+    }
+
+    *offset = o;
+    if (type == ETHERNET_TYPE_IP && len >= o + 20)
+        return 4;
+    if (type == ETHERNET_TYPE_IPV6 && len >= o + 40)
+        return 6;
+    return 0;
+}
+
+/** \internal
+ *  \brief pick the shard for a raw packet
+ *
+ *  Uses the same address sum as the autofp 'ippair' load balancer, so all
+ *  packets between two hosts, fragments included, end up on the same shard.
+ *  Packets that are not IP, or use a datalink we don't parse here, go to
+ *  shard 0.
+ */
+static uint16_t PcapFileShardGet(
+        const int datalink, const uint8_t *pkt, const uint32_t len, const uint16_t shards)
+{
+    uint32_t offset = 0;
+    uint32_t addr_hash = 0;
+    uint32_t a[8];
+
+    switch (PcapFileShardGetIPHeader(datalink, pkt, len, &offset)) {
+        case 4:
+            memcpy(a, pkt + offset + 12, 8);
+            addr_hash = a[0] + a[1];
+            break;
+        case 6:
+            memcpy(a, pkt + offset + 8, 32);
+            for (int i = 0; i < 8; i++) {
+                addr_hash += a[i];
+            }
+            break;
+        default:
+            return 0;
+    }
+    return (uint16_t)(addr_hash % shards);
+}
+
+#ifdef HAVE_SYS_MMAN_H
+static void PcapFileMapDeref(PcapFileMap *map)
+{
+    if (SC_ATOMIC_SUB(map->ref, 1) == 1) {
+        munmap(map->data, map->size);
+        SCFree(map);
+    }
+}
+
+/** \internal
+ *  \brief release a packet pointing into a mapped pcap file */
+static void PcapFileMmapReleasePacket(Packet *p)
+{
+    PcapFileMap *map = p->pcap_v.map;
+    p->pcap_v.map = NULL;
+    PacketFreeOrRelease(p);
+    if (map != NULL)
+        PcapFileMapDeref(map);
+}
+#endif
+
 void PcapFileCallbackLoop(char *user, struct pcap_pkthdr *h, u_char *pkt)
 {
     SCEnter();
@@ -69,6 +197,15 @@ void PcapFileCallbackLoop(char *user, struct pcap_pkthdr *h, u_char *pkt)
     }
 #endif
     PcapFileFileVars *ptv = (PcapFileFileVars *)user;
+
+    if (pcap_g.shards > 1) {
+        ptv->shared->shard_pcap_cnt++;
+        if (PcapFileShardGet(ptv->datalink, pkt, h->caplen, pcap_g.shards) !=
+                ptv->shared->shard_id) {
+            SCReturn;
+        }
+    }
+
     Packet *p = PacketGetFromQueueOrAlloc();
 
     if (unlikely(p == NULL)) {
@@ -80,12 +217,26 @@ void PcapFileCallbackLoop(char *user, struct pcap_pkthdr *h, u_char *pkt)
     p->ts = SCTIME_FROM_TIMEVAL_UNTRUSTED(&h->ts);
     SCLogDebug("p->ts.tv_sec %" PRIuMAX "", (uintmax_t)SCTIME_SECS(p->ts));
     p->datalink = ptv->datalink;
-    p->pcap_cnt = ++pcap_g.cnt;
+    if (pcap_g.shards > 1) {
+        p->pcap_cnt = ptv->shared->shard_pcap_cnt;
+    } else {
+        p->pcap_cnt = ++pcap_g.cnt;
+    }
 
     p->pcap_v.tenant_id = ptv->shared->tenant_id;
     ptv->shared->pkts++;
     ptv->shared->bytes += h->caplen;
 
+#ifdef HAVE_SYS_MMAN_H
+    if (ptv->map != NULL) {
+        /* the packet points into the mapping, so it holds a reference
+         * until it is released */
+        (void)SC_ATOMIC_ADD(ptv->map->ref, 1);
+        p->pcap_v.map = ptv->map;
+        p->ReleasePacket = PcapFileMmapReleasePacket;
+        (void)PacketSetData(p, pkt, h->caplen);
+    } else
+#endif
     if (unlikely(PacketCopyData(p, pkt, h->caplen))) {
         TmqhOutputPacketpool(ptv->shared->tv, p);
         PACKET_PROFILING_TMM_END(p, TMM_RECEIVEPCAPFILE);
@@ -106,7 +257,8 @@ void PcapFileCallbackLoop(char *user, struct pcap_pkthdr *h, u_char *pkt)
     PACKET_PROFILING_TMM_END(p, TMM_RECEIVEPCAPFILE);
 
     if (TmThreadsSlotProcessPkt(ptv->shared->tv, ptv->shared->slot, p) != TM_ECODE_OK) {
-        pcap_breakloop(ptv->pcap_handle);
+        if (ptv->map == NULL)
+            pcap_breakloop(ptv->pcap_handle);
         ptv->shared->cb_result = TM_ECODE_FAILED;
     }
 
@@ -120,6 +272,241 @@ const char *PcapFileGetFilename(void)
     return pcap_filename;
 }
 
+#ifdef HAVE_SYS_MMAN_H
+/* classic pcap file format, see pcap-savefile(5) */
+#define PCAP_FILE_MAGIC_USEC  0xa1b2c3d4U
+#define PCAP_FILE_MAGIC_NSEC  0xa1b23c4dU
+#define PCAP_FILE_HDR_LEN     24
+#define PCAP_FILE_REC_HDR_LEN 16
+/** records with a larger capture length are considered corrupt, like
+ *  libpcap does */
+#define PCAP_FILE_MAX_CAPLEN 262144U
+/** how far ahead of the reader the kernel is asked to page in the file */
+#define PCAP_FILE_READAHEAD (64ULL * 1024ULL * 1024ULL)
+
+static inline uint32_t PcapFileMmapGet32(const PcapFileFileVars *pfv, const uint8_t *ptr)
+{
+    uint32_t v;
+    memcpy(&v, ptr, sizeof(v));
+    return pfv->map_swapped ? SCByteSwap32(v) : v;
+}
+
+/** \internal
+ *  \brief map a classic pcap file and parse its file header
+ *
+ *  \retval 1 file is mapped
+ *  \retval 0 file can't be mapped or is not a classic pcap (e.g. pcapng),
+ *          caller should fall back to libpcap
+ */
+static int PcapFileMmapOpen(PcapFileFileVars *pfv)
+{
+    int fd = open(pfv->filename, O_RDONLY);
+    if (fd < 0)
+        return 0;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size < PCAP_FILE_HDR_LEN) {
+        close(fd);
+        return 0;
+    }
+    /* private writable mapping: decoders may modify the packet data, which
+     * then only touches a copy of the page */
+    uint8_t *data = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        SCLogDebug("mmap of %s failed: %s", pfv->filename, strerror(errno));
+        return 0;
+    }
+
+    uint32_t magic;
+    memcpy(&magic, data, sizeof(magic));
+    if (magic == PCAP_FILE_MAGIC_USEC || magic == PCAP_FILE_MAGIC_NSEC) {
+        pfv->map_swapped = false;
+    } else if (magic == SCByteSwap32(PCAP_FILE_MAGIC_USEC) ||
+               magic == SCByteSwap32(PCAP_FILE_MAGIC_NSEC)) {
+        pfv->map_swapped = true;
+        magic = SCByteSwap32(magic);
+    } else {
+        SCLogDebug("%s is not a classic pcap file, reading it through libpcap", pfv->filename);
+        munmap(data, (size_t)st.st_size);
+        return 0;
+    }
+
+    PcapFileMap *map = SCCalloc(1, sizeof(*map));
+    if (unlikely(map == NULL)) {
+        munmap(data, (size_t)st.st_size);
+        return 0;
+    }
+    map->data = data;
+    map->size = (uint64_t)st.st_size;
+    SC_ATOMIC_INIT(map->ref);
+    SC_ATOMIC_SET(map->ref, 1);
+    (void)madvise(data, (size_t)st.st_size, MADV_SEQUENTIAL);
+
+    pfv->map = map;
+    pfv->map_nsec = (magic == PCAP_FILE_MAGIC_NSEC);
+    pfv->map_snaplen = PcapFileMmapGet32(pfv, data + 16);
+    /* upper bits of the link type field carry FCS info */
+    const uint32_t linktype = PcapFileMmapGet32(pfv, data + 20) & 0xffff;
+    /* libpcap translates the file's LINKTYPE_RAW to the platform's DLT_RAW */
+    pfv->datalink = linktype == LINKTYPE_RAW2 ? LINKTYPE_RAW : (int)linktype;
+    pfv->map_offset = PCAP_FILE_HDR_LEN;
+    pfv->map_advised = 0;
+    return 1;
+}
+
+/** \internal
+ *  \brief parse the pcap record at the current offset
+ *
+ *  \param advance move the offset past the record
+ *
+ *  \retval 1 record returned in h and pkt
+ *  \retval 0 end of file
+ *  \retval -1 truncated or corrupt record
+ */
+static int PcapFileMmapNext(
+        PcapFileFileVars *pfv, struct pcap_pkthdr *h, u_char **pkt, const bool advance)
+{
+    const PcapFileMap *map = pfv->map;
+    const uint64_t left = map->size - pfv->map_offset;
+    if (left == 0)
+        return 0;
+    if (left < PCAP_FILE_REC_HDR_LEN) {
+        SCLogError("truncated pcap record header at offset %" PRIu64 " in %s", pfv->map_offset,
+                pfv->filename);
+        return -1;
+    }
+
+    uint8_t *rec = map->data + pfv->map_offset;
+    const uint32_t caplen = PcapFileMmapGet32(pfv, rec + 8);
+    if (caplen > PCAP_FILE_MAX_CAPLEN) {
+        SCLogError("invalid capture length %u at offset %" PRIu64 " in %s", caplen,
+                pfv->map_offset, pfv->filename);
+        return -1;
+    }
+    if (caplen > left - PCAP_FILE_REC_HDR_LEN) {
+        SCLogError("truncated pcap record at offset %" PRIu64 " in %s", pfv->map_offset,
+                pfv->filename);
+        return -1;
+    }
+
+    const uint32_t ts_frac = PcapFileMmapGet32(pfv, rec + 4);
+    h->ts.tv_sec = (time_t)PcapFileMmapGet32(pfv, rec);
+    h->ts.tv_usec = (suseconds_t)(pfv->map_nsec ? ts_frac / 1000 : ts_frac);
+    h->caplen = caplen;
+    h->len = PcapFileMmapGet32(pfv, rec + 12);
+    *pkt = rec + PCAP_FILE_REC_HDR_LEN;
+
+    if (advance)
+        pfv->map_offset += PCAP_FILE_REC_HDR_LEN + caplen;
+    return 1;
+}
+
+/** \internal
+ *  \brief ask the kernel to page in the part of the file ahead of the reader
+ *
+ *  MADV_SEQUENTIAL only makes the kernel's own read-ahead more aggressive.
+ *  Explicitly requesting the next window keeps the disk busy while the
+ *  current one is processed. Done in half window steps to limit the syscalls.
+ */
+static void PcapFileMmapReadAhead(PcapFileFileVars *pfv)
+{
+    static uint64_t page_mask = 0;
+    if (unlikely(page_mask == 0))
+        page_mask = (uint64_t)sysconf(_SC_PAGESIZE) - 1;
+
+    const PcapFileMap *map = pfv->map;
+    if (pfv->map_advised >= map->size ||
+            pfv->map_offset + PCAP_FILE_READAHEAD / 2 < pfv->map_advised)
+        return;
+
+    const uint64_t start = MAX(pfv->map_advised, pfv->map_offset) & ~page_mask;
+    const uint64_t end = MIN(map->size, pfv->map_offset + PCAP_FILE_READAHEAD);
+    (void)madvise(map->data + start, (size_t)(end - start), MADV_WILLNEED);
+    pfv->map_advised = end;
+}
+
+static TmEcode PcapFileMmapDispatch(PcapFileFileVars *ptv)
+{
+    SCEnter();
+    const int packet_q_len = 64;
+    TmEcode loop_result = TM_ECODE_OK;
+
+    while (loop_result == TM_ECODE_OK) {
+        if (suricata_ctl_flags & SURICATA_STOP) {
+            SCReturnInt(TM_ECODE_OK);
+        }
+
+        /* make sure we have at least one packet in the packet pool, to prevent
+         * us from alloc'ing packets at line rate */
+        PacketPoolWait();
+
+        PcapFileMmapReadAhead(ptv);
+
+        for (int i = 0; i < packet_q_len; i++) {
+            struct pcap_pkthdr h;
+            u_char *pkt = NULL;
+            const int r = PcapFileMmapNext(ptv, &h, &pkt, true);
+            if (unlikely(r < 0)) {
+                loop_result = TM_ECODE_DONE;
+                break;
+            } else if (unlikely(r == 0)) {
+                SCLogInfo("pcap file %s end of file reached", ptv->filename);
+                ptv->shared->files++;
+                loop_result = TM_ECODE_DONE;
+                break;
+            }
+
+            if (ptv->map_filter && pcap_offline_filter(&ptv->filter, &h, pkt) == 0)
+                continue;
+
+            PcapFileCallbackLoop((char *)ptv, &h, pkt);
+            if (ptv->shared->cb_result == TM_ECODE_FAILED) {
+                SCLogError("Pcap callback PcapFileCallbackLoop failed for %s", ptv->filename);
+                loop_result = TM_ECODE_FAILED;
+                break;
+            }
+        }
+        StatsSyncCountersIfSignalled(ptv->shared->tv);
+    }
+
+    SCReturnInt(loop_result);
+}
+
+/** \internal
+ *  \brief setup a mapped file: bpf and first packet timestamp */
+static TmEcode PcapFileMmapInit(PcapFileFileVars *pfv)
+{
+    if (pfv->shared != NULL && pfv->shared->bpf_string != NULL) {
+        char errbuf[PCAP_ERRBUF_SIZE] = "";
+
+        SCLogInfo("using bpf-filter \"%s\"", pfv->shared->bpf_string);
+        if (SCBPFCompile((int)pfv->map_snaplen, pfv->datalink, &pfv->filter,
+                    pfv->shared->bpf_string, 1, 0, errbuf, sizeof(errbuf)) < 0) {
+            SCLogError("bpf compilation error %s for %s", errbuf, pfv->filename);
+            SCReturnInt(TM_ECODE_FAILED);
+        }
+        pfv->map_filter = true;
+    }
+
+    SCLogDebug("datalink %" PRId32 "", pfv->datalink);
+    DatalinkSetGlobalType(pfv->datalink);
+
+    struct pcap_pkthdr h;
+    u_char *pkt = NULL;
+    if (PcapFileMmapNext(pfv, &h, &pkt, false) != 1) {
+        SCLogError("failed to get first packet timestamp for %s", pfv->filename);
+        SCReturnInt(TM_ECODE_FAILED);
+    }
+    pfv->first_pkt_ts.tv_sec = h.ts.tv_sec;
+    pfv->first_pkt_ts.tv_usec = h.ts.tv_usec;
+
+    DecoderFunc UnusedFnPtr;
+    TmEcode validated = ValidateLinkType(pfv->datalink, &UnusedFnPtr);
+    SCReturnInt(validated);
+}
+#endif /* HAVE_SYS_MMAN_H */
+
 /**
  *  \brief Main PCAP file reading Loop function
  */
@@ -128,8 +515,13 @@ TmEcode PcapFileDispatch(PcapFileFileVars *ptv)
     SCEnter();
 
     /* initialize all the thread's initial timestamp */
+    if (likely(ptv->first_pkt_hdr != NULL || ptv->map != NULL)) {
+        /* with shards, leave it to the first one so we don't move the time
+         * of shards that are already running back */
+        if (pcap_g.shards <= 1 || ptv->shared->shard_id == 0)
+            TmThreadsInitThreadsTimestamp(SCTIME_FROM_TIMEVAL(&ptv->first_pkt_ts));
+    }
     if (likely(ptv->first_pkt_hdr != NULL)) {
-        TmThreadsInitThreadsTimestamp(SCTIME_FROM_TIMEVAL(&ptv->first_pkt_ts));
         PcapFileCallbackLoop((char *)ptv, ptv->first_pkt_hdr,
                 (u_char *)ptv->first_pkt_data);
         ptv->first_pkt_hdr = NULL;
@@ -140,6 +532,11 @@ TmEcode PcapFileDispatch(PcapFileFileVars *ptv)
     TmEcode loop_result = TM_ECODE_OK;
     strlcpy(pcap_filename, ptv->filename, sizeof(pcap_filename));
 
+#ifdef HAVE_SYS_MMAN_H
+    if (ptv->map != NULL)
+        SCReturnInt(PcapFileMmapDispatch(ptv));
+#endif
+
     while (loop_result == TM_ECODE_OK) {
         if (suricata_ctl_flags & SURICATA_STOP) {
             SCReturnInt(TM_ECODE_OK);
@@ -202,6 +599,12 @@ TmEcode InitPcapFile(PcapFileFileVars *pfv)
         SCReturnInt(TM_ECODE_FAILED);
     }
 
+#ifdef HAVE_SYS_MMAN_H
+    if (pcap_g.mmap && PcapFileMmapOpen(pfv) == 1) {
+        SCReturnInt(PcapFileMmapInit(pfv));
+    }
+#endif
+
     pfv->pcap_handle = pcap_open_offline(pfv->filename, errbuf);
     if (pfv->pcap_handle == NULL) {
         SCLogError("%s", errbuf);
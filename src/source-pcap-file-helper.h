@@ -33,6 +33,15 @@ typedef struct PcapFileGlobalVars_ {
     ChecksumValidationMode checksum_mode;
     SC_ATOMIC_DECLARE(unsigned int, invalid_checksums);
     uint32_t read_buffer_size;
+    /** read the files through a memory mapping instead of libpcap */
+    bool mmap;
+
+    /** number of shards in the 'workers' runmode. Each shard reads all input
+     *  and processes only the packets of its share of the IP pairs. 0 if not
+     *  sharding. */
+    uint16_t shards;
+    SC_ATOMIC_DECLARE(uint16_t, shard_ids);     /**< next shard id to hand out */
+    SC_ATOMIC_DECLARE(uint16_t, shards_active); /**< shards still reading */
 } PcapFileGlobalVars;
 
 /**
@@ -59,10 +68,26 @@ typedef struct PcapFileSharedVars_
     uint8_t done;
     uint32_t errs;
 
+    /** shard handled by this thread, see PcapFileGlobalVars::shards */
+    uint16_t shard_id;
+    /** packets read including those skipped for other shards. Used as
+     *  pcap_cnt when sharding so it matches the position in the input. */
+    uint64_t shard_pcap_cnt;
+
     /** callback result -- set if one of the thread module failed. */
     int cb_result;
 } PcapFileSharedVars;
 
+/**
+ * A pcap file mapped in memory. Packets point into the mapping, so it is
+ * reference counted: one reference for the file vars and one per packet.
+ */
+typedef struct PcapFileMap_ {
+    uint8_t *data;
+    uint64_t size;
+    SC_ATOMIC_DECLARE(uint32_t, ref);
+} PcapFileMap;
+
 /**
  * Data specific to a single pcap file
  */
@@ -82,6 +107,16 @@ typedef struct PcapFileFileVars_
     struct pcap_pkthdr *first_pkt_hdr;
     struct timeval first_pkt_ts;
 
+    /** file mapping if the file is read with pcap-file.mmap, NULL when it is
+     *  read through libpcap */
+    PcapFileMap *map;
+    uint64_t map_offset;  /**< offset of the next record */
+    uint64_t map_advised; /**< end of the range the kernel was asked to read ahead */
+    uint32_t map_snaplen;
+    bool map_swapped; /**< file written with the other byte order */
+    bool map_nsec;    /**< timestamps in nanoseconds */
+    bool map_filter;  /**< bpf filter compiled into filter */
+
     /** flex array member for the libc io read buffer. Size controlled by
      * PcapFileGlobalVars::read_buffer_size. */
 #if defined(HAVE_SETVBUF) && defined(OS_LINUX)
@@ -147,6 +147,8 @@ void PcapFileGlobalInit(void)
 {
     memset(&pcap_g, 0x00, sizeof(pcap_g));
     SC_ATOMIC_INIT(pcap_g.invalid_checksums);
+    SC_ATOMIC_INIT(pcap_g.shard_ids);
+    SC_ATOMIC_INIT(pcap_g.shards_active);
 
 #if defined(HAVE_SETVBUF) && defined(OS_LINUX)
     pcap_g.read_buffer_size = PCAP_FILE_BUFFER_SIZE_DEFAULT;
@@ -166,6 +168,29 @@ void PcapFileGlobalInit(void)
         }
     }
 #endif
+
+    int use_mmap = 0;
+    if (SCConfGetBool("pcap-file.mmap", &use_mmap) == 1 && use_mmap) {
+#ifdef HAVE_SYS_MMAN_H
+        SCLogConfig("pcap-file: reading files through mmap");
+        pcap_g.mmap = true;
+#else
+        SCLogWarning("pcap-file.mmap is not supported on this platform, ignoring");
+#endif
+    }
+}
+
+/**
+ *  \brief set the number of reader threads that split the input by IP pair
+ *
+ *  Needs to be called after PcapFileGlobalInit() and before the reader
+ *  threads are started.
+ */
+void PcapFileSetShards(uint16_t shards)
+{
+    pcap_g.shards = shards;
+    SC_ATOMIC_SET(pcap_g.shard_ids, 0);
+    SC_ATOMIC_SET(pcap_g.shards_active, shards);
 }
 
 TmEcode PcapFileExit(TmEcode status, struct timespec *last_processed)
@@ -214,6 +239,14 @@ TmEcode ReceivePcapFileLoop(ThreadVars *tv, void *data, void *slot)
 
     SCLogDebug("Pcap file loop complete with status %u", status);
 
+    /* with shards, the last one to finish stops the engine. The others stay
+     * around to handle the flow timeouts of their flows. */
+    if (pcap_g.shards > 1 && status != TM_ECODE_FAILED &&
+            SC_ATOMIC_SUB(pcap_g.shards_active, 1) > 1) {
+        SCLogInfo("shard %u done, waiting for the other shards", ptv->shared.shard_id);
+        SCReturnInt(TM_ECODE_DONE);
+    }
+
     status = PcapFileExit(status, &ptv->shared.last_processed);
     SCReturnInt(status);
 }
@@ -267,6 +300,18 @@ TmEcode ReceivePcapFileThreadInit(ThreadVars *tv, const void *initdata, void **d
         ptv->shared.should_delete = should_delete == 1;
     }
 
+    if (pcap_g.shards > 1) {
+        ptv->shared.shard_id = SC_ATOMIC_ADD(pcap_g.shard_ids, 1);
+        SCLogDebug("reading shard %u of %u", ptv->shared.shard_id, pcap_g.shards);
+        /* all shards read the same files, so none of them can delete them */
+        if (ptv->shared.should_delete) {
+            if (ptv->shared.shard_id == 0)
+                SCLogWarning("pcap-file.delete-when-done is not supported with the "
+                             "workers runmode, ignoring");
+            ptv->shared.should_delete = false;
+        }
+    }
+
     DIR *directory = NULL;
     SCLogDebug("checking file or directory %s", (char*)initdata);
     if(PcapDetermineDirectoryOrFile((char *)initdata, &directory) == TM_ECODE_FAILED) {
@@ -411,9 +456,16 @@ void ReceivePcapFileThreadExitStats(ThreadVars *tv, void *data)
                 SCLogInfo("1/%" PRIu64 "th of packets have an invalid checksum",
                       chrate);
         }
-        SCLogNotice("read %" PRIu64 " file%s, %" PRIu64 " packets, %" PRIu64 " bytes",
-                ptv->shared.files, ptv->shared.files == 1 ? "" : "s", ptv->shared.pkts,
-                ptv->shared.bytes);
+        if (pcap_g.shards > 1) {
+            SCLogNotice("shard %u: read %" PRIu64 " file%s, %" PRIu64 " of %" PRIu64
+                        " packets, %" PRIu64 " bytes",
+                    ptv->shared.shard_id, ptv->shared.files, ptv->shared.files == 1 ? "" : "s",
+                    ptv->shared.pkts, ptv->shared.shard_pcap_cnt, ptv->shared.bytes);
+        } else {
+            SCLogNotice("read %" PRIu64 " file%s, %" PRIu64 " packets, %" PRIu64 " bytes",
+                    ptv->shared.files, ptv->shared.files == 1 ? "" : "s", ptv->shared.pkts,
+                    ptv->shared.bytes);
+        }
     }
 }
 
@@ -30,5 +30,6 @@ void TmModuleDecodePcapFileRegister (void);
 void PcapIncreaseInvalidChecksum(void);
 
 void PcapFileGlobalInit(void);
+void PcapFileSetShards(uint16_t shards);
 
 #endif /* SURICATA_SOURCE_PCAP_FILE_H */
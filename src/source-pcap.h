@@ -31,10 +31,14 @@ void PcapTranslateIPToDevice(char *pcap_dev, size_t len);
 #define LIBPCAP_COPYWAIT    500
 #define LIBPCAP_PROMISC     1
 
+struct PcapFileMap_;
+
 /* per packet Pcap vars */
 typedef struct PcapPacketVars_
 {
     uint32_t tenant_id;
+    /** pcap file mapping the packet data points into, see pcap-file.mmap */
+    struct PcapFileMap_ *map;
 } PcapPacketVars;
 
 /** needs to be able to contain Windows adapter id's, so
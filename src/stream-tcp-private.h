@@ -51,6 +51,15 @@ typedef struct StreamTcpSackRecord {
 
 int TcpSackCompare(struct StreamTcpSackRecord *a, struct StreamTcpSackRecord *b);
 
+/** number of SACK ranges kept in the TcpStream itself before switching to
+ *  the tree */
+#define STREAM_SACK_INLINE_RANGES 8
+
+typedef struct StreamTcpSackRange_ {
+    uint32_t le;    /**< left edge, host order */
+    uint32_t re;    /**< right edge, host order */
+} StreamTcpSackRange;
+
 /* red-black tree prototype for SACK records */
 RB_HEAD(TCPSACK, StreamTcpSackRecord);
 RB_PROTOTYPE(TCPSACK, StreamTcpSackRecord, rb, TcpSackCompare);
@@ -138,7 +147,12 @@ typedef struct TcpStream_ {
 
     uint32_t sack_size;             /**< combined size of the SACK ranges currently in our tree. Updated
                                      *   at INSERT/REMOVE time. */
+    uint8_t sack_inline_cnt;        /**< number of ranges in sack_inline. 0 when the tree is in use. */
+    StreamTcpSackRange sack_inline[STREAM_SACK_INLINE_RANGES]; /**< sorted SACK ranges, used
+                                                                *   until they no longer fit */
     struct TCPSACK sack_tree;       /**< red back tree of TCP SACK records. */
+
+    struct MpmStreamState_ *mpm_stream; /**< raw stream MPM state for streaming mode */
 } TcpStream;
 
 #define STREAM_BASE_OFFSET(stream)  ((stream)->sb.region.stream_offset)
@@ -208,6 +222,11 @@ enum TcpState {
 /* zero window probe */
 #define STREAMTCP_FLAG_ZWP_TS BIT_U32(17)
 #define STREAMTCP_FLAG_ZWP_TC BIT_U32(18)
+/** session counted in the per alproto reassembly counters */
+#define STREAMTCP_FLAG_ALPROTO_COUNTED BIT_U32(19)
+/** session counted as 'unknown' in the per alproto reassembly counters until
+ *  protocol detection completes, see TcpSession::alproto_pending */
+#define STREAMTCP_FLAG_ALPROTO_PENDING BIT_U32(20)
 
 /*
  * Per STREAM flags
@@ -280,6 +299,16 @@ enum TcpState {
         }                                                                                          \
     }
 
+/** reassembly work of a session counted as 'unknown' in the per alproto
+ *  counters before protocol detection completed */
+typedef struct TcpSessionAlprotoPending_ {
+    uint32_t segments;
+    uint32_t bytes;
+    uint32_t bytes_copied;
+    uint32_t regions;
+    uint32_t gaps;
+} TcpSessionAlprotoPending;
+
 typedef struct TcpSession_ {
     PoolThreadId pool_id;
     uint8_t state:4;                        /**< tcp state from state enum */
@@ -296,6 +325,7 @@ typedef struct TcpSession_ {
     TcpStream server;
     TcpStream client;
     TcpStateQueue *queue; /**< list of SYN or SYN/ACK candidates */
+    TcpSessionAlprotoPending alproto_pending;
 } TcpSession;
 
 #define StreamTcpSetStreamFlagAppProtoDetectionCompleted(stream) \
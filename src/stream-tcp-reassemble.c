@@ -61,6 +61,7 @@
 #include "util-debug.h"
 #include "app-layer-protos.h"
 #include "app-layer.h"
+#include "app-layer-detect-proto.h"
 #include "app-layer-events.h"
 #include "app-layer-parser.h"
 #include "app-layer-frames.h"
@@ -88,6 +89,19 @@ SC_ATOMIC_DECLARE(uint64_t, ra_memuse);
 
 static int g_tcp_session_dump_enabled = 0;
 
+typedef struct StreamReassemblyAlprotoCounterNames_ {
+    char streams[64];
+    char segments[64];
+    char bytes[64];
+    char bytes_copied[64];
+    char regions[64];
+    char gaps[64];
+} StreamReassemblyAlprotoCounterNames;
+
+/** counter names per alproto, NULL if per alproto stats are disabled. The
+ *  names need to stay valid as long as the counters are registered. */
+static StreamReassemblyAlprotoCounterNames *reassembly_alproto_counter_names = NULL;
+
 inline bool IsTcpSessionDumpingEnabled(void)
 {
     return g_tcp_session_dump_enabled == 1;
@@ -113,7 +127,7 @@ void StreamTcpReassembleInitMemuse(void)
  *
  *  \param  size Size of the TCP segment and its payload length memory allocated
  */
-static void StreamTcpReassembleIncrMemuse(uint64_t size)
+void StreamTcpReassembleIncrMemuse(uint64_t size)
 {
     (void) SC_ATOMIC_ADD(ra_memuse, size);
     SCLogDebug("REASSEMBLY %" PRIu64 ", incr %" PRIu64, StreamTcpReassembleMemuseGlobalCounter(),
@@ -126,7 +140,7 @@ static void StreamTcpReassembleIncrMemuse(uint64_t size)
  *
  *  \param  size Size of the TCP segment and its payload length memory allocated
  */
-static void StreamTcpReassembleDecrMemuse(uint64_t size)
+void StreamTcpReassembleDecrMemuse(uint64_t size)
 {
 #ifdef UNITTESTS
     uint64_t presize = SC_ATOMIC_GET(ra_memuse);
@@ -469,6 +483,79 @@ int StreamTcpAppLayerIsDisabled(Flow *f)
     return (ssn->flags & STREAMTCP_FLAG_APP_LAYER_DISABLED);
 }
 
+static void StreamTcpReassembleSetupAlprotoCounterName(AppProto alproto)
+{
+    const char *alproto_str = AppProtoToString(alproto);
+    StreamReassemblyAlprotoCounterNames *n = &reassembly_alproto_counter_names[alproto];
+
+    snprintf(n->streams, sizeof(n->streams), "tcp.reassembly.%s.streams", alproto_str);
+    snprintf(n->segments, sizeof(n->segments), "tcp.reassembly.%s.segments", alproto_str);
+    snprintf(n->bytes, sizeof(n->bytes), "tcp.reassembly.%s.bytes", alproto_str);
+    snprintf(n->bytes_copied, sizeof(n->bytes_copied), "tcp.reassembly.%s.bytes_copied",
+            alproto_str);
+    snprintf(n->regions, sizeof(n->regions), "tcp.reassembly.%s.regions", alproto_str);
+    snprintf(n->gaps, sizeof(n->gaps), "tcp.reassembly.%s.gaps", alproto_str);
+}
+
+/** \internal
+ *  \brief set up the counter names for the protocols that can run over TCP,
+ *         plus "unknown" for data seen before protocol detection completes
+ *         and "failed" for streams where it failed. */
+static void StreamTcpReassembleSetupAlprotoCounters(void)
+{
+    if (reassembly_alproto_counter_names != NULL)
+        return;
+
+    reassembly_alproto_counter_names =
+            SCCalloc(g_alproto_max, sizeof(StreamReassemblyAlprotoCounterNames));
+    if (unlikely(reassembly_alproto_counter_names == NULL)) {
+        FatalError("Unable to alloc reassembly_alproto_counter_names.");
+    }
+
+    AppProto alprotos[g_alproto_max];
+    AppLayerProtoDetectSupportedAppProtocols(alprotos);
+
+    for (AppProto alproto = 0; alproto < g_alproto_max; alproto++) {
+        if (alproto == ALPROTO_UNKNOWN || alproto == ALPROTO_FAILED) {
+            StreamTcpReassembleSetupAlprotoCounterName(alproto);
+        } else if (alprotos[alproto] == 1) {
+            uint8_t ipprotos[256 / 8];
+            memset(ipprotos, 0, sizeof(ipprotos));
+            AppLayerProtoDetectSupportedIpprotos(alproto, ipprotos);
+            if (ipprotos[IPPROTO_TCP / 8] & (1 << (IPPROTO_TCP % 8))) {
+                StreamTcpReassembleSetupAlprotoCounterName(alproto);
+            }
+        }
+    }
+}
+
+/** \brief register the per alproto counters for this thread, if enabled */
+void StreamTcpReassembleRegisterAlprotoCounters(ThreadVars *tv, TcpReassemblyThreadCtx *ra_ctx)
+{
+    if (reassembly_alproto_counter_names == NULL)
+        return;
+
+    ra_ctx->counter_alproto = SCCalloc(g_alproto_max, sizeof(StreamReassemblyAlprotoCounters));
+    if (unlikely(ra_ctx->counter_alproto == NULL)) {
+        SCLogWarning("failed to alloc per alproto reassembly counters");
+        return;
+    }
+
+    for (AppProto alproto = 0; alproto < g_alproto_max; alproto++) {
+        const StreamReassemblyAlprotoCounterNames *n = &reassembly_alproto_counter_names[alproto];
+        StreamReassemblyAlprotoCounters *c = &ra_ctx->counter_alproto[alproto];
+        if (n->streams[0] == '\0')
+            continue;
+
+        c->streams = StatsRegisterCounter(n->streams, tv);
+        c->segments = StatsRegisterCounter(n->segments, tv);
+        c->bytes = StatsRegisterCounter(n->bytes, tv);
+        c->bytes_copied = StatsRegisterCounter(n->bytes_copied, tv);
+        c->regions = StatsRegisterCounter(n->regions, tv);
+        c->gaps = StatsRegisterCounter(n->gaps, tv);
+    }
+}
+
 static int StreamTcpReassemblyConfig(bool quiet)
 {
     uint32_t segment_prealloc = 2048;
@@ -517,6 +604,14 @@ static int StreamTcpReassemblyConfig(bool quiet)
     stream_config.sbcnf.Realloc = StreamTcpReassembleRealloc;
     stream_config.sbcnf.Free = ReassembleFree;
 
+    int alproto_stats = 0;
+    (void)SCConfGetBool("stream.reassembly.alproto-stats", &alproto_stats);
+    if (!quiet)
+        SCLogConfig("stream.reassembly \"alproto-stats\": %s", alproto_stats ? "yes" : "no");
+    if (alproto_stats) {
+        StreamTcpReassembleSetupAlprotoCounters();
+    }
+
     return 0;
 }
 
@@ -552,6 +647,11 @@ void StreamTcpReassembleFree(bool quiet)
                 segment_pool_memuse, segment_pool_memcnt);
     SCMutexDestroy(&segment_pool_memuse_mutex);
 #endif
+
+    if (reassembly_alproto_counter_names != NULL) {
+        SCFree(reassembly_alproto_counter_names);
+        reassembly_alproto_counter_names = NULL;
+    }
 }
 
 TcpReassemblyThreadCtx *StreamTcpReassembleInitThreadCtx(ThreadVars *tv)
@@ -600,6 +700,8 @@ void StreamTcpReassembleFreeThreadCtx(TcpReassemblyThreadCtx *ra_ctx)
 
     if (ra_ctx) {
         AppLayerDestroyCtxThread(ra_ctx->app_tctx);
+        if (ra_ctx->counter_alproto != NULL)
+            SCFree(ra_ctx->counter_alproto);
         SCFree(ra_ctx);
     }
     SCReturn;
@@ -733,6 +835,162 @@ uint32_t StreamDataAvailableForProtoDetect(TcpStream *stream)
     return stream->sb.sbb_size;
 }
 
+/** \internal
+ *  \brief add the streaming buffer work done since 'pre' to the counters */
+static void StreamTcpReassembleAccountBufferStats(ThreadVars *tv, TcpSession *ssn,
+        const StreamReassemblyAlprotoCounters *c, const StreamingBufferThreadStats *pre)
+{
+    StreamingBufferThreadStats post;
+    StreamingBufferGetThreadStats(&post);
+    const uint64_t regions = post.regions - pre->regions;
+    const uint64_t bytes_copied = post.bytes_copied - pre->bytes_copied;
+    if (regions != 0)
+        StatsAddUI64(tv, c->regions, regions);
+    if (bytes_copied != 0)
+        StatsAddUI64(tv, c->bytes_copied, bytes_copied);
+    if (ssn->flags & STREAMTCP_FLAG_ALPROTO_PENDING) {
+        ssn->alproto_pending.regions += (uint32_t)regions;
+        ssn->alproto_pending.bytes_copied += (uint32_t)bytes_copied;
+    }
+}
+
+/** \internal
+ *  \brief get the counters the session's reassembly work is charged to
+ *
+ *  Until protocol detection completes this is 'unknown'.
+ *
+ *  \retval c counters or NULL if the protocol has none registered */
+static const StreamReassemblyAlprotoCounters *StreamTcpReassembleGetAlprotoCounters(
+        const TcpReassemblyThreadCtx *ra_ctx, const TcpSession *ssn, const Flow *f)
+{
+    AppProto alproto = f->alproto < g_alproto_max ? f->alproto : ALPROTO_UNKNOWN;
+    if (ssn->flags & STREAMTCP_FLAG_ALPROTO_PENDING)
+        alproto = ALPROTO_UNKNOWN;
+    const StreamReassemblyAlprotoCounters *c = &ra_ctx->counter_alproto[alproto];
+    if (c->segments == 0)
+        return NULL;
+    return c;
+}
+
+/** \internal
+ *  \brief move the work counted as 'unknown' to the session's protocol
+ *
+ *  Called after the app-layer update. Once protocol detection has set the
+ *  protocol or has failed, the stream and the work done before are taken out
+ *  of the 'unknown' counters and added to the protocol's counters, so each
+ *  session is counted in the streams of the protocol its data is counted for.
+ */
+static void StreamTcpReassembleMoveAlprotoCounters(
+        ThreadVars *tv, TcpReassemblyThreadCtx *ra_ctx, TcpSession *ssn, const Flow *f)
+{
+    if (ra_ctx->counter_alproto == NULL || !(ssn->flags & STREAMTCP_FLAG_ALPROTO_PENDING) ||
+            f->alproto == ALPROTO_UNKNOWN)
+        return;
+
+    const StreamReassemblyAlprotoCounters *u =
+            StreamTcpReassembleGetAlprotoCounters(ra_ctx, ssn, f);
+    ssn->flags &= ~STREAMTCP_FLAG_ALPROTO_PENDING;
+    const StreamReassemblyAlprotoCounters *c =
+            StreamTcpReassembleGetAlprotoCounters(ra_ctx, ssn, f);
+    if (u != NULL && c != NULL) {
+        const TcpSessionAlprotoPending *pending = &ssn->alproto_pending;
+
+        StatsDecr(tv, u->streams);
+        StatsSubUI64(tv, u->segments, pending->segments);
+        StatsSubUI64(tv, u->bytes, pending->bytes);
+        StatsSubUI64(tv, u->bytes_copied, pending->bytes_copied);
+        StatsSubUI64(tv, u->regions, pending->regions);
+        StatsSubUI64(tv, u->gaps, pending->gaps);
+
+        StatsIncr(tv, c->streams);
+        StatsAddUI64(tv, c->segments, pending->segments);
+        StatsAddUI64(tv, c->bytes, pending->bytes);
+        StatsAddUI64(tv, c->bytes_copied, pending->bytes_copied);
+        StatsAddUI64(tv, c->regions, pending->regions);
+        StatsAddUI64(tv, c->gaps, pending->gaps);
+    }
+    memset(&ssn->alproto_pending, 0, sizeof(ssn->alproto_pending));
+}
+
+/** \brief prune the session and account the buffer copies done by sliding
+ *         the stream to the flow's app-layer protocol
+ *  \param ra_ctx reassembly thread ctx, can be NULL */
+void StreamTcpReassemblePruneSession(
+        ThreadVars *tv, TcpReassemblyThreadCtx *ra_ctx, Flow *f, uint8_t flags)
+{
+    if (ra_ctx == NULL || ra_ctx->counter_alproto == NULL || f == NULL ||
+            f->protoctx == NULL) {
+        StreamTcpPruneSession(f, flags);
+        return;
+    }
+
+    TcpSession *ssn = f->protoctx;
+    const StreamReassemblyAlprotoCounters *c =
+            StreamTcpReassembleGetAlprotoCounters(ra_ctx, ssn, f);
+    if (c == NULL) {
+        StreamTcpPruneSession(f, flags);
+        return;
+    }
+
+    StreamingBufferThreadStats pre;
+    StreamingBufferGetThreadStats(&pre);
+    StreamTcpPruneSession(f, flags);
+    StreamTcpReassembleAccountBufferStats(tv, ssn, c, &pre);
+}
+
+/** \internal
+ *  \brief insert a segment and update the per alproto counters
+ *
+ *  Takes a snapshot of the streaming buffer thread stats around the insert
+ *  so that region allocations and copies are accounted to the flow's
+ *  app-layer protocol. The session is counted in the streams on its first
+ *  segment, as 'unknown' if protocol detection hasn't completed yet.
+ */
+static int StreamTcpReassembleInsertSegmentAccounted(ThreadVars *tv,
+        TcpReassemblyThreadCtx *ra_ctx, TcpSession *ssn, TcpStream *stream, TcpSegment *seg,
+        Packet *p, const uint16_t payload_len, const uint16_t size)
+{
+    if (!(ssn->flags & STREAMTCP_FLAG_ALPROTO_COUNTED) && p->flow->alproto == ALPROTO_UNKNOWN)
+        ssn->flags |= STREAMTCP_FLAG_ALPROTO_PENDING;
+
+    const StreamReassemblyAlprotoCounters *c =
+            StreamTcpReassembleGetAlprotoCounters(ra_ctx, ssn, p->flow);
+    if (c == NULL) {
+        ssn->flags &= ~STREAMTCP_FLAG_ALPROTO_PENDING;
+        return StreamTcpReassembleInsertSegment(
+                tv, ra_ctx, stream, seg, p, p->payload, payload_len);
+    }
+
+    bool gap = false;
+    if (SEQ_GT(seg->seq, stream->base_seq)) {
+        const uint64_t seg_offset = STREAM_BASE_OFFSET(stream) + (seg->seq - stream->base_seq);
+        gap = seg_offset > StreamingBufferGetConsecutiveDataRightEdge(&stream->sb);
+    }
+
+    StreamingBufferThreadStats pre;
+    StreamingBufferGetThreadStats(&pre);
+
+    int r = StreamTcpReassembleInsertSegment(tv, ra_ctx, stream, seg, p, p->payload, payload_len);
+
+    StreamTcpReassembleAccountBufferStats(tv, ssn, c, &pre);
+    if (r < 0)
+        return r;
+    if (!(ssn->flags & STREAMTCP_FLAG_ALPROTO_COUNTED)) {
+        ssn->flags |= STREAMTCP_FLAG_ALPROTO_COUNTED;
+        StatsIncr(tv, c->streams);
+    }
+    if (gap)
+        StatsIncr(tv, c->gaps);
+    StatsIncr(tv, c->segments);
+    StatsAddUI64(tv, c->bytes, size);
+    if (ssn->flags & STREAMTCP_FLAG_ALPROTO_PENDING) {
+        ssn->alproto_pending.gaps += gap;
+        ssn->alproto_pending.segments++;
+        ssn->alproto_pending.bytes += size;
+    }
+    return r;
+}
+
 /**
  *  \brief Insert a TCP packet data into the stream reassembly engine.
  *
@@ -868,7 +1126,13 @@ int StreamTcpReassembleHandleSegmentHandleData(ThreadVars *tv, TcpReassemblyThre
                 APPLAYER_PROTO_DETECTION_SKIPPED);
     }
 
-    int r = StreamTcpReassembleInsertSegment(tv, ra_ctx, stream, seg, p, p->payload, payload_len);
+    int r;
+    if (ra_ctx->counter_alproto != NULL) {
+        r = StreamTcpReassembleInsertSegmentAccounted(
+                tv, ra_ctx, ssn, stream, seg, p, payload_len, (uint16_t)size);
+    } else {
+        r = StreamTcpReassembleInsertSegment(tv, ra_ctx, stream, seg, p, p->payload, payload_len);
+    }
     if (r < 0) {
         if (r == -SC_ENOMEM) {
             ssn->flags |= STREAMTCP_FLAG_LOSSY_BE_LIBERAL;
@@ -1424,13 +1688,16 @@ int StreamTcpReassembleAppLayer(ThreadVars *tv, TcpReassemblyThreadCtx *ra_ctx,
             AppLayerHandleTCPData(
                     tv, ra_ctx, p, p->flow, ssn, &stream, NULL, 0, stream_flags, app_update_dir);
             AppLayerProfilingStore(ra_ctx->app_tctx, p);
+            StreamTcpReassembleMoveAlprotoCounters(tv, ra_ctx, ssn, p->flow);
 
             SCReturnInt(0);
         }
     }
 
     /* with all that out of the way, lets update the app-layer */
-    return ReassembleUpdateAppLayer(tv, ra_ctx, ssn, &stream, p, app_update_dir);
+    int r = ReassembleUpdateAppLayer(tv, ra_ctx, ssn, &stream, p, app_update_dir);
+    StreamTcpReassembleMoveAlprotoCounters(tv, ra_ctx, ssn, p->flow);
+    SCReturnInt(r);
 }
 
 /** \internal
@@ -3893,6 +4160,69 @@ end:
     return ret;
 }
 
+/** \test per alproto counters: work done before protocol detection is moved
+ *        from 'unknown' to the detected protocol */
+static int StreamTcpReassembleAlprotoTest01(void)
+{
+    TcpReassemblyThreadCtx *ra_ctx = NULL;
+    ThreadVars tv;
+    TcpSession ssn;
+    Flow f;
+
+    memset(&tv, 0x00, sizeof(tv));
+
+    StreamTcpUTInit(&ra_ctx);
+    ra_ctx->counter_alproto = SCCalloc(g_alproto_max, sizeof(StreamReassemblyAlprotoCounters));
+    FAIL_IF_NULL(ra_ctx->counter_alproto);
+    /* counter ids only need to be set, stats are not set up for unittests */
+    const AppProto alprotos[] = { ALPROTO_UNKNOWN, ALPROTO_HTTP1 };
+    for (size_t i = 0; i < ARRAY_SIZE(alprotos); i++) {
+        StreamReassemblyAlprotoCounters *c = &ra_ctx->counter_alproto[alprotos[i]];
+        c->streams = c->segments = c->bytes = c->bytes_copied = c->regions = c->gaps = 1;
+    }
+
+    StreamTcpUTSetupSession(&ssn);
+    StreamTcpUTSetupStream(&ssn.client, 1);
+    FLOW_INITIALIZE(&f);
+    f.protoctx = &ssn;
+    f.alproto = ALPROTO_UNKNOWN;
+
+    uint8_t payload[] = { 'G', 'E', 'T', ' ', '/' };
+    Packet *p = UTHBuildPacketReal(payload, 5, IPPROTO_TCP, "1.1.1.1", "2.2.2.2", 1024, 80);
+    FAIL_IF_NULL(p);
+    p->l4.hdrs.tcph->th_seq = htonl(2);
+    p->l4.hdrs.tcph->th_ack = htonl(31);
+    p->flow = &f;
+
+    FAIL_IF(StreamTcpReassembleHandleSegmentHandleData(&tv, ra_ctx, &ssn, &ssn.client, p) < 0);
+    FAIL_IF_NOT(ssn.flags & STREAMTCP_FLAG_ALPROTO_COUNTED);
+    FAIL_IF_NOT(ssn.flags & STREAMTCP_FLAG_ALPROTO_PENDING);
+    FAIL_IF_NOT(ssn.alproto_pending.segments == 1);
+    FAIL_IF_NOT(ssn.alproto_pending.bytes == 5);
+
+    /* still unknown: nothing moves */
+    StreamTcpReassembleMoveAlprotoCounters(&tv, ra_ctx, &ssn, &f);
+    FAIL_IF_NOT(ssn.flags & STREAMTCP_FLAG_ALPROTO_PENDING);
+
+    f.alproto = ALPROTO_HTTP1;
+    StreamTcpReassembleMoveAlprotoCounters(&tv, ra_ctx, &ssn, &f);
+    FAIL_IF(ssn.flags & STREAMTCP_FLAG_ALPROTO_PENDING);
+    FAIL_IF_NOT(ssn.alproto_pending.segments == 0);
+    FAIL_IF_NOT(ssn.alproto_pending.bytes == 0);
+
+    /* after detection the work is counted for the protocol directly */
+    p->l4.hdrs.tcph->th_seq = htonl(7);
+    FAIL_IF(StreamTcpReassembleHandleSegmentHandleData(&tv, ra_ctx, &ssn, &ssn.client, p) < 0);
+    FAIL_IF(ssn.flags & STREAMTCP_FLAG_ALPROTO_PENDING);
+    FAIL_IF_NOT(ssn.alproto_pending.segments == 0);
+
+    UTHFreePacket(p);
+    StreamTcpUTClearSession(&ssn);
+    FLOW_DESTROY(&f);
+    StreamTcpUTDeinit(ra_ctx);
+    PASS;
+}
+
 #include "tests/stream-tcp-reassemble.c"
 #endif /* UNITTESTS */
 
@@ -3952,6 +4282,7 @@ void StreamTcpReassembleRegisterTests(void)
                    StreamTcpReassembleInsertTest02);
     UtRegisterTest("StreamTcpReassembleInsertTest03 -- insert with overlap",
                    StreamTcpReassembleInsertTest03);
+    UtRegisterTest("StreamTcpReassembleAlprotoTest01", StreamTcpReassembleAlprotoTest01);
 
     StreamTcpInlineRegisterTests();
     StreamTcpUtilRegisterTests();
@@ -58,6 +58,17 @@ enum StreamUpdateDir {
     UPDATE_DIR_BOTH,
 };
 
+/** per app-layer protocol reassembly counters. Only registered when
+ *  stream.reassembly.alproto-stats is enabled. */
+typedef struct StreamReassemblyAlprotoCounters_ {
+    uint16_t streams;      /**< sessions that received data */
+    uint16_t segments;     /**< segments inserted */
+    uint16_t bytes;        /**< payload bytes added to the stream buffers */
+    uint16_t bytes_copied; /**< bytes moved between buffer regions */
+    uint16_t regions;      /**< buffer regions allocated */
+    uint16_t gaps;         /**< out of order segments, leaving a gap */
+} StreamReassemblyAlprotoCounters;
+
 typedef struct TcpReassemblyThreadCtx_ {
     void *app_tctx;
 
@@ -86,6 +97,9 @@ typedef struct TcpReassemblyThreadCtx_ {
 
     /** count OOB bytes */
     uint16_t counter_tcp_urgent_oob;
+
+    /** per alproto counters, indexed by alproto. NULL if disabled. */
+    StreamReassemblyAlprotoCounters *counter_alproto;
 } TcpReassemblyThreadCtx;
 
 #define OS_POLICY_DEFAULT   OS_POLICY_BSD
@@ -99,6 +113,7 @@ void *StreamTcpReassembleRealloc(void *optr, size_t orig_size, size_t size);
 void StreamTcpReassembleRegisterTests(void);
 TcpReassemblyThreadCtx *StreamTcpReassembleInitThreadCtx(ThreadVars *tv);
 void StreamTcpReassembleFreeThreadCtx(TcpReassemblyThreadCtx *);
+void StreamTcpReassembleRegisterAlprotoCounters(ThreadVars *tv, TcpReassemblyThreadCtx *ra_ctx);
 int StreamTcpReassembleAppLayer (ThreadVars *tv, TcpReassemblyThreadCtx *ra_ctx,
                                  TcpSession *ssn, TcpStream *stream,
                                  Packet *p, enum StreamUpdateDir dir);
@@ -123,11 +138,15 @@ void StreamTcpSegmentReturntoPool(TcpSegment *);
 void StreamTcpReassembleTriggerRawInspection(TcpSession *, int direction);
 
 void StreamTcpPruneSession(Flow *, uint8_t);
+void StreamTcpReassemblePruneSession(
+        ThreadVars *tv, TcpReassemblyThreadCtx *ra_ctx, Flow *f, uint8_t flags);
 bool StreamTcpReassembleDepthReached(Packet *p);
 
 int StreamTcpReassembleSetMemcap(uint64_t size);
 uint64_t StreamTcpReassembleGetMemcap(void);
 int StreamTcpReassembleCheckMemcap(uint64_t size);
+void StreamTcpReassembleIncrMemuse(uint64_t size);
+void StreamTcpReassembleDecrMemuse(uint64_t size);
 uint64_t StreamTcpReassembleMemuseGlobalCounter(void);
 
 void StreamTcpDisableAppLayer(Flow *f);
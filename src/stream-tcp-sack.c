@@ -50,6 +50,9 @@ int TcpSackCompare(struct StreamTcpSackRecord *a, struct StreamTcpSackRecord *b)
 static void StreamTcpSackPrintList(TcpStream *stream)
 {
     SCLogDebug("size %u", stream->sack_size);
+    for (uint8_t i = 0; i < stream->sack_inline_cnt; i++) {
+        SCLogDebug("- inline %8u - %8u", stream->sack_inline[i].le, stream->sack_inline[i].re);
+    }
     StreamTcpSackRecord *rec = NULL;
     RB_FOREACH(rec, TCPSACK, &stream->sack_tree) {
         SCLogDebug("- record %8u - %8u", rec->le, rec->re);
@@ -204,6 +207,78 @@ static int Insert(TcpStream *stream, struct TCPSACK *tree, uint32_t le, uint32_t
     return 0;
 }
 
+/** \internal
+ *  \brief move the inline SACK ranges into the tree
+ *
+ *  \retval 0 ok
+ *  \retval -1 memcap or alloc failure, the inline ranges are left untouched
+ */
+static int SackInlineToTree(TcpStream *stream)
+{
+    for (uint8_t i = 0; i < stream->sack_inline_cnt; i++) {
+        StreamTcpSackRecord *rec = StreamTcpSackRecordAlloc();
+        if (unlikely(rec == NULL)) {
+            StreamTcpSackRecord *r = NULL, *safe = NULL;
+            RB_FOREACH_SAFE (r, TCPSACK, &stream->sack_tree, safe) {
+                TCPSACK_RB_REMOVE(&stream->sack_tree, r);
+                StreamTcpSackRecordFree(r);
+            }
+            return -1;
+        }
+        rec->le = stream->sack_inline[i].le;
+        rec->re = stream->sack_inline[i].re;
+        TCPSACK_RB_INSERT(&stream->sack_tree, rec);
+    }
+    SCLogDebug("moved %u inline ranges to the tree", stream->sack_inline_cnt);
+    stream->sack_inline_cnt = 0;
+    return 0;
+}
+
+/** \internal
+ *  \brief insert a range into the sorted inline array
+ *
+ *  Ranges that overlap or touch the new range are merged into it, like
+ *  the tree consolidation does. Only if the range is disjoint from all
+ *  others and the array is full we switch to the tree.
+ */
+static int InsertInline(TcpStream *stream, uint32_t le, uint32_t re)
+{
+    StreamTcpSackRange *ranges = stream->sack_inline;
+    const uint8_t cnt = stream->sack_inline_cnt;
+
+    /* skip ranges entirely before the new one */
+    uint8_t first = 0;
+    while (first < cnt && SEQ_LT(ranges[first].re, le))
+        first++;
+
+    /* merge the ranges that overlap or touch the new one */
+    uint8_t last = first;
+    while (last < cnt && SEQ_LEQ(ranges[last].le, re)) {
+        if (SEQ_LT(ranges[last].le, le))
+            le = ranges[last].le;
+        if (SEQ_GT(ranges[last].re, re))
+            re = ranges[last].re;
+        last++;
+    }
+
+    if (first == last && cnt == STREAM_SACK_INLINE_RANGES) {
+        if (SackInlineToTree(stream) < 0)
+            return -1;
+        return Insert(stream, &stream->sack_tree, le, re);
+    }
+
+    for (uint8_t i = first; i < last; i++) {
+        stream->sack_size -= (ranges[i].re - ranges[i].le);
+    }
+    /* replace ranges first..last with the new range */
+    memmove(&ranges[first + 1], &ranges[last], (cnt - last) * sizeof(ranges[0]));
+    ranges[first].le = le;
+    ranges[first].re = re;
+    stream->sack_inline_cnt = (uint8_t)(cnt - (last - first) + 1);
+    stream->sack_size += (re - le);
+    return 0;
+}
+
 /**
  *  \brief insert a SACK range
  *
@@ -231,8 +306,12 @@ static int StreamTcpSackInsertRange(TcpStream *stream, uint32_t le, uint32_t re)
         SCReturnInt(0);
     }
 
-    if (Insert(stream, &stream->sack_tree, le, re) < 0)
+    if (RB_EMPTY(&stream->sack_tree)) {
+        if (InsertInline(stream, le, re) < 0)
+            SCReturnInt(-1);
+    } else if (Insert(stream, &stream->sack_tree, le, re) < 0) {
         SCReturnInt(-1);
+    }
 
     SCReturnInt(0);
 }
@@ -354,6 +433,20 @@ static struct StreamTcpSackRecord *FindOverlap(
     return res;
 }
 
+/** \internal
+ *  \brief check if a range is fully covered by one of the inline ranges */
+static bool InlineEclipsed(const TcpStream *stream, const uint32_t le, const uint32_t re)
+{
+    for (uint8_t i = 0; i < stream->sack_inline_cnt; i++) {
+        const StreamTcpSackRange *r = &stream->sack_inline[i];
+        if (SEQ_GT(r->le, le))
+            break;
+        if (SEQ_LEQ(re, r->re))
+            return true;
+    }
+    return false;
+}
+
 bool StreamTcpSackPacketIsOutdated(TcpStream *stream, Packet *p)
 {
     const TCPHdr *tcph = PacketGetTCP(p);
@@ -369,6 +462,15 @@ bool StreamTcpSackPacketIsOutdated(TcpStream *stream, Packet *p)
             SCLogDebug("%p last_ack %u, left edge %u, right edge %u", sack_rec, stream->last_ack,
                     le, re);
 
+            if (stream->sack_inline_cnt) {
+                if (InlineEclipsed(stream, le, re)) {
+                    SCLogDebug("SACK rec le:%u re:%u eclipsed by inline range", le, re);
+                    sack_outdated++;
+                }
+                sack_rec++;
+                continue;
+            }
+
             struct StreamTcpSackRecord lookup = { .le = le, .re = re };
             struct StreamTcpSackRecord *res = FindOverlap(&stream->sack_tree, &lookup);
             SCLogDebug("res %p", res);
@@ -400,10 +502,39 @@ bool StreamTcpSackPacketIsOutdated(TcpStream *stream, Packet *p)
     return false;
 }
 
+static void PruneInline(TcpStream *stream)
+{
+    uint8_t keep = 0;
+    for (uint8_t i = 0; i < stream->sack_inline_cnt; i++) {
+        StreamTcpSackRange r = stream->sack_inline[i];
+        if (SEQ_LT(r.re, stream->last_ack)) {
+            SCLogDebug("removing le %u re %u", r.le, r.re);
+            stream->sack_size -= (r.re - r.le);
+            continue;
+        } else if (SEQ_LT(r.le, stream->last_ack)) {
+            SCLogDebug("adjusting record to le %u re %u", r.le, r.re);
+            /* last ack inside this record, update */
+            stream->sack_size -= (r.re - r.le);
+            r.le = stream->last_ack;
+            stream->sack_size += (r.re - r.le);
+        }
+        stream->sack_inline[keep++] = r;
+    }
+    stream->sack_inline_cnt = keep;
+}
+
 void StreamTcpSackPruneList(TcpStream *stream)
 {
     SCEnter();
 
+    if (stream->sack_inline_cnt) {
+        PruneInline(stream);
+#ifdef DEBUG
+        StreamTcpSackPrintList(stream);
+#endif
+        SCReturn;
+    }
+
     StreamTcpSackRecord *rec = NULL, *safe = NULL;
     RB_FOREACH_SAFE(rec, TCPSACK, &stream->sack_tree, safe) {
         if (SEQ_LT(rec->re, stream->last_ack)) {
@@ -431,7 +562,7 @@ void StreamTcpSackPruneList(TcpStream *stream)
 }
 
 /**
- *  \brief Free SACK tree from a stream
+ *  \brief Free SACK ranges from a stream
  *
  *  \param stream Stream to cleanup
  */
@@ -439,6 +570,11 @@ void StreamTcpSackFreeList(TcpStream *stream)
 {
     SCEnter();
 
+    for (uint8_t i = 0; i < stream->sack_inline_cnt; i++) {
+        stream->sack_size -= (stream->sack_inline[i].re - stream->sack_inline[i].le);
+    }
+    stream->sack_inline_cnt = 0;
+
     StreamTcpSackRecord *rec = NULL, *safe = NULL;
     RB_FOREACH_SAFE(rec, TCPSACK, &stream->sack_tree, safe) {
         stream->sack_size -= (rec->re - rec->le);
@@ -452,6 +588,22 @@ void StreamTcpSackFreeList(TcpStream *stream)
 
 #ifdef UNITTESTS
 
+/** \internal
+ *  \brief get the left most SACK range, inline or from the tree */
+static bool SackGetFirst(TcpStream *stream, StreamTcpSackRange *out)
+{
+    if (stream->sack_inline_cnt) {
+        *out = stream->sack_inline[0];
+        return true;
+    }
+    StreamTcpSackRecord *rec = RB_MIN(TCPSACK, &stream->sack_tree);
+    if (rec == NULL)
+        return false;
+    out->le = rec->le;
+    out->re = rec->re;
+    return true;
+}
+
 /**
  *  \test   Test the insertion of SACK ranges.
  *
@@ -476,11 +628,11 @@ static int StreamTcpSackTest01 (void)
     StreamTcpSackPrintList(&stream);
 #endif /* DEBUG */
 
-    StreamTcpSackRecord *rec = RB_MIN(TCPSACK, &stream.sack_tree);
-    FAIL_IF_NULL(rec);
+    StreamTcpSackRange rec;
+    FAIL_IF_NOT(SackGetFirst(&stream, &rec));
 
-    FAIL_IF(rec->le != 1);
-    FAIL_IF(rec->re != 20);
+    FAIL_IF(rec.le != 1);
+    FAIL_IF(rec.re != 20);
 
     FAIL_IF(StreamTcpSackedSize(&stream) != 19);
     StreamTcpSackFreeList(&stream);
@@ -505,11 +657,11 @@ static int StreamTcpSackTest02 (void)
     StreamTcpSackPrintList(&stream);
 #endif /* DEBUG */
 
-    StreamTcpSackRecord *rec = RB_MIN(TCPSACK, &stream.sack_tree);
-    FAIL_IF_NULL(rec);
+    StreamTcpSackRange rec;
+    FAIL_IF_NOT(SackGetFirst(&stream, &rec));
 
-    FAIL_IF(rec->le != 1);
-    FAIL_IF(rec->re != 20);
+    FAIL_IF(rec.le != 1);
+    FAIL_IF(rec.re != 20);
 
     FAIL_IF(StreamTcpSackedSize(&stream) != 19);
     StreamTcpSackFreeList(&stream);
@@ -538,11 +690,11 @@ static int StreamTcpSackTest03 (void)
     StreamTcpSackPrintList(&stream);
 #endif /* DEBUG */
 
-    StreamTcpSackRecord *rec = RB_MIN(TCPSACK, &stream.sack_tree);
-    FAIL_IF_NULL(rec);
+    StreamTcpSackRange rec;
+    FAIL_IF_NOT(SackGetFirst(&stream, &rec));
 
-    FAIL_IF(rec->le != 5);
-    FAIL_IF(rec->re != 25);
+    FAIL_IF(rec.le != 5);
+    FAIL_IF(rec.re != 25);
 
     FAIL_IF(StreamTcpSackedSize(&stream) != 20);
     StreamTcpSackFreeList(&stream);
@@ -568,11 +720,11 @@ static int StreamTcpSackTest04 (void)
     StreamTcpSackPrintList(&stream);
 #endif /* DEBUG */
 
-    StreamTcpSackRecord *rec = RB_MIN(TCPSACK, &stream.sack_tree);
-    FAIL_IF_NULL(rec);
+    StreamTcpSackRange rec;
+    FAIL_IF_NOT(SackGetFirst(&stream, &rec));
 
-    FAIL_IF(rec->le != 0);
-    FAIL_IF(rec->re != 25);
+    FAIL_IF(rec.le != 0);
+    FAIL_IF(rec.re != 25);
 
     FAIL_IF(StreamTcpSackedSize(&stream) != 45);
     StreamTcpSackFreeList(&stream);
@@ -598,11 +750,11 @@ static int StreamTcpSackTest05 (void)
     StreamTcpSackPrintList(&stream);
 #endif /* DEBUG */
 
-    StreamTcpSackRecord *rec = RB_MIN(TCPSACK, &stream.sack_tree);
-    FAIL_IF_NULL(rec);
+    StreamTcpSackRange rec;
+    FAIL_IF_NOT(SackGetFirst(&stream, &rec));
 
-    FAIL_IF(rec->le != 0);
-    FAIL_IF(rec->re != 50);
+    FAIL_IF(rec.le != 0);
+    FAIL_IF(rec.re != 50);
 
     FAIL_IF(StreamTcpSackedSize(&stream) != 50);
     StreamTcpSackFreeList(&stream);
@@ -630,11 +782,11 @@ static int StreamTcpSackTest06 (void)
     StreamTcpSackPrintList(&stream);
 #endif /* DEBUG */
 
-    StreamTcpSackRecord *rec = RB_MIN(TCPSACK, &stream.sack_tree);
-    FAIL_IF_NULL(rec);
+    StreamTcpSackRange rec;
+    FAIL_IF_NOT(SackGetFirst(&stream, &rec));
 
-    FAIL_IF(rec->le != 0);
-    FAIL_IF(rec->re != 40);
+    FAIL_IF(rec.le != 0);
+    FAIL_IF(rec.re != 40);
 
     FAIL_IF(StreamTcpSackedSize(&stream) != 40);
     StreamTcpSackFreeList(&stream);
@@ -662,10 +814,10 @@ static int StreamTcpSackTest07 (void)
     StreamTcpSackPrintList(&stream);
 #endif /* DEBUG */
 
-    StreamTcpSackRecord *rec = RB_MIN(TCPSACK, &stream.sack_tree);
-    FAIL_IF_NULL(rec);
-    FAIL_IF(rec->le != 0);
-    FAIL_IF(rec->re != 40);
+    StreamTcpSackRange rec;
+    FAIL_IF_NOT(SackGetFirst(&stream, &rec));
+    FAIL_IF(rec.le != 0);
+    FAIL_IF(rec.re != 40);
     FAIL_IF(StreamTcpSackedSize(&stream) != 40);
 
     stream.last_ack = 10;
@@ -697,10 +849,10 @@ static int StreamTcpSackTest08 (void)
     StreamTcpSackPrintList(&stream);
 #endif /* DEBUG */
 
-    StreamTcpSackRecord *rec = RB_MIN(TCPSACK, &stream.sack_tree);
-    FAIL_IF_NULL(rec);
-    FAIL_IF(rec->le != 0);
-    FAIL_IF(rec->re != 40);
+    StreamTcpSackRange rec;
+    FAIL_IF_NOT(SackGetFirst(&stream, &rec));
+    FAIL_IF(rec.le != 0);
+    FAIL_IF(rec.re != 40);
     FAIL_IF(StreamTcpSackedSize(&stream) != 40);
 
     stream.last_ack = 41;
@@ -733,10 +885,10 @@ static int StreamTcpSackTest09 (void)
     StreamTcpSackPrintList(&stream);
 #endif /* DEBUG */
 
-    StreamTcpSackRecord *rec = RB_MIN(TCPSACK, &stream.sack_tree);
-    FAIL_IF_NULL(rec);
-    FAIL_IF(rec->le != 0);
-    FAIL_IF(rec->re != 40);
+    StreamTcpSackRange rec;
+    FAIL_IF_NOT(SackGetFirst(&stream, &rec));
+    FAIL_IF(rec.le != 0);
+    FAIL_IF(rec.re != 40);
     FAIL_IF(StreamTcpSackedSize(&stream) != 40);
 
     stream.last_ack = 39;
@@ -768,10 +920,10 @@ static int StreamTcpSackTest10 (void)
     StreamTcpSackPrintList(&stream);
 #endif /* DEBUG */
 
-    StreamTcpSackRecord *rec = RB_MIN(TCPSACK, &stream.sack_tree);
-    FAIL_IF_NULL(rec);
-    FAIL_IF(rec->le != 100);
-    FAIL_IF(rec->re != 140);
+    StreamTcpSackRange rec;
+    FAIL_IF_NOT(SackGetFirst(&stream, &rec));
+    FAIL_IF(rec.le != 100);
+    FAIL_IF(rec.re != 140);
     FAIL_IF(StreamTcpSackedSize(&stream) != 40);
 
     stream.last_ack = 99;
@@ -803,10 +955,10 @@ static int StreamTcpSackTest11 (void)
     StreamTcpSackPrintList(&stream);
 #endif /* DEBUG */
 
-    StreamTcpSackRecord *rec = RB_MIN(TCPSACK, &stream.sack_tree);
-    FAIL_IF_NULL(rec);
-    FAIL_IF(rec->le != 100);
-    FAIL_IF(rec->re != 140);
+    StreamTcpSackRange rec;
+    FAIL_IF_NOT(SackGetFirst(&stream, &rec));
+    FAIL_IF(rec.le != 100);
+    FAIL_IF(rec.re != 140);
     FAIL_IF(StreamTcpSackedSize(&stream) != 40);
 
     stream.last_ack = 99;
@@ -838,10 +990,10 @@ static int StreamTcpSackTest12 (void)
     StreamTcpSackPrintList(&stream);
 #endif /* DEBUG */
 
-    StreamTcpSackRecord *rec = RB_MIN(TCPSACK, &stream.sack_tree);
-    FAIL_IF_NULL(rec);
-    FAIL_IF(rec->le != 100);
-    FAIL_IF(rec->re != 1000);
+    StreamTcpSackRange rec;
+    FAIL_IF_NOT(SackGetFirst(&stream, &rec));
+    FAIL_IF(rec.le != 100);
+    FAIL_IF(rec.re != 1000);
     FAIL_IF(StreamTcpSackedSize(&stream) != 900);
 
     StreamTcpSackInsertRange(&stream, 0, 1000);
@@ -905,6 +1057,53 @@ static int StreamTcpSackTest14 (void) {
     PASS;
 }
 
+/**
+ *  \test   Test the switch from inline ranges to the tree and back.
+ */
+
+static int StreamTcpSackTest15(void)
+{
+    TcpStream stream;
+    memset(&stream, 0, sizeof(stream));
+    stream.window = 2000;
+
+    for (int i = 0; i < STREAM_SACK_INLINE_RANGES; i++) {
+        FAIL_IF(StreamTcpSackInsertRange(&stream, 100 + (20 * i), 110 + (20 * i)) != 0);
+    }
+    FAIL_IF(stream.sack_inline_cnt != STREAM_SACK_INLINE_RANGES);
+    FAIL_IF(!RB_EMPTY(&stream.sack_tree));
+    FAIL_IF(StreamTcpSackedSize(&stream) != 10 * STREAM_SACK_INLINE_RANGES);
+
+    /* merges with an existing range, so still fits */
+    FAIL_IF(StreamTcpSackInsertRange(&stream, 110, 115) != 0);
+    FAIL_IF(stream.sack_inline_cnt != STREAM_SACK_INLINE_RANGES);
+    FAIL_IF(StreamTcpSackedSize(&stream) != 10 * STREAM_SACK_INLINE_RANGES + 5);
+
+    /* disjoint, moves all ranges to the tree */
+    FAIL_IF(StreamTcpSackInsertRange(&stream, 10, 20) != 0);
+    FAIL_IF(stream.sack_inline_cnt != 0);
+    FAIL_IF(RB_EMPTY(&stream.sack_tree));
+    FAIL_IF(StreamTcpSackedSize(&stream) != 10 * STREAM_SACK_INLINE_RANGES + 15);
+
+    StreamTcpSackRange rec;
+    FAIL_IF_NOT(SackGetFirst(&stream, &rec));
+    FAIL_IF(rec.le != 10);
+    FAIL_IF(rec.re != 20);
+
+    /* once the tree is empty new ranges go inline again */
+    stream.last_ack = 1000;
+    StreamTcpSackPruneList(&stream);
+    FAIL_IF(StreamTcpSackHasRecords(&stream));
+    FAIL_IF(StreamTcpSackedSize(&stream) != 0);
+    FAIL_IF(StreamTcpSackInsertRange(&stream, 1100, 1200) != 0);
+    FAIL_IF(stream.sack_inline_cnt != 1);
+    FAIL_IF(StreamTcpSackedSize(&stream) != 100);
+
+    StreamTcpSackFreeList(&stream);
+    FAIL_IF(StreamTcpSackHasRecords(&stream));
+    PASS;
+}
+
 #endif /* UNITTESTS */
 
 void StreamTcpSackRegisterTests (void)
@@ -928,5 +1127,6 @@ void StreamTcpSackRegisterTests (void)
                    StreamTcpSackTest13);
     UtRegisterTest("StreamTcpSackTest14 -- Insertion out of window",
                    StreamTcpSackTest14);
+    UtRegisterTest("StreamTcpSackTest15 -- Inline ranges to tree", StreamTcpSackTest15);
 #endif
 }
@@ -38,6 +38,16 @@ static inline uint32_t StreamTcpSackedSize(TcpStream *stream)
     SCReturnUInt(stream->sack_size);
 }
 
+/**
+ *  \brief Check if the stream has SACK ranges
+ *
+ *  \param stream Stream to check.
+ */
+static inline bool StreamTcpSackHasRecords(const TcpStream *stream)
+{
+    return (stream->sack_inline_cnt != 0 || !RB_EMPTY(&stream->sack_tree));
+}
+
 int StreamTcpSackUpdatePacket(TcpStream *, Packet *);
 bool StreamTcpSackPacketIsOutdated(TcpStream *stream, Packet *p);
 void StreamTcpSackPruneList(TcpStream *);
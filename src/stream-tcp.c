@@ -303,9 +303,47 @@ void StreamTcpStreamCleanup(TcpStream *stream)
         StreamTcpSackFreeList(stream);
         StreamTcpReturnStreamSegments(stream);
         StreamingBufferClear(&stream->sb, &stream_config.sbcnf);
+        MpmStreamStateFree(stream->mpm_stream);
+        stream->mpm_stream = NULL;
     }
 }
 
+/** \internal
+ *  \brief release the buffers of a stream without segments or SACK ranges
+ *  \retval size bytes released */
+static uint32_t StreamTcpStreamCompact(TcpStream *stream)
+{
+    if (!RB_EMPTY(&stream->seg_tree) || StreamTcpSackHasRecords(stream)) {
+        return 0;
+    }
+
+    uint32_t size = StreamingBufferCompact(&stream->sb, &stream_config.sbcnf);
+    if (stream->mpm_stream != NULL) {
+        MpmStreamStateFree(stream->mpm_stream);
+        stream->mpm_stream = NULL;
+        size += (uint32_t)sizeof(MpmStreamState);
+    }
+    return size;
+}
+
+/**
+ *  \brief Release the memory an idle session doesn't need.
+ *
+ *  Frees the stream buffers and raw stream MPM states of the directions
+ *  that have no data waiting for ACK or inspection. The session keeps its
+ *  sequence and progress tracking, the buffers are allocated again when
+ *  new data arrives. Caller must hold the flow lock.
+ *
+ *  \retval size bytes released
+ */
+uint32_t StreamTcpSessionCompact(TcpSession *ssn)
+{
+    if (ssn == NULL || ssn->state < TCP_ESTABLISHED)
+        return 0;
+
+    return StreamTcpStreamCompact(&ssn->client) + StreamTcpStreamCompact(&ssn->server);
+}
+
 static void StreamTcp3wsFreeQueue(TcpSession *ssn)
 {
     TcpStateQueue *q, *q_next;
@@ -694,6 +732,19 @@ void StreamTcpInitConfig(bool quiet)
         SCLogConfig("stream \"max-synack-queued\": %"PRIu8, stream_config.max_synack_queued);
     }
 
+    if ((SCConfGetInt("stream.idle-compact-timeout", &value)) == 1) {
+        if (value >= 0 && value <= UINT32_MAX) {
+            stream_config.idle_compact_timeout = (uint32_t)value;
+        } else {
+            SCLogWarning("invalid stream.idle-compact-timeout %" PRIdMAX ", disabling", value);
+            stream_config.idle_compact_timeout = 0;
+        }
+    }
+    if (!quiet && stream_config.idle_compact_timeout > 0) {
+        SCLogConfig("stream \"idle-compact-timeout\": %" PRIu32 "s",
+                stream_config.idle_compact_timeout);
+    }
+
     const char *temp_stream_reassembly_memcap_str;
     if (SCConfGet("stream.reassembly.memcap", &temp_stream_reassembly_memcap_str) == 1) {
         uint64_t stream_reassembly_memcap_copy;
@@ -6150,6 +6201,7 @@ TmEcode StreamTcpThreadInit(ThreadVars *tv, void *initdata, void **data)
     stt->ra_ctx->counter_tcp_reass_data_normal_fail = StatsRegisterCounter("tcp.insert_data_normal_fail", tv);
     stt->ra_ctx->counter_tcp_reass_data_overlap_fail = StatsRegisterCounter("tcp.insert_data_overlap_fail", tv);
     stt->ra_ctx->counter_tcp_urgent_oob = StatsRegisterCounter("tcp.urgent_oob_data", tv);
+    StreamTcpReassembleRegisterAlprotoCounters(tv, stt->ra_ctx);
 
     SCLogDebug("StreamTcp thread specific ctx online at %p, reassembly ctx %p",
                 stt, stt->ra_ctx);
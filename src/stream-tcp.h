@@ -86,6 +86,10 @@ typedef struct TcpStreamCnf_ {
     /* default to "LINUX" timestamp behavior if true*/
     bool liberal_timestamps;
 
+    /** seconds without packets after which the flow manager releases the
+     *  buffers of a session, 0 to disable. */
+    uint32_t idle_compact_timeout;
+
     StreamingBufferConfig sbcnf;
 } TcpStreamCnf;
 
@@ -139,6 +143,7 @@ int StreamTcpSegmentForSession(
         const Packet *p, uint8_t flag, StreamSegmentCallback CallbackFunc, void *data);
 void StreamTcpReassembleConfigEnableOverlapCheck(void);
 void TcpSessionSetReassemblyDepth(TcpSession *ssn, uint32_t size);
+uint32_t StreamTcpSessionCompact(TcpSession *ssn);
 
 typedef int (*StreamReassembleRawFunc)(
         void *data, const uint8_t *input, const uint32_t input_len, const uint64_t offset);
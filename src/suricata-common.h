@@ -473,7 +473,8 @@ typedef enum PacketProfileDetectId_ {
     PROF_DETECT_SIZE,
 } PacketProfileDetectId;
 
-/** \note update PacketProfileLoggerIdToString if you change anything here */
+/** \note update PacketProfileLoggerIdToString and cpu_ticks_logger_names if you
+ *        change anything here */
 typedef enum LoggerId {
     LOGGER_UNDEFINED,
 
@@ -126,8 +126,11 @@
 #include "util-hugepages.h"
 #include "util-ioctl.h"
 #include "util-landlock.h"
+#include "util-latency.h"
+#include "util-cpu-ticks.h"
 #include "util-macset.h"
 #include "util-flow-rate.h"
+#include "util-flow-cost.h"
 #include "util-misc.h"
 #include "util-mpm-hs.h"
 #include "util-path.h"
@@ -406,6 +409,7 @@ void GlobalsDestroy(void)
     DetectEngineClearMaster();
 
     AppLayerDeSetup();
+    CpuTicksGlobalDeinit();
     DatasetsSave();
     DatasetsDestroy();
     OutputTxShutdown();
@@ -430,6 +434,10 @@ void GlobalsDestroy(void)
     AFPPeersListClean();
 #endif
 
+#ifdef HAVE_AF_XDP
+    AFXDPPeersListClean();
+#endif
+
 #ifdef NFQ
     NFQContextsClean();
 #endif
@@ -2777,6 +2785,7 @@ int PostConfLoadedSetup(SCInstance *suri)
 
     MacSetRegisterFlowStorage();
     FlowRateRegisterFlowStorage();
+    FlowCostRegisterFlowStorage();
 
     SigTableInit();
 
@@ -2910,6 +2919,8 @@ int PostConfLoadedSetup(SCInstance *suri)
     CoredumpLoadConfig();
 
     DecodeGlobalConfig();
+    PacketLatencyGlobalInit();
+    CpuTicksGlobalInit();
 
     /* hostmode depends on engine mode being set */
     PostConfLoadedSetupHostMode();
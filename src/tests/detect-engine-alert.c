@@ -65,6 +65,34 @@ static int TestDetectAlertPacketApplySignatureActions02(void)
     PASS;
 }
 
+/**
+ * \brief Tests that the alert array is only attached to packets that alert
+ */
+static int TestDetectAlertPacketAlertsAttach01(void)
+{
+    uint8_t payload[] = "Hi all!";
+    uint16_t length = sizeof(payload) - 1;
+    Packet *p = UTHBuildPacketReal(
+            (uint8_t *)payload, length, IPPROTO_TCP, "192.168.1.5", "192.168.1.1", 41424, 80);
+    FAIL_IF_NULL(p);
+
+    const char sig1[] = "alert tcp any any -> any any (content:\"nomatch\"; sid:1;)";
+    FAIL_IF(UTHPacketMatchSig(p, sig1) == 1);
+    FAIL_IF_NOT_NULL(p->alerts.alerts);
+
+    const char sig2[] = "alert tcp any any -> any any (content:\"Hi all\"; sid:2;)";
+    FAIL_IF(UTHPacketMatchSig(p, sig2) == 0);
+    FAIL_IF_NULL(p->alerts.alerts);
+    FAIL_IF_NOT(p->alerts.cnt == 1);
+
+    PacketRecycle(p);
+    FAIL_IF_NOT_NULL(p->alerts.alerts);
+    FAIL_IF_NOT(p->alerts.cnt == 0);
+
+    UTHFreePackets(&p, 1);
+    PASS;
+}
+
 /**
  * \brief Registers Detect Engine Alert unit tests
  */
@@ -74,4 +102,5 @@ void DetectEngineAlertRegisterTests(void)
             TestDetectAlertPacketApplySignatureActions01);
     UtRegisterTest("TestDetectAlertPacketApplySignatureActions02",
             TestDetectAlertPacketApplySignatureActions02);
+    UtRegisterTest("TestDetectAlertPacketAlertsAttach01", TestDetectAlertPacketAlertsAttach01);
 }
@@ -3402,6 +3402,63 @@ end:
     return ret;
 }
 
+/** \test 'balanced' autofp scheduler: a flow whose bucket was moved to another
+ *        worker is taken over by that worker and not flagged as being on
+ *        the wrong thread */
+static int StreamTcpTest46(void)
+{
+    ThreadVars tv1, tv2;
+    DecodeThreadVars dtv;
+    StreamTcpThread stt;
+    PacketQueueNoLock pq;
+    memset(&tv1, 0, sizeof(tv1));
+    memset(&tv2, 0, sizeof(tv2));
+    memset(&dtv, 0, sizeof(dtv));
+    memset(&stt, 0, sizeof(stt));
+    memset(&pq, 0, sizeof(pq));
+    tv1.id = 1;
+    tv2.id = 2;
+
+    StreamTcpUTInit(&stt.ra_ctx);
+
+    Flow *f = UTHBuildFlow(AF_INET, "1.1.1.1", "2.2.2.2", 1024, 80);
+    FAIL_IF_NULL(f);
+    f->proto = IPPROTO_TCP;
+    f->protomap = FlowGetProtoMapping(IPPROTO_TCP);
+    Packet *p = UTHBuildPacketReal(NULL, 0, IPPROTO_TCP, "1.1.1.1", "2.2.2.2", 1024, 80);
+    FAIL_IF_NULL(p);
+    p->l4.hdrs.tcph->th_flags = TH_SYN;
+    p->l4.hdrs.tcph->th_seq = htonl(10);
+    p->flags |= PKT_AUTOFP_BALANCED | PKT_IGNORE_CHECKSUM;
+    p->pkt_src = PKT_SRC_WIRE;
+    p->flow = f;
+
+    FlowHandlePacketUpdate(f, p, &tv1, &dtv);
+    FAIL_IF_NOT(StreamTcp(&tv1, p, &stt, &pq) == TM_ECODE_OK);
+    FAIL_IF_NOT(f->thread_id[0] == 1);
+
+    /* bucket moved: the SYN is retransmitted through the second worker */
+    FlowHandlePacketUpdate(f, p, &tv2, &dtv);
+    FAIL_IF_NOT(StreamTcp(&tv2, p, &stt, &pq) == TM_ECODE_OK);
+    FAIL_IF_NOT(f->thread_id[0] == 2);
+    FAIL_IF(f->flags & FLOW_WRONG_THREAD);
+    FAIL_IF(ENGINE_ISSET_EVENT(p, STREAM_WRONG_THREAD));
+
+    /* without the scheduler moving it, the flow stays with its worker */
+    p->flags &= ~PKT_AUTOFP_BALANCED;
+    FlowHandlePacketUpdate(f, p, &tv1, &dtv);
+    FAIL_IF_NOT(StreamTcp(&tv1, p, &stt, &pq) == TM_ECODE_OK);
+    FAIL_IF_NOT(f->thread_id[0] == 2);
+    FAIL_IF_NOT(f->flags & FLOW_WRONG_THREAD);
+    FAIL_IF_NOT(ENGINE_ISSET_EVENT(p, STREAM_WRONG_THREAD));
+
+    StreamTcpSessionClear(f->protoctx);
+    UTHFreePacket(p);
+    UTHFreeFlow(f);
+    StreamTcpUTDeinit(stt.ra_ctx);
+    PASS;
+}
+
 void StreamTcpRegisterTests(void)
 {
     UtRegisterTest("StreamTcpTest01 -- TCP session allocation", StreamTcpTest01);
@@ -3459,6 +3516,7 @@ void StreamTcpRegisterTests(void)
     UtRegisterTest("StreamTcpTest43 -- SYN/ACK queue", StreamTcpTest43);
     UtRegisterTest("StreamTcpTest44 -- SYN/ACK queue", StreamTcpTest44);
     UtRegisterTest("StreamTcpTest45 -- SYN/ACK queue", StreamTcpTest45);
+    UtRegisterTest("StreamTcpTest46 -- autofp balanced flow move", StreamTcpTest46);
 
     /* set up the reassembly tests as well */
     StreamTcpReassembleRegisterTests();
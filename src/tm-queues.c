@@ -43,6 +43,7 @@ Tmq *TmqCreateQueue(const char *name)
         FatalError("SCStrdup failed");
 
     q->id = tmq_id++;
+    SC_ATOMIC_INIT(q->reader_sleeping);
     q->is_packet_pool = (strcmp(q->name, "packetpool") == 0);
     if (!q->is_packet_pool) {
         q->pq = PacketQueueAlloc();
@@ -66,6 +67,40 @@ Tmq *TmqGetQueueByName(const char *name)
     return NULL;
 }
 
+/**
+ * \brief add a ring for a new writer to the queue
+ *
+ * Rings are only added while setting up the threads, so the reader can
+ * walk the array without locking.
+ *
+ * \retval r ring for the writer or NULL on error
+ */
+PacketRing *TmqAddRing(Tmq *q, uint32_t size)
+{
+    PacketRing **rings = SCRealloc(q->rings, (q->rings_cnt + 1) * sizeof(PacketRing *));
+    if (rings == NULL)
+        return NULL;
+    q->rings = rings;
+
+    PacketRing *r = PacketRingAlloc(size);
+    if (r == NULL)
+        return NULL;
+    q->rings[q->rings_cnt++] = r;
+    return r;
+}
+
+/**
+ * \brief check if all packets in the queue's rings have been handled
+ */
+bool TmqRingsEmpty(Tmq *q)
+{
+    for (uint16_t i = 0; i < q->rings_cnt; i++) {
+        if (!PacketRingIsEmpty(q->rings[i]))
+            return false;
+    }
+    return true;
+}
+
 void TmqDebugList(void)
 {
     Tmq *tmq = NULL;
@@ -89,6 +124,10 @@ void TmqResetQueues(void)
         if (tmq->pq) {
             PacketQueueFree(tmq->pq);
         }
+        for (uint16_t i = 0; i < tmq->rings_cnt; i++) {
+            PacketRingFree(tmq->rings[i]);
+        }
+        SCFree(tmq->rings);
         SCFree(tmq);
     }
     tmq_id = 0;
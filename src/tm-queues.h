@@ -33,11 +33,19 @@ typedef struct Tmq_ {
     uint16_t reader_cnt;
     uint16_t writer_cnt;
     PacketQueue *pq;
+    /** rings used by the autofp 'ring' queue: one per writer, all read
+     *  by the queue's single reader. Set up before the threads run. */
+    PacketRing **rings;
+    uint16_t rings_cnt;
+    /** reader is (about to be) waiting on pq->cond_q */
+    SC_ATOMIC_DECLARE(bool, reader_sleeping);
     TAILQ_ENTRY(Tmq_) next;
 } Tmq;
 
 Tmq* TmqCreateQueue(const char *name);
 Tmq* TmqGetQueueByName(const char *name);
+PacketRing *TmqAddRing(Tmq *q, uint32_t size);
+bool TmqRingsEmpty(Tmq *q);
 
 void TmqDebugList(void);
 void TmqResetQueues(void);
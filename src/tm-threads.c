@@ -41,6 +41,7 @@
 #include "util-debug.h"
 #include "util-privs.h"
 #include "util-cpu.h"
+#include "util-cpu-ticks.h"
 #include "util-optimize.h"
 #include "util-profiling.h"
 #include "util-signal.h"
@@ -134,7 +135,10 @@ TmEcode TmThreadsSlotVarRun(ThreadVars *tv, Packet *p, TmSlot *slot)
 {
     for (TmSlot *s = slot; s != NULL; s = s->slot_next) {
         PACKET_PROFILING_TMM_START(p, s->tm_id);
+        const int ticks_prev = CpuTicksEnter(
+                (s->tm_flags & TM_FLAG_DECODE_TM) ? CPU_TICKS_DECODE : CPU_TICKS_NONE);
         TmEcode r = s->SlotFunc(tv, p, SC_ATOMIC_GET(s->slot_data));
+        CpuTicksLeave(ticks_prev);
         PACKET_PROFILING_TMM_END(p, s->tm_id);
         DEBUG_VALIDATE_BUG_ON(p->flow != NULL);
 
@@ -145,6 +149,7 @@ TmEcode TmThreadsSlotVarRun(ThreadVars *tv, Packet *p, TmSlot *slot)
             return TM_ECODE_FAILED;
         }
         if (s->tm_flags & TM_FLAG_DECODE_TM) {
+            PACKET_LATENCY_STAMP(p, PKT_LATENCY_DECODE);
             if (TmThreadsProcessDecodePseudoPackets(tv, &tv->decode_pq, s->slot_next) !=
                     TM_ECODE_OK) {
                 return TM_ECODE_FAILED;
@@ -214,7 +219,10 @@ static bool TmThreadsSlotPktAcqLoopInit(ThreadVars *tv)
         TmThreadSetupOptions(tv);
 
     CaptureStatsSetup(tv);
+    PacketLatencySetup(tv);
+    CpuTicksSetup(tv);
     PacketPoolInit();
+    PacketPoolSetupCounters(tv);
 
     for (TmSlot *slot = s; slot != NULL; slot = slot->slot_next) {
         if (slot->SlotThreadInit != NULL) {
@@ -415,7 +423,10 @@ static void *TmThreadsSlotVar(void *td)
     TmEcode r = TM_ECODE_OK;
 
     CaptureStatsSetup(tv);
+    PacketLatencySetup(tv);
+    CpuTicksSetup(tv);
     PacketPoolInit();//Empty();
+    PacketPoolSetupCounters(tv);
 
     SCSetThreadName(tv->name);
 
@@ -511,6 +522,7 @@ static void *TmThreadsSlotVar(void *td)
             }
 
             /* output the packet */
+            PACKET_LATENCY_UPDATE(tv, p);
             tv->tmqh_out(tv, p);
 
             /* now handle the stream pq packets */
@@ -1222,6 +1234,9 @@ static bool ThreadStillHasPackets(ThreadVars *tv)
         if (len != 0) {
             return true;
         }
+        if (!TmqRingsEmpty(tv->inq)) {
+            return true;
+        }
     }
 
     if (tv->stream_pq != NULL) {
@@ -29,6 +29,7 @@
 #include "tm-threads-common.h"
 #include "tm-modules.h"
 #include "flow.h" // for the FlowQueue
+#include "util-latency.h"
 
 #ifdef OS_WIN32
 static inline void SleepUsec(uint64_t usec)
@@ -199,12 +200,15 @@ static inline TmEcode TmThreadsSlotProcessPkt(ThreadVars *tv, TmSlot *s, Packet
         return TM_ECODE_OK;
     }
 
+    PACKET_LATENCY_START(tv, p);
+
     TmEcode r = TmThreadsSlotVarRun(tv, p, s);
     if (unlikely(r == TM_ECODE_FAILED)) {
         TmThreadsSlotProcessPktFail(tv, p);
         return TM_ECODE_FAILED;
     }
 
+    PACKET_LATENCY_UPDATE(tv, p);
     tv->tmqh_out(tv, p);
 
     TmThreadsHandleInjectedPackets(tv);
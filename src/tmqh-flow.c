@@ -34,20 +34,64 @@
 #include "threadvars.h"
 #include "tmqh-flow.h"
 #include "flow-hash.h"
+#include "tm-threads.h"
 
 #include "tm-queuehandlers.h"
 
 #include "conf.h"
+#include "counters.h"
 #include "util-unittest.h"
 
 Packet *TmqhInputFlow(ThreadVars *t);
+static Packet *TmqhInputFlowRing(ThreadVars *tv);
 void TmqhOutputFlowHash(ThreadVars *t, Packet *p);
 void TmqhOutputFlowIPPair(ThreadVars *t, Packet *p);
 static void TmqhOutputFlowFTPHash(ThreadVars *t, Packet *p);
+static void TmqhOutputFlowBalanced(ThreadVars *tv, Packet *p);
 void *TmqhOutputFlowSetupCtx(const char *queue_str);
+static void *TmqhOutputFlowRingSetupCtx(const char *queue_str);
 void TmqhOutputFlowFreeCtx(void *ctx);
 void TmqhFlowRegisterTests(void);
 
+/** buckets in the indirection table of the 'balanced' scheduler */
+#define TMQH_FLOW_BALANCE_BUCKETS 4096
+/** min time between two rebalance rounds */
+#define TMQH_FLOW_BALANCE_INTERVAL_MS 100
+/** packets in flight on a worker before it's considered overloaded */
+#define TMQH_FLOW_BALANCE_DEPTH 64
+/** max buckets moved per round */
+#define TMQH_FLOW_BALANCE_MOVES 16
+
+typedef struct TmqhFlowBucket_ {
+    /** worker the bucket maps to in the upper 32 bits, packets of the
+     *  bucket queued or being processed in the lower 32 bits. Kept in a
+     *  single atomic so a bucket is only moved while it's idle. */
+    SC_ATOMIC_DECLARE(uint64_t, state);
+    /** packets since the last rebalance round */
+    SC_ATOMIC_DECLARE(uint32_t, pkts);
+} TmqhFlowBucket;
+
+/** indirection table and state of the 'balanced' scheduler, shared by all
+ *  capture threads so a flow maps to the same worker for all of them */
+static struct TmqhFlowBalancer_ {
+    TmqhFlowBucket buckets[TMQH_FLOW_BALANCE_BUCKETS];
+
+    /* rebalance round state, protected by 'lock' */
+    SCMutex lock;
+    uint16_t workers;
+    struct timeval last;
+    uint32_t pkts[TMQH_FLOW_BALANCE_BUCKETS];
+    uint64_t *worker_depth;
+    uint64_t *worker_pkts;
+
+    SC_ATOMIC_DECLARE(uint64_t, rounds);
+    SC_ATOMIC_DECLARE(uint64_t, moved);
+    SC_ATOMIC_DECLARE(uint64_t, blocked);
+} balancer;
+
+/** bucket the packet that the worker thread is processing holds */
+static thread_local TmqhFlowBucket *balancer_bucket = NULL;
+
 void TmqhFlowRegister(void)
 {
     tmqh_table[TMQH_FLOW].name = "flow";
@@ -70,6 +114,9 @@ void TmqhFlowRegister(void)
             tmqh_table[TMQH_FLOW].OutHandler = TmqhOutputFlowIPPair;
         } else if (strcasecmp(scheduler, "ftp-hash") == 0) {
             tmqh_table[TMQH_FLOW].OutHandler = TmqhOutputFlowFTPHash;
+        } else if (strcasecmp(scheduler, "balanced") == 0) {
+            tmqh_table[TMQH_FLOW].OutHandler = TmqhOutputFlowBalanced;
+            SCMutexInit(&balancer.lock, NULL);
         } else {
             SCLogError("Invalid entry \"%s\" "
                        "for autofp-scheduler in conf.  Killing engine.",
@@ -79,6 +126,19 @@ void TmqhFlowRegister(void)
     } else {
         tmqh_table[TMQH_FLOW].OutHandler = TmqhOutputFlowHash;
     }
+
+    const char *queue = NULL;
+    if (SCConfGet("autofp-queue", &queue) == 1) {
+        if (strcasecmp(queue, "ring") == 0) {
+            tmqh_table[TMQH_FLOW].InHandler = TmqhInputFlowRing;
+            tmqh_table[TMQH_FLOW].OutHandlerCtxSetup = TmqhOutputFlowRingSetupCtx;
+        } else if (strcasecmp(queue, "mutex") != 0) {
+            SCLogError("Invalid entry \"%s\" "
+                       "for autofp-queue in conf.  Killing engine.",
+                    queue);
+            exit(EXIT_FAILURE);
+        }
+    }
 }
 
 void TmqhFlowPrintAutofpHandler(void)
@@ -90,8 +150,31 @@ void TmqhFlowPrintAutofpHandler(void)
     PRINT_IF_FUNC(TmqhOutputFlowHash, "Hash");
     PRINT_IF_FUNC(TmqhOutputFlowIPPair, "IPPair");
     PRINT_IF_FUNC(TmqhOutputFlowFTPHash, "FTPHash");
+    PRINT_IF_FUNC(TmqhOutputFlowBalanced, "Balanced");
 
 #undef PRINT_IF_FUNC
+
+    if (tmqh_table[TMQH_FLOW].InHandler == TmqhInputFlowRing)
+        SCLogConfig("AutoFP mode using lock free rings to pass packets to the workers");
+}
+
+/** \internal
+ *  \brief the worker is done with the previous packet: drop its hold on
+ *         the 'balanced' scheduler bucket so it can be moved again */
+static inline void TmqhFlowBalancedRelease(void)
+{
+    if (balancer_bucket != NULL) {
+        SC_ATOMIC_SUB(balancer_bucket->state, 1);
+        balancer_bucket = NULL;
+    }
+}
+
+static inline Packet *TmqhFlowBalancedTrack(Packet *p)
+{
+    if (p != NULL && (p->flags & PKT_AUTOFP_BALANCED)) {
+        balancer_bucket = &balancer.buckets[p->flow_hash % TMQH_FLOW_BALANCE_BUCKETS];
+    }
+    return p;
 }
 
 /* same as 'simple' */
@@ -99,6 +182,7 @@ Packet *TmqhInputFlow(ThreadVars *tv)
 {
     PacketQueue *q = tv->inq->pq;
 
+    TmqhFlowBalancedRelease();
     StatsSyncCountersIfSignalled(tv);
 
     SCMutexLock(&q->mutex_q);
@@ -110,7 +194,7 @@ Packet *TmqhInputFlow(ThreadVars *tv)
     if (q->len > 0) {
         Packet *p = PacketDequeue(q);
         SCMutexUnlock(&q->mutex_q);
-        return p;
+        return TmqhFlowBalancedTrack(p);
     } else {
         /* return NULL if we have no pkt. Should only happen on signals. */
         SCMutexUnlock(&q->mutex_q);
@@ -118,7 +202,121 @@ Packet *TmqhInputFlow(ThreadVars *tv)
     }
 }
 
-static int StoreQueueId(TmqhFlowCtx *ctx, char *name)
+/** polls of all rings before the 'ring' reader goes to sleep. The budget
+ *  grows while spinning pays off and shrinks each time we end up sleeping. */
+#define TMQH_FLOW_RING_SPINS_MIN 64
+#define TMQH_FLOW_RING_SPINS_MAX 8192
+
+/** per reader thread state of the 'ring' input handler */
+static thread_local struct TmqhFlowRingReader {
+    uint16_t cur;   /**< ring we're currently taking packets from */
+    uint16_t taken; /**< packets taken from 'cur' in a row */
+    uint32_t spins; /**< current spin budget */
+} ring_reader = { 0, 0, TMQH_FLOW_RING_SPINS_MAX };
+
+/** \internal
+ *  \brief get a packet from one of the rings of the queue
+ *
+ *  Stays on a ring for up to PACKET_RING_BATCH packets so the consumer
+ *  side of the ring only publishes once per batch, then moves on to the
+ *  next one so a busy writer can't starve the others.
+ */
+static inline Packet *TmqhFlowRingPollRings(Tmq *tmq)
+{
+    const uint16_t cnt = tmq->rings_cnt;
+    for (uint16_t i = 0; i < cnt; i++) {
+        if (ring_reader.cur >= cnt)
+            ring_reader.cur = 0;
+        Packet *p = PacketRingDequeue(tmq->rings[ring_reader.cur]);
+        if (p != NULL) {
+            if (++ring_reader.taken < PACKET_RING_BATCH)
+                return p;
+        }
+        ring_reader.taken = 0;
+        ring_reader.cur++;
+        if (p != NULL)
+            return p;
+    }
+    return NULL;
+}
+
+/** \internal
+ *  \brief get a packet from the rings or from the locked queue. The latter
+ *         is still used for the pseudo packets injected by the engine. */
+static inline Packet *TmqhFlowRingPoll(Tmq *tmq)
+{
+    PacketQueue *q = tmq->pq;
+    if (q->len > 0) {
+        SCMutexLock(&q->mutex_q);
+        Packet *p = PacketDequeue(q);
+        SCMutexUnlock(&q->mutex_q);
+        if (p != NULL)
+            return p;
+    }
+    return TmqhFlowRingPollRings(tmq);
+}
+
+static inline bool TmqhFlowRingReaderInterrupted(ThreadVars *tv)
+{
+    if (TmThreadsCheckFlag(tv, (THV_KILL | THV_REQ_FLOW_LOOP)))
+        return true;
+    return (tv->flow_queue && SC_ATOMIC_GET(tv->flow_queue->non_empty));
+}
+
+/**
+ * \brief input handler for the 'ring' queue
+ *
+ * Polls the rings for a while, then sleeps on the queue's condition. The
+ * writers only signal the condition if we flagged we're sleeping, so in the
+ * busy case no locks or syscalls are involved at all.
+ */
+static Packet *TmqhInputFlowRing(ThreadVars *tv)
+{
+    Tmq *tmq = tv->inq;
+
+    TmqhFlowBalancedRelease();
+    StatsSyncCountersIfSignalled(tv);
+
+    for (uint32_t spin = 0; spin < ring_reader.spins; spin++) {
+        Packet *p = TmqhFlowRingPoll(tmq);
+        if (p != NULL) {
+            if (spin > 0 && ring_reader.spins < TMQH_FLOW_RING_SPINS_MAX)
+                ring_reader.spins *= 2;
+            return TmqhFlowBalancedTrack(p);
+        }
+        if (TmqhFlowRingReaderInterrupted(tv))
+            return NULL;
+    }
+    if (ring_reader.spins > TMQH_FLOW_RING_SPINS_MIN)
+        ring_reader.spins /= 2;
+
+    /* nothing came in while spinning, go to sleep. Flag it before looking at
+     * the rings a last time: a writer either sees the flag and signals us, or
+     * we see its packet. */
+    Packet *p = NULL;
+    PacketQueue *q = tmq->pq;
+    SCMutexLock(&q->mutex_q);
+    SC_ATOMIC_SET(tmq->reader_sleeping, true);
+    if (q->len == 0) {
+        p = TmqhFlowRingPollRings(tmq);
+        if (p == NULL && !TmqhFlowRingReaderInterrupted(tv)) {
+            SCCondWait(&q->cond_q, &q->mutex_q);
+        }
+    }
+    SC_ATOMIC_SET(tmq->reader_sleeping, false);
+    if (p == NULL && q->len > 0) {
+        p = PacketDequeue(q);
+    }
+    SCMutexUnlock(&q->mutex_q);
+
+    if (p == NULL) {
+        p = TmqhFlowRingPollRings(tmq);
+    }
+    /* return NULL if we have no pkt. Should only happen on signals. */
+    return TmqhFlowBalancedTrack(p);
+}
+
+static int StoreQueueId(TmqhFlowCtx *ctx, char *name, const bool ring)
 {
     void *ptmp;
     Tmq *tmq = TmqGetQueueByName(name);
@@ -149,6 +347,71 @@ static int StoreQueueId(TmqhFlowCtx *ctx, char *name)
     }
     ctx->queues[ctx->size - 1].q = tmq->pq;
 
+    if (ring) {
+        /* we can't have more packets in flight than our packet pool holds,
+         * except for tunnel packets, so leave some room for those */
+        extern uint32_t max_pending_packets;
+        PacketRing *r = TmqAddRing(tmq, max_pending_packets * 2);
+        if (r == NULL)
+            return -1;
+        ctx->queues[ctx->size - 1].ring = r;
+        ctx->queues[ctx->size - 1].tmq = tmq;
+    }
+
+    return 0;
+}
+
+static uint64_t TmqhFlowBalancerRoundsCounter(void)
+{
+    return SC_ATOMIC_GET(balancer.rounds);
+}
+
+static uint64_t TmqhFlowBalancerMovedCounter(void)
+{
+    return SC_ATOMIC_GET(balancer.moved);
+}
+
+static uint64_t TmqhFlowBalancerBlockedCounter(void)
+{
+    return SC_ATOMIC_GET(balancer.blocked);
+}
+
+/** \internal
+ *  \brief set up the indirection table for 'workers' workers
+ *
+ *  Called for each capture thread's ctx during thread setup. All use the
+ *  same list of queues, so the table is only (re)initialized if the number
+ *  of workers changed.
+ */
+static int TmqhFlowBalancerSetup(const uint16_t workers)
+{
+    SCMutexLock(&balancer.lock);
+    if (balancer.workers != workers) {
+        uint64_t *depth = SCCalloc(workers, sizeof(uint64_t));
+        uint64_t *pkts = SCCalloc(workers, sizeof(uint64_t));
+        if (depth == NULL || pkts == NULL) {
+            SCFree(depth);
+            SCFree(pkts);
+            SCMutexUnlock(&balancer.lock);
+            return -1;
+        }
+        SCFree(balancer.worker_depth);
+        SCFree(balancer.worker_pkts);
+        balancer.worker_depth = depth;
+        balancer.worker_pkts = pkts;
+        balancer.workers = workers;
+
+        for (uint32_t i = 0; i < TMQH_FLOW_BALANCE_BUCKETS; i++) {
+            SC_ATOMIC_SET(balancer.buckets[i].state, (uint64_t)(i % workers) << 32);
+            SC_ATOMIC_SET(balancer.buckets[i].pkts, 0);
+        }
+        gettimeofday(&balancer.last, NULL);
+    }
+    SCMutexUnlock(&balancer.lock);
+
+    StatsRegisterGlobalCounter("autofp.rebalance.rounds", TmqhFlowBalancerRoundsCounter);
+    StatsRegisterGlobalCounter("autofp.rebalance.buckets_moved", TmqhFlowBalancerMovedCounter);
+    StatsRegisterGlobalCounter("autofp.rebalance.buckets_blocked", TmqhFlowBalancerBlockedCounter);
     return 0;
 }
 
@@ -162,7 +425,7 @@ static int StoreQueueId(TmqhFlowCtx *ctx, char *name)
  *
  * \retval ctx queues handlers ctx or NULL in error
  */
-void *TmqhOutputFlowSetupCtx(const char *queue_str)
+static void *TmqhOutputFlowSetupCtxDo(const char *queue_str, const bool ring)
 {
     if (queue_str == NULL || strlen(queue_str) == 0)
         return NULL;
@@ -185,18 +448,23 @@ void *TmqhOutputFlowSetupCtx(const char *queue_str)
         if (comma != NULL) {
             *comma = '\0';
             char *qname = tstr;
-            int r = StoreQueueId(ctx,qname);
+            int r = StoreQueueId(ctx, qname, ring);
             if (r < 0)
                 goto error;
         } else {
             char *qname = tstr;
-            int r = StoreQueueId(ctx,qname);
+            int r = StoreQueueId(ctx, qname, ring);
             if (r < 0)
                 goto error;
         }
         tstr = comma ? (comma + 1) : comma;
     } while (tstr != NULL);
 
+    if (tmqh_table[TMQH_FLOW].OutHandler == TmqhOutputFlowBalanced) {
+        if (TmqhFlowBalancerSetup(ctx->size) < 0)
+            goto error;
+    }
+
     SCFree(str);
     return (void *)ctx;
 
@@ -207,6 +475,22 @@ error:
     return NULL;
 }
 
+void *TmqhOutputFlowSetupCtx(const char *queue_str)
+{
+    return TmqhOutputFlowSetupCtxDo(queue_str, false);
+}
+
+/**
+ * \brief setup the queue handlers ctx for the 'ring' queue
+ *
+ * Same as TmqhOutputFlowSetupCtx, but also adds a ring for this writer to
+ * each of the queues.
+ */
+static void *TmqhOutputFlowRingSetupCtx(const char *queue_str)
+{
+    return TmqhOutputFlowSetupCtxDo(queue_str, true);
+}
+
 void TmqhOutputFlowFreeCtx(void *ctx)
 {
     TmqhFlowCtx *fctx = (TmqhFlowCtx *)ctx;
@@ -217,6 +501,41 @@ void TmqhOutputFlowFreeCtx(void *ctx)
     SCFree(fctx);
 }
 
+/** \internal
+ *  \brief pass a packet to the selected queue
+ *
+ *  For the 'ring' queue, wait for the worker to make room if our ring is
+ *  full, as falling back to the locked queue would reorder the flow.
+ */
+static inline void TmqhFlowEnqueue(ThreadVars *tv, TmqhFlowMode *m, Packet *p)
+{
+    PacketQueue *q = m->q;
+
+    if (m->ring != NULL) {
+        uint32_t spin = 0;
+        while (!PacketRingEnqueue(m->ring, p)) {
+            if (TmThreadsCheckFlag(tv, THV_KILL)) {
+                /* shutting down, order no longer matters */
+                goto locked;
+            }
+            if (++spin > TMQH_FLOW_RING_SPINS_MIN)
+                SleepUsec(10);
+        }
+        if (SC_ATOMIC_GET(m->tmq->reader_sleeping)) {
+            SCMutexLock(&q->mutex_q);
+            SCCondSignal(&q->cond_q);
+            SCMutexUnlock(&q->mutex_q);
+        }
+        return;
+    }
+
+locked:
+    SCMutexLock(&q->mutex_q);
+    PacketEnqueue(q, p);
+    SCCondSignal(&q->cond_q);
+    SCMutexUnlock(&q->mutex_q);
+}
+
 void TmqhOutputFlowHash(ThreadVars *tv, Packet *p)
 {
     uint32_t qid;
@@ -232,11 +551,7 @@ void TmqhOutputFlowHash(ThreadVars *tv, Packet *p)
             ctx->last = 0;
     }
 
-    PacketQueue *q = ctx->queues[qid].q;
-    SCMutexLock(&q->mutex_q);
-    PacketEnqueue(q, p);
-    SCCondSignal(&q->cond_q);
-    SCMutexUnlock(&q->mutex_q);
+    TmqhFlowEnqueue(tv, &ctx->queues[qid], p);
 }
 
 /**
@@ -260,11 +575,7 @@ void TmqhOutputFlowIPPair(ThreadVars *tv, Packet *p)
     }
 
     uint32_t qid = addr_hash % ctx->size;
-    PacketQueue *q = ctx->queues[qid].q;
-    SCMutexLock(&q->mutex_q);
-    PacketEnqueue(q, p);
-    SCCondSignal(&q->cond_q);
-    SCMutexUnlock(&q->mutex_q);
+    TmqhFlowEnqueue(tv, &ctx->queues[qid], p);
 }
 
 static void TmqhOutputFlowFTPHash(ThreadVars *tv, Packet *p)
@@ -286,11 +597,142 @@ static void TmqhOutputFlowFTPHash(ThreadVars *tv, Packet *p)
             ctx->last = 0;
     }
 
-    PacketQueue *q = ctx->queues[qid].q;
-    SCMutexLock(&q->mutex_q);
-    PacketEnqueue(q, p);
-    SCCondSignal(&q->cond_q);
-    SCMutexUnlock(&q->mutex_q);
+    TmqhFlowEnqueue(tv, &ctx->queues[qid], p);
+}
+
+/** \internal
+ *  \brief move buckets off the most loaded worker if it's falling behind
+ *
+ *  Load is the number of packets queued to or being processed by a worker.
+ *  If the most loaded worker has a backlog and substantially more than the
+ *  least loaded one, buckets that had traffic in the last interval are moved
+ *  over until about half of the difference in packets is moved. A single
+ *  bucket carrying more than that, like an elephant flow, stays put: moving
+ *  it would only move the hot spot. Only buckets without packets in flight
+ *  are moved, so packets of a flow are never processed by two workers at
+ *  the same time and can't get reordered.
+ */
+static void TmqhFlowBalancerRun(void)
+{
+    if (SCMutexTrylock(&balancer.lock) != 0)
+        return;
+
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    const int64_t elapsed_ms = (int64_t)(now.tv_sec - balancer.last.tv_sec) * 1000 +
+                               (now.tv_usec - balancer.last.tv_usec) / 1000;
+    if (elapsed_ms < TMQH_FLOW_BALANCE_INTERVAL_MS) {
+        SCMutexUnlock(&balancer.lock);
+        return;
+    }
+    balancer.last = now;
+
+    const uint16_t workers = balancer.workers;
+    memset(balancer.worker_depth, 0, workers * sizeof(uint64_t));
+    memset(balancer.worker_pkts, 0, workers * sizeof(uint64_t));
+    for (uint32_t i = 0; i < TMQH_FLOW_BALANCE_BUCKETS; i++) {
+        TmqhFlowBucket *b = &balancer.buckets[i];
+        const uint64_t state = SC_ATOMIC_GET(b->state);
+        const uint16_t w = (uint16_t)(state >> 32);
+        const uint32_t pkts = SC_ATOMIC_GET(b->pkts);
+        SC_ATOMIC_SUB(b->pkts, pkts);
+
+        balancer.pkts[i] = pkts;
+        balancer.worker_depth[w] += (uint32_t)state;
+        balancer.worker_pkts[w] += pkts;
+    }
+
+    uint16_t hot = 0, cold = 0;
+    for (uint16_t w = 1; w < workers; w++) {
+        if (balancer.worker_depth[w] > balancer.worker_depth[hot])
+            hot = w;
+        if (balancer.worker_depth[w] < balancer.worker_depth[cold] ||
+                (balancer.worker_depth[w] == balancer.worker_depth[cold] &&
+                        balancer.worker_pkts[w] < balancer.worker_pkts[cold]))
+            cold = w;
+    }
+    if (hot == cold || balancer.worker_depth[hot] < TMQH_FLOW_BALANCE_DEPTH ||
+            balancer.worker_depth[hot] < 2 * balancer.worker_depth[cold] ||
+            balancer.worker_pkts[hot] <= balancer.worker_pkts[cold]) {
+        SCMutexUnlock(&balancer.lock);
+        return;
+    }
+
+    const uint64_t target = (balancer.worker_pkts[hot] - balancer.worker_pkts[cold]) / 2;
+    uint64_t moved_pkts = 0;
+    uint32_t moved = 0;
+    uint32_t blocked = 0;
+    while (moved < TMQH_FLOW_BALANCE_MOVES && moved_pkts < target) {
+        /* busiest bucket of the hot worker that still fits the target */
+        uint32_t best = TMQH_FLOW_BALANCE_BUCKETS;
+        for (uint32_t i = 0; i < TMQH_FLOW_BALANCE_BUCKETS; i++) {
+            const uint32_t pkts = balancer.pkts[i];
+            if (pkts == 0 || pkts > target - moved_pkts)
+                continue;
+            if ((uint16_t)(SC_ATOMIC_GET(balancer.buckets[i].state) >> 32) != hot)
+                continue;
+            if (best == TMQH_FLOW_BALANCE_BUCKETS || pkts > balancer.pkts[best])
+                best = i;
+        }
+        if (best == TMQH_FLOW_BALANCE_BUCKETS)
+            break;
+
+        const uint32_t pkts = balancer.pkts[best];
+        balancer.pkts[best] = 0;
+
+        /* only succeeds if no packets of the bucket are in flight */
+        uint64_t expected = (uint64_t)hot << 32;
+        if (SC_ATOMIC_CAS(&balancer.buckets[best].state, expected, (uint64_t)cold << 32)) {
+            moved++;
+            moved_pkts += pkts;
+        } else {
+            blocked++;
+        }
+    }
+
+    if (moved > 0) {
+        SCLogDebug("moved %u buckets (%" PRIu64 " pkts) from worker %u to %u", moved, moved_pkts,
+                hot, cold);
+        SC_ATOMIC_ADD(balancer.rounds, 1);
+        SC_ATOMIC_ADD(balancer.moved, moved);
+    }
+    if (blocked > 0) {
+        SC_ATOMIC_ADD(balancer.blocked, blocked);
+    }
+    SCMutexUnlock(&balancer.lock);
+}
+
+/**
+ * \brief select the queue through the 'balanced' scheduler's indirection
+ *        table, using the flow hash to pick the bucket.
+ *
+ * \param tv thread vars.
+ * \param p packet.
+ */
+static void TmqhOutputFlowBalanced(ThreadVars *tv, Packet *p)
+{
+    uint32_t qid;
+    TmqhFlowCtx *ctx = (TmqhFlowCtx *)tv->outctx;
+
+    if (p->flags & PKT_WANTS_FLOW) {
+        TmqhFlowBucket *b = &balancer.buckets[p->flow_hash % TMQH_FLOW_BALANCE_BUCKETS];
+        /* taking a hold on the bucket and looking up its worker is a single
+         * atomic op, so it can't be moved in between */
+        const uint64_t state = SC_ATOMIC_ADD(b->state, 1);
+        SC_ATOMIC_ADD(b->pkts, 1);
+        qid = (uint32_t)(state >> 32);
+        p->flags |= PKT_AUTOFP_BALANCED;
+
+        if ((++ctx->balance_cnt & 1023) == 0)
+            TmqhFlowBalancerRun();
+    } else {
+        qid = ctx->last++;
+
+        if (ctx->last == ctx->size)
+            ctx->last = 0;
+    }
+
+    TmqhFlowEnqueue(tv, &ctx->queues[qid], p);
 }
 
 #ifdef UNITTESTS
@@ -391,6 +833,104 @@ static int TmqhOutputFlowSetupCtxTest03(void)
     PASS;
 }
 
+/** \test 'ring' queue: a ring per writer per queue, FIFO and full handling */
+static int TmqhOutputFlowRingSetupCtxTest01(void)
+{
+    TmqResetQueues();
+
+    TmqhFlowCtx *w1 = TmqhOutputFlowRingSetupCtx("queue1,queue2");
+    FAIL_IF_NULL(w1);
+    TmqhFlowCtx *w2 = TmqhOutputFlowRingSetupCtx("queue1,queue2");
+    FAIL_IF_NULL(w2);
+
+    Tmq *tmq1 = TmqGetQueueByName("queue1");
+    FAIL_IF_NULL(tmq1);
+    FAIL_IF_NOT(tmq1->rings_cnt == 2);
+    FAIL_IF_NOT(w1->queues[0].tmq == tmq1);
+    FAIL_IF_NOT(w1->queues[0].ring == tmq1->rings[0]);
+    FAIL_IF_NOT(w2->queues[0].ring == tmq1->rings[1]);
+    Tmq *tmq2 = TmqGetQueueByName("queue2");
+    FAIL_IF_NULL(tmq2);
+    FAIL_IF_NOT(tmq2->rings_cnt == 2);
+    FAIL_IF_NOT(w2->queues[1].ring == tmq2->rings[1]);
+
+    /* the packets are never looked at, so fake pointers will do */
+    PacketRing *r = w1->queues[0].ring;
+    const uint32_t size = r->mask + 1;
+    FAIL_IF_NOT(PacketRingIsEmpty(r));
+    for (uint32_t i = 0; i < size; i++) {
+        FAIL_IF_NOT(PacketRingEnqueue(r, (Packet *)(uintptr_t)(i + 1)));
+    }
+    FAIL_IF(PacketRingEnqueue(r, (Packet *)(uintptr_t)(size + 1)));
+    FAIL_IF(PacketRingIsEmpty(r));
+    FAIL_IF_NOT(TmqRingsEmpty(tmq2));
+    FAIL_IF(TmqRingsEmpty(tmq1));
+
+    /* room is only handed back to the writer per batch */
+    FAIL_IF_NOT(PacketRingDequeue(r) == (Packet *)(uintptr_t)1);
+    FAIL_IF(PacketRingEnqueue(r, (Packet *)(uintptr_t)(size + 1)));
+    for (uint32_t i = 1; i < PACKET_RING_BATCH; i++) {
+        FAIL_IF_NOT(PacketRingDequeue(r) == (Packet *)(uintptr_t)(i + 1));
+    }
+    FAIL_IF_NOT(PacketRingEnqueue(r, (Packet *)(uintptr_t)(size + 1)));
+
+    for (uint32_t i = PACKET_RING_BATCH; i < size + 1; i++) {
+        FAIL_IF_NOT(PacketRingDequeue(r) == (Packet *)(uintptr_t)(i + 1));
+    }
+    FAIL_IF_NOT(PacketRingDequeue(r) == NULL);
+    FAIL_IF_NOT(PacketRingIsEmpty(r));
+    FAIL_IF_NOT(TmqRingsEmpty(tmq1));
+
+    TmqhOutputFlowFreeCtx(w1);
+    TmqhOutputFlowFreeCtx(w2);
+    TmqResetQueues();
+    PASS;
+}
+
+/** \test 'balanced' scheduler: elephant and busy buckets stay put */
+static int TmqhFlowBalancerTest01(void)
+{
+    SCMutexInit(&balancer.lock, NULL);
+    balancer.workers = 0;
+    FAIL_IF(TmqhFlowBalancerSetup(2) < 0);
+    FAIL_IF_NOT(SC_ATOMIC_GET(balancer.buckets[0].state) == 0);
+    FAIL_IF_NOT(SC_ATOMIC_GET(balancer.buckets[1].state) == (1ULL << 32));
+    const uint64_t moved = SC_ATOMIC_GET(balancer.moved);
+    const uint64_t blocked = SC_ATOMIC_GET(balancer.blocked);
+
+    /* worker 0: an elephant with a backlog, an idle bucket and a bucket
+     * with a packet in flight. Worker 1 has a bit of traffic. */
+    SC_ATOMIC_SET(balancer.buckets[0].state, 100);
+    SC_ATOMIC_SET(balancer.buckets[0].pkts, 1000);
+    SC_ATOMIC_SET(balancer.buckets[2].pkts, 100);
+    SC_ATOMIC_SET(balancer.buckets[4].state, 1);
+    SC_ATOMIC_SET(balancer.buckets[4].pkts, 50);
+    SC_ATOMIC_SET(balancer.buckets[1].pkts, 10);
+
+    /* too soon */
+    TmqhFlowBalancerRun();
+    FAIL_IF_NOT(SC_ATOMIC_GET(balancer.moved) == moved);
+
+    balancer.last.tv_sec -= 1;
+    TmqhFlowBalancerRun();
+    FAIL_IF_NOT(SC_ATOMIC_GET(balancer.moved) == moved + 1);
+    FAIL_IF_NOT(SC_ATOMIC_GET(balancer.blocked) == blocked + 1);
+    FAIL_IF_NOT(SC_ATOMIC_GET(balancer.buckets[0].state) == 100);
+    FAIL_IF_NOT(SC_ATOMIC_GET(balancer.buckets[2].state) == (1ULL << 32));
+    FAIL_IF_NOT(SC_ATOMIC_GET(balancer.buckets[4].state) == 1);
+    FAIL_IF_NOT(SC_ATOMIC_GET(balancer.buckets[0].pkts) == 0);
+
+    /* next round: only the elephant has traffic, nothing to move */
+    SC_ATOMIC_SET(balancer.buckets[0].pkts, 1000);
+    balancer.last.tv_sec -= 1;
+    TmqhFlowBalancerRun();
+    FAIL_IF_NOT(SC_ATOMIC_GET(balancer.moved) == moved + 1);
+
+    balancer.workers = 0;
+    SCMutexDestroy(&balancer.lock);
+    PASS;
+}
+
 #endif /* UNITTESTS */
 
 void TmqhFlowRegisterTests(void)
@@ -402,5 +942,7 @@ void TmqhFlowRegisterTests(void)
                    TmqhOutputFlowSetupCtxTest02);
     UtRegisterTest("TmqhOutputFlowSetupCtxTest03",
                    TmqhOutputFlowSetupCtxTest03);
+    UtRegisterTest("TmqhOutputFlowRingSetupCtxTest01", TmqhOutputFlowRingSetupCtxTest01);
+    UtRegisterTest("TmqhFlowBalancerTest01", TmqhFlowBalancerTest01);
 #endif
 }
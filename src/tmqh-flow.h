@@ -26,6 +26,9 @@
 
 typedef struct TmqhFlowMode_ {
     PacketQueue *q;
+    /* 'ring' queue: our ring into the queue and the queue itself */
+    PacketRing *ring;
+    Tmq *tmq;
 } TmqhFlowMode;
 
 /** \brief Ctx for the flow queue handler
@@ -34,6 +37,8 @@ typedef struct TmqhFlowMode_ {
 typedef struct TmqhFlowCtx_ {
     uint16_t size;
     uint16_t last;
+    /** packets sent by the 'balanced' scheduler, used to pace rebalancing */
+    uint32_t balance_cnt;
 
     TmqhFlowMode *queues;
 } TmqhFlowCtx;
@@ -34,6 +34,8 @@
 #include "util-profiling.h"
 #include "util-validate.h"
 #include "action-globals.h"
+#include "util-time.h"
+#include "counters.h"
 
 extern uint32_t max_pending_packets;
 
@@ -68,6 +70,17 @@ static void UpdateReturnThreshold(PktPool *pool)
     }
 }
 
+/** \brief add to one of the pool stats counters
+ *
+ *  Only threads with a ThreadVars have counters, and they can only be used
+ *  once the thread's counters are set up.
+ */
+static inline void PacketPoolStatsAdd(PktPool *pool, uint16_t id, uint64_t x)
+{
+    if (pool->tv != NULL && pool->tv->perf_private_ctx.initialized)
+        StatsAddUI64(pool->tv, id, x);
+}
+
 void PacketPoolWait(void)
 {
     PktPool *my_pool = GetThreadPacketPool();
@@ -75,12 +88,28 @@ void PacketPoolWait(void)
     if (my_pool->head == NULL) {
         SC_ATOMIC_SET(my_pool->return_stack.return_threshold, 1);
 
-        SCMutexLock(&my_pool->return_stack.mutex);
-        int rc = 0;
-        while (my_pool->return_stack.cnt == 0 && rc == 0) {
-            rc = SCCondWait(&my_pool->return_stack.cond, &my_pool->return_stack.mutex);
+        if (SC_ATOMIC_GET(my_pool->return_stack.head) == NULL) {
+            const SCTime_t start = SCTimeGetTime();
+
+            SCMutexLock(&my_pool->return_stack.mutex);
+            /* returning threads check the flag after pushing, so either
+             * they see it and signal us, or we see their packets here */
+            SC_ATOMIC_SET(my_pool->return_stack.waiting, true);
+            int rc = 0;
+            while (SC_ATOMIC_GET(my_pool->return_stack.head) == NULL && rc == 0) {
+                rc = SCCondWait(&my_pool->return_stack.cond, &my_pool->return_stack.mutex);
+            }
+            SC_ATOMIC_SET(my_pool->return_stack.waiting, false);
+            SCMutexUnlock(&my_pool->return_stack.mutex);
+
+            const SCTime_t end = SCTimeGetTime();
+            const int64_t usecs = ((int64_t)SCTIME_SECS(end) - (int64_t)SCTIME_SECS(start)) *
+                                          1000000 +
+                                  ((int64_t)SCTIME_USECS(end) - (int64_t)SCTIME_USECS(start));
+            PacketPoolStatsAdd(my_pool, my_pool->counter_empty_waits, 1);
+            if (usecs > 0)
+                PacketPoolStatsAdd(my_pool, my_pool->counter_empty_wait_usecs, (uint64_t)usecs);
         }
-        SCMutexUnlock(&my_pool->return_stack.mutex);
 
         UpdateReturnThreshold(my_pool);
     }
@@ -99,13 +128,21 @@ static void PacketPoolStorePacket(Packet *p)
 
 static void PacketPoolGetReturnedPackets(PktPool *pool)
 {
-    SCMutexLock(&pool->return_stack.mutex);
-    /* Move all the packets from the locked return stack to the local stack. */
-    pool->head = pool->return_stack.head;
-    pool->return_stack.head = NULL;
-    pool->cnt += pool->return_stack.cnt;
-    pool->return_stack.cnt = 0;
-    SCMutexUnlock(&pool->return_stack.mutex);
+    /* Take the whole return stack. Other threads only ever push onto it,
+     * so there is no ABA issue taking it all at once. */
+    Packet *head = SC_ATOMIC_GET(pool->return_stack.head);
+    while (head != NULL && !SC_ATOMIC_CAS(&pool->return_stack.head, head, NULL)) {
+        head = SC_ATOMIC_GET(pool->return_stack.head);
+    }
+    if (head == NULL)
+        return;
+
+    uint32_t cnt = 0;
+    for (Packet *p = head; p != NULL; p = p->next) {
+        cnt++;
+    }
+    pool->head = head;
+    pool->cnt += cnt;
 }
 
 /** \brief Get a new packet from the packet pool
@@ -135,8 +172,7 @@ Packet *PacketPoolGetPacket(void)
         return p;
     }
 
-    /* Local Stack is empty, so check the return stack, which requires
-     * locking. */
+    /* Local Stack is empty, so check the return stack. */
     PacketPoolGetReturnedPackets(pool);
 
     /* Try to allocate again. Need to check for not empty again, since the
@@ -162,6 +198,56 @@ Packet *PacketPoolGetPacket(void)
     return NULL;
 }
 
+/** \brief hand a magazine over to the return stack of its pool */
+static void PacketPoolFlushMagazine(PktPool *my_pool, PktPoolMagazine *mag)
+{
+    PktPool *pool = mag->pool;
+
+    Packet *head;
+    do {
+        head = SC_ATOMIC_GET(pool->return_stack.head);
+        mag->tail->next = head;
+    } while (!SC_ATOMIC_CAS(&pool->return_stack.head, head, mag->head));
+
+    /* the owner may be sleeping in PacketPoolWait() for these packets */
+    if (SC_ATOMIC_GET(pool->return_stack.waiting)) {
+        SCMutexLock(&pool->return_stack.mutex);
+        SCCondSignal(&pool->return_stack.cond);
+        SCMutexUnlock(&pool->return_stack.mutex);
+    }
+
+    PacketPoolStatsAdd(my_pool, my_pool->counter_magazine_flushes, 1);
+    memset(mag, 0, sizeof(*mag));
+}
+
+/** \brief get the magazine for returning packets to a pool
+ *
+ *  If all magazines are in use by other pools, the fullest one is flushed
+ *  and reused.
+ */
+static PktPoolMagazine *PacketPoolGetMagazine(PktPool *my_pool, PktPool *pool)
+{
+    PktPoolMagazine *empty = NULL;
+    PktPoolMagazine *fullest = &my_pool->magazines[0];
+
+    for (int i = 0; i < PKT_POOL_MAGAZINES; i++) {
+        PktPoolMagazine *mag = &my_pool->magazines[i];
+        if (mag->pool == pool)
+            return mag;
+        if (mag->pool == NULL) {
+            if (empty == NULL)
+                empty = mag;
+        } else if (mag->cnt > fullest->cnt) {
+            fullest = mag;
+        }
+    }
+    if (empty != NULL)
+        return empty;
+
+    PacketPoolFlushMagazine(my_pool, fullest);
+    return fullest;
+}
+
 /** \brief Return packet to Packet pool
  *
  */
@@ -189,45 +275,23 @@ void PacketPoolReturnPacket(Packet *p)
         my_pool->head = p;
         my_pool->cnt++;
     } else {
-        PktPool *pending_pool = my_pool->pending_pool;
-        if (pending_pool == NULL || pending_pool == pool) {
-            if (pending_pool == NULL) {
-                /* No pending packet, so store the current packet. */
-                p->next = NULL;
-                my_pool->pending_pool = pool;
-                my_pool->pending_head = p;
-                my_pool->pending_tail = p;
-                my_pool->pending_count = 1;
-            } else if (pending_pool == pool) {
-                /* Another packet for the pending pool list. */
-                p->next = my_pool->pending_head;
-                my_pool->pending_head = p;
-                my_pool->pending_count++;
-            }
-
-            const uint32_t threshold = SC_ATOMIC_GET(pool->return_stack.return_threshold);
-            if (my_pool->pending_count >= threshold) {
-                /* Return the entire list of pending packets. */
-                SCMutexLock(&pool->return_stack.mutex);
-                my_pool->pending_tail->next = pool->return_stack.head;
-                pool->return_stack.head = my_pool->pending_head;
-                pool->return_stack.cnt += my_pool->pending_count;
-                SCCondSignal(&pool->return_stack.cond);
-                SCMutexUnlock(&pool->return_stack.mutex);
-                /* Clear the list of pending packets to return. */
-                my_pool->pending_pool = NULL;
-                my_pool->pending_head = NULL;
-                my_pool->pending_tail = NULL;
-                my_pool->pending_count = 0;
-            }
+        PktPoolMagazine *mag = PacketPoolGetMagazine(my_pool, pool);
+        if (mag->pool == NULL) {
+            p->next = NULL;
+            mag->pool = pool;
+            mag->head = p;
+            mag->tail = p;
+            mag->cnt = 1;
         } else {
-            /* Push onto return stack for this pool */
-            SCMutexLock(&pool->return_stack.mutex);
-            p->next = pool->return_stack.head;
-            pool->return_stack.head = p;
-            pool->return_stack.cnt++;
-            SCCondSignal(&pool->return_stack.cond);
-            SCMutexUnlock(&pool->return_stack.mutex);
+            p->next = mag->head;
+            mag->head = p;
+            mag->cnt++;
+        }
+        PacketPoolStatsAdd(my_pool, my_pool->counter_cross_returns, 1);
+
+        const uint32_t threshold = SC_ATOMIC_GET(pool->return_stack.return_threshold);
+        if (mag->cnt >= threshold) {
+            PacketPoolFlushMagazine(my_pool, mag);
         }
     }
 }
@@ -242,6 +306,8 @@ void PacketPoolInit(void)
     my_pool->destroyed = 0;
 #endif /* DEBUG_VALIDATION */
 
+    SC_ATOMIC_INITPTR(my_pool->return_stack.head);
+    SC_ATOMIC_INIT(my_pool->return_stack.waiting);
     SCMutexInit(&my_pool->return_stack.mutex, NULL);
     SCCondInit(&my_pool->return_stack.cond, NULL);
     SC_ATOMIC_INIT(my_pool->return_stack.return_threshold);
@@ -262,6 +328,22 @@ void PacketPoolInit(void)
     //        max_pending_packets, (uintmax_t)(max_pending_packets*SIZE_OF_PACKET));
 }
 
+/** \brief register the packet pool counters of a thread
+ *
+ *  Needs to be called by the thread itself after PacketPoolInit().
+ */
+void PacketPoolSetupCounters(ThreadVars *tv)
+{
+    PktPool *my_pool = GetThreadPacketPool();
+
+    my_pool->tv = tv;
+    my_pool->counter_cross_returns = StatsRegisterCounter("packet_pool.cross_thread_returns", tv);
+    my_pool->counter_magazine_flushes = StatsRegisterCounter("packet_pool.magazine_flushes", tv);
+    my_pool->counter_empty_waits = StatsRegisterCounter("packet_pool.empty_waits", tv);
+    my_pool->counter_empty_wait_usecs =
+            StatsRegisterCounter("packet_pool.empty_wait_usecs", tv);
+}
+
 void PacketPoolDestroy(void)
 {
     Packet *p = NULL;
@@ -271,25 +353,27 @@ void PacketPoolDestroy(void)
     BUG_ON(my_pool && my_pool->destroyed);
 #endif /* DEBUG_VALIDATION */
 
-    if (my_pool && my_pool->pending_pool != NULL) {
-        p = my_pool->pending_head;
+    for (int i = 0; i < PKT_POOL_MAGAZINES; i++) {
+        PktPoolMagazine *mag = &my_pool->magazines[i];
+        p = mag->head;
         while (p) {
             Packet *next_p = p->next;
             PacketFree(p);
             p = next_p;
-            my_pool->pending_count--;
+            mag->cnt--;
         }
 #ifdef DEBUG_VALIDATION
-        BUG_ON(my_pool->pending_count);
+        BUG_ON(mag->cnt);
 #endif /* DEBUG_VALIDATION */
-        my_pool->pending_pool = NULL;
-        my_pool->pending_head = NULL;
-        my_pool->pending_tail = NULL;
+        memset(mag, 0, sizeof(*mag));
     }
 
     while ((p = PacketPoolGetPacket()) != NULL) {
         PacketFree(p);
     }
+    my_pool->tv = NULL;
+    PacketAlertCacheFree();
+    PacketTunnelPoolFree();
 
 #ifdef DEBUG_VALIDATION
     my_pool->initialized = 0;
@@ -27,19 +27,38 @@
 #include "decode.h"
 #include "threads.h"
 
-    /* Return stack, onto which other threads free packets. */
+/* Return stack, onto which other threads free packets. Other threads push
+ * whole magazines onto it with a CAS, the owner takes everything at once,
+ * so no lock is needed. The mutex and cond are only used by the owner to
+ * sleep while its pool is empty. */
 typedef struct PktPoolLockedStack_{
     /* linked list of free packets. */
+    SC_ATOMIC_DECLARE(Packet *, head);
+    /** set by the owner while it sleeps on cond */
+    SC_ATOMIC_DECLARE(bool, waiting);
     SCMutex mutex;
     SCCondT cond;
     /** number of packets in needed to trigger a sync during
      *  the return to pool logic. Updated by pool owner based
      *  on how full the pool is. */
     SC_ATOMIC_DECLARE(uint32_t, return_threshold);
-    uint32_t cnt;
-    Packet *head;
 } __attribute__((aligned(CLS))) PktPoolLockedStack;
 
+/** Number of magazines a thread keeps for returning packets to the pools
+ *  of other threads. */
+#define PKT_POOL_MAGAZINES 8
+
+/** Packets waiting (pending) to be returned to the given Packet Pool.
+ *  Packets for the same pool are accumulated until the pool's return
+ *  threshold is reached, then the whole magazine is pushed at once. The
+ *  head and tail are kept for fast insertion onto a return stack. */
+typedef struct PktPoolMagazine_ {
+    struct PktPool_ *pool;
+    Packet *head;
+    Packet *tail;
+    uint32_t cnt;
+} PktPoolMagazine;
+
 typedef struct PktPool_ {
     /* link listed of free packets local to this thread.
      * No mutex is needed.
@@ -47,15 +66,17 @@ typedef struct PktPool_ {
     Packet *head;
     uint32_t cnt;
 
-    /* Packets waiting (pending) to be returned to the given Packet
-     * Pool. Accumulate packets for the same pool until a threshold is
-     * reached, then return them all at once.  Keep the head and tail
-     * to fast insertion of the entire list onto a return stack.
-     */
-    struct PktPool_ *pending_pool;
-    Packet *pending_head;
-    Packet *pending_tail;
-    uint32_t pending_count;
+    /* Magazines of packets to return to other threads' pools. With autofp
+     * and multiple capture threads, a worker returns packets to several
+     * pools, so it keeps one magazine per pool. */
+    PktPoolMagazine magazines[PKT_POOL_MAGAZINES];
+
+    /* stats, see PacketPoolSetupCounters() */
+    ThreadVars *tv;
+    uint16_t counter_cross_returns;
+    uint16_t counter_magazine_flushes;
+    uint16_t counter_empty_waits;
+    uint16_t counter_empty_wait_usecs;
 
 #ifdef DEBUG_VALIDATION
     int initialized;
@@ -80,6 +101,7 @@ Packet *PacketPoolGetPacket(void);
 void PacketPoolWait(void);
 void PacketPoolReturnPacket(Packet *p);
 void PacketPoolInit(void);
+void PacketPoolSetupCounters(ThreadVars *tv);
 void PacketPoolDestroy(void);
 void PacketPoolPostRunmodes(void);
 
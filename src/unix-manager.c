@@ -813,6 +813,19 @@ static TmEcode UnixManagerRulesetProfileStopCommand(json_t *cmd, json_t *server_
 }
 #endif
 
+static TmEcode UnixManagerRulesetSampleProfileCommand(json_t *cmd, json_t *server_msg, void *data)
+{
+    SCEnter();
+    json_t *js = DetectEngineRuleSamplingToJSON();
+    if (js == NULL) {
+        json_object_set_new(server_msg, "message",
+                json_string("rule sampling is not enabled: see detect.profiling.sampling"));
+        SCReturnInt(TM_ECODE_FAILED);
+    }
+    json_object_set_new(server_msg, "message", js);
+    SCReturnInt(TM_ECODE_OK);
+}
+
 static TmEcode UnixManagerShowFailedRules(json_t *cmd,
                                           json_t *server_msg, void *data)
 {
@@ -1096,6 +1109,8 @@ int UnixManagerInit(void)
     UnixManagerRegisterCommand(
             "ruleset-profile-stop", UnixManagerRulesetProfileStopCommand, NULL, 0);
 #endif
+    UnixManagerRegisterCommand(
+            "ruleset-sample-profile", UnixManagerRulesetSampleProfileCommand, NULL, 0);
     UnixManagerRegisterCommand("register-tenant-handler", UnixSocketRegisterTenantHandler, &command, UNIX_CMD_TAKE_ARGS);
     UnixManagerRegisterCommand("unregister-tenant-handler", UnixSocketUnregisterTenantHandler, &command, UNIX_CMD_TAKE_ARGS);
     UnixManagerRegisterCommand("register-tenant", UnixSocketRegisterTenant, &command, UNIX_CMD_TAKE_ARGS);
@@ -152,6 +152,11 @@
 #define SC_ATOMIC_LOAD_EXPLICIT(name, order) \
     atomic_load_explicit(&(name ## _sc_atomic__), (order))
 
+/**
+ *  \brief Memory fence with the given memory order.
+ */
+#define SC_ATOMIC_THREAD_FENCE(order) atomic_thread_fence((order))
+
 /**
  *  \brief Set the value for the atomic variable.
  *
@@ -160,6 +165,9 @@
 #define SC_ATOMIC_SET(name, val)    \
     atomic_store(&(name ## _sc_atomic__), (val))
 
+#define SC_ATOMIC_STORE_EXPLICIT(name, val, order) \
+    atomic_store_explicit(&(name ## _sc_atomic__), (val), (order))
+
 #else
 
 #define SC_ATOMIC_MEMORY_ORDER_RELAXED
@@ -378,6 +386,11 @@
 #define SC_ATOMIC_LOAD_EXPLICIT(name, order) \
     (name ## _sc_atomic__)
 
+/**
+ *  \brief Memory fence, always a full one.
+ */
+#define SC_ATOMIC_THREAD_FENCE(order) __sync_synchronize()
+
 /**
  *  \brief Set the value for the atomic variable.
  *
@@ -388,6 +401,12 @@
         ;                                                       \
         })
 
+/** \brief store with a full fence before it, which covers any order */
+#define SC_ATOMIC_STORE_EXPLICIT(name, val, order) ({ \
+    __sync_synchronize();                            \
+    (name ## _sc_atomic__) = (val);                  \
+})
+
 #endif /* no c11 atomics */
 
 void SCAtomicRegisterTests(void);
@@ -0,0 +1,334 @@
+/* Copyright (C) 2025 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Per thread cpu tick counters for the pipeline stages
+ *
+ * If stats.cpu-ticks.enabled is set, each packet thread keeps track of the
+ * stage it is currently working on: decode, flow handling, stream, the
+ * parser of an app-layer protocol, detect, output or one of the loggers.
+ * Every switch between stages reads the cpu tick counter and adds the
+ * ticks since the previous switch to the counter of the stage that was
+ * left. Nested stages, like the app-layer parsers called from the stream
+ * engine, are not counted again in the outer stage. The counters are
+ * regular stats counters, so they show up in stats.log and the eve stats
+ * records.
+ *
+ * The same stage tracking is used for the per flow cost accounting (see
+ * util-flow-cost.c): while a flow is set, the stream, app-layer and detect
+ * ticks are also added to the flow.
+ */
+
+#include "suricata-common.h"
+#include "app-layer-detect-proto.h"
+#include "conf.h"
+#include "counters.h"
+#include "threadvars.h"
+#include "util-cpu.h"
+#include "util-cpu-ticks.h"
+#include "util-debug.h"
+#include "util-flow-cost.h"
+#include "util-unittest.h"
+
+bool g_cpu_ticks_enabled = false;
+/** register the stats counters, otherwise only flow cost is tracked */
+static bool cpu_ticks_counters = false;
+
+/** app-layer protocols beyond this are not accounted */
+#define CPU_TICKS_ALPROTO_MAX 256
+#define CPU_TICKS_STAGE_MAX   CPU_TICKS_STAGE_APPLAYER(CPU_TICKS_ALPROTO_MAX)
+
+#define CPU_TICKS_NAME_MAX 64
+
+static const char *cpu_ticks_stage_names[CPU_TICKS_LOGGER_BASE] = {
+    NULL,
+    "cpu_ticks.decode",
+    "cpu_ticks.flow",
+    "cpu_ticks.stream",
+    "cpu_ticks.detect",
+    "cpu_ticks.output.core",
+};
+
+/** \note keep in sync with LoggerId */
+static const char *cpu_ticks_logger_names[LOGGER_SIZE] = {
+    [LOGGER_UNDEFINED] = NULL,
+    [LOGGER_HTTP] = "cpu_ticks.output.http",
+    [LOGGER_TLS_STORE] = "cpu_ticks.output.tls_store",
+    [LOGGER_TLS_STORE_CLIENT] = "cpu_ticks.output.tls_store_client",
+    [LOGGER_TLS] = "cpu_ticks.output.tls",
+    [LOGGER_JSON_TX] = "cpu_ticks.output.json_tx",
+    [LOGGER_FILE] = "cpu_ticks.output.file",
+    [LOGGER_FILEDATA] = "cpu_ticks.output.filedata",
+    [LOGGER_ALERT_DEBUG] = "cpu_ticks.output.alert_debug",
+    [LOGGER_ALERT_FAST] = "cpu_ticks.output.alert_fast",
+    [LOGGER_ALERT_SYSLOG] = "cpu_ticks.output.alert_syslog",
+    [LOGGER_JSON_ALERT] = "cpu_ticks.output.json_alert",
+    [LOGGER_JSON_ANOMALY] = "cpu_ticks.output.json_anomaly",
+    [LOGGER_JSON_DROP] = "cpu_ticks.output.json_drop",
+    [LOGGER_FILE_STORE] = "cpu_ticks.output.file_store",
+    [LOGGER_JSON_FILE] = "cpu_ticks.output.json_file",
+    [LOGGER_TCP_DATA] = "cpu_ticks.output.tcp_data",
+    [LOGGER_JSON_FLOW] = "cpu_ticks.output.json_flow",
+    [LOGGER_JSON_NETFLOW] = "cpu_ticks.output.json_netflow",
+    [LOGGER_STATS] = "cpu_ticks.output.stats",
+    [LOGGER_JSON_STATS] = "cpu_ticks.output.json_stats",
+    [LOGGER_PCAP] = "cpu_ticks.output.pcap",
+    [LOGGER_JSON_METADATA] = "cpu_ticks.output.json_metadata",
+    [LOGGER_JSON_FRAME] = "cpu_ticks.output.json_frame",
+    [LOGGER_JSON_STREAM] = "cpu_ticks.output.json_stream",
+    [LOGGER_JSON_ARP] = "cpu_ticks.output.json_arp",
+    [LOGGER_USER] = "cpu_ticks.output.user",
+};
+
+/** "cpu_ticks.app_layer.<proto>", built at start up, indexed by AppProto */
+static char (*cpu_ticks_alproto_names)[CPU_TICKS_NAME_MAX] = NULL;
+static AppProto cpu_ticks_alproto_cnt = 0;
+
+typedef struct CpuTicksThreadCtx_ {
+    ThreadVars *tv;   /**< NULL if the thread doesn't account ticks */
+    uint64_t start;   /**< tick counter at the last switch */
+    int stage;        /**< stage being charged */
+    FlowCost *flow_cost; /**< flow being charged, if any */
+    uint16_t ids[CPU_TICKS_STAGE_MAX];
+} CpuTicksThreadCtx;
+
+static thread_local CpuTicksThreadCtx t_cpu_ticks;
+
+void CpuTicksGlobalInit(void)
+{
+    int enabled = 0;
+    if (SCConfGetBool("stats.cpu-ticks.enabled", &enabled) != 1 || !enabled) {
+        g_cpu_ticks_enabled = FlowCostStorageEnabled();
+        return;
+    }
+
+    cpu_ticks_alproto_cnt = MIN(g_alproto_max, CPU_TICKS_ALPROTO_MAX);
+    cpu_ticks_alproto_names = SCCalloc(cpu_ticks_alproto_cnt, sizeof(*cpu_ticks_alproto_names));
+    if (unlikely(cpu_ticks_alproto_names == NULL)) {
+        FatalError("Unable to alloc cpu ticks counter names.");
+    }
+
+    AppProto alprotos[g_alproto_max];
+    AppLayerProtoDetectSupportedAppProtocols(alprotos);
+    for (AppProto a = 0; a < cpu_ticks_alproto_cnt; a++) {
+        if (alprotos[a] == 1) {
+            snprintf(cpu_ticks_alproto_names[a], sizeof(cpu_ticks_alproto_names[a]),
+                    "cpu_ticks.app_layer.%s", AppLayerProtoDetectGetProtoName(a));
+        }
+    }
+
+    cpu_ticks_counters = true;
+    g_cpu_ticks_enabled = true;
+    SCLogConfig("per stage cpu tick counters enabled");
+}
+
+void CpuTicksGlobalDeinit(void)
+{
+    SCFree(cpu_ticks_alproto_names);
+    cpu_ticks_alproto_names = NULL;
+    cpu_ticks_alproto_cnt = 0;
+    cpu_ticks_counters = false;
+    g_cpu_ticks_enabled = false;
+}
+
+/** \brief register the counters for a packet processing thread */
+void CpuTicksSetup(ThreadVars *tv)
+{
+    if (!g_cpu_ticks_enabled)
+        return;
+
+    CpuTicksThreadCtx *c = &t_cpu_ticks;
+    if (cpu_ticks_counters) {
+        for (int s = CPU_TICKS_DECODE; s < CPU_TICKS_LOGGER_BASE; s++) {
+            c->ids[s] = StatsRegisterCounter(cpu_ticks_stage_names[s], tv);
+        }
+        for (int l = LOGGER_UNDEFINED + 1; l < LOGGER_SIZE; l++) {
+            c->ids[CPU_TICKS_STAGE_LOGGER(l)] =
+                    StatsRegisterCounter(cpu_ticks_logger_names[l], tv);
+        }
+        for (AppProto a = 0; a < cpu_ticks_alproto_cnt; a++) {
+            if (cpu_ticks_alproto_names[a][0] != '\0') {
+                c->ids[CPU_TICKS_STAGE_APPLAYER(a)] =
+                        StatsRegisterCounter(cpu_ticks_alproto_names[a], tv);
+            }
+        }
+    }
+    c->stage = CPU_TICKS_NONE;
+    c->flow_cost = NULL;
+    c->tv = tv;
+}
+
+/** \internal
+ *  \brief map a stage to the flow cost it adds to
+ *  \retval type FlowCostType or -1 if the stage is not part of the flow cost */
+static inline int CpuTicksFlowCostType(const int stage)
+{
+    switch (stage) {
+        case CPU_TICKS_STREAM:
+            return FLOW_COST_STREAM;
+        case CPU_TICKS_DETECT:
+            return FLOW_COST_DETECT;
+        default:
+            if (stage >= CPU_TICKS_STAGE_APPLAYER(0))
+                return FLOW_COST_APP_LAYER;
+            return -1;
+    }
+}
+
+/** \internal
+ *  \brief charge the ticks since the last switch to the current stage */
+static inline void CpuTicksCharge(CpuTicksThreadCtx *c, const uint64_t now)
+{
+    const int stage = c->stage;
+    if (stage == CPU_TICKS_NONE || now <= c->start)
+        return;
+
+    const uint64_t ticks = now - c->start;
+    if (c->ids[stage] != 0) {
+        StatsAddUI64(c->tv, c->ids[stage], ticks);
+    }
+    if (c->flow_cost != NULL) {
+        const int type = CpuTicksFlowCostType(stage);
+        if (type >= 0)
+            c->flow_cost->ticks[type] += ticks;
+    }
+}
+
+/** \brief charge the ticks since the last switch to the current stage
+ *         and make stage the current one
+ *  \retval prev the stage that was current */
+int CpuTicksSwitch(int stage)
+{
+    CpuTicksThreadCtx *c = &t_cpu_ticks;
+    if (c->tv == NULL)
+        return CPU_TICKS_NONE;
+
+    const uint64_t now = UtilCpuGetTicksFast();
+    const int prev = c->stage;
+    CpuTicksCharge(c, now);
+    c->stage = (stage >= 0 && stage < CPU_TICKS_STAGE_MAX) ? stage : CPU_TICKS_NONE;
+    c->start = now;
+    return prev;
+}
+
+/** \brief set the flow cost the ticks are added to, NULL for none
+ *  \retval prev the flow cost that was set */
+FlowCost *CpuTicksSetFlowCost(FlowCost *fc)
+{
+    CpuTicksThreadCtx *c = &t_cpu_ticks;
+    if (c->tv == NULL)
+        return NULL;
+
+    /* the ticks so far belong to the flow that was set */
+    const uint64_t now = UtilCpuGetTicksFast();
+    CpuTicksCharge(c, now);
+    c->start = now;
+
+    FlowCost *prev = c->flow_cost;
+    c->flow_cost = fc;
+    return prev;
+}
+
+#ifdef UNITTESTS
+/** \test nested stages are restored and charged to the right stage */
+static int CpuTicksTest01(void)
+{
+    ThreadVars tv;
+    memset(&tv, 0, sizeof(tv));
+
+    CpuTicksThreadCtx *c = &t_cpu_ticks;
+    memset(c, 0, sizeof(*c));
+
+    /* thread without counters: nothing is tracked */
+    FAIL_IF_NOT(CpuTicksSwitch(CPU_TICKS_STREAM) == CPU_TICKS_NONE);
+    FAIL_IF_NOT(c->stage == CPU_TICKS_NONE);
+
+    c->tv = &tv;
+    int prev = CpuTicksSwitch(CPU_TICKS_FLOW);
+    FAIL_IF_NOT(prev == CPU_TICKS_NONE);
+    int prev2 = CpuTicksSwitch(CPU_TICKS_STREAM);
+    FAIL_IF_NOT(prev2 == CPU_TICKS_FLOW);
+    int prev3 = CpuTicksSwitch(CPU_TICKS_STAGE_APPLAYER(ALPROTO_HTTP1));
+    FAIL_IF_NOT(prev3 == CPU_TICKS_STREAM);
+    FAIL_IF_NOT(c->stage == CPU_TICKS_STAGE_APPLAYER(ALPROTO_HTTP1));
+    FAIL_IF_NOT(CpuTicksSwitch(prev3) == CPU_TICKS_STAGE_APPLAYER(ALPROTO_HTTP1));
+    FAIL_IF_NOT(CpuTicksSwitch(prev2) == CPU_TICKS_STREAM);
+    FAIL_IF_NOT(CpuTicksSwitch(prev) == CPU_TICKS_FLOW);
+    FAIL_IF_NOT(c->stage == CPU_TICKS_NONE);
+
+    /* out of range stages are not accounted */
+    CpuTicksSwitch(CPU_TICKS_STAGE_MAX);
+    FAIL_IF_NOT(c->stage == CPU_TICKS_NONE);
+
+    memset(c, 0, sizeof(*c));
+    PASS;
+}
+
+static void CpuTicksTestWait(void)
+{
+    const uint64_t start = UtilCpuGetTicksFast();
+    while (UtilCpuGetTicksFast() == start)
+        ;
+}
+
+/** \test flow cost only gets the stream, app-layer and detect ticks */
+static int CpuTicksTest02(void)
+{
+    ThreadVars tv;
+    memset(&tv, 0, sizeof(tv));
+    FlowCost fc;
+    memset(&fc, 0, sizeof(fc));
+
+    CpuTicksThreadCtx *c = &t_cpu_ticks;
+    memset(c, 0, sizeof(*c));
+    c->tv = &tv;
+
+    CpuTicksSwitch(CPU_TICKS_FLOW);
+    FAIL_IF_NOT(CpuTicksSetFlowCost(&fc) == NULL);
+    CpuTicksTestWait();
+    CpuTicksSwitch(CPU_TICKS_STREAM);
+    FAIL_IF_NOT(fc.ticks[FLOW_COST_STREAM] == 0);
+    CpuTicksTestWait();
+    CpuTicksSwitch(CPU_TICKS_STAGE_APPLAYER(ALPROTO_DNS));
+    FAIL_IF_NOT(fc.ticks[FLOW_COST_STREAM] > 0);
+    CpuTicksTestWait();
+    CpuTicksSwitch(CPU_TICKS_DETECT);
+    FAIL_IF_NOT(fc.ticks[FLOW_COST_APP_LAYER] > 0);
+    CpuTicksTestWait();
+    FAIL_IF_NOT(CpuTicksSetFlowCost(NULL) == &fc);
+    FAIL_IF_NOT(fc.ticks[FLOW_COST_DETECT] > 0);
+
+    /* no longer charged once the flow is unset */
+    const uint64_t detect = fc.ticks[FLOW_COST_DETECT];
+    CpuTicksTestWait();
+    CpuTicksSwitch(CPU_TICKS_NONE);
+    FAIL_IF_NOT(fc.ticks[FLOW_COST_DETECT] == detect);
+
+    memset(c, 0, sizeof(*c));
+    PASS;
+}
+#endif /* UNITTESTS */
+
+void CpuTicksRegisterTests(void)
+{
+#ifdef UNITTESTS
+    UtRegisterTest("CpuTicksTest01", CpuTicksTest01);
+    UtRegisterTest("CpuTicksTest02", CpuTicksTest02);
+#endif /* UNITTESTS */
+}
@@ -0,0 +1,71 @@
+/* Copyright (C) 2025 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Per thread cpu tick counters for the pipeline stages
+ */
+
+#ifndef SURICATA_UTIL_CPU_TICKS_H
+#define SURICATA_UTIL_CPU_TICKS_H
+
+#include "app-layer-protos.h"
+#include "threadvars.h"
+
+/** fixed stages, followed by one stage per LoggerId and one per AppProto */
+enum CpuTicksStage {
+    CPU_TICKS_NONE = 0, /**< not accounted */
+    CPU_TICKS_DECODE,
+    CPU_TICKS_FLOW,
+    CPU_TICKS_STREAM,
+    CPU_TICKS_DETECT,
+    CPU_TICKS_OUTPUT, /**< output work outside of the loggers */
+    CPU_TICKS_LOGGER_BASE,
+};
+
+#define CPU_TICKS_STAGE_LOGGER(id)       (CPU_TICKS_LOGGER_BASE + (int)(id))
+#define CPU_TICKS_STAGE_APPLAYER(alproto) (CPU_TICKS_LOGGER_BASE + LOGGER_SIZE + (int)(alproto))
+
+struct FlowCost_;
+
+extern bool g_cpu_ticks_enabled;
+
+void CpuTicksGlobalInit(void);
+void CpuTicksGlobalDeinit(void);
+void CpuTicksSetup(ThreadVars *tv);
+int CpuTicksSwitch(int stage);
+struct FlowCost_ *CpuTicksSetFlowCost(struct FlowCost_ *fc);
+void CpuTicksRegisterTests(void);
+
+/** \brief start charging ticks to a stage
+ *  \retval prev the stage to return to with CpuTicksLeave() */
+static inline int CpuTicksEnter(const int stage)
+{
+    if (likely(!g_cpu_ticks_enabled))
+        return CPU_TICKS_NONE;
+    return CpuTicksSwitch(stage);
+}
+
+/** \brief stop charging the current stage, continue with prev */
+static inline void CpuTicksLeave(const int prev)
+{
+    if (unlikely(g_cpu_ticks_enabled))
+        CpuTicksSwitch(prev);
+}
+
+#endif /* SURICATA_UTIL_CPU_TICKS_H */
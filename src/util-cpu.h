@@ -33,4 +33,29 @@ void UtilCpuPrintSummary(void);
 
 uint64_t UtilCpuGetTicks(void);
 
+/**
+ * Get the current number of ticks without serializing the CPU.
+ *
+ * Unlike UtilCpuGetTicks() there is no cpuid barrier around the read, so
+ * the result may be off by a few instructions. The cost is low enough
+ * for always-on instrumentation. On platforms without a usable cycle
+ * counter the value is in microseconds.
+ */
+static inline uint64_t UtilCpuGetTicksFast(void)
+{
+#if defined(__GNUC__) && (defined(__x86_64) || defined(_X86_64_) || defined(ia_64) || defined(__i386__))
+    uint32_t a, d;
+    __asm__ __volatile__("rdtsc" : "=a"(a), "=d"(d));
+    return ((uint64_t)a) | (((uint64_t)d) << 32);
+#elif defined(__GNUC__) && defined(__aarch64__)
+    uint64_t val;
+    __asm__ __volatile__("mrs %0, cntvct_el0" : "=r"(val));
+    return val;
+#else
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return ((uint64_t)now.tv_sec * 1000000) + now.tv_usec;
+#endif
+}
+
 #endif /* SURICATA_UTIL_CPU_H */
@@ -0,0 +1,467 @@
+/* Copyright (C) 2025 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ *  \defgroup dpdk DPDK flow bypass helpers functions
+ *
+ *  @{
+ */
+
+/**
+ * \file
+ *
+ * DPDK flow bypass offload
+ *
+ * A bypassed flow is offloaded to the NIC as two rte_flow rules, one per
+ * direction, matching the 5-tuple (and VLAN tags) of the flow. In IDS mode
+ * the rules drop the packets in the NIC. In TAP/IPS mode the packets still
+ * have to be forwarded, so the rules only mark them and Suricata sends the
+ * marked packets to the copy interface without inspecting them.
+ *
+ * Both rules carry a COUNT action. The flow manager queries the counters
+ * through FlowBypassedTimeout() to keep the flow alive while packets are
+ * seen and removes the rules once the flow goes idle.
+ *
+ * The rules of a port are created by its workers and queried or destroyed by
+ * the flow manager, so all of these run under bypass_lock. The port flush on
+ * shutdown takes the same lock and invalidates the handles of the rules left.
+ */
+
+#include "suricata-common.h"
+#include "util-dpdk-bypass.h"
+#include "util-debug.h"
+
+#if defined(HAVE_DPDK) && defined(CAPTURE_OFFLOAD)
+
+#include "flow-storage.h"
+#include "flow-util.h"
+#include "util-device-private.h"
+
+/* ETH, up to 2 VLANs, IP, L4 and END */
+#define DPDK_BYPASS_PATTERN_MAX 6
+/* MARK, COUNT, fate action and END */
+#define DPDK_BYPASS_ACTION_MAX 4
+
+/** serializes the rule operations of the workers and the flow manager with
+ *  the port flush */
+static SCMutex bypass_lock = SCMUTEX_INITIALIZER;
+/** ports whose rules have been flushed, the rule handles are no longer valid */
+static bool bypass_port_flushed[RTE_MAX_ETHPORTS];
+
+typedef struct DPDKBypassData_ {
+    uint16_t port_id;
+    /** rules of the to server [0] and to client [1] direction */
+    struct rte_flow *flow[2];
+} DPDKBypassData;
+
+typedef struct DPDKBypassActionConf_ {
+    struct rte_flow_action_mark mark;
+    struct rte_flow_action_queue queue;
+    struct rte_flow_action_count count;
+} DPDKBypassActionConf;
+
+static void BypassActionsInit(struct rte_flow_action *actions, DPDKBypassActionConf *conf,
+        bool mark, uint16_t queue_id)
+{
+    int i = 0;
+    memset(conf, 0, sizeof(*conf));
+    if (mark) {
+        conf->mark.id = DPDK_BYPASS_MARK;
+        actions[i].type = RTE_FLOW_ACTION_TYPE_MARK;
+        actions[i++].conf = &conf->mark;
+    }
+    actions[i].type = RTE_FLOW_ACTION_TYPE_COUNT;
+    actions[i++].conf = &conf->count;
+    if (mark) {
+        /* keep the packets on the queue they arrive on, the RSS is symmetric */
+        conf->queue.index = queue_id;
+        actions[i].type = RTE_FLOW_ACTION_TYPE_QUEUE;
+        actions[i++].conf = &conf->queue;
+    } else {
+        actions[i++].type = RTE_FLOW_ACTION_TYPE_DROP;
+    }
+    actions[i].type = RTE_FLOW_ACTION_TYPE_END;
+}
+
+/**
+ * \brief Check that the port accepts the bypass rules
+ *
+ * Many PMDs (e.g. net_pcap, net_null or virtio) do not implement rte_flow at
+ * all. Suricata then falls back to bypass the flows locally.
+ *
+ * \param mark true to probe for mark rules, false for drop rules
+ * \return 0 if the rules are supported, negative errno otherwise
+ */
+int DPDKBypassProbe(uint16_t port_id, const char *port_name, bool mark)
+{
+    struct rte_flow_attr attr = { .ingress = 1 };
+    struct rte_flow_item_ipv4 ipv4_mask = { 0 };
+    struct rte_flow_item_udp udp_mask = { 0 };
+    struct rte_flow_item pattern[DPDK_BYPASS_PATTERN_MAX] = { { 0 } };
+    struct rte_flow_action actions[DPDK_BYPASS_ACTION_MAX] = { { 0 } };
+    struct rte_flow_error flow_error = { 0 };
+    DPDKBypassActionConf conf;
+
+    ipv4_mask.hdr.src_addr = UINT32_MAX;
+    ipv4_mask.hdr.dst_addr = UINT32_MAX;
+    ipv4_mask.hdr.next_proto_id = UINT8_MAX;
+    udp_mask.hdr.src_port = UINT16_MAX;
+    udp_mask.hdr.dst_port = UINT16_MAX;
+
+    pattern[0].type = RTE_FLOW_ITEM_TYPE_ETH;
+    pattern[1].type = RTE_FLOW_ITEM_TYPE_IPV4;
+    pattern[1].spec = &ipv4_mask;
+    pattern[1].mask = &ipv4_mask;
+    pattern[2].type = RTE_FLOW_ITEM_TYPE_UDP;
+    pattern[2].spec = &udp_mask;
+    pattern[2].mask = &udp_mask;
+    pattern[3].type = RTE_FLOW_ITEM_TYPE_END;
+    BypassActionsInit(actions, &conf, mark, 0);
+
+    int retval = rte_flow_validate(port_id, &attr, pattern, actions, &flow_error);
+    if (retval != 0) {
+        SCLogDebug("%s: bypass rule validation failed: %s, errmsg: %s", port_name,
+                rte_strerror(-retval), flow_error.message ? flow_error.message : "none");
+    }
+    return retval;
+}
+
+/**
+ * \brief Create the rule matching one direction of the packet's flow
+ *
+ * \param reverse true to match the packets going in the opposite direction of p
+ */
+static struct rte_flow *BypassRuleCreate(const Packet *p, bool reverse)
+{
+    struct rte_flow_attr attr = { .ingress = 1 };
+    struct rte_flow_item pattern[DPDK_BYPASS_PATTERN_MAX] = { { 0 } };
+    struct rte_flow_action actions[DPDK_BYPASS_ACTION_MAX] = { { 0 } };
+    struct rte_flow_error flow_error = { 0 };
+    struct rte_flow_item_vlan vlan_spec[2] = { { 0 } };
+    struct rte_flow_item_vlan vlan_mask = { 0 };
+    struct rte_flow_item_ipv4 ipv4_spec = { 0 }, ipv4_mask = { 0 };
+    struct rte_flow_item_ipv6 ipv6_spec = { 0 }, ipv6_mask = { 0 };
+    struct rte_flow_item_tcp tcp_spec = { 0 }, tcp_mask = { 0 };
+    struct rte_flow_item_udp udp_spec = { 0 }, udp_mask = { 0 };
+    DPDKBypassActionConf conf;
+    const Address *src = reverse ? &p->dst : &p->src;
+    const Address *dst = reverse ? &p->src : &p->dst;
+    const uint16_t sp = reverse ? p->dp : p->sp;
+    const uint16_t dp = reverse ? p->sp : p->dp;
+    int i = 0;
+
+    pattern[i++].type = RTE_FLOW_ITEM_TYPE_ETH;
+    vlan_mask.tci = rte_cpu_to_be_16(0x0fff);
+    for (uint8_t v = 0; v < p->vlan_idx; v++) {
+        vlan_spec[v].tci = rte_cpu_to_be_16(p->vlan_id[v]);
+        pattern[i].type = RTE_FLOW_ITEM_TYPE_VLAN;
+        pattern[i].spec = &vlan_spec[v];
+        pattern[i++].mask = &vlan_mask;
+    }
+
+    if (PacketIsIPv4(p)) {
+        ipv4_spec.hdr.src_addr = src->addr_data32[0];
+        ipv4_spec.hdr.dst_addr = dst->addr_data32[0];
+        ipv4_spec.hdr.next_proto_id = p->proto;
+        ipv4_mask.hdr.src_addr = UINT32_MAX;
+        ipv4_mask.hdr.dst_addr = UINT32_MAX;
+        ipv4_mask.hdr.next_proto_id = UINT8_MAX;
+        pattern[i].type = RTE_FLOW_ITEM_TYPE_IPV4;
+        pattern[i].spec = &ipv4_spec;
+        pattern[i++].mask = &ipv4_mask;
+    } else {
+        memcpy(&ipv6_spec.hdr.src_addr, src->addr_data32, sizeof(ipv6_spec.hdr.src_addr));
+        memcpy(&ipv6_spec.hdr.dst_addr, dst->addr_data32, sizeof(ipv6_spec.hdr.dst_addr));
+        ipv6_spec.hdr.proto = p->proto;
+        memset(&ipv6_mask.hdr.src_addr, 0xff, sizeof(ipv6_mask.hdr.src_addr));
+        memset(&ipv6_mask.hdr.dst_addr, 0xff, sizeof(ipv6_mask.hdr.dst_addr));
+        ipv6_mask.hdr.proto = UINT8_MAX;
+        pattern[i].type = RTE_FLOW_ITEM_TYPE_IPV6;
+        pattern[i].spec = &ipv6_spec;
+        pattern[i++].mask = &ipv6_mask;
+    }
+
+    if (p->proto == IPPROTO_TCP) {
+        tcp_spec.hdr.src_port = rte_cpu_to_be_16(sp);
+        tcp_spec.hdr.dst_port = rte_cpu_to_be_16(dp);
+        tcp_mask.hdr.src_port = UINT16_MAX;
+        tcp_mask.hdr.dst_port = UINT16_MAX;
+        pattern[i].type = RTE_FLOW_ITEM_TYPE_TCP;
+        pattern[i].spec = &tcp_spec;
+        pattern[i++].mask = &tcp_mask;
+    } else {
+        udp_spec.hdr.src_port = rte_cpu_to_be_16(sp);
+        udp_spec.hdr.dst_port = rte_cpu_to_be_16(dp);
+        udp_mask.hdr.src_port = UINT16_MAX;
+        udp_mask.hdr.dst_port = UINT16_MAX;
+        pattern[i].type = RTE_FLOW_ITEM_TYPE_UDP;
+        pattern[i].spec = &udp_spec;
+        pattern[i++].mask = &udp_mask;
+    }
+    pattern[i].type = RTE_FLOW_ITEM_TYPE_END;
+
+    BypassActionsInit(actions, &conf, p->dpdk_v.copy_mode != DPDK_COPY_MODE_NONE,
+            p->dpdk_v.out_queue_id);
+
+    struct rte_flow *flow =
+            rte_flow_create(p->dpdk_v.port_id, &attr, pattern, actions, &flow_error);
+    if (flow == NULL) {
+        SCLogDebug("%s: bypass rule creation error: %s", p->livedev->dev,
+                flow_error.message ? flow_error.message : "none");
+    }
+    return flow;
+}
+
+/** \brief Destroy the rules of a flow, bypass_lock must be held */
+static void BypassRulesDestroy(DPDKBypassData *db)
+{
+    struct rte_flow_error flow_error = { 0 };
+    for (int i = 0; i < 2; i++) {
+        if (db->flow[i] == NULL)
+            continue;
+        int retval = rte_flow_destroy(db->port_id, db->flow[i], &flow_error);
+        if (retval != 0) {
+            SCLogDebug("port %u: unable to destroy bypass rule: %s", db->port_id,
+                    rte_strerror(-retval));
+        }
+        db->flow[i] = NULL;
+    }
+}
+
+/**
+ * \brief Read the counter of one direction and update the flow counters
+ *
+ * \return true if the rule has seen packets since the last query
+ */
+static bool BypassCheckHalfFlow(FlowBypassInfo *fc, DPDKBypassData *db, int index)
+{
+    struct rte_flow_action count_action[] = { { 0 }, { 0 } };
+    struct rte_flow_action_count count_conf = { 0 };
+    struct rte_flow_query_count query = { 0 };
+    struct rte_flow_error flow_error = { 0 };
+
+    count_action[0].type = RTE_FLOW_ACTION_TYPE_COUNT;
+    count_action[0].conf = &count_conf;
+    count_action[1].type = RTE_FLOW_ACTION_TYPE_END;
+
+    int retval = rte_flow_query(db->port_id, db->flow[index], count_action, &query, &flow_error);
+    if (retval != 0 || !query.hits_set) {
+        SCLogDebug("port %u: unable to query bypass rule: %s", db->port_id,
+                rte_strerror(-retval));
+        return false;
+    }
+
+    if (index == 0) {
+        if (query.hits != fc->todstpktcnt) {
+            fc->todstpktcnt = query.hits;
+            if (query.bytes_set)
+                fc->todstbytecnt = query.bytes;
+            return true;
+        }
+    } else {
+        if (query.hits != fc->tosrcpktcnt) {
+            fc->tosrcpktcnt = query.hits;
+            if (query.bytes_set)
+                fc->tosrcbytecnt = query.bytes;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * \brief Check both rules of a bypassed flow for activity
+ *
+ * Called by the flow manager from FlowBypassedTimeout(). The rules are
+ * removed from the NIC once the flow has not seen packets since the previous
+ * check so the flow can time out.
+ *
+ * \return true if the flow is still active, false otherwise
+ */
+static bool DPDKBypassUpdate(Flow *f, void *data, time_t tsec)
+{
+    DPDKBypassData *db = (DPDKBypassData *)data;
+    if (db == NULL) {
+        return false;
+    }
+    FlowBypassInfo *fc = FlowGetStorageById(f, GetFlowBypassInfoID());
+    if (fc == NULL) {
+        return false;
+    }
+
+    SCMutexLock(&bypass_lock);
+    if (db->flow[0] == NULL || bypass_port_flushed[db->port_id]) {
+        db->flow[0] = db->flow[1] = NULL;
+        SCMutexUnlock(&bypass_lock);
+        return false;
+    }
+    bool activity = BypassCheckHalfFlow(fc, db, 0);
+    activity |= BypassCheckHalfFlow(fc, db, 1);
+    if (!activity) {
+        SCLogDebug("Delete bypass rules of flow %" PRIu64, FlowGetId(f));
+        BypassRulesDestroy(db);
+    }
+    SCMutexUnlock(&bypass_lock);
+
+    if (!activity) {
+        return false;
+    }
+    f->lastts = SCTIME_FROM_SECS(tsec);
+    return true;
+}
+
+/**
+ * \brief Free the bypass data of a flow
+ *
+ * A flow can be evicted while its rules are still installed, e.g. on
+ * emergency mode or memcap pressure, so the rules are destroyed here unless
+ * the port has already been flushed.
+ */
+static void DPDKBypassFree(void *data)
+{
+    DPDKBypassData *db = (DPDKBypassData *)data;
+    SCMutexLock(&bypass_lock);
+    if (!bypass_port_flushed[db->port_id]) {
+        BypassRulesDestroy(db);
+    }
+    SCMutexUnlock(&bypass_lock);
+    SCFree(db);
+}
+
+/**
+ * \brief Flush all rte_flow rules of a port
+ *
+ * The port is flushed only once, by the first caller, and no bypass rules
+ * are created on it afterwards. The handles of the rules still referenced
+ * by flows are invalidated so they are not destroyed a second time.
+ *
+ * \return 0 on success or if already flushed, negative errno otherwise
+ */
+int DPDKBypassPortFlush(uint16_t port_id, const char *port_name)
+{
+    int retval = 0;
+    SCMutexLock(&bypass_lock);
+    if (!bypass_port_flushed[port_id]) {
+        struct rte_flow_error flush_error = { 0 };
+        retval = rte_flow_flush(port_id, &flush_error);
+        if (retval != 0) {
+            SCLogError("%s: unable to flush rte_flow rules: %s Flush error msg: %s", port_name,
+                    rte_strerror(-retval), flush_error.message);
+        }
+        bypass_port_flushed[port_id] = true;
+    }
+    SCMutexUnlock(&bypass_lock);
+    return retval;
+}
+
+/**
+ * \brief Bypass callback for DPDK capture
+ *
+ * Offloads the flow of the packet to the NIC with one rte_flow rule per
+ * direction. Only TCP and UDP flows that are not tunneled are supported.
+ *
+ * \param p the packet belonging to the flow to bypass
+ * \return 0 if unable to bypass, 1 if success
+ */
+int DPDKBypassCallback(Packet *p)
+{
+    /* If we don't have a flow attached to the packet the rules could never
+     * be removed, as the flow manager would not know about them */
+    if (p->flow == NULL) {
+        return 0;
+    }
+    if (!(PacketIsTCP(p) || PacketIsUDP(p)) || PacketIsTunnel(p)) {
+        return 0;
+    }
+    /* the NICs match at most two VLAN layers */
+    if (p->vlan_idx > 2) {
+        return 0;
+    }
+    const int family = PacketIsIPv4(p) ? AF_INET : AF_INET6;
+
+    FlowBypassInfo *fc = FlowGetStorageById(p->flow, GetFlowBypassInfoID());
+    if (fc == NULL) {
+        LiveDevAddBypassFail(p->livedev, 1, family);
+        return 0;
+    }
+    if (fc->bypass_data != NULL) {
+        // bypass already activated
+        return 1;
+    }
+
+    DPDKBypassData *db = SCCalloc(1, sizeof(DPDKBypassData));
+    if (db == NULL) {
+        LiveDevAddBypassFail(p->livedev, 1, family);
+        return 0;
+    }
+    db->port_id = p->dpdk_v.port_id;
+
+    SCMutexLock(&bypass_lock);
+    if (!bypass_port_flushed[db->port_id]) {
+        /* rule 0 matches the to server direction of the flow */
+        const bool toclient = !PKT_IS_TOSERVER(p);
+        db->flow[0] = BypassRuleCreate(p, toclient);
+        if (db->flow[0] != NULL)
+            db->flow[1] = BypassRuleCreate(p, !toclient);
+        if (db->flow[0] == NULL || db->flow[1] == NULL) {
+            BypassRulesDestroy(db);
+        }
+    }
+    SCMutexUnlock(&bypass_lock);
+    if (db->flow[0] == NULL) {
+        SCFree(db);
+        LiveDevAddBypassFail(p->livedev, 1, family);
+        return 0;
+    }
+
+    fc->BypassUpdate = DPDKBypassUpdate;
+    fc->BypassFree = DPDKBypassFree;
+    fc->bypass_data = db;
+
+    LiveDevAddBypassStats(p->livedev, 1, family);
+    LiveDevAddBypassSuccess(p->livedev, 1, family);
+    return 1;
+}
+
+#elif defined(HAVE_DPDK)
+
+int DPDKBypassProbe(uint16_t port_id __attribute__((unused)),
+        const char *port_name __attribute__((unused)), bool mark __attribute__((unused)))
+{
+    return -ENOTSUP;
+}
+
+int DPDKBypassPortFlush(uint16_t port_id, const char *port_name)
+{
+    struct rte_flow_error flush_error = { 0 };
+    int retval = rte_flow_flush(port_id, &flush_error);
+    if (retval != 0) {
+        SCLogError("%s: unable to flush rte_flow rules: %s Flush error msg: %s", port_name,
+                rte_strerror(-retval), flush_error.message);
+    }
+    return retval;
+}
+
+int DPDKBypassCallback(Packet *p __attribute__((unused)))
+{
+    return 0;
+}
+
+#endif /* HAVE_DPDK && CAPTURE_OFFLOAD */
+/**
+ * @}
+ */
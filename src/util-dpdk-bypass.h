@@ -0,0 +1,51 @@
+/* Copyright (C) 2025 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * DPDK flow bypass offload through rte_flow rules
+ */
+
+#ifndef UTIL_DPDK_BYPASS_H
+#define UTIL_DPDK_BYPASS_H
+
+#include "suricata-common.h"
+
+#ifdef HAVE_DPDK
+
+#include "decode.h"
+#include "util-dpdk.h"
+
+/** mark set by the NIC on the packets of flows bypassed in mark mode */
+#define DPDK_BYPASS_MARK 0x5343U
+
+int DPDKBypassProbe(uint16_t port_id, const char *port_name, bool mark);
+int DPDKBypassPortFlush(uint16_t port_id, const char *port_name);
+int DPDKBypassCallback(Packet *p);
+
+/**
+ * \brief Check if the NIC marked the mbuf as belonging to a bypassed flow
+ */
+static inline bool DPDKBypassMbufIsMarked(const struct rte_mbuf *m)
+{
+    return (m->ol_flags & RTE_MBUF_F_RX_FDIR_ID) && m->hash.fdir.hi == DPDK_BYPASS_MARK;
+}
+
+#endif /* HAVE_DPDK */
+
+#endif /* UTIL_DPDK_BYPASS_H */
@@ -45,6 +45,7 @@
 
 #if RTE_VERSION < RTE_VERSION_NUM(21, 11, 0, 0)
 #define RTE_ETH_TX_OFFLOAD_MBUF_FAST_FREE DEV_TX_OFFLOAD_MBUF_FAST_FREE
+#define RTE_ETH_TX_OFFLOAD_MULTI_SEGS     DEV_TX_OFFLOAD_MULTI_SEGS
 
 #define RTE_ETH_RX_OFFLOAD_CHECKSUM DEV_RX_OFFLOAD_CHECKSUM
 
@@ -0,0 +1,381 @@
+/* Copyright (C) 2025 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Per flow cpu cost accounting
+ *
+ * If flow.cost-tracking.enabled is set, each flow gets a FlowCost storage
+ * that the flow worker sets as the current flow of the thread while it
+ * handles a packet of the flow (see util-cpu-ticks.c). The cpu ticks spent
+ * in the stream engine, the app-layer parsers and detect are added to it.
+ *
+ * The cost is logged in the eve flow record. When the flow is cleared it
+ * is also offered to a global list of the most expensive flows, which the
+ * eve stats logger reports and resets at each stats interval.
+ */
+
+#include "suricata-common.h"
+#include "conf.h"
+#include "flow-private.h"
+#include "flow-util.h"
+#include "flow-storage.h"
+#include "util-byte.h"
+#include "util-debug.h"
+#include "util-flow-cost.h"
+#include "util-print.h"
+#include "util-proto-name.h"
+#include "util-time.h"
+#include "util-unittest.h"
+
+#define FLOW_COST_TOP_DEFAULT 10
+#define FLOW_COST_TOP_MAX     1000
+
+bool g_flow_cost_enabled = false;
+static FlowStorageId g_flow_cost_storage_id = { .id = -1 };
+
+static const char *flow_cost_names[FLOW_COST_MAX] = {
+    "stream",
+    "app_layer",
+    "detect",
+};
+
+typedef struct FlowCostTopEntry_ {
+    uint64_t flow_id;
+    uint64_t total;
+    uint64_t ticks[FLOW_COST_MAX];
+    uint64_t bytes_toserver;
+    uint64_t bytes_toclient;
+    uint32_t pkts_toserver;
+    uint32_t pkts_toclient;
+    SCTime_t startts;
+    SCTime_t lastts;
+    AppProto alproto;
+    uint8_t proto;
+    Port sp;
+    Port dp;
+    char src_ip[46];
+    char dst_ip[46];
+} FlowCostTopEntry;
+
+/** most expensive flows cleared in the current stats interval */
+static struct FlowCostTop_ {
+    SCMutex lock;
+    uint32_t size;
+    uint32_t cnt;
+    FlowCostTopEntry *entries;
+} flow_cost_top = { .lock = SCMUTEX_INITIALIZER };
+
+/** total cost a flow needs to make it into a full list, checked without
+ *  taking the lock */
+static SC_ATOMIC_DECLARE(uint64_t, flow_cost_top_min);
+
+static void FlowCostFree(void *ptr)
+{
+    if (ptr == NULL)
+        return;
+    SCFree(ptr);
+    (void)SC_ATOMIC_SUB(flow_memuse, sizeof(FlowCost));
+}
+
+void FlowCostRegisterFlowStorage(void)
+{
+    int enabled = 0;
+    if (SCConfGetBool("flow.cost-tracking.enabled", &enabled) != 1 || !enabled)
+        return;
+
+    uint32_t top = FLOW_COST_TOP_DEFAULT;
+    const char *val = NULL;
+    if (SCConfGet("flow.cost-tracking.top", &val) == 1 && val != NULL) {
+        if (StringParseU32RangeCheck(&top, 10, 0, val, 0, FLOW_COST_TOP_MAX) < 0) {
+            FatalError("Invalid value for flow.cost-tracking.top: %s, expected 0-%d", val,
+                    FLOW_COST_TOP_MAX);
+        }
+    }
+    if (top > 0) {
+        flow_cost_top.entries = SCCalloc(top, sizeof(FlowCostTopEntry));
+        if (unlikely(flow_cost_top.entries == NULL)) {
+            FatalError("Unable to alloc the expensive flows list");
+        }
+        flow_cost_top.size = top;
+    }
+    SC_ATOMIC_INIT(flow_cost_top_min);
+
+    g_flow_cost_storage_id =
+            FlowStorageRegister("flowcost", sizeof(void *), NULL, FlowCostFree);
+    g_flow_cost_enabled = true;
+    SCLogConfig("flow cost tracking enabled, reporting the top %u flows", top);
+}
+
+bool FlowCostStorageEnabled(void)
+{
+    return (g_flow_cost_storage_id.id != -1);
+}
+
+FlowStorageId FlowCostGetStorageID(void)
+{
+    return g_flow_cost_storage_id;
+}
+
+FlowCost *FlowCostInit(void)
+{
+    if (!FLOW_CHECK_MEMCAP(sizeof(FlowCost))) {
+        return NULL;
+    }
+    FlowCost *fc = SCCalloc(1, sizeof(*fc));
+    if (unlikely(fc == NULL)) {
+        return NULL;
+    }
+    (void)SC_ATOMIC_ADD(flow_memuse, sizeof(*fc));
+    return fc;
+}
+
+uint64_t FlowCostTotal(const FlowCost *fc)
+{
+    uint64_t total = 0;
+    for (int i = 0; i < FLOW_COST_MAX; i++) {
+        total += fc->ticks[i];
+    }
+    return total;
+}
+
+/** \internal
+ *  \brief update the lowest cost in a full list
+ *  \note flow_cost_top.lock must be held */
+static void FlowCostTopUpdateMin(void)
+{
+    uint64_t min = 0;
+    if (flow_cost_top.cnt == flow_cost_top.size) {
+        min = UINT64_MAX;
+        for (uint32_t i = 0; i < flow_cost_top.cnt; i++) {
+            if (flow_cost_top.entries[i].total < min)
+                min = flow_cost_top.entries[i].total;
+        }
+    }
+    SC_ATOMIC_SET(flow_cost_top_min, min);
+}
+
+static void FlowCostTopAdd(const Flow *f, const FlowCost *fc)
+{
+    const uint64_t total = FlowCostTotal(fc);
+    if (total == 0 || total <= SC_ATOMIC_GET(flow_cost_top_min))
+        return;
+
+    SCMutexLock(&flow_cost_top.lock);
+    FlowCostTopEntry *e = NULL;
+    if (flow_cost_top.cnt < flow_cost_top.size) {
+        e = &flow_cost_top.entries[flow_cost_top.cnt++];
+    } else {
+        /* replace the cheapest entry, if we're still more expensive */
+        for (uint32_t i = 0; i < flow_cost_top.cnt; i++) {
+            if (e == NULL || flow_cost_top.entries[i].total < e->total)
+                e = &flow_cost_top.entries[i];
+        }
+        if (e->total >= total) {
+            SCMutexUnlock(&flow_cost_top.lock);
+            return;
+        }
+    }
+
+    memset(e, 0, sizeof(*e));
+    e->flow_id = FlowGetId(f);
+    e->total = total;
+    memcpy(e->ticks, fc->ticks, sizeof(e->ticks));
+    e->pkts_toserver = f->todstpktcnt;
+    e->pkts_toclient = f->tosrcpktcnt;
+    e->bytes_toserver = f->todstbytecnt;
+    e->bytes_toclient = f->tosrcbytecnt;
+    e->startts = f->startts;
+    e->lastts = f->lastts;
+    e->alproto = f->alproto;
+    e->proto = f->proto;
+    e->sp = f->sp;
+    e->dp = f->dp;
+    if (FLOW_IS_IPV4(f)) {
+        PrintInet(AF_INET, (const void *)&f->src.addr_data32[0], e->src_ip, sizeof(e->src_ip));
+        PrintInet(AF_INET, (const void *)&f->dst.addr_data32[0], e->dst_ip, sizeof(e->dst_ip));
+    } else if (FLOW_IS_IPV6(f)) {
+        PrintInet(AF_INET6, (const void *)f->src.addr_data32, e->src_ip, sizeof(e->src_ip));
+        PrintInet(AF_INET6, (const void *)f->dst.addr_data32, e->dst_ip, sizeof(e->dst_ip));
+    }
+    FlowCostTopUpdateMin();
+    SCMutexUnlock(&flow_cost_top.lock);
+}
+
+/** \brief offer a flow that is being cleared to the expensive flows list
+ *  \param f locked flow */
+void FlowCostFlowEnd(const Flow *f)
+{
+    if (flow_cost_top.size == 0)
+        return;
+
+    const FlowCost *fc = FlowGetStorageById(f, FlowCostGetStorageID());
+    if (fc != NULL)
+        FlowCostTopAdd(f, fc);
+}
+
+static int FlowCostTopCompare(const void *a, const void *b)
+{
+    const FlowCostTopEntry *ea = a;
+    const FlowCostTopEntry *eb = b;
+    if (ea->total == eb->total)
+        return 0;
+    return ea->total > eb->total ? -1 : 1;
+}
+
+/** \brief get the most expensive flows cleared since the last reset */
+json_t *FlowCostTopToJSON(void)
+{
+    if (flow_cost_top.size == 0)
+        return NULL;
+
+    json_t *js = json_object();
+    if (js == NULL)
+        return NULL;
+    json_t *js_flows = json_array();
+    if (js_flows == NULL) {
+        json_decref(js);
+        return NULL;
+    }
+
+    SCMutexLock(&flow_cost_top.lock);
+    qsort(flow_cost_top.entries, flow_cost_top.cnt, sizeof(FlowCostTopEntry),
+            FlowCostTopCompare);
+    for (uint32_t i = 0; i < flow_cost_top.cnt; i++) {
+        const FlowCostTopEntry *e = &flow_cost_top.entries[i];
+        json_t *jf = json_object();
+        if (jf == NULL)
+            break;
+
+        char timebuf[64];
+        json_object_set_new(jf, "flow_id", json_integer(e->flow_id));
+        json_object_set_new(jf, "src_ip", json_string(e->src_ip));
+        json_object_set_new(jf, "src_port", json_integer(e->sp));
+        json_object_set_new(jf, "dest_ip", json_string(e->dst_ip));
+        json_object_set_new(jf, "dest_port", json_integer(e->dp));
+        if (SCProtoNameValid(e->proto)) {
+            json_object_set_new(jf, "proto", json_string(known_proto[e->proto]));
+        } else {
+            char proto[4];
+            snprintf(proto, sizeof(proto), "%u", e->proto);
+            json_object_set_new(jf, "proto", json_string(proto));
+        }
+        json_object_set_new(jf, "app_proto", json_string(AppProtoToString(e->alproto)));
+        CreateIsoTimeString(e->startts, timebuf, sizeof(timebuf));
+        json_object_set_new(jf, "start", json_string(timebuf));
+        CreateIsoTimeString(e->lastts, timebuf, sizeof(timebuf));
+        json_object_set_new(jf, "end", json_string(timebuf));
+        json_object_set_new(jf, "pkts_toserver", json_integer(e->pkts_toserver));
+        json_object_set_new(jf, "pkts_toclient", json_integer(e->pkts_toclient));
+        json_object_set_new(jf, "bytes_toserver", json_integer(e->bytes_toserver));
+        json_object_set_new(jf, "bytes_toclient", json_integer(e->bytes_toclient));
+
+        json_t *jt = json_object();
+        if (jt != NULL) {
+            for (int t = 0; t < FLOW_COST_MAX; t++) {
+                json_object_set_new(jt, flow_cost_names[t], json_integer(e->ticks[t]));
+            }
+            json_object_set_new(jt, "total", json_integer(e->total));
+            json_object_set_new(jf, "cpu_ticks", jt);
+        }
+        json_array_append_new(js_flows, jf);
+    }
+    SCMutexUnlock(&flow_cost_top.lock);
+
+    json_object_set_new(js, "flows", js_flows);
+    return js;
+}
+
+/** \brief start a new list of expensive flows
+ *
+ *  Called by the stats thread after all stats loggers ran, so each logger
+ *  reports the same flows for an interval. */
+void FlowCostTopReset(void)
+{
+    if (flow_cost_top.size == 0)
+        return;
+
+    SCMutexLock(&flow_cost_top.lock);
+    flow_cost_top.cnt = 0;
+    FlowCostTopUpdateMin();
+    SCMutexUnlock(&flow_cost_top.lock);
+}
+
+#ifdef UNITTESTS
+static void FlowCostTestSetup(uint32_t size)
+{
+    flow_cost_top.entries = SCCalloc(size, sizeof(FlowCostTopEntry));
+    flow_cost_top.size = size;
+    flow_cost_top.cnt = 0;
+    SC_ATOMIC_INIT(flow_cost_top_min);
+}
+
+static void FlowCostTestCleanup(void)
+{
+    SCFree(flow_cost_top.entries);
+    flow_cost_top.entries = NULL;
+    flow_cost_top.size = 0;
+    flow_cost_top.cnt = 0;
+}
+
+/** \test the list keeps the most expensive flows */
+static int FlowCostTest01(void)
+{
+    FlowCostTestSetup(2);
+
+    Flow f;
+    memset(&f, 0, sizeof(f));
+    FlowCost fc;
+
+    const uint64_t costs[] = { 10, 30, 20, 5 };
+    for (size_t i = 0; i < ARRAY_SIZE(costs); i++) {
+        memset(&fc, 0, sizeof(fc));
+        fc.ticks[FLOW_COST_DETECT] = costs[i];
+        f.sp = (Port)i;
+        FlowCostTopAdd(&f, &fc);
+    }
+    FAIL_IF_NOT(flow_cost_top.cnt == 2);
+    FAIL_IF_NOT(SC_ATOMIC_GET(flow_cost_top_min) == 20);
+    uint64_t sum = flow_cost_top.entries[0].total + flow_cost_top.entries[1].total;
+    FAIL_IF_NOT(sum == 50);
+
+    /* reports leave the list to the reset */
+    json_t *js = FlowCostTopToJSON();
+    FAIL_IF_NULL(js);
+    FAIL_IF_NOT(json_array_size(json_object_get(js, "flows")) == 2);
+    json_decref(js);
+    js = FlowCostTopToJSON();
+    FAIL_IF_NULL(js);
+    FAIL_IF_NOT(json_array_size(json_object_get(js, "flows")) == 2);
+    json_decref(js);
+
+    FlowCostTopReset();
+    FAIL_IF_NOT(flow_cost_top.cnt == 0);
+    FAIL_IF_NOT(SC_ATOMIC_GET(flow_cost_top_min) == 0);
+
+    FlowCostTestCleanup();
+    PASS;
+}
+#endif /* UNITTESTS */
+
+void FlowCostRegisterTests(void)
+{
+#ifdef UNITTESTS
+    UtRegisterTest("FlowCostTest01", FlowCostTest01);
+#endif /* UNITTESTS */
+}
@@ -0,0 +1,72 @@
+/* Copyright (C) 2025 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Per flow cpu cost accounting
+ */
+
+#ifndef SURICATA_UTIL_FLOW_COST_H
+#define SURICATA_UTIL_FLOW_COST_H
+
+#include "flow.h"
+#include "flow-storage.h"
+#include "util-cpu-ticks.h"
+
+enum FlowCostType {
+    FLOW_COST_STREAM = 0,
+    FLOW_COST_APP_LAYER,
+    FLOW_COST_DETECT,
+    FLOW_COST_MAX,
+};
+
+typedef struct FlowCost_ {
+    uint64_t ticks[FLOW_COST_MAX];
+} FlowCost;
+
+extern bool g_flow_cost_enabled;
+
+void FlowCostRegisterFlowStorage(void);
+bool FlowCostStorageEnabled(void);
+FlowStorageId FlowCostGetStorageID(void);
+FlowCost *FlowCostInit(void);
+uint64_t FlowCostTotal(const FlowCost *fc);
+void FlowCostFlowEnd(const Flow *f);
+json_t *FlowCostTopToJSON(void);
+void FlowCostTopReset(void);
+void FlowCostRegisterTests(void);
+
+/** \brief charge the stream, app-layer and detect work of this thread to
+ *         the flow until FlowCostLeave()
+ *  \param f locked flow
+ *  \retval prev flow cost to pass to FlowCostLeave() */
+static inline FlowCost *FlowCostEnter(const Flow *f)
+{
+    if (likely(!g_flow_cost_enabled))
+        return NULL;
+    return CpuTicksSetFlowCost(FlowGetStorageById(f, FlowCostGetStorageID()));
+}
+
+/** \brief stop charging the flow, must be called before it is unlocked */
+static inline void FlowCostLeave(FlowCost *prev)
+{
+    if (unlikely(g_flow_cost_enabled))
+        CpuTicksSetFlowCost(prev);
+}
+
+#endif /* SURICATA_UTIL_FLOW_COST_H */
@@ -0,0 +1,256 @@
+/* Copyright (C) 2025 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Per packet pipeline latency histograms
+ *
+ * If stats.latency.enabled is set, packets are stamped with the cpu tick
+ * counter when they enter the pipeline, after decode, after flow/stream/
+ * app-layer handling, after detect and after output. Once a packet has
+ * been through output the time spent between the stamps is added to per
+ * thread log2 histograms, which are regular stats counters. This way they
+ * show up in stats.log, the eve stats records and through the unix socket
+ * dump-counters command without further plumbing.
+ *
+ * In live mode the capture timestamp of the packet (as set by the kernel
+ * or NIC) is compared to the wall clock at pipeline entry as well.
+ */
+
+#include "suricata-common.h"
+#include "conf.h"
+#include "counters.h"
+#include "decode.h"
+#include "threadvars.h"
+#include "tm-threads.h"
+#include "util-cpu.h"
+#include "util-latency.h"
+#include "util-time.h"
+#include "util-unittest.h"
+
+bool g_pkt_latency_enabled = false;
+static bool g_pkt_latency_capture = true;
+static uint64_t g_pkt_latency_ticks_per_usec = 1;
+
+/* histograms: one per pipeline stage, slot PKT_LATENCY_START is used for
+ * the capture latency, PKT_LATENCY_STAGE_MAX for the total */
+#define LATENCY_HIST_CAPTURE PKT_LATENCY_START
+#define LATENCY_HIST_TOTAL   PKT_LATENCY_STAGE_MAX
+#define LATENCY_HIST_MAX     (PKT_LATENCY_STAGE_MAX + 1)
+
+#define LATENCY_BUCKET_NAMES(stage)                                                                \
+    {                                                                                              \
+        "latency." stage ".lt_1us", "latency." stage ".lt_2us", "latency." stage ".lt_4us",        \
+                "latency." stage ".lt_8us", "latency." stage ".lt_16us",                           \
+                "latency." stage ".lt_32us", "latency." stage ".lt_64us",                          \
+                "latency." stage ".lt_128us", "latency." stage ".lt_256us",                        \
+                "latency." stage ".lt_512us", "latency." stage ".lt_1024us",                       \
+                "latency." stage ".lt_2048us", "latency." stage ".lt_4096us",                      \
+                "latency." stage ".lt_8192us", "latency." stage ".lt_16384us",                     \
+                "latency." stage ".ge_16384us",                                                    \
+    }
+
+static const char *latency_bucket_names[LATENCY_HIST_MAX][PKT_LATENCY_BUCKETS] = {
+    LATENCY_BUCKET_NAMES("capture"),
+    LATENCY_BUCKET_NAMES("decode"),
+    LATENCY_BUCKET_NAMES("flow"),
+    LATENCY_BUCKET_NAMES("detect"),
+    LATENCY_BUCKET_NAMES("output"),
+    LATENCY_BUCKET_NAMES("total"),
+};
+
+static const char *latency_max_names[LATENCY_HIST_MAX] = {
+    "latency.capture.max_us",
+    "latency.decode.max_us",
+    "latency.flow.max_us",
+    "latency.detect.max_us",
+    "latency.output.max_us",
+    "latency.total.max_us",
+};
+
+typedef struct PacketLatencyCounters_ {
+    uint16_t bucket[LATENCY_HIST_MAX][PKT_LATENCY_BUCKETS];
+    uint16_t max[LATENCY_HIST_MAX];
+} PacketLatencyCounters;
+
+static thread_local PacketLatencyCounters t_latency_counters;
+
+/** \internal
+ *  \brief estimate the tick rate of UtilCpuGetTicksFast() against the
+ *         wall clock */
+static uint64_t PacketLatencyCalibrate(void)
+{
+    struct timeval start, end;
+
+    gettimeofday(&start, NULL);
+    const uint64_t t0 = UtilCpuGetTicksFast();
+    SleepUsec(10000);
+    const uint64_t t1 = UtilCpuGetTicksFast();
+    gettimeofday(&end, NULL);
+
+    const uint64_t usecs = (uint64_t)(end.tv_sec - start.tv_sec) * 1000000 +
+                           (uint64_t)(end.tv_usec - start.tv_usec);
+    if (usecs == 0 || t1 <= t0)
+        return 1;
+    const uint64_t tpu = (t1 - t0) / usecs;
+    return tpu > 0 ? tpu : 1;
+}
+
+void PacketLatencyGlobalInit(void)
+{
+    int enabled = 0;
+    if (SCConfGetBool("stats.latency.enabled", &enabled) != 1 || !enabled)
+        return;
+
+    int capture = 1;
+    if (SCConfGetBool("stats.latency.capture", &capture) == 1)
+        g_pkt_latency_capture = capture != 0;
+
+    g_pkt_latency_ticks_per_usec = PacketLatencyCalibrate();
+    g_pkt_latency_enabled = true;
+
+    SCLogConfig("packet latency tracking enabled (capture %s, %" PRIu64 " ticks/usec)",
+            g_pkt_latency_capture ? "yes" : "no", g_pkt_latency_ticks_per_usec);
+}
+
+void PacketLatencySetup(ThreadVars *tv)
+{
+    if (!g_pkt_latency_enabled)
+        return;
+
+    PacketLatencyCounters *c = &t_latency_counters;
+    for (int h = 0; h < LATENCY_HIST_MAX; h++) {
+        if (h == LATENCY_HIST_CAPTURE && !g_pkt_latency_capture)
+            continue;
+        for (int b = 0; b < PKT_LATENCY_BUCKETS; b++) {
+            c->bucket[h][b] = StatsRegisterCounter(latency_bucket_names[h][b], tv);
+        }
+        c->max[h] = StatsRegisterMaxCounter(latency_max_names[h], tv);
+    }
+}
+
+/** \brief get the log2 histogram bucket for a latency
+ *
+ *  Bucket 0 holds values below 1us, bucket n values below 2^n us. The
+ *  last bucket holds everything else.
+ */
+uint32_t PacketLatencyBucket(uint64_t usecs)
+{
+    if (usecs == 0)
+        return 0;
+    const uint32_t b = 64 - __builtin_clzll(usecs);
+    return b < PKT_LATENCY_BUCKETS ? b : PKT_LATENCY_BUCKETS - 1;
+}
+
+static inline void PacketLatencyRecord(ThreadVars *tv, const int h, const uint64_t usecs)
+{
+    const PacketLatencyCounters *c = &t_latency_counters;
+    StatsIncr(tv, c->bucket[h][PacketLatencyBucket(usecs)]);
+    StatsSetUI64(tv, c->max[h], usecs);
+}
+
+static inline uint64_t PacketLatencyTicksToUsecs(const uint64_t start, const uint64_t end)
+{
+    /* stages may be stamped on different cpus, don't trust the order */
+    if (end <= start)
+        return 0;
+    return (end - start) / g_pkt_latency_ticks_per_usec;
+}
+
+void PacketLatencyStart(ThreadVars *tv, Packet *p)
+{
+    if (PKT_IS_PSEUDOPKT(p))
+        return;
+
+    p->latency_ts[PKT_LATENCY_START] = UtilCpuGetTicksFast();
+
+    /* the capture timestamp is only comparable to the wall clock
+     * when we're processing live traffic */
+    if (g_pkt_latency_capture && TimeModeIsLive() && SCTIME_SECS(p->ts) != 0) {
+        const SCTime_t now = SCTimeGetTime();
+        uint64_t usecs = 0;
+        if (SCTIME_CMP_GT(now, p->ts)) {
+            usecs = (SCTIME_SECS(now) - SCTIME_SECS(p->ts)) * 1000000 + SCTIME_USECS(now) -
+                    SCTIME_USECS(p->ts);
+        }
+        PacketLatencyRecord(tv, LATENCY_HIST_CAPTURE, usecs);
+    }
+}
+
+/** \brief record the stage deltas of the packet
+ *
+ *  The output stamp is cleared afterwards, so that a later slot thread the
+ *  packet passes through, like the verdict thread of the NFQ and IPFW autofp
+ *  runmodes, doesn't record the packet again. */
+void PacketLatencyUpdate(ThreadVars *tv, Packet *p)
+{
+    uint64_t prev = p->latency_ts[PKT_LATENCY_START];
+    for (int s = PKT_LATENCY_DECODE; s < PKT_LATENCY_STAGE_MAX; s++) {
+        const uint64_t ts = p->latency_ts[s];
+        /* stage was skipped, e.g. a drop in the pre-flow hook */
+        if (ts == 0)
+            continue;
+        PacketLatencyRecord(tv, s, PacketLatencyTicksToUsecs(prev, ts));
+        prev = ts;
+    }
+    PacketLatencyRecord(tv, LATENCY_HIST_TOTAL,
+            PacketLatencyTicksToUsecs(
+                    p->latency_ts[PKT_LATENCY_START], p->latency_ts[PKT_LATENCY_OUTPUT]));
+    p->latency_ts[PKT_LATENCY_OUTPUT] = 0;
+}
+
+#ifdef UNITTESTS
+static int PacketLatencyBucketTest01(void)
+{
+    FAIL_IF_NOT(PacketLatencyBucket(0) == 0);
+    FAIL_IF_NOT(PacketLatencyBucket(1) == 1);
+    FAIL_IF_NOT(PacketLatencyBucket(2) == 2);
+    FAIL_IF_NOT(PacketLatencyBucket(3) == 2);
+    FAIL_IF_NOT(PacketLatencyBucket(4) == 3);
+    FAIL_IF_NOT(PacketLatencyBucket(16383) == 14);
+    FAIL_IF_NOT(PacketLatencyBucket(16384) == 15);
+    FAIL_IF_NOT(PacketLatencyBucket(UINT64_MAX) == 15);
+    PASS;
+}
+
+/** \test a packet is only recorded by the first thread updating it */
+static int PacketLatencyUpdateTest01(void)
+{
+    ThreadVars tv;
+    memset(&tv, 0, sizeof(tv));
+    Packet *p = PacketGetFromAlloc();
+    FAIL_IF_NULL(p);
+
+    p->latency_ts[PKT_LATENCY_START] = 1;
+    p->latency_ts[PKT_LATENCY_OUTPUT] = 2;
+    PACKET_LATENCY_UPDATE(&tv, p);
+    FAIL_IF_NOT(p->latency_ts[PKT_LATENCY_OUTPUT] == 0);
+    FAIL_IF_NOT(p->latency_ts[PKT_LATENCY_START] == 1);
+
+    PacketFree(p);
+    PASS;
+}
+#endif /* UNITTESTS */
+
+void PacketLatencyRegisterTests(void)
+{
+#ifdef UNITTESTS
+    UtRegisterTest("PacketLatencyBucketTest01", PacketLatencyBucketTest01);
+    UtRegisterTest("PacketLatencyUpdateTest01", PacketLatencyUpdateTest01);
+#endif /* UNITTESTS */
+}
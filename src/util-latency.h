@@ -0,0 +1,61 @@
+/* Copyright (C) 2025 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Per packet pipeline latency histograms
+ */
+
+#ifndef SURICATA_UTIL_LATENCY_H
+#define SURICATA_UTIL_LATENCY_H
+
+#include "decode.h"
+#include "util-cpu.h"
+
+/** number of log2 buckets per histogram: <1us, <2us, ... <16384us, >=16384us */
+#define PKT_LATENCY_BUCKETS 16
+
+extern bool g_pkt_latency_enabled;
+
+void PacketLatencyGlobalInit(void);
+void PacketLatencySetup(ThreadVars *tv);
+void PacketLatencyStart(ThreadVars *tv, Packet *p);
+void PacketLatencyUpdate(ThreadVars *tv, Packet *p);
+uint32_t PacketLatencyBucket(uint64_t usecs);
+void PacketLatencyRegisterTests(void);
+
+/** \brief mark the packet's entry into the pipeline */
+#define PACKET_LATENCY_START(tv, p)                                                                \
+    if (unlikely(g_pkt_latency_enabled) && (p)->latency_ts[PKT_LATENCY_START] == 0) {              \
+        PacketLatencyStart((tv), (p));                                                             \
+    }
+
+/** \brief stamp a stage, only for packets that were started */
+#define PACKET_LATENCY_STAMP(p, stage)                                                             \
+    if ((p)->latency_ts[PKT_LATENCY_START] != 0) {                                                 \
+        (p)->latency_ts[(stage)] = UtilCpuGetTicksFast();                                          \
+    }
+
+/** \brief record the stage deltas once the packet went through output,
+ *         only once per packet */
+#define PACKET_LATENCY_UPDATE(tv, p)                                                               \
+    if ((p)->latency_ts[PKT_LATENCY_OUTPUT] != 0) {                                                \
+        PacketLatencyUpdate((tv), (p));                                                            \
+    }
+
+#endif /* SURICATA_UTIL_LATENCY_H */
@@ -74,6 +74,12 @@ typedef struct SCHSThreadCtx_ {
 
     /** size of scratch space, for accounting. */
     size_t scratch_size;
+
+    /** streaming mode: per pattern id the id of the last scan that reported
+     *  it, so that a pattern is reported once per scan. */
+    uint32_t *stream_hits;
+    uint32_t stream_hits_size;
+    uint32_t stream_scan_id;
 } SCHSThreadCtx;
 
 typedef struct PatternDatabase_ {
@@ -81,6 +87,13 @@ typedef struct PatternDatabase_ {
     hs_database_t *hs_db;
     uint32_t pattern_cnt;
 
+    /** streaming mode database, only compiled for MPMCTX_FLAGS_STREAMING ctxs */
+    hs_database_t *hs_stream_db;
+    /** unique id of hs_stream_db, used to detect stale per flow stream states */
+    uint32_t stream_db_id;
+    /** size of a stream state of hs_stream_db, see hs_stream_size() */
+    size_t stream_state_size;
+
     /** Reference count: number of MPM contexts using this pattern database. */
     uint32_t ref_cnt;
     /** Signals if the matcher has loaded/saved the pattern database to disk */
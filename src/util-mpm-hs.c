@@ -47,6 +47,8 @@
 #include "util-hyperscan.h"
 #include "util-path.h"
 
+#include "stream-tcp-reassemble.h"
+
 #ifdef BUILD_HYPERSCAN
 
 #include <hs.h>
@@ -85,6 +87,12 @@ static SCMutex g_scratch_proto_mutex = SCMUTEX_INITIALIZER;
 static HashTable *g_db_table = NULL;
 static SCMutex g_db_table_mutex = SCMUTEX_INITIALIZER;
 
+/* Streaming mode database ids and the largest pattern count of the streaming
+ * databases, used to size the per thread match tracking. Protected by
+ * g_db_table_mutex. */
+static uint32_t g_stream_db_id = 0;
+static uint32_t g_stream_max_pattern_cnt = 0;
+
 /**
  * \internal
  * \brief Wraps SCMalloc (which is a macro) so that it can be passed to
@@ -532,6 +540,9 @@ static void PatternDatabaseFree(PatternDatabase *pd)
     }
 
     hs_free_database(pd->hs_db);
+    if (pd->hs_stream_db != NULL) {
+        hs_free_database(pd->hs_stream_db);
+    }
 
     SCFree(pd);
 }
@@ -752,6 +763,84 @@ static int PatternDatabaseCompile(PatternDatabase *pd, SCHSCompileData *cd)
     return 0;
 }
 
+/**
+ * \brief Compile the streaming mode database for a pattern database.
+ *
+ * Patterns are compiled without HS_FLAG_SINGLEMATCH as that would limit them
+ * to a single match for the lifetime of the stream. Offset and depth are not
+ * used: stream states can be (re)opened at any offset in the stream and the
+ * rule inspection enforces these constraints anyway.
+ *
+ * Must be called with g_db_table_mutex held.
+ */
+static int PatternDatabaseCompileStream(PatternDatabase *pd, size_t *db_size)
+{
+    SCHSCompileData *cd = CompileDataAlloc(pd->pattern_cnt);
+    if (cd == NULL) {
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < pd->pattern_cnt; i++) {
+        const SCHSPattern *p = pd->parray[i];
+        cd->ids[i] = i;
+        cd->flags[i] = 0;
+        if (p->flags & MPM_PATTERN_FLAG_NOCASE) {
+            cd->flags[i] |= HS_FLAG_CASELESS;
+        }
+        cd->expressions[i] = HSRenderPattern(p->original_pat, p->len);
+    }
+
+    hs_compile_error_t *compile_err = NULL;
+    hs_error_t err = hs_compile_multi((const char *const *)cd->expressions, cd->flags, cd->ids,
+            cd->pattern_cnt, HS_MODE_STREAM, NULL, &pd->hs_stream_db, &compile_err);
+    CompileDataFree(cd);
+    if (err != HS_SUCCESS) {
+        HSLogCompileError(compile_err);
+        return -1;
+    }
+
+    if (HSScratchAlloc(pd->hs_stream_db) != 0) {
+        return -1;
+    }
+
+    err = hs_database_size(pd->hs_stream_db, db_size);
+    if (err != HS_SUCCESS) {
+        SCLogError("failed to query database size: %s", HSErrorToStr(err));
+        return -1;
+    }
+
+    err = hs_stream_size(pd->hs_stream_db, &pd->stream_state_size);
+    if (err != HS_SUCCESS) {
+        SCLogError("failed to query stream state size: %s", HSErrorToStr(err));
+        return -1;
+    }
+
+    pd->stream_db_id = ++g_stream_db_id;
+    g_stream_max_pattern_cnt = MAX(g_stream_max_pattern_cnt, pd->pattern_cnt);
+    return 0;
+}
+
+/**
+ * \brief Add the streaming mode database to the pattern database of a
+ *        MPMCTX_FLAGS_STREAMING ctx, unless it already has one.
+ *
+ * Must be called with g_db_table_mutex held.
+ */
+static int SCHSPrepareStream(MpmCtx *mpm_ctx, PatternDatabase *pd)
+{
+    if (!(mpm_ctx->flags & MPMCTX_FLAGS_STREAMING) || pd->hs_stream_db != NULL) {
+        return 0;
+    }
+
+    size_t db_size = 0;
+    if (PatternDatabaseCompileStream(pd, &db_size) != 0) {
+        return -1;
+    }
+    mpm_ctx->memory_cnt++;
+    mpm_ctx->memory_size += (uint32_t)db_size;
+    return 0;
+}
+
 /**
  * \brief Process the patterns added to the mpm, and create the internal tables.
  *
@@ -796,6 +885,10 @@ int SCHSPreparePatterns(MpmConfig *mpm_conf, MpmCtx *mpm_ctx)
             mpm_ctx->memory_cnt++;
             mpm_ctx->memory_size += ctx->hs_db_size;
         }
+        if (SCHSPrepareStream(mpm_ctx, pd) != 0) {
+            SCMutexUnlock(&g_db_table_mutex);
+            return -1;
+        }
         SCMutexUnlock(&g_db_table_mutex);
         return 0;
     }
@@ -817,6 +910,12 @@ int SCHSPreparePatterns(MpmConfig *mpm_conf, MpmCtx *mpm_ctx)
     mpm_ctx->memory_cnt++;
     mpm_ctx->memory_size += ctx->hs_db_size;
 
+    if (SCHSPrepareStream(mpm_ctx, pd) != 0) {
+        SCMutexUnlock(&g_db_table_mutex);
+        CompileDataFree(cd);
+        return -1;
+    }
+
     SCMutexUnlock(&g_db_table_mutex);
     CompileDataFree(cd);
     return 0;
@@ -903,6 +1002,19 @@ void SCHSInitThreadCtx(MpmCtx *mpm_ctx, MpmThreadCtx *mpm_thread_ctx)
 
     mpm_thread_ctx->memory_cnt++;
     mpm_thread_ctx->memory_size += ctx->scratch_size;
+
+    SCMutexLock(&g_db_table_mutex);
+    const uint32_t stream_pattern_cnt = g_stream_max_pattern_cnt;
+    SCMutexUnlock(&g_db_table_mutex);
+    if (stream_pattern_cnt > 0) {
+        ctx->stream_hits = SCCalloc(stream_pattern_cnt, sizeof(uint32_t));
+        if (ctx->stream_hits == NULL) {
+            FatalError("Unable to allocate streaming match tracking");
+        }
+        ctx->stream_hits_size = stream_pattern_cnt;
+        mpm_thread_ctx->memory_cnt++;
+        mpm_thread_ctx->memory_size += stream_pattern_cnt * sizeof(uint32_t);
+    }
 }
 
 /**
@@ -949,6 +1061,11 @@ void SCHSDestroyThreadCtx(MpmCtx *mpm_ctx, MpmThreadCtx *mpm_thread_ctx)
             mpm_thread_ctx->memory_cnt--;
             mpm_thread_ctx->memory_size -= thr_ctx->scratch_size;
         }
+        if (thr_ctx->stream_hits != NULL) {
+            SCFree(thr_ctx->stream_hits);
+            mpm_thread_ctx->memory_cnt--;
+            mpm_thread_ctx->memory_size -= thr_ctx->stream_hits_size * sizeof(uint32_t);
+        }
 
         SCFree(mpm_thread_ctx->ctx);
         mpm_thread_ctx->ctx = NULL;
@@ -1067,6 +1184,139 @@ uint32_t SCHSSearch(const MpmCtx *mpm_ctx, MpmThreadCtx *mpm_thread_ctx,
     return ret;
 }
 
+/** \brief per stream state of the streaming mode search */
+typedef struct SCHSStream_ {
+    hs_stream_t *hs_stream;
+    /** PatternDatabase::stream_db_id of the db hs_stream was opened for */
+    uint32_t db_id;
+    /** memory charged to the stream reassembly memcap */
+    uint32_t memuse;
+} SCHSStream;
+
+typedef struct SCHSStreamCallbackCtx_ {
+    const PatternDatabase *pd;
+    SCHSThreadCtx *thread_ctx;
+    PrefilterRuleStore *pmq;
+    uint32_t match_count;
+} SCHSStreamCallbackCtx;
+
+/* Hyperscan streaming MPM match event handler. As the patterns are not
+ * compiled as single match, skip patterns already reported in this scan. */
+static int SCHSStreamMatchEvent(unsigned int id, unsigned long long from, unsigned long long to,
+        unsigned int flags, void *ctx)
+{
+    SCHSStreamCallbackCtx *cctx = ctx;
+    SCHSThreadCtx *thread_ctx = cctx->thread_ctx;
+    const SCHSPattern *pat = cctx->pd->parray[id];
+
+    if (id < thread_ctx->stream_hits_size) {
+        if (thread_ctx->stream_hits[id] == thread_ctx->stream_scan_id) {
+            return 0;
+        }
+        thread_ctx->stream_hits[id] = thread_ctx->stream_scan_id;
+    }
+
+    SCLogDebug("Hyperscan stream match %" PRIu32 ": id=%" PRIu32 " @ %" PRIuMAX
+               " (pat id=%" PRIu32 ")",
+            cctx->match_count, (uint32_t)id, (uintmax_t)to, pat->id);
+
+    PrefilterAddSids(cctx->pmq, pat->sids, pat->sids_size);
+
+    cctx->match_count++;
+    return 0;
+}
+
+static void SCHSStreamFree(void *ptr)
+{
+    SCHSStream *s = ptr;
+    if (s == NULL)
+        return;
+    /* no scratch or callback: close without reporting end of data matches */
+    (void)hs_close_stream(s->hs_stream, NULL, NULL, NULL);
+    StreamTcpReassembleDecrMemuse(s->memuse);
+    SCFree(s);
+}
+
+/**
+ * \brief The Hyperscan streaming mode search function.
+ *
+ * \param mpm_ctx        Pointer to the mpm context.
+ * \param mpm_thread_ctx Pointer to the mpm thread context.
+ * \param stream         Pointer to the per stream state, opened on demand.
+ * \param pmq            Pointer to the Pattern Matcher Queue to hold
+ *                       search matches.
+ * \param buf            Buffer to be searched, continuing the stream.
+ * \param buflen         Buffer length.
+ *
+ * \retval matches Match count.
+ */
+static uint32_t SCHSStreamSearch(const MpmCtx *mpm_ctx, MpmThreadCtx *mpm_thread_ctx,
+        void **stream, PrefilterRuleStore *pmq, const uint8_t *buf, const uint32_t buflen)
+{
+    SCHSCtx *ctx = (SCHSCtx *)mpm_ctx->ctx;
+    SCHSThreadCtx *hs_thread_ctx = (SCHSThreadCtx *)(mpm_thread_ctx->ctx);
+    const PatternDatabase *pd = ctx->pattern_db;
+
+    if (unlikely(buflen == 0)) {
+        return 0;
+    }
+    if (unlikely(pd->hs_stream_db == NULL)) {
+        return SCHSSearch(mpm_ctx, mpm_thread_ctx, pmq, buf, buflen);
+    }
+
+    SCHSStream *s = *stream;
+    if (s != NULL && s->db_id != pd->stream_db_id) {
+        /* opened for another database, e.g. before a rule reload */
+        SCHSStreamFree(s);
+        s = *stream = NULL;
+    }
+    if (s == NULL) {
+        /* the Hyperscan stream state is per flow memory like the reassembly
+         * buffers: fall back to block mode if it doesn't fit the memcap */
+        const uint32_t memuse = (uint32_t)(sizeof(*s) + pd->stream_state_size);
+        if (StreamTcpReassembleCheckMemcap(memuse) == 0) {
+            return SCHSSearch(mpm_ctx, mpm_thread_ctx, pmq, buf, buflen);
+        }
+        s = SCCalloc(1, sizeof(*s));
+        if (unlikely(s == NULL)) {
+            return SCHSSearch(mpm_ctx, mpm_thread_ctx, pmq, buf, buflen);
+        }
+        if (hs_open_stream(pd->hs_stream_db, 0, &s->hs_stream) != HS_SUCCESS) {
+            SCFree(s);
+            return SCHSSearch(mpm_ctx, mpm_thread_ctx, pmq, buf, buflen);
+        }
+        s->db_id = pd->stream_db_id;
+        s->memuse = memuse;
+        StreamTcpReassembleIncrMemuse(memuse);
+        *stream = s;
+    }
+
+    if (++hs_thread_ctx->stream_scan_id == 0) {
+        if (hs_thread_ctx->stream_hits != NULL) {
+            memset(hs_thread_ctx->stream_hits, 0,
+                    hs_thread_ctx->stream_hits_size * sizeof(uint32_t));
+        }
+        hs_thread_ctx->stream_scan_id = 1;
+    }
+
+    SCHSStreamCallbackCtx cctx = {
+        .pd = pd, .thread_ctx = hs_thread_ctx, .pmq = pmq, .match_count = 0
+    };
+
+    hs_scratch_t *scratch = hs_thread_ctx->scratch;
+    DEBUG_VALIDATE_BUG_ON(scratch == NULL);
+
+    hs_error_t err = hs_scan_stream(s->hs_stream, (const char *)buf, buflen, 0, scratch,
+            SCHSStreamMatchEvent, &cctx);
+    if (err != HS_SUCCESS) {
+        /* see SCHSSearch: not something we can recover from at scan time. */
+        SCLogError("Hyperscan returned error %d", err);
+        exit(EXIT_FAILURE);
+    }
+
+    return cctx.match_count;
+}
+
 /**
  * \brief Add a case insensitive pattern.  Although we have different calls for
  *        adding case sensitive and insensitive patterns, we make a single call
@@ -1188,12 +1438,15 @@ void MpmHSRegister(void)
     mpm_table[MPM_HS].Prepare = SCHSPreparePatterns;
     mpm_table[MPM_HS].CacheRuleset = SCHSCacheRuleset;
     mpm_table[MPM_HS].Search = SCHSSearch;
+    mpm_table[MPM_HS].StreamSearch = SCHSStreamSearch;
+    mpm_table[MPM_HS].StreamFree = SCHSStreamFree;
     mpm_table[MPM_HS].PrintCtx = SCHSPrintInfo;
     mpm_table[MPM_HS].PrintThreadCtx = SCHSPrintSearchStats;
 #ifdef UNITTESTS
     mpm_table[MPM_HS].RegisterUnittests = SCHSRegisterTests;
 #endif
-    mpm_table[MPM_HS].feature_flags = MPM_FEATURE_FLAG_DEPTH | MPM_FEATURE_FLAG_OFFSET;
+    mpm_table[MPM_HS].feature_flags =
+            MPM_FEATURE_FLAG_DEPTH | MPM_FEATURE_FLAG_OFFSET | MPM_FEATURE_FLAG_STREAMING;
     /* Set Hyperscan memory allocators */
     SCHSSetAllocators();
 }
@@ -1219,6 +1472,7 @@ void MpmHSGlobalCleanup(void)
         HashTableFree(g_db_table);
         g_db_table = NULL;
     }
+    g_stream_max_pattern_cnt = 0;
     SCMutexUnlock(&g_db_table_mutex);
 }
 
@@ -2275,6 +2529,92 @@ end:
     return result;
 }
 
+/** \test streaming mode: match spanning buffers, skip of data scanned
+ *        before and reset on a gap */
+static int SCHSTest30(void)
+{
+    MpmCtx mpm_ctx;
+    MpmThreadCtx mpm_thread_ctx;
+    PrefilterRuleStore pmq;
+    MpmStreamState *state = NULL;
+
+    memset(&mpm_ctx, 0, sizeof(MpmCtx));
+    memset(&mpm_thread_ctx, 0, sizeof(MpmThreadCtx));
+    MpmInitCtx(&mpm_ctx, MPM_HS);
+    mpm_ctx.flags |= MPMCTX_FLAGS_STREAMING;
+
+    MpmAddPatternCS(&mpm_ctx, (uint8_t *)"abcdef", 6, 0, 0, 0, 0, 0);
+    PmqSetup(&pmq);
+
+    FAIL_IF(SCHSPreparePatterns(NULL, &mpm_ctx) != 0);
+    SCHSInitThreadCtx(&mpm_ctx, &mpm_thread_ctx);
+
+    uint32_t cnt = MpmStreamSearch(
+            &mpm_ctx, &mpm_thread_ctx, &state, &pmq, (uint8_t *)"xxabc", 5, 0);
+    FAIL_IF_NOT(cnt == 0);
+    cnt = MpmStreamSearch(&mpm_ctx, &mpm_thread_ctx, &state, &pmq, (uint8_t *)"defyy", 5, 5);
+    FAIL_IF_NOT(cnt == 1);
+    FAIL_IF_NOT(state->offset == 10);
+    /* overlapping data was scanned before */
+    cnt = MpmStreamSearch(&mpm_ctx, &mpm_thread_ctx, &state, &pmq, (uint8_t *)"abcdefyy", 8, 2);
+    FAIL_IF_NOT(cnt == 0);
+    /* gap: match after the gap only */
+    cnt = MpmStreamSearch(&mpm_ctx, &mpm_thread_ctx, &state, &pmq, (uint8_t *)"defabcdef", 9, 20);
+    FAIL_IF_NOT(cnt == 1);
+    FAIL_IF_NOT(state->offset == 29);
+
+    MpmStreamStateFree(state);
+    SCHSDestroyCtx(&mpm_ctx);
+    SCHSDestroyThreadCtx(&mpm_ctx, &mpm_thread_ctx);
+    PmqFree(&pmq);
+    PASS;
+}
+
+/** \test streaming mode: block mode fallback if the stream state doesn't fit
+ *        the stream reassembly memcap */
+static int SCHSTest31(void)
+{
+    MpmCtx mpm_ctx;
+    MpmThreadCtx mpm_thread_ctx;
+    PrefilterRuleStore pmq;
+    MpmStreamState *state = NULL;
+
+    memset(&mpm_ctx, 0, sizeof(MpmCtx));
+    memset(&mpm_thread_ctx, 0, sizeof(MpmThreadCtx));
+    MpmInitCtx(&mpm_ctx, MPM_HS);
+    mpm_ctx.flags |= MPMCTX_FLAGS_STREAMING;
+
+    MpmAddPatternCS(&mpm_ctx, (uint8_t *)"abcdef", 6, 0, 0, 0, 0, 0);
+    PmqSetup(&pmq);
+
+    FAIL_IF(SCHSPreparePatterns(NULL, &mpm_ctx) != 0);
+    SCHSInitThreadCtx(&mpm_ctx, &mpm_thread_ctx);
+
+    const uint64_t memcap = StreamTcpReassembleGetMemcap();
+    const uint64_t memuse = StreamTcpReassembleMemuseGlobalCounter();
+    FAIL_IF_NOT(StreamTcpReassembleSetMemcap(memuse + 1) == 1);
+
+    uint32_t cnt = MpmStreamSearch(
+            &mpm_ctx, &mpm_thread_ctx, &state, &pmq, (uint8_t *)"xxabcdef", 8, 0);
+    FAIL_IF_NOT(cnt == 1);
+    FAIL_IF_NOT_NULL(state->ctx);
+    FAIL_IF_NOT(StreamTcpReassembleMemuseGlobalCounter() == memuse);
+
+    /* with room for the stream state it is charged until it is freed */
+    FAIL_IF_NOT(StreamTcpReassembleSetMemcap(memcap) == 1);
+    cnt = MpmStreamSearch(&mpm_ctx, &mpm_thread_ctx, &state, &pmq, (uint8_t *)"abcdef", 6, 8);
+    FAIL_IF_NOT(cnt == 1);
+    FAIL_IF_NULL(state->ctx);
+    FAIL_IF_NOT(StreamTcpReassembleMemuseGlobalCounter() > memuse);
+
+    MpmStreamStateFree(state);
+    FAIL_IF_NOT(StreamTcpReassembleMemuseGlobalCounter() == memuse);
+    SCHSDestroyCtx(&mpm_ctx);
+    SCHSDestroyThreadCtx(&mpm_ctx, &mpm_thread_ctx);
+    PmqFree(&pmq);
+    PASS;
+}
+
 static void SCHSRegisterTests(void)
 {
     UtRegisterTest("SCHSTest01", SCHSTest01);
@@ -2306,6 +2646,8 @@ static void SCHSRegisterTests(void)
     UtRegisterTest("SCHSTest27", SCHSTest27);
     UtRegisterTest("SCHSTest28", SCHSTest28);
     UtRegisterTest("SCHSTest29", SCHSTest29);
+    UtRegisterTest("SCHSTest30", SCHSTest30);
+    UtRegisterTest("SCHSTest31", SCHSTest31);
 }
 #endif /* UNITTESTS */
 #endif /* BUILD_HYPERSCAN */
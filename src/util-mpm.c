@@ -246,6 +246,76 @@ void MpmTableSetup(void)
 #endif /* BUILD_HYPERSCAN */
 }
 
+/**
+ *  \brief scan stream data incrementally
+ *
+ *  Data before MpmStreamState::offset has been scanned already and is
+ *  skipped. If there is a gap between the state's offset and the buffer the
+ *  matcher's stream state is reset, so matches can't span the gap.
+ *
+ *  \param state pointer to the stream state, allocated on first use
+ *  \param offset stream offset of the first byte of buf
+ *
+ *  \retval cnt number of pattern matches
+ */
+uint32_t MpmStreamSearch(const MpmCtx *mpm_ctx, MpmThreadCtx *mpm_thread_ctx,
+        MpmStreamState **state, PrefilterRuleStore *pmq, const uint8_t *buf, uint32_t buflen,
+        uint64_t offset)
+{
+    DEBUG_VALIDATE_BUG_ON(mpm_table[mpm_ctx->mpm_type].StreamSearch == NULL);
+
+    MpmStreamState *s = *state;
+    if (s == NULL) {
+        s = SCCalloc(1, sizeof(*s));
+        if (unlikely(s == NULL))
+            return 0;
+        s->mpm_type = mpm_ctx->mpm_type;
+        s->offset = offset;
+        *state = s;
+    } else if (s->mpm_type != mpm_ctx->mpm_type) {
+        /* matcher changed, e.g. by a rule reload */
+        if (s->ctx != NULL) {
+            mpm_table[s->mpm_type].StreamFree(s->ctx);
+            s->ctx = NULL;
+        }
+        s->mpm_type = mpm_ctx->mpm_type;
+        s->offset = offset;
+    }
+
+    if (offset > s->offset) {
+        SCLogDebug("gap: state offset %" PRIu64 ", data offset %" PRIu64, s->offset, offset);
+        if (s->ctx != NULL) {
+            mpm_table[s->mpm_type].StreamFree(s->ctx);
+            s->ctx = NULL;
+        }
+        s->offset = offset;
+    } else if (offset < s->offset) {
+        if (offset + buflen <= s->offset) {
+            SCLogDebug("all data scanned before");
+            return 0;
+        }
+        const uint32_t skip = (uint32_t)(s->offset - offset);
+        SCLogDebug("skipping %u bytes scanned before", skip);
+        buf += skip;
+        buflen -= skip;
+    }
+
+    const uint32_t r = mpm_table[s->mpm_type].StreamSearch(
+            mpm_ctx, mpm_thread_ctx, &s->ctx, pmq, buf, buflen);
+    s->offset += buflen;
+    return r;
+}
+
+void MpmStreamStateFree(MpmStreamState *state)
+{
+    if (state == NULL)
+        return;
+    if (state->ctx != NULL) {
+        mpm_table[state->mpm_type].StreamFree(state->ctx);
+    }
+    SCFree(state);
+}
+
 int MpmAddPatternCS(struct MpmCtx_ *mpm_ctx, uint8_t *pat, uint16_t patlen,
                     uint16_t offset, uint16_t depth,
                     uint32_t pid, SigIntId sid, uint8_t flags)
@@ -85,6 +85,8 @@ typedef struct MpmPattern_ {
 #define MPMCTX_FLAGS_GLOBAL     BIT_U8(0)
 #define MPMCTX_FLAGS_NODEPTH    BIT_U8(1)
 #define MPMCTX_FLAGS_CACHE_TO_DISK BIT_U8(2)
+/** ctx is used to scan stream data incrementally, see MpmStreamSearch() */
+#define MPMCTX_FLAGS_STREAMING     BIT_U8(3)
 
 typedef struct MpmConfig_ {
     const char *cache_dir_path;
@@ -146,6 +148,16 @@ typedef struct MpmCtxFactoryContainer_ {
 #define MPM_FEATURE_FLAG_DEPTH    BIT_U8(0)
 #define MPM_FEATURE_FLAG_OFFSET   BIT_U8(1)
 #define MPM_FEATURE_FLAG_ENDSWITH BIT_U8(2)
+#define MPM_FEATURE_FLAG_STREAMING BIT_U8(3)
+
+/** per stream (direction) state for matchers supporting streaming mode.
+ *  Tracks the stream offset of the next byte to scan so that data that was
+ *  scanned before is not scanned again. */
+typedef struct MpmStreamState_ {
+    void *ctx;           /**< matcher specific stream state */
+    uint64_t offset;     /**< stream offset of the next byte to scan */
+    uint8_t mpm_type;    /**< matcher that owns 'ctx' */
+} MpmStreamState;
 
 typedef struct MpmTableElmt_ {
     const char *name;
@@ -176,6 +188,13 @@ typedef struct MpmTableElmt_ {
     int (*CacheRuleset)(MpmConfig *);
     /** \retval cnt number of patterns that matches: once per pattern max. */
     uint32_t (*Search)(const struct MpmCtx_ *, struct MpmThreadCtx_ *, PrefilterRuleStore *, const uint8_t *, uint32_t);
+    /** streaming search: scan the buffer as the continuation of the data
+     *  previously scanned with the same stream state. The matcher (re)opens
+     *  its stream state in the void ** if needed.
+     *  \retval cnt number of pattern matches */
+    uint32_t (*StreamSearch)(const struct MpmCtx_ *, struct MpmThreadCtx_ *, void **,
+            PrefilterRuleStore *, const uint8_t *, uint32_t);
+    void (*StreamFree)(void *);
     void (*PrintCtx)(struct MpmCtx_ *);
     void (*PrintThreadCtx)(struct MpmThreadCtx_ *);
 #ifdef UNITTESTS
@@ -196,6 +215,11 @@ MpmCtx *MpmFactoryGetMpmCtxForProfile(const struct DetectEngineCtx_ *, int32_t,
 void MpmFactoryDeRegisterAllMpmCtxProfiles(struct DetectEngineCtx_ *);
 int32_t MpmFactoryIsMpmCtxAvailable(const struct DetectEngineCtx_ *, const MpmCtx *);
 
+uint32_t MpmStreamSearch(const MpmCtx *mpm_ctx, MpmThreadCtx *mpm_thread_ctx,
+        MpmStreamState **state, PrefilterRuleStore *pmq, const uint8_t *buf, uint32_t buflen,
+        uint64_t offset);
+void MpmStreamStateFree(MpmStreamState *state);
+
 void MpmTableSetup(void);
 void MpmRegisterTests(void);
 
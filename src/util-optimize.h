@@ -48,4 +48,13 @@
  */
 #define hw_barrier() __sync_synchronize()
 
+/** Prefetch the cache line at addr for reading, e.g. the headers of the next
+ *  packet of a batch while the current one is processed.
+ */
+#if CPPCHECK==1
+#define prefetch(addr)
+#else
+#define prefetch(addr) __builtin_prefetch((addr), 0, 3)
+#endif
+
 #endif /* SURICATA_UTIL_OPTIMIZE_H */
@@ -68,6 +68,14 @@ static void *CallocFunc(const size_t nm, const size_t sz)
 
 static void SBBFree(StreamingBuffer *sb, const StreamingBufferConfig *cfg);
 
+static thread_local StreamingBufferThreadStats sb_thread_stats;
+
+/** \brief get the streaming buffer totals of the calling thread */
+void StreamingBufferGetThreadStats(StreamingBufferThreadStats *stats)
+{
+    *stats = sb_thread_stats;
+}
+
 RB_GENERATE(SBB, StreamingBufferBlock, rb, SBBCompare);
 
 int SBBCompare(struct StreamingBufferBlock *a, struct StreamingBufferBlock *b)
@@ -231,6 +239,7 @@ static inline StreamingBufferRegion *InitBufferRegion(
     }
     aux_r->buf_size = MAX(cfg->buf_size, min_size);
     sb->regions++;
+    sb_thread_stats.regions++;
     sb->max_regions = MAX(sb->regions, sb->max_regions);
     return aux_r;
 }
@@ -242,6 +251,7 @@ static inline int InitBuffer(StreamingBuffer *sb, const StreamingBufferConfig *c
         return sc_errno;
     }
     sb->region.buf_size = cfg->buf_size;
+    sb_thread_stats.regions++;
     return SC_OK;
 }
 
@@ -299,6 +309,30 @@ void StreamingBufferFree(StreamingBuffer *sb, const StreamingBufferConfig *cfg)
     }
 }
 
+/**
+ *  \brief free the memory of a buffer that holds no data
+ *
+ *  Unlike StreamingBufferClear the stream offset is preserved. The buffer
+ *  is allocated again on the next append or insert.
+ *
+ *  \retval size bytes freed
+ */
+uint32_t StreamingBufferCompact(StreamingBuffer *sb, const StreamingBufferConfig *cfg)
+{
+    if (sb->region.buf == NULL || sb->region.buf_offset != 0 || sb->region.next != NULL ||
+            !RB_EMPTY(&sb->sbb_tree)) {
+        return 0;
+    }
+
+    const uint32_t size = sb->region.buf_size;
+    FREE(cfg, sb->region.buf, sb->region.buf_size);
+    sb->region.buf = NULL;
+    sb->region.buf_size = 0;
+    SCLogDebug("compacted sb %p at offset %" PRIu64 ", freed %u", sb, sb->region.stream_offset,
+            size);
+    return size;
+}
+
 #ifdef DEBUG
 static void SBBPrintList(StreamingBuffer *sb)
 {
@@ -930,6 +964,7 @@ static inline void StreamingBufferSlideToOffsetWithRegions(
                     // post-grow [nextnextnextXXX]
                     // post-move [XXXnextnextnext]
                     memmove(next->buf + next_data_offset, next->buf, prev_buf_size);
+                    sb_thread_stats.bytes_copied += prev_buf_size;
 
                     // move portion of "start" into "next"
                     //
@@ -938,6 +973,7 @@ static inline void StreamingBufferSlideToOffsetWithRegions(
                     // post-next    [kkkkknextnextnext]
                     const uint32_t start_data_size = start->buf_size - start_data_offset;
                     memcpy(next->buf, start->buf + start_data_offset, start_data_size);
+                    sb_thread_stats.bytes_copied += start_data_size;
 
                     // free "start"s buffer, we will use the one from "next"
                     FREE(cfg, start->buf, start->buf_size);
@@ -970,6 +1006,7 @@ static inline void StreamingBufferSlideToOffsetWithRegions(
                     // post:    [AAAxxxxxxx]
                     SCLogDebug("s %u new_data_size %u", s, new_data_size);
                     memmove(start->buf, start->buf + s, new_data_size);
+                    sb_thread_stats.bytes_copied += new_data_size;
 
                     // copy in "next"
                     // pre:     [AAAxxxxxxx]
@@ -978,6 +1015,7 @@ static inline void StreamingBufferSlideToOffsetWithRegions(
                     SCLogDebug("copy next->buf %p/%u to start->buf offset %u", next->buf,
                             next->buf_size, new_data_size);
                     memcpy(start->buf + new_data_size, next->buf, next->buf_size);
+                    sb_thread_stats.bytes_copied += next->buf_size;
 
                     start->stream_offset = slide_offset;
                     start->next = next->next;
@@ -994,6 +1032,7 @@ static inline void StreamingBufferSlideToOffsetWithRegions(
         just_main:
             SCLogDebug("s %u new_data_size %u", s, new_data_size);
             memmove(to_shift->buf, to_shift->buf + s, new_data_size);
+            sb_thread_stats.bytes_copied += new_data_size;
             /* shrink memory region. If this fails we keep the old */
             void *ptr = REALLOC(cfg, to_shift->buf, to_shift->buf_size, new_mem_size);
             if (ptr != NULL) {
@@ -1055,6 +1094,7 @@ void StreamingBufferSlideToOffset(
                 SCLogDebug("sliding %u forward, size of original buffer left after slide %u", slide,
                         size);
                 memmove(sb->region.buf, sb->region.buf + slide, size);
+                sb_thread_stats.bytes_copied += size;
                 if (sb->region.buf_offset > slide) {
                     sb->region.buf_offset -= slide;
                 } else {
@@ -1071,6 +1111,7 @@ void StreamingBufferSlideToOffset(
                 SCLogDebug("sliding %u forward, size of original buffer left after slide %u", slide,
                         size);
                 memmove(sb->region.buf, sb->region.buf + slide, size);
+                sb_thread_stats.bytes_copied += size;
                 sb->region.stream_offset = offset;
                 sb->region.buf_offset = size;
             } else {
@@ -1301,8 +1342,10 @@ static StreamingBufferRegion *BufferInsertAtRegionConsolidate(StreamingBuffer *s
     SCLogDebug("resized to %u -> %u", dst_size, dst->buf_size);
     /* validate that the size is exactly what we asked for */
     DEBUG_VALIDATE_BUG_ON(dst_size != dst->buf_size);
-    if (dst_copy_offset != 0)
+    if (dst_copy_offset != 0) {
         memmove(dst->buf + dst_copy_offset, dst->buf, old_size);
+        sb_thread_stats.bytes_copied += old_size;
+    }
     if (dst_offset != dst->stream_offset) {
         dst->stream_offset = dst_offset;
         // buf_offset no longer valid, reset.
@@ -1320,8 +1363,10 @@ static StreamingBufferRegion *BufferInsertAtRegionConsolidate(StreamingBuffer *s
 
         start_is_main = true;
         SCLogDebug("src_start is main region");
-        if (src_start != dst)
+        if (src_start != dst) {
             memcpy(dst->buf, src_start->buf, src_start->buf_offset);
+            sb_thread_stats.bytes_copied += src_start->buf_offset;
+        }
         if (src_start == src_end) {
             SCLogDebug("src_start == src_end == main, we're done");
             DEBUG_VALIDATE_BUG_ON(src_start != dst);
@@ -1351,6 +1396,7 @@ static StreamingBufferRegion *BufferInsertAtRegionConsolidate(StreamingBuffer *s
         DEBUG_VALIDATE_BUG_ON(target_offset > dst->buf_size);
         DEBUG_VALIDATE_BUG_ON(target_offset + r->buf_size > dst->buf_size);
         memcpy(dst->buf + target_offset, r->buf, r->buf_size);
+        sb_thread_stats.bytes_copied += r->buf_size;
 
         StreamingBufferRegion *next = r->next;
         FREE(cfg, r->buf, r->buf_size);
@@ -2437,6 +2483,56 @@ static int StreamingBufferTest12(void)
 }
 #endif
 
+/** \test compact an empty buffer and reuse it at the same stream offset */
+static int StreamingBufferTest13(void)
+{
+    StreamingBufferConfig cfg = { 16, 1, STREAMING_BUFFER_REGION_GAP_DEFAULT, NULL, NULL, NULL };
+    StreamingBuffer *sb = StreamingBufferInit(&cfg);
+    FAIL_IF(sb == NULL);
+
+    StreamingBufferSegment seg1;
+    FAIL_IF(StreamingBufferAppend(sb, &cfg, &seg1, (const uint8_t *)"ABCDEFGH", 8) != 0);
+    /* data in the buffer, nothing to compact */
+    FAIL_IF(StreamingBufferCompact(sb, &cfg) != 0);
+
+    StreamingBufferSlideToOffset(sb, &cfg, 8);
+    FAIL_IF(sb->region.buf_offset != 0);
+    FAIL_IF(StreamingBufferCompact(sb, &cfg) != 16);
+    FAIL_IF(sb->region.buf != NULL);
+    FAIL_IF(sb->region.stream_offset != 8);
+
+    StreamingBufferSegment seg2;
+    FAIL_IF(StreamingBufferAppend(sb, &cfg, &seg2, (const uint8_t *)"01234567", 8) != 0);
+    FAIL_IF(seg2.stream_offset != 8);
+    FAIL_IF(!StreamingBufferSegmentCompareRawData(sb, &seg2, (const uint8_t *)"01234567", 8));
+
+    StreamingBufferFree(sb, &cfg);
+    PASS;
+}
+
+static int StreamingBufferTest14(void)
+{
+    StreamingBufferConfig cfg = { 16, 1, STREAMING_BUFFER_REGION_GAP_DEFAULT, NULL, NULL, NULL };
+    StreamingBufferThreadStats pre, post;
+    StreamingBufferGetThreadStats(&pre);
+
+    StreamingBuffer *sb = StreamingBufferInit(&cfg);
+    FAIL_IF(sb == NULL);
+    StreamingBufferSegment seg1;
+    FAIL_IF(StreamingBufferAppend(sb, &cfg, &seg1, (const uint8_t *)"ABCDEFGH", 8) != 0);
+    StreamingBufferGetThreadStats(&post);
+    FAIL_IF(post.regions != pre.regions + 1);
+    FAIL_IF(post.bytes_copied != pre.bytes_copied);
+
+    StreamingBufferSlideToOffset(sb, &cfg, 4);
+    StreamingBufferGetThreadStats(&post);
+    FAIL_IF(post.regions != pre.regions + 1);
+    FAIL_IF(post.bytes_copied < pre.bytes_copied + 4);
+
+    StreamingBufferFree(sb, &cfg);
+    PASS;
+}
+
 void StreamingBufferRegisterTests(void)
 {
 #ifdef UNITTESTS
@@ -2450,5 +2546,7 @@ void StreamingBufferRegisterTests(void)
     UtRegisterTest("StreamingBufferTest10", StreamingBufferTest10);
     UtRegisterTest("StreamingBufferTest11 Bug 6903", StreamingBufferTest11);
     UtRegisterTest("StreamingBufferTest12 Bug 6782", StreamingBufferTest12);
+    UtRegisterTest("StreamingBufferTest13", StreamingBufferTest13);
+    UtRegisterTest("StreamingBufferTest14", StreamingBufferTest14);
 #endif
 }
@@ -117,6 +117,15 @@ typedef struct StreamingBuffer_ {
 #endif
 } StreamingBuffer;
 
+/** per thread totals of the work done by the streaming buffer code. Callers
+ *  can take a snapshot before and after an operation to attribute the cost. */
+typedef struct StreamingBufferThreadStats_ {
+    uint64_t regions;      /**< memory regions (incl. main buffer) allocated */
+    uint64_t bytes_copied; /**< bytes moved within or between regions */
+} StreamingBufferThreadStats;
+
+void StreamingBufferGetThreadStats(StreamingBufferThreadStats *stats);
+
 static inline bool StreamingBufferHasData(const StreamingBuffer *sb)
 {
     return (sb->region.stream_offset || sb->region.buf_offset || sb->region.next != NULL ||
@@ -155,6 +164,7 @@ typedef struct StreamingBufferSegment_ {
 StreamingBuffer *StreamingBufferInit(const StreamingBufferConfig *cfg);
 void StreamingBufferClear(StreamingBuffer *sb, const StreamingBufferConfig *cfg);
 void StreamingBufferFree(StreamingBuffer *sb, const StreamingBufferConfig *cfg);
+uint32_t StreamingBufferCompact(StreamingBuffer *sb, const StreamingBufferConfig *cfg);
 
 void StreamingBufferSlideToOffset(
         StreamingBuffer *sb, const StreamingBufferConfig *cfg, uint64_t offset);